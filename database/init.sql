@@ -22,7 +22,9 @@ CREATE TABLE IF NOT EXISTS rooms (
     description TEXT,
     created_by INTEGER REFERENCES users(id) ON DELETE SET NULL,
     created_at TIMESTAMP(0) DEFAULT CURRENT_TIMESTAMP,
-    is_private BOOLEAN DEFAULT FALSE
+    is_private BOOLEAN DEFAULT FALSE,
+    -- Last change sequence handed out to this room's messages
+    change_seq BIGINT NOT NULL DEFAULT 0
 );
 
 -- Messages table
@@ -35,7 +37,11 @@ CREATE TABLE IF NOT EXISTS messages (
     message_type VARCHAR(20) DEFAULT 'text',
     created_at TIMESTAMP(0) DEFAULT CURRENT_TIMESTAMP,
     edited_at TIMESTAMP(0),
-    is_deleted BOOLEAN DEFAULT FALSE
+    is_deleted BOOLEAN DEFAULT FALSE,
+    -- Room change sequence of the latest insert, edit or delete of this row
+    change_seq BIGINT NOT NULL DEFAULT 0,
+    -- Client-chosen Idempotency-Key of the send, unique per sender (see below)
+    idempotency_key VARCHAR(255)
 );
 
 -- Room members table 
@@ -48,9 +54,35 @@ CREATE TABLE IF NOT EXISTS room_members (
     UNIQUE(room_id, user_id)
 );
 
+-- Databases created before change sequences get the columns here; this script only
+-- adds what is missing, so it can be re-run against an existing volume
+ALTER TABLE rooms ADD COLUMN IF NOT EXISTS change_seq BIGINT NOT NULL DEFAULT 0;
+ALTER TABLE messages ADD COLUMN IF NOT EXISTS change_seq BIGINT NOT NULL DEFAULT 0;
+
+-- Number messages that predate them in id order. Every stamped message bumps its room,
+-- so a room still at 0 that has messages has never been numbered.
+UPDATE messages m SET change_seq = numbered.seq
+FROM (
+    SELECT id, row_number() OVER (PARTITION BY room_id ORDER BY id) AS seq
+    FROM messages
+    WHERE room_id IN (SELECT id FROM rooms WHERE change_seq = 0)
+) numbered
+WHERE m.id = numbered.id;
+
+UPDATE rooms r SET change_seq = (SELECT count(*) FROM messages WHERE room_id = r.id)
+WHERE r.change_seq = 0 AND EXISTS (SELECT 1 FROM messages WHERE room_id = r.id);
+
 -- Indexes for better query performance
 CREATE INDEX IF NOT EXISTS idx_messages_room_id ON messages(room_id);
+CREATE INDEX IF NOT EXISTS idx_messages_room_id_id ON messages(room_id, id);
+CREATE INDEX IF NOT EXISTS idx_messages_room_id_change_seq ON messages(room_id, change_seq);
 CREATE INDEX IF NOT EXISTS idx_messages_user_id ON messages(user_id);
+
+-- A retried POST can't insert twice; keys only have to be unique per sender.
+-- Databases created before per-sender keys still carry the old global constraint
+ALTER TABLE messages ADD COLUMN IF NOT EXISTS idempotency_key VARCHAR(255);
+ALTER TABLE messages DROP CONSTRAINT IF EXISTS messages_idempotency_key_key;
+CREATE UNIQUE INDEX IF NOT EXISTS idx_messages_user_id_idempotency_key ON messages(user_id, idempotency_key);
 CREATE INDEX IF NOT EXISTS idx_messages_created_at ON messages(created_at DESC);
 CREATE INDEX IF NOT EXISTS idx_room_members_room_id ON room_members(room_id);
 CREATE INDEX IF NOT EXISTS idx_room_members_user_id ON room_members(user_id);
@@ -58,9 +90,10 @@ CREATE INDEX IF NOT EXISTS idx_notifications_user_id ON notifications(user_id);
 CREATE INDEX IF NOT EXISTS idx_notifications_is_read ON notifications(is_read);
 
 -- Create default "general" room
-INSERT INTO rooms (name, description, is_private) 
-VALUES ('general', 'General discussion room', FALSE)
-ON CONFLICT DO NOTHING;
+-- (room names aren't unique, so check rather than rely on ON CONFLICT when re-run)
+INSERT INTO rooms (name, description, is_private)
+SELECT 'general', 'General discussion room', FALSE
+WHERE NOT EXISTS (SELECT 1 FROM rooms WHERE name = 'general');
 
 -- Create default test user (password: "test123")
 -- Password hash for "test123" using bcrypt
@@ -78,11 +111,159 @@ END;
 $$ language 'plpgsql';
 
 -- Trigger to update updated_at on users table
-CREATE TRIGGER update_users_updated_at 
+DROP TRIGGER IF EXISTS update_users_updated_at ON users;
+CREATE TRIGGER update_users_updated_at
     BEFORE UPDATE ON users 
     FOR EACH ROW 
     EXECUTE FUNCTION update_updated_at_column();
 
+-- Stamp every message insert, edit and delete with the room's next change sequence.
+-- The UPDATE locks the room row until the writer commits, so sequence numbers become
+-- visible in order and GET /api/rooms/:id/changes?since= never skips one.
+CREATE OR REPLACE FUNCTION stamp_message_change_seq()
+RETURNS TRIGGER AS $$
+BEGIN
+    UPDATE rooms SET change_seq = change_seq + 1
+    WHERE id = NEW.room_id
+    RETURNING change_seq INTO NEW.change_seq;
+    RETURN NEW;
+END;
+$$ language 'plpgsql';
+
+DROP TRIGGER IF EXISTS messages_change_seq ON messages;
+CREATE TRIGGER messages_change_seq
+    BEFORE INSERT OR UPDATE OF content, is_deleted ON messages
+    FOR EACH ROW
+    EXECUTE FUNCTION stamp_message_change_seq();
+
+-- Real-time fan-out without a broker: api_server LISTENs on chat_messages
+-- and replays each change to its SSE / WebSocket / long-poll clients
+CREATE OR REPLACE FUNCTION notify_message_change()
+RETURNS TRIGGER AS $$
+DECLARE
+    event_type TEXT;
+    sent_at_us BIGINT;
+    payload TEXT;
+BEGIN
+    IF TG_OP = 'INSERT' THEN
+        event_type := 'message.created';
+    ELSIF NEW.is_deleted AND NOT OLD.is_deleted THEN
+        event_type := 'message.deleted';
+    ELSIF NEW.content IS DISTINCT FROM OLD.content THEN
+        event_type := 'message.updated';
+    ELSE
+        RETURN NEW;
+    END IF;
+
+    sent_at_us := (EXTRACT(EPOCH FROM clock_timestamp()) * 1000000)::BIGINT;
+    -- Same fields and formats as the API's message JSON
+    payload := json_build_object(
+        'type', event_type,
+        'room_id', NEW.room_id,
+        'id', NEW.id,
+        'sent_at_us', sent_at_us,
+        'message', json_build_object(
+            'id', NEW.id,
+            'room_id', NEW.room_id,
+            'user_id', NEW.user_id,
+            'content', NEW.content,
+            'message_type', NEW.message_type,
+            'created_at', NEW.created_at::TEXT,
+            'edited_at', COALESCE(NEW.edited_at::TEXT, ''),
+            'is_deleted', NEW.is_deleted,
+            'change_seq', NEW.change_seq
+        )
+    )::TEXT;
+
+    -- NOTIFY payloads must stay under 8000 bytes; the listener reads long messages back
+    IF octet_length(payload) > 7900 THEN
+        payload := json_build_object(
+            'type', event_type,
+            'room_id', NEW.room_id,
+            'id', NEW.id,
+            'sent_at_us', sent_at_us
+        )::TEXT;
+    END IF;
+
+    PERFORM pg_notify('chat_messages', payload);
+    RETURN NEW;
+END;
+$$ language 'plpgsql';
+
+-- Trigger to announce message inserts, edits and deletes
+DROP TRIGGER IF EXISTS messages_notify ON messages;
+CREATE TRIGGER messages_notify
+    AFTER INSERT OR UPDATE ON messages
+    FOR EACH ROW
+    EXECUTE FUNCTION notify_message_change();
+
+-- Cached responses and ETags on every replica depend on rooms, members and users too.
+-- Announce what each write invalidates, under the names api_server's ChangeVersions uses
+CREATE OR REPLACE FUNCTION notify_invalidation(what TEXT, target_room INTEGER)
+RETURNS VOID AS $$
+BEGIN
+    PERFORM pg_notify('chat_messages', json_build_object(
+        'type', 'invalidate',
+        'what', what,
+        'room_id', target_room
+    )::TEXT);
+END;
+$$ language 'plpgsql';
+
+CREATE OR REPLACE FUNCTION notify_room_change()
+RETURNS TRIGGER AS $$
+BEGIN
+    IF TG_OP = 'DELETE' THEN
+        PERFORM notify_invalidation('room', OLD.id);
+    ELSE
+        PERFORM notify_invalidation('room', NEW.id);
+    END IF;
+    PERFORM notify_invalidation('rooms', 0);
+    RETURN NULL;
+END;
+$$ language 'plpgsql';
+
+CREATE OR REPLACE FUNCTION notify_member_change()
+RETURNS TRIGGER AS $$
+BEGIN
+    IF TG_OP = 'DELETE' THEN
+        PERFORM notify_invalidation('room', OLD.room_id);
+    ELSE
+        PERFORM notify_invalidation('room', NEW.room_id);
+    END IF;
+    RETURN NULL;
+END;
+$$ language 'plpgsql';
+
+-- Usernames show up in member lists of any room
+CREATE OR REPLACE FUNCTION notify_user_change()
+RETURNS TRIGGER AS $$
+BEGIN
+    PERFORM notify_invalidation('all', 0);
+    RETURN NULL;
+END;
+$$ language 'plpgsql';
+
+-- change_seq bumps are left out: they come with a message change, announced above
+DROP TRIGGER IF EXISTS rooms_notify ON rooms;
+CREATE TRIGGER rooms_notify
+    AFTER INSERT OR DELETE OR UPDATE OF name, description, is_private ON rooms
+    FOR EACH ROW
+    EXECUTE FUNCTION notify_room_change();
+
+DROP TRIGGER IF EXISTS room_members_notify ON room_members;
+CREATE TRIGGER room_members_notify
+    AFTER INSERT OR DELETE ON room_members
+    FOR EACH ROW
+    EXECUTE FUNCTION notify_member_change();
+
+-- Not last_login: logins would invalidate everything
+DROP TRIGGER IF EXISTS users_notify ON users;
+CREATE TRIGGER users_notify
+    AFTER DELETE OR UPDATE OF username, email, is_active ON users
+    FOR EACH ROW
+    EXECUTE FUNCTION notify_user_change();
+
 -- Grant permissions
 GRANT ALL PRIVILEGES ON ALL TABLES IN SCHEMA public TO chatuser;
 GRANT ALL PRIVILEGES ON ALL SEQUENCES IN SCHEMA public TO chatuser;
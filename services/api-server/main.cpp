@@ -12,19 +12,48 @@
 #include "src/clients/RabbitMQClient.hpp"
 #include "src/clients/TranslationClient.hpp"
 #include "src/routing/HTTPRouter.hpp"
+#include "src/routing/ServerOptions.hpp"
+#include "src/routing/Prefork.hpp"
 
 /**
  * Application configuration constants
  */
 namespace Config {
     constexpr const char* DB_CONNECTION_STRING = "host=localhost port=5432 dbname=chatdb user=chatuser password=chatpass";
+    constexpr size_t DB_POOL_SIZE = 16;            // Postgres connections shared by all request threads
+    constexpr size_t DB_READ_CONNECTIONS = 4;      // pipelined connections for single-statement reads (0 = use the pool)
+    constexpr size_t DB_READ_PIPELINE_DEPTH = 32;  // reads in flight per pipelined connection
     constexpr const char* RABBITMQ_HOST = "localhost";
     constexpr int RABBITMQ_PORT = 5672;
     constexpr const char* RABBITMQ_USER = "chatuser";
     constexpr const char* RABBITMQ_PASS = "chatpass";
+    constexpr int RABBITMQ_PUBLISH_TIMEOUT_MS = 1000;  // a stalled broker can't hold a request longer
     constexpr const char* TRANSLATION_API_URL = "http://localhost:5001";
     constexpr const char* SERVER_HOST = "0.0.0.0";
     constexpr int SERVER_PORT = 8080;
+    constexpr unsigned TRACE_SAMPLE_EVERY = 100;   // keep 1 in N request traces
+    constexpr size_t TRACE_BUFFER_SIZE = 256;      // traces retained for /api/debug/traces
+    constexpr size_t COMPRESSION_MIN_BYTES = 1024; // smaller responses are sent uncompressed
+    constexpr int GZIP_LEVEL = 6;
+    constexpr int ZSTD_LEVEL = 3;
+    constexpr size_t RESPONSE_CACHE_BYTES = 16 * 1024 * 1024;  // cached GET bodies
+    constexpr unsigned VERSION_MAX_STALENESS_SECONDS = 30;     // ETags and cached bodies expire, in case a replica's invalidation is lost
+    constexpr size_t IDEMPOTENCY_MAX_KEYS = 65536;     // remembered Idempotency-Key responses
+    constexpr unsigned IDEMPOTENCY_TTL_SECONDS = 3600;
+    constexpr bool RATE_LIMIT_ENABLED = true;      // per-client and per-user token buckets (see ServerOptions)
+    constexpr size_t HTTP_WORKER_THREADS = 16;     // threads for ordinary requests
+    constexpr bool HTTP_EVENT_LOOP = false;        // epoll front end: idle keep-alive connections hold no thread (Linux)
+    constexpr unsigned HTTP_KEEP_ALIVE_SECONDS = 120;  // with the event loop; httplib closes idle ones after 5
+    constexpr unsigned REQUEST_TIMEOUT_MS = 5000;  // default deadline; clients may send X-Request-Timeout-Ms
+    constexpr size_t BATCH_MAX_REQUESTS = 100;     // sub-requests per POST /api/batch
+    constexpr size_t SSE_MAX_STREAMS = 256;        // each open stream holds its own thread
+    constexpr unsigned SSE_HEARTBEAT_SECONDS = 15;
+    constexpr int WEBSOCKET_PORT = 8081;           // 0 disables the WebSocket gateway
+    constexpr unsigned WEBSOCKET_WORKERS = 8;      // threads for WebSocket commands that hit Postgres
+    constexpr size_t WEBSOCKET_DB_CONNECTIONS = 4; // per gateway loop, for long-polls (0 = use the workers)
+    constexpr const char* REALTIME_TRANSPORT = "auto";  // rabbitmq | postgres | auto | none
+    constexpr bool PREFORK = false;                // run worker processes sharing the ports (Linux)
+    constexpr unsigned PREFORK_WORKERS = 0;        // 0 = one per core; pools and limits above are per worker
 }
 
 /**
@@ -38,11 +67,26 @@ namespace Config {
  * 5. Start HTTP server on port 8080
  */
 int main() {
+    // Pre-fork mode: this process only supervises from here; every worker runs the rest.
+    // Must happen before any thread exists, hence first.
+    ChangeVersions::State* sharedVersions = nullptr;
+#if defined(__linux__)
+    if (Config::PREFORK) {
+        sharedVersions = ChangeVersions::shared();
+        if (!Prefork::run(Prefork::Options{.workers = Config::PREFORK_WORKERS})) {
+            return 0;
+        }
+    }
+#endif
+
     // Initialize HTTP server
     httplib::Server svr;
 
     // Connect to PostgreSQL database
-    Database db(Config::DB_CONNECTION_STRING);
+    Database db(Config::DB_CONNECTION_STRING, Config::DB_POOL_SIZE, Database::ReadPipeline{
+        .connections = Config::DB_READ_CONNECTIONS,
+        .depth = Config::DB_READ_PIPELINE_DEPTH,
+    });
 
     if (!db.connect()) {
         std::cerr << "Failed to connect to database. Exiting." << std::endl;
@@ -52,7 +96,8 @@ int main() {
     std::cout << "Connected to database successfully." << std::endl;
 
     // Connect to RabbitMQ
-    RabbitMQClient rabbitmq(Config::RABBITMQ_HOST, Config::RABBITMQ_PORT, Config::RABBITMQ_USER, Config::RABBITMQ_PASS);
+    RabbitMQClient rabbitmq(Config::RABBITMQ_HOST, Config::RABBITMQ_PORT, Config::RABBITMQ_USER, Config::RABBITMQ_PASS,
+                            std::chrono::milliseconds(Config::RABBITMQ_PUBLISH_TIMEOUT_MS));
 
     if (!rabbitmq.isConnected()) {
         std::cerr << "Warning: RabbitMQ not connected. Events will not be published." << std::endl;
@@ -67,13 +112,66 @@ int main() {
         std::cout << "Translation API connected successfully." << std::endl;
     }
 
+    // HTTP layer tunables
+    ServerOptions options{
+        .traceSampleEvery = Config::TRACE_SAMPLE_EVERY,
+        .traceBufferSize = Config::TRACE_BUFFER_SIZE,
+        .compressionMinBytes = Config::COMPRESSION_MIN_BYTES,
+        .gzipLevel = Config::GZIP_LEVEL,
+        .zstdLevel = Config::ZSTD_LEVEL,
+        .responseCacheBytes = Config::RESPONSE_CACHE_BYTES,
+        .versionMaxStalenessSeconds = Config::VERSION_MAX_STALENESS_SECONDS,
+        .idempotencyMaxKeys = Config::IDEMPOTENCY_MAX_KEYS,
+        .idempotencyTtlSeconds = Config::IDEMPOTENCY_TTL_SECONDS,
+        .rateLimitEnabled = Config::RATE_LIMIT_ENABLED,
+        .deadlineDefaultMs = Config::REQUEST_TIMEOUT_MS,
+        .batchMaxRequests = Config::BATCH_MAX_REQUESTS,
+        .sseMaxStreams = Config::SSE_MAX_STREAMS,
+        .sseHeartbeatSeconds = Config::SSE_HEARTBEAT_SECONDS,
+        .websocketHost = Config::SERVER_HOST,
+        .websocketPort = Config::WEBSOCKET_PORT,
+        .websocketWorkers = Config::WEBSOCKET_WORKERS,
+        .websocketDbConnections = Config::WEBSOCKET_DB_CONNECTIONS,
+        .httpEventLoop = Config::HTTP_EVENT_LOOP,
+        .httpHost = Config::SERVER_HOST,
+        .httpPort = Config::SERVER_PORT,
+        .httpKeepAliveSeconds = Config::HTTP_KEEP_ALIVE_SECONDS,
+        .realtimeTransport = Config::REALTIME_TRANSPORT,
+        .clusterBrokerHost = Config::RABBITMQ_HOST,
+        .clusterBrokerPort = Config::RABBITMQ_PORT,
+        .clusterBrokerUser = Config::RABBITMQ_USER,
+        .clusterBrokerPassword = Config::RABBITMQ_PASS,
+        .sharedVersions = sharedVersions
+    };
+
     // Initialize router and register all routes
-    HTTPRouter router(svr, db, rabbitmq, translationClient);
+    HTTPRouter router(svr, db, rabbitmq, translationClient, options);
     router.registerRoutes();
 
+    // Open SSE streams each pin a worker, so the pool has room for all of them on top
+    // of the threads that serve ordinary requests
+    svr.new_task_queue = [&router] {
+        return router.newTaskQueue(Config::HTTP_WORKER_THREADS + Config::SSE_MAX_STREAMS);
+    };
+
+    // WebSocket gateway runs on its own port and threads, next to the HTTP server
+    if (!router.startWebSocketGateway()) {
+        std::cerr << "Warning: WebSocket gateway not started. Real-time clients must use SSE." << std::endl;
+    } else if (Config::WEBSOCKET_PORT > 0) {
+        std::cout << "WebSocket gateway listening on port " << Config::WEBSOCKET_PORT << std::endl;
+    }
+
     // Start the HTTP server and listen on all interfaces at port 8080
     std::cout << "Starting server on port " << Config::SERVER_PORT << "..." << std::endl;
-    svr.listen(Config::SERVER_HOST, Config::SERVER_PORT);
+    if (Config::HTTP_EVENT_LOOP) {
+        // Same routes and worker pool, but connections wait on epoll instead of a thread each
+        if (!router.listenEventLoop(Config::HTTP_WORKER_THREADS + Config::SSE_MAX_STREAMS)) {
+            std::cerr << "Failed to start the event-loop HTTP front end. Exiting." << std::endl;
+            return 1;
+        }
+    } else {
+        svr.listen(Config::SERVER_HOST, Config::SERVER_PORT);
+    }
 
     return 0;
 }
\ No newline at end of file
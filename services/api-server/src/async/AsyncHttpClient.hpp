@@ -0,0 +1,185 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include <curl/curl.h>
+#include "../realtime/EventLoop.hpp"
+#include "Task.hpp"
+
+/**
+ * HTTP calls as coroutines on one EventLoop, over the curl multi interface
+ * curl tells us which sockets it wants watched (CURLMOPT_SOCKETFUNCTION) and when it
+ * next needs a timeout pass (CURLMOPT_TIMERFUNCTION); both go straight to the loop, and
+ * each finished transfer resumes the coroutine that started it. Any number of calls can
+ * be in flight on the loop thread, and curl reuses connections between them.
+ *
+ * Every member must be used on the loop thread.
+ */
+class AsyncHttpClient {
+public:
+    struct Response {
+        CURLcode code{CURLE_OK};
+        long status{0};
+        std::string body;
+    };
+
+    explicit AsyncHttpClient(EventLoop& loop)
+        : loop_(loop), multi_(curl_multi_init()) {
+        curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, onSocket);
+        curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+        curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, onTimer);
+        curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+    }
+
+    /**
+     * Must run on the loop thread or after it has stopped; calls still in flight never finish
+     */
+    ~AsyncHttpClient() {
+        loop_.cancelTimer(timer_);
+        curl_multi_cleanup(multi_);
+    }
+
+    AsyncHttpClient(const AsyncHttpClient&) = delete;
+    AsyncHttpClient& operator=(const AsyncHttpClient&) = delete;
+
+    /**
+     * POST body to url; code is CURLE_OPERATION_TIMEDOUT once timeout has passed
+     */
+    Task<Response> post(std::string url, std::string body, std::vector<std::string> headers,
+                        std::chrono::milliseconds timeout) {
+        Transfer transfer{*this};
+        CURL* easy = transfer.easy;
+        if (!easy) {
+            co_return Response{CURLE_FAILED_INIT, 0, {}};
+        }
+        for (const std::string& header : headers) {
+            transfer.headers = curl_slist_append(transfer.headers, header.c_str());
+        }
+        curl_easy_setopt(easy, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(easy, CURLOPT_POST, 1L);
+        curl_easy_setopt(easy, CURLOPT_POSTFIELDS, body.c_str());
+        curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE, static_cast<long>(body.size()));
+        curl_easy_setopt(easy, CURLOPT_HTTPHEADER, transfer.headers);
+        curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, onData);
+        curl_easy_setopt(easy, CURLOPT_WRITEDATA, &transfer.response.body);
+        curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, static_cast<long>(timeout.count()));
+        curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(easy, CURLOPT_PRIVATE, &transfer);
+
+        co_await transfer;
+        curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &transfer.response.status);
+        co_return std::move(transfer.response);
+    }
+
+private:
+    // One call: lives in the calling coroutine's frame, which stays suspended until it is done
+    struct Transfer {
+        explicit Transfer(AsyncHttpClient& owner)
+            : client(owner), easy(curl_easy_init()) {
+        }
+        ~Transfer() {
+            if (easy) curl_easy_cleanup(easy);
+            if (headers) curl_slist_free_all(headers);
+        }
+        Transfer(const Transfer&) = delete;
+        Transfer& operator=(const Transfer&) = delete;
+
+        bool await_ready() const { return false; }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            waiter = handle;
+            if (curl_multi_add_handle(client.multi_, easy) != CURLM_OK) {
+                response.code = CURLE_FAILED_INIT;
+                return false;
+            }
+            return true;
+        }
+
+        void await_resume() const {}
+
+        AsyncHttpClient& client;
+        CURL* easy;
+        curl_slist* headers{nullptr};
+        Response response;
+        std::coroutine_handle<> waiter;
+    };
+
+    static size_t onData(char* data, size_t size, size_t count, void* userp) {
+        static_cast<std::string*>(userp)->append(data, size * count);
+        return size * count;
+    }
+
+    // curl wants socket s watched for what (or no longer watched)
+    static int onSocket(CURL*, curl_socket_t s, int what, void* userp, void* socketp) {
+        auto& client = *static_cast<AsyncHttpClient*>(userp);
+        if (what == CURL_POLL_REMOVE) {
+            client.loop_.remove(s);
+            return 0;
+        }
+        uint32_t events = (what & CURL_POLL_IN ? EPOLLIN : 0u) | (what & CURL_POLL_OUT ? EPOLLOUT : 0u);
+        if (socketp) {
+            client.loop_.modify(s, events);
+        } else {
+            client.loop_.add(s, events, [&client, s](uint32_t ready) { client.onReady(s, ready); });
+            curl_multi_assign(client.multi_, s, &client);  // non-null: registered
+        }
+        return 0;
+    }
+
+    // curl wants a timeout pass in timeoutMs (-1: cancel)
+    static int onTimer(CURLM*, long timeoutMs, void* userp) {
+        auto& client = *static_cast<AsyncHttpClient*>(userp);
+        client.loop_.cancelTimer(std::exchange(client.timer_, 0));
+        if (timeoutMs >= 0) {
+            // Never act from inside the callback; curl may be in the middle of something
+            client.timer_ = client.loop_.runAfter(std::chrono::milliseconds(timeoutMs), [&client] {
+                client.timer_ = 0;
+                client.act(CURL_SOCKET_TIMEOUT, 0);
+            });
+        }
+        return 0;
+    }
+
+    void onReady(curl_socket_t s, uint32_t events) {
+        int flags = (events & EPOLLIN ? CURL_CSELECT_IN : 0) | (events & EPOLLOUT ? CURL_CSELECT_OUT : 0) |
+                    (events & (EPOLLERR | EPOLLHUP) ? CURL_CSELECT_ERR : 0);
+        act(s, flags);
+    }
+
+    /**
+     * Let curl progress on s, then resume the callers whose transfers finished
+     */
+    void act(curl_socket_t s, int flags) {
+        int running = 0;
+        curl_multi_socket_action(multi_, s, flags, &running);
+
+        std::vector<Transfer*> finished;
+        int queued = 0;
+        while (CURLMsg* message = curl_multi_info_read(multi_, &queued)) {
+            if (message->msg != CURLMSG_DONE) {
+                continue;
+            }
+            Transfer* transfer = nullptr;
+            curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &transfer);
+            transfer->response.code = message->data.result;
+            curl_multi_remove_handle(multi_, message->easy_handle);
+            finished.push_back(transfer);
+        }
+        // Resumed only now: a caller may start its next call, or free the transfer
+        for (Transfer* transfer : finished) {
+            transfer->waiter.resume();
+        }
+    }
+
+    EventLoop& loop_;
+    CURLM* multi_;
+    uint64_t timer_{0};
+};
+
+#endif // __linux__
@@ -0,0 +1,662 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <libpq-fe.h>
+#include "../database/Database.h"
+#include "../realtime/EventLoop.hpp"
+#include "../utils/RequestContext.hpp"
+#include "Task.hpp"
+
+/**
+ * Postgres queries as coroutines on one EventLoop, over non-blocking libpq
+ * A query is sent with PQsendQueryParams and the coroutine is suspended until its result
+ * arrives; the loop thread serves everything else meanwhile, without a thread per query.
+ *
+ * With pipelineDepth > 1 the connections run in libpq pipeline mode: up to that many
+ * queries from different callers are written back to back on one connection, each with
+ * its own sync point (so one failing doesn't abort the others), and their results come
+ * back in order - callers share round trips instead of paying one each. Queries sent
+ * during one pass of the loop go out in a single flush. A query goes to the least busy
+ * connection, and more are opened (up to connections) while every open one is busy.
+ *
+ * Every member must be used on the loop thread. Connections are opened on demand with
+ * PQconnectStart/PQconnectPoll so connecting doesn't block the loop either; each gets
+ * statement_timeout = queryTimeout so the server gives up when the client does. A caller
+ * whose timeout passes gets DeadlineExceeded; the query's result is dropped when it
+ * arrives, and its connection takes no new queries until then.
+ */
+class AsyncPostgres {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Params = std::vector<std::optional<std::string>>;
+    using WaitObserver = std::function<void(Clock::duration)>;
+
+    struct Options {
+        std::string connectionString;
+        size_t connections{2};
+        size_t pipelineDepth{1};  // queries in flight per connection
+        std::chrono::milliseconds queryTimeout{5000};
+    };
+
+    /**
+     * Owns one PGresult
+     */
+    class Result {
+    public:
+        // One field, read like a pqxx field
+        class Field {
+        public:
+            Field(const PGresult* result, int row, int col)
+                : result_(result), row_(row), col_(col) {
+            }
+
+            bool is_null() const { return PQgetisnull(result_, row_, col_) != 0; }
+
+            template <typename T>
+            T as() const {
+                if (col_ < 0) {
+                    throw std::out_of_range("no such column");
+                }
+                std::string_view value{PQgetvalue(result_, row_, col_),
+                                       static_cast<size_t>(PQgetlength(result_, row_, col_))};
+                if constexpr (std::is_same_v<T, std::string>) {
+                    return std::string(value);
+                } else if constexpr (std::is_same_v<T, bool>) {
+                    return value == "t";
+                } else {
+                    T out{};
+                    std::from_chars(value.data(), value.data() + value.size(), out);
+                    return out;
+                }
+            }
+
+        private:
+            const PGresult* result_;
+            int row_;
+            int col_;
+        };
+
+        // One row, read like a pqxx row: row["name"].as<T>()
+        class Row {
+        public:
+            Row(const PGresult* result, int row)
+                : result_(result), row_(row) {
+            }
+
+            Field operator[](const char* name) const {
+                return Field(result_, row_, PQfnumber(result_, name));
+            }
+
+        private:
+            const PGresult* result_;
+            int row_;
+        };
+
+        Result() = default;
+        explicit Result(PGresult* result)
+            : result_(result) {
+        }
+        Result(Result&& other) noexcept
+            : result_(std::exchange(other.result_, nullptr)) {
+        }
+        Result& operator=(Result&& other) noexcept {
+            if (this != &other) {
+                if (result_) PQclear(result_);
+                result_ = std::exchange(other.result_, nullptr);
+            }
+            return *this;
+        }
+        ~Result() {
+            if (result_) PQclear(result_);
+        }
+        Result(const Result&) = delete;
+        Result& operator=(const Result&) = delete;
+
+        explicit operator bool() const { return result_ != nullptr; }
+        int rows() const { return PQntuples(result_); }
+        Row operator[](int row) const { return Row(result_, row); }
+        int column(const char* name) const { return PQfnumber(result_, name); }
+        bool isNull(int row, int col) const { return PQgetisnull(result_, row, col) != 0; }
+
+        std::string_view text(int row, int col) const {
+            return {PQgetvalue(result_, row, col), static_cast<size_t>(PQgetlength(result_, row, col))};
+        }
+
+        template <typename Int>
+        Int integer(int row, int col) const {
+            std::string_view value = text(row, col);
+            Int out{};
+            std::from_chars(value.data(), value.data() + value.size(), out);
+            return out;
+        }
+
+        bool boolean(int row, int col) const {
+            return text(row, col) == "t";
+        }
+
+        PGresult* get() const { return result_; }
+
+    private:
+        PGresult* result_{nullptr};
+    };
+
+    AsyncPostgres(EventLoop& loop, Options options)
+        : loop_(loop), options_(std::move(options)) {
+        options_.connections = std::max<size_t>(options_.connections, 1);
+        options_.pipelineDepth = std::max<size_t>(options_.pipelineDepth, 1);
+    }
+
+    /**
+     * Closes the connections; must run on the loop thread or after it has stopped.
+     * Queries still in flight never finish.
+     */
+    ~AsyncPostgres() {
+        for (auto& conn : conns_) {
+            for (auto& pending : conn->inflight) {
+                loop_.cancelTimer(pending->timer);
+            }
+            close(*conn);
+        }
+        for (auto& waiter : waiting_) {
+            loop_.cancelTimer(waiter.timer);
+        }
+    }
+
+    AsyncPostgres(const AsyncPostgres&) = delete;
+    AsyncPostgres& operator=(const AsyncPostgres&) = delete;
+
+    /**
+     * Called (on the loop thread) with how long each query waited for room on a connection.
+     * Set before the first query.
+     */
+    void setWaitObserver(WaitObserver observer) {
+        waitObserver_ = std::move(observer);
+    }
+
+    /**
+     * Run sql with text parameters ($1, $2, ... ; nullopt is NULL) and return its result.
+     * timeout (default queryTimeout) bounds the whole call, the wait for a connection included.
+     */
+    Task<Result> query(std::string sql, Params params = {}, std::chrono::milliseconds timeout = {}) {
+        if (timeout.count() <= 0) {
+            timeout = options_.queryTimeout;
+        }
+        Clock::time_point start = Clock::now();
+        Clock::time_point deadline = start + timeout;
+        Conn* conn = co_await connection(deadline);
+        if (waitObserver_) {
+            waitObserver_(Clock::now() - start);
+        }
+
+        auto pending = std::make_shared<Pending>();
+        send(*conn, sql, params, pending);
+        co_await Completion{*this, pending, deadline};
+        if (pending->timedOut) {
+            throw DeadlineExceeded();
+        }
+        if (!pending->error.empty()) {
+            throw std::runtime_error(pending->error);
+        }
+        co_return std::move(pending->result);
+    }
+
+    // ---------- the reads the event loops serve ----------
+
+    Task<bool> roomExists(int roomId) {
+        Params params{std::to_string(roomId)};
+        Result r = co_await query("SELECT 1 FROM rooms WHERE id=$1", std::move(params));
+        co_return r.rows() > 0;
+    }
+
+    /**
+     * Same rows as Database::getMessagesAfter, but errors propagate instead of reading as none
+     */
+    Task<std::vector<Message>> messagesAfter(int roomId, int afterId, int limit) {
+        Params params{std::to_string(roomId), std::to_string(afterId), std::to_string(limit)};
+        Result r = co_await query(
+            "SELECT * FROM messages "
+            "WHERE room_id=$1 AND id>$2 AND is_deleted=false "
+            "ORDER BY id ASC "
+            "LIMIT $3",
+            std::move(params));
+
+        int id = r.column("id"), room = r.column("room_id"), user = r.column("user_id");
+        int content = r.column("content"), type = r.column("message_type"), created = r.column("created_at");
+        int edited = r.column("edited_at"), deleted = r.column("is_deleted"), seq = r.column("change_seq");
+
+        std::vector<Message> messages;
+        messages.reserve(static_cast<size_t>(r.rows()));
+        for (int row = 0; row < r.rows(); ++row) {
+            messages.push_back(Message{
+                r.integer<int>(row, id),
+                r.integer<int>(row, room),
+                r.integer<int>(row, user),
+                std::string(r.text(row, content)),
+                std::string(r.text(row, type)),
+                std::string(r.text(row, created)),
+                r.isNull(row, edited) ? "" : std::string(r.text(row, edited)),
+                r.boolean(row, deleted),
+                r.integer<int64_t>(row, seq)
+            });
+        }
+        co_return messages;
+    }
+
+private:
+    struct Conn;
+
+    // One query sent on a connection; the connection keeps it until its results are read
+    struct Pending {
+        Conn* conn{nullptr};
+        std::coroutine_handle<> waiter;
+        Result result;
+        std::string error;          // set when the query (or its connection) failed
+        bool resultsDone{false};    // pipeline mode: results read, its sync point is next
+        bool done{false};
+        bool timedOut{false};       // the caller gave up; whatever arrives is dropped
+        uint64_t timer{0};
+    };
+
+    struct Conn {
+        PGconn* pg{nullptr};
+        int fd{-1};                             // registered with the loop
+        bool ready{false};                      // connected and set up
+        bool wantWrite{false};                  // EPOLLOUT registered
+        bool flushQueued{false};
+        std::deque<std::shared_ptr<Pending>> inflight;
+        size_t abandoned{0};                    // timed-out queries still in inflight
+
+        // While connecting
+        std::coroutine_handle<> waiter;
+        uint32_t events{0};
+        uint64_t timer{0};
+        bool timedOut{false};
+    };
+
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        uint64_t timer{0};
+    };
+
+    /**
+     * Suspend until pending's results are in (or the deadline passes)
+     */
+    struct Completion {
+        AsyncPostgres& pool;
+        const std::shared_ptr<Pending>& pending;  // held by the awaiting frame
+        Clock::time_point deadline;
+
+        bool await_ready() const { return pending->done; }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            pending->waiter = handle;
+            pending->timer = pool.loop_.runAfter(pool.until(deadline), [pending = pending] {
+                pending->timer = 0;
+                pending->timedOut = true;
+                ++pending->conn->abandoned;
+                std::exchange(pending->waiter, {}).resume();
+            });
+        }
+
+        void await_resume() const {}
+    };
+
+    /**
+     * Suspend until a query finishes or a connection closes (or the deadline passes)
+     */
+    struct Vacancy {
+        AsyncPostgres& pool;
+        Clock::time_point deadline;
+
+        bool await_ready() const { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            AsyncPostgres* owner = &pool;
+            uint64_t timer = pool.loop_.runAfter(pool.until(deadline), [owner, handle] {
+                std::erase_if(owner->waiting_, [handle](const Waiter& w) { return w.handle == handle; });
+                handle.resume();
+            });
+            pool.waiting_.push_back(Waiter{handle, timer});
+        }
+
+        void await_resume() const {}
+    };
+
+    /**
+     * Suspend a connecting coroutine until conn's socket reports events
+     */
+    struct Readiness {
+        AsyncPostgres& pool;
+        Conn& conn;
+        uint32_t events;
+        Clock::time_point deadline;
+
+        bool await_ready() const { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            conn.waiter = handle;
+            bool write = (events & EPOLLOUT) != 0;
+            if (write != conn.wantWrite) {
+                conn.wantWrite = write;
+                pool.loop_.modify(conn.fd, EPOLLIN | (write ? EPOLLOUT : 0u));
+            }
+            Conn* target = &conn;
+            conn.timer = pool.loop_.runAfter(pool.until(deadline), [target] {
+                target->timer = 0;
+                target->timedOut = true;
+                std::exchange(target->waiter, {}).resume();
+            });
+        }
+
+        uint32_t await_resume() const {
+            if (conn.timedOut) {
+                throw DeadlineExceeded();
+            }
+            return conn.events;
+        }
+    };
+
+    std::chrono::milliseconds until(Clock::time_point deadline) const {
+        auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now());
+        return std::max(left, std::chrono::milliseconds(1));
+    }
+
+    bool pipelined() const {
+        return options_.pipelineDepth > 1;
+    }
+
+    /**
+     * A connection with room for one more query: an idle one, else a new one while below
+     * capacity, else the least busy one, else wait for room
+     */
+    Task<Conn*> connection(Clock::time_point deadline) {
+        for (;;) {
+            Conn* best = nullptr;
+            for (auto& conn : conns_) {
+                if (conn->ready && conn->abandoned == 0 && conn->inflight.size() < options_.pipelineDepth &&
+                    (!best || conn->inflight.size() < best->inflight.size())) {
+                    best = conn.get();
+                }
+            }
+            if (best && best->inflight.empty()) {
+                co_return best;
+            }
+            if (conns_.size() < options_.connections) {
+                co_return co_await open(deadline);
+            }
+            if (best) {
+                co_return best;
+            }
+            if (Clock::now() >= deadline) {
+                throw DeadlineExceeded();
+            }
+            co_await Vacancy{*this, deadline};
+        }
+    }
+
+    Task<Conn*> open(Clock::time_point deadline) {
+        conns_.push_back(std::make_unique<Conn>());  // counts against capacity while connecting
+        Conn* conn = conns_.back().get();
+        std::exception_ptr error;
+        try {
+            conn->pg = PQconnectStart(options_.connectionString.c_str());
+            if (!conn->pg || PQstatus(conn->pg) == CONNECTION_BAD) {
+                throw std::runtime_error(conn->pg ? PQerrorMessage(conn->pg) : "out of memory");
+            }
+            PostgresPollingStatusType status = PGRES_POLLING_WRITING;
+            while (status != PGRES_POLLING_OK) {
+                if (status == PGRES_POLLING_FAILED) {
+                    throw std::runtime_error(PQerrorMessage(conn->pg));
+                }
+                watch(*conn);  // the socket can change while libpq tries each address
+                co_await Readiness{*this, *conn, status == PGRES_POLLING_READING ? EPOLLIN : EPOLLOUT, deadline};
+                status = PQconnectPoll(conn->pg);
+            }
+            watch(*conn);
+            if (PQsetnonblocking(conn->pg, 1) != 0 || (pipelined() && PQenterPipelineMode(conn->pg) != 1)) {
+                throw std::runtime_error(PQerrorMessage(conn->pg));
+            }
+        } catch (...) {
+            error = std::current_exception();
+        }
+        if (error) {
+            fail(*conn, "");
+            std::rethrow_exception(error);
+        }
+
+        conn->ready = true;
+        if (conn->wantWrite) {
+            conn->wantWrite = false;
+            loop_.modify(conn->fd, EPOLLIN);
+        }
+        wakeWaiters(waiting_.size());  // pipelined queries can queue behind the setup
+
+        auto setup = std::make_shared<Pending>();
+        std::string setTimeout = "SET statement_timeout = " + std::to_string(options_.queryTimeout.count());
+        send(*conn, setTimeout, {}, setup);
+        co_await Completion{*this, setup, deadline};
+        if (owns(conn) && (setup->timedOut || !setup->error.empty())) {
+            fail(*conn, "");
+        }
+        if (setup->timedOut) {
+            throw DeadlineExceeded();
+        }
+        if (!owns(conn)) {
+            throw std::runtime_error(setup->error.empty() ? "connection lost" : setup->error);
+        }
+        co_return conn;
+    }
+
+    /**
+     * Register conn's current socket with the loop (replacing a previous one)
+     */
+    void watch(Conn& conn) {
+        int fd = PQsocket(conn.pg);
+        if (fd < 0) {
+            throw std::runtime_error(PQerrorMessage(conn.pg));
+        }
+        if (fd == conn.fd) {
+            return;
+        }
+        if (conn.fd >= 0) {
+            loop_.remove(conn.fd);
+        }
+        conn.fd = fd;
+        conn.wantWrite = false;
+        Conn* target = &conn;
+        loop_.add(fd, EPOLLIN, [this, target](uint32_t events) { onEvents(*target, events); });
+    }
+
+    void onEvents(Conn& conn, uint32_t events) {
+        if (!conn.ready) {
+            if (conn.waiter) {
+                loop_.cancelTimer(std::exchange(conn.timer, 0));
+                conn.events = events;
+                std::exchange(conn.waiter, {}).resume();
+            }
+            return;
+        }
+        if ((events & EPOLLOUT) && !flush(conn)) {
+            return;
+        }
+        if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+            readResults(conn);
+        }
+    }
+
+    /**
+     * Queue sql on conn; libpq buffers it until the flush at the end of this loop pass.
+     * On failure the connection is closed and pending completes with the error.
+     */
+    void send(Conn& conn, const std::string& sql, const Params& params, std::shared_ptr<Pending> pending) {
+        std::vector<const char*> values;
+        values.reserve(params.size());
+        for (const auto& param : params) {
+            values.push_back(param ? param->c_str() : nullptr);
+        }
+
+        pending->conn = &conn;
+        conn.inflight.push_back(std::move(pending));
+        if (!PQsendQueryParams(conn.pg, sql.c_str(), static_cast<int>(values.size()), nullptr, values.data(),
+                               nullptr, nullptr, 0) ||
+            (pipelined() && !PQpipelineSync(conn.pg))) {
+            fail(conn, PQerrorMessage(conn.pg));
+            return;
+        }
+        if (!conn.flushQueued) {
+            conn.flushQueued = true;
+            Conn* target = &conn;
+            loop_.post([this, target] {
+                if (owns(target)) {  // it may have failed since
+                    target->flushQueued = false;
+                    flush(*target);
+                }
+            });
+        }
+    }
+
+    bool owns(const Conn* conn) const {
+        return std::any_of(conns_.begin(), conns_.end(), [conn](const auto& c) { return c.get() == conn; });
+    }
+
+    /**
+     * Write what libpq has buffered, watching for writability while the socket is full;
+     * false if the connection failed
+     */
+    bool flush(Conn& conn) {
+        int flushed = PQflush(conn.pg);
+        if (flushed < 0) {
+            fail(conn, PQerrorMessage(conn.pg));
+            return false;
+        }
+        bool write = flushed == 1;
+        if (write != conn.wantWrite) {
+            conn.wantWrite = write;
+            loop_.modify(conn.fd, EPOLLIN | (write ? EPOLLOUT : 0u));
+        }
+        return true;
+    }
+
+    /**
+     * Hand every complete result to its query, oldest first, then resume their callers
+     */
+    void readResults(Conn& conn) {
+        if (!PQconsumeInput(conn.pg)) {
+            fail(conn, PQerrorMessage(conn.pg));
+            return;
+        }
+
+        std::vector<std::shared_ptr<Pending>> finished;
+        size_t completed = 0;
+        while (!conn.inflight.empty() && !PQisBusy(conn.pg)) {
+            Pending& front = *conn.inflight.front();
+            PGresult* next = PQgetResult(conn.pg);
+            if (!next) {
+                // End of this query's results; in pipeline mode its sync point follows
+                front.resultsDone = true;
+                if (pipelined()) continue;
+            } else if (PQresultStatus(next) == PGRES_PIPELINE_SYNC) {
+                PQclear(next);
+            } else {
+                if (!front.result) {
+                    front.result = Result(next);
+                } else {
+                    PQclear(next);  // only the first statement's result is kept
+                }
+                continue;
+            }
+
+            std::shared_ptr<Pending> pending = std::move(conn.inflight.front());
+            conn.inflight.pop_front();
+            ++completed;
+            ExecStatusType status = pending->result ? PQresultStatus(pending->result.get()) : PGRES_FATAL_ERROR;
+            if (status != PGRES_TUPLES_OK && status != PGRES_COMMAND_OK) {
+                pending->error = pending->result ? PQresultErrorMessage(pending->result.get()) : "no result";
+            }
+            pending->done = true;
+            if (pending->timedOut) {
+                --conn.abandoned;
+            } else if (pending->waiter) {
+                loop_.cancelTimer(std::exchange(pending->timer, 0));
+                finished.push_back(std::move(pending));
+            }
+        }
+
+        if (conn.inflight.empty() && PQstatus(conn.pg) != CONNECTION_OK) {
+            fail(conn, PQerrorMessage(conn.pg));  // the server closed it
+        } else {
+            wakeWaiters(completed);
+        }
+        // Resumed only now: a caller may send its next query, on this connection too
+        for (auto& pending : finished) {
+            std::exchange(pending->waiter, {}).resume();
+        }
+    }
+
+    /**
+     * Close conn and fail everything in flight on it; the callers resume from the loop's
+     * queue, not inside whatever noticed the failure
+     */
+    void fail(Conn& conn, const std::string& error) {
+        std::deque<std::shared_ptr<Pending>> inflight = std::move(conn.inflight);
+        close(conn);
+        std::erase_if(conns_, [&conn](const auto& c) { return c.get() == &conn; });
+
+        for (auto& pending : inflight) {
+            loop_.cancelTimer(std::exchange(pending->timer, 0));
+            pending->conn = nullptr;
+            pending->error = error.empty() ? "connection lost" : error;
+            pending->done = true;
+            if (pending->waiter && !pending->timedOut) {
+                loop_.post([handle = std::exchange(pending->waiter, {})] { handle.resume(); });
+            }
+        }
+        wakeWaiters(1);  // room for a new connection
+    }
+
+    void close(Conn& conn) {
+        loop_.cancelTimer(std::exchange(conn.timer, 0));
+        if (conn.fd >= 0) {
+            loop_.remove(std::exchange(conn.fd, -1));
+        }
+        if (conn.pg) {
+            PQfinish(std::exchange(conn.pg, nullptr));
+        }
+    }
+
+    /**
+     * Let up to count callers waiting for room look again
+     */
+    void wakeWaiters(size_t count) {
+        for (; count > 0 && !waiting_.empty(); --count) {
+            Waiter next = waiting_.front();
+            waiting_.pop_front();
+            loop_.cancelTimer(next.timer);
+            loop_.post([handle = next.handle] { handle.resume(); });
+        }
+    }
+
+    EventLoop& loop_;
+    Options options_;
+    WaitObserver waitObserver_;
+    std::vector<std::unique_ptr<Conn>> conns_;  // connected, or being opened
+    std::deque<Waiter> waiting_;
+};
+
+#endif // __linux__
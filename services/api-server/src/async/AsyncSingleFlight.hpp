@@ -0,0 +1,74 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Task.hpp"
+
+/**
+ * SingleFlight for coroutines on one thread
+ * The first caller for a key runs its task; callers that arrive while it is running are
+ * suspended and resumed with the leader's result (or exception) instead of running
+ * their own. No locks: every caller must be on the same thread (e.g. one EventLoop).
+ *
+ * As with SingleFlight, the key must capture everything the result depends on.
+ */
+template <typename Value>
+class AsyncSingleFlight {
+public:
+    using Result = std::shared_ptr<const Value>;
+
+    /**
+     * Result for key; task (not started yet) only runs if no flight for key is in the air
+     */
+    Task<Result> run(std::string key, Task<Value> task) {
+        auto found = flights_.find(key);
+        if (found != flights_.end()) {
+            std::shared_ptr<Flight> flight = found->second;
+            co_await Join{*flight};
+            if (flight->error) {
+                std::rethrow_exception(flight->error);
+            }
+            co_return flight->result;
+        }
+
+        auto flight = std::make_shared<Flight>();
+        flights_.emplace(key, flight);
+        try {
+            flight->result = std::make_shared<const Value>(co_await std::move(task));
+        } catch (...) {
+            flight->error = std::current_exception();
+        }
+        flights_.erase(key);
+
+        // Later callers start a flight of their own from here on
+        for (std::coroutine_handle<> follower : flight->followers) {
+            follower.resume();
+        }
+        if (flight->error) {
+            std::rethrow_exception(flight->error);
+        }
+        co_return flight->result;
+    }
+
+private:
+    struct Flight {
+        Result result;
+        std::exception_ptr error;
+        std::vector<std::coroutine_handle<>> followers;
+    };
+
+    struct Join {
+        Flight& flight;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { flight.followers.push_back(handle); }
+        void await_resume() const noexcept {}
+    };
+
+    std::unordered_map<std::string, std::shared_ptr<Flight>> flights_;
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <iostream>
+#include <utility>
+#include <variant>
+
+/**
+ * Lazily started coroutine returning T
+ * A Task does nothing until it is co_awaited; the awaiting coroutine is suspended and
+ * resumed (by symmetric transfer, so long chains don't grow the stack) once the task
+ * finishes. An exception thrown in the task is rethrown at the co_await.
+ *
+ * Tasks don't pick a thread: a task resumes wherever the event that completed its
+ * awaitable was handled - for AsyncPostgres and AsyncHttpClient, their EventLoop.
+ * The top of a chain is started with spawn().
+ */
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation;
+
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> finished) noexcept {
+            std::coroutine_handle<> next = finished.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    std::variant<std::monostate, T, std::exception_ptr> result;
+
+    Task<T> get_return_object();
+
+    template <typename U>
+    void return_value(U&& value) {
+        result.template emplace<1>(std::forward<U>(value));
+    }
+
+    void unhandled_exception() {
+        result.template emplace<2>(std::current_exception());
+    }
+
+    T take() {
+        if (result.index() == 2) {
+            std::rethrow_exception(std::get<2>(result));
+        }
+        return std::move(std::get<1>(result));
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    std::exception_ptr error;
+
+    Task<void> get_return_object();
+
+    void return_void() {}
+
+    void unhandled_exception() {
+        error = std::current_exception();
+    }
+
+    void take() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+}  // namespace detail
+
+template <typename T>
+class [[nodiscard]] Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit Task(Handle handle)
+        : handle_(handle) {
+    }
+
+    Task(Task&& other) noexcept
+        : handle_(std::exchange(other.handle_, {})) {
+    }
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) handle_.destroy();
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+
+    ~Task() {
+        if (handle_) handle_.destroy();
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            Handle handle;
+
+            bool await_ready() const noexcept { return false; }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+
+            T await_resume() {
+                return handle.promise().take();
+            }
+        };
+        return Awaiter{handle_};
+    }
+
+private:
+    Handle handle_;
+};
+
+namespace detail {
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// Runs eagerly and frees itself when done; nothing can await it
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() const noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+};
+
+inline Detached detach(Task<void> task) {
+    try {
+        co_await std::move(task);
+    } catch (const std::exception& e) {
+        std::cerr << "Coroutine error: " << e.what() << std::endl;
+    }
+}
+
+}  // namespace detail
+
+/**
+ * Start task on the calling thread, running until its first suspension; the frame frees
+ * itself when the task finishes. Exceptions that escape the task are logged.
+ */
+inline void spawn(Task<void> task) {
+    detail::detach(std::move(task));
+}
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <sys/mman.h>
+#include "../external/httplib.h"
+
+/**
+ * Change versions behind the ETags of the polling endpoints
+ * - room(id):  bumped by message, member and room writes for that room
+ * - roomList:  bumped when a room is created, renamed or deleted
+ * - global:    bumped by writes that can touch any room (user updates/deletes cascade)
+ *
+ * Rooms share a fixed table of atomic slots (id modulo ROOM_SLOTS), so a lookup never
+ * locks or allocates. Two rooms that share a slot just invalidate each other - a spurious
+ * 200, never a stale 304. The process epoch goes into every tag so versions restarting
+ * from zero after a restart can't collide with tags clients still hold.
+ *
+ * Readers must take the version BEFORE querying Postgres and writers must bump AFTER
+ * their write commits; then any tag a client holds is at worst older than its data.
+ *
+ * Pre-forked worker processes share one State in shared memory (shared()), so a write
+ * served by one worker changes the tags - and response cache keys - of all of them.
+ * Other replicas learn of a bump through the relay (setRelay) and repeat it with
+ * applyRemote(); the Postgres transport gets the same from triggers instead.
+ *
+ * Relayed bumps are transient and a replica that was disconnected misses them, so tags
+ * also carry the current maxStaleness window: a tag - and the response cache entry
+ * keyed by it - is never honoured for longer than that, whatever was lost.
+ */
+class ChangeVersions {
+public:
+    static constexpr size_t ROOM_SLOTS = 4096;
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> value{0};
+    };
+
+    // The counters; lock-free atomics, so they work in memory shared between processes too
+    struct State {
+        State()
+            : epoch(static_cast<uint64_t>(
+                  std::chrono::system_clock::now().time_since_epoch() / std::chrono::microseconds(1))) {
+        }
+
+        const uint64_t epoch;
+        std::atomic<uint64_t> global{0};
+        std::atomic<uint64_t> roomList{0};
+        std::array<Slot, ROOM_SLOTS> rooms{};
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+    // What a bump covered, as relayed between replicas
+    static constexpr std::string_view ROOM = "room";        // one room (roomId)
+    static constexpr std::string_view ROOM_LIST = "rooms";  // the room list (roomId 0)
+    static constexpr std::string_view ALL = "all";          // everything (roomId 0)
+
+    using Relay = std::function<void(std::string_view what, int roomId)>;
+
+    /**
+     * Versions kept in shared (which must outlive this), or in this object when null;
+     * a zero maxStaleness trusts the relay alone
+     */
+    explicit ChangeVersions(State* shared = nullptr, std::chrono::seconds maxStaleness = std::chrono::seconds(0))
+        : owned_(shared ? nullptr : std::make_unique<State>()),
+          state_(shared ? *shared : *owned_),
+          maxStaleness_(maxStaleness) {
+    }
+
+    ChangeVersions(const ChangeVersions&) = delete;
+    ChangeVersions& operator=(const ChangeVersions&) = delete;
+
+    /**
+     * A State in an anonymous shared mapping; every process forked after this call sees
+     * the same counters. Never unmapped.
+     */
+    static State* shared() {
+        void* memory = mmap(nullptr, sizeof(State), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "mmap change versions");
+        }
+        return new (memory) State();
+    }
+
+    /**
+     * Called after every local bump so other replicas can repeat it; set before serving
+     */
+    void setRelay(Relay relay) {
+        relay_ = std::move(relay);
+    }
+
+    /**
+     * Repeat a bump another replica relayed (not relayed again); false if what is unknown
+     */
+    bool applyRemote(std::string_view what, int roomId) {
+        return bump(what, roomId);
+    }
+
+    uint64_t room(int roomId) const {
+        return slot(roomId).load(std::memory_order_acquire);
+    }
+
+    uint64_t roomList() const {
+        return state_.roomList.load(std::memory_order_acquire);
+    }
+
+    void bumpRoom(int roomId) {
+        bump(ROOM, roomId);
+        relay(ROOM, roomId);
+    }
+
+    void bumpRoomList() {
+        bump(ROOM_LIST, 0);
+        relay(ROOM_LIST, 0);
+    }
+
+    void bumpAll() {
+        bump(ALL, 0);
+        relay(ALL, 0);
+    }
+
+    /**
+     * W/"<kind><id>-<epoch>-<global>-<version>[-<window>]" - weak, because the bytes on
+     * the wire also depend on content coding
+     */
+    std::string roomTag(char kind, int roomId) const {
+        return makeTag(kind, roomId, room(roomId));
+    }
+
+    std::string roomListTag() const {
+        return makeTag('L', 0, roomList());
+    }
+
+private:
+    bool bump(std::string_view what, int roomId) {
+        if (what == ROOM) {
+            slot(roomId).fetch_add(1, std::memory_order_acq_rel);
+        } else if (what == ROOM_LIST) {
+            state_.roomList.fetch_add(1, std::memory_order_acq_rel);
+        } else if (what == ALL) {
+            state_.global.fetch_add(1, std::memory_order_acq_rel);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    void relay(std::string_view what, int roomId) {
+        if (relay_) {
+            relay_(what, roomId);
+        }
+    }
+
+    std::atomic<uint64_t>& slot(int roomId) {
+        return state_.rooms[static_cast<uint32_t>(roomId) % ROOM_SLOTS].value;
+    }
+
+    const std::atomic<uint64_t>& slot(int roomId) const {
+        return state_.rooms[static_cast<uint32_t>(roomId) % ROOM_SLOTS].value;
+    }
+
+    std::string makeTag(char kind, int id, uint64_t version) const {
+        std::string tag = "W/\"";
+        tag += kind;
+        tag += std::to_string(id);
+        tag += '-';
+        tag += std::to_string(state_.epoch);
+        tag += '-';
+        tag += std::to_string(state_.global.load(std::memory_order_acquire));
+        tag += '-';
+        tag += std::to_string(version);
+        if (maxStaleness_.count() > 0) {
+            // steady_clock, so pre-forked workers sharing State agree on the window
+            tag += '-';
+            tag += std::to_string(std::chrono::steady_clock::now().time_since_epoch() / maxStaleness_);
+        }
+        tag += '"';
+        return tag;
+    }
+
+    std::unique_ptr<State> owned_;
+    State& state_;
+    const std::chrono::seconds maxStaleness_;
+    Relay relay_;
+};
+
+namespace ConditionalGet {
+
+/**
+ * Does an If-None-Match list of tags match etag?
+ * Uses the weak comparison RFC 9110 prescribes for If-None-Match. "*" is not honoured:
+ * it would need to know the resource exists, and answering 200 instead is always safe.
+ */
+inline bool matches(std::string_view header, std::string_view etag) {
+    auto opaque = [](std::string_view tag) {
+        if (tag.starts_with("W/")) tag.remove_prefix(2);
+        return tag;
+    };
+
+    std::string_view wanted = opaque(etag);
+    while (!header.empty()) {
+        size_t comma = header.find(',');
+        std::string_view candidate = header.substr(0, comma);
+        header = comma == std::string_view::npos ? std::string_view{} : header.substr(comma + 1);
+
+        while (!candidate.empty() && candidate.front() == ' ') candidate.remove_prefix(1);
+        while (!candidate.empty() && candidate.back() == ' ') candidate.remove_suffix(1);
+
+        if (opaque(candidate) == wanted) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Answer 304 if the client already holds this version (checked before any DB work)
+ */
+inline bool notModified(const httplib::Request& req, httplib::Response& res, const std::string& etag) {
+    if (!req.has_header("If-None-Match") || !matches(req.get_header_value("If-None-Match"), etag)) {
+        return false;
+    }
+    res.set_header("ETag", etag);
+    res.set_header("Cache-Control", "no-cache");
+    res.status = 304;
+    return true;
+}
+
+/**
+ * Tag a successful response so the client can revalidate it next time
+ */
+inline void tag(httplib::Response& res, const std::string& etag) {
+    res.set_header("ETag", etag);
+    res.set_header("Cache-Control", "no-cache");
+}
+
+} // namespace ConditionalGet
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "../external/json.hpp"
+
+/**
+ * Responses remembered per Idempotency-Key, so a retried POST is answered without a write
+ * - claim() reserves a key for the first request; the caller then either complete()s it
+ *   with the response it sent or release()s it so a retry can try again
+ * - A retry of a completed key gets the stored response back; one that arrives while the
+ *   first is still running is told so, and a key reused for a different request (another
+ *   fingerprint) is refused
+ * - Entries expire after ttl and each shard keeps at most maxEntries / SHARDS, dropping
+ *   the oldest first. Every entry has the same ttl, so insertion order is expiry order.
+ *
+ * Callers scope keys to the client that chose them (e.g. "<user id>:<key>").
+ * This is only the fast path: messages has UNIQUE (user_id, idempotency_key), so a retry
+ * that lands on another replica or after eviction still can't insert twice.
+ */
+class IdempotencyStore {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t SHARDS = 16;
+
+    struct Response {
+        int status{0};
+        std::string body;
+    };
+
+    enum class Outcome {
+        Started,     // first request with this key - run it
+        Replay,      // already answered - send response
+        InProgress,  // the first request hasn't finished
+        Mismatch     // key already used for a different request
+    };
+
+    struct Claim {
+        Outcome outcome;
+        std::shared_ptr<const Response> response;  // set for Replay
+    };
+
+    IdempotencyStore(size_t maxEntries, std::chrono::seconds ttl)
+        : shardCapacity_(std::max<size_t>(maxEntries / SHARDS, 1)), ttl_(ttl) {
+    }
+
+    IdempotencyStore(const IdempotencyStore&) = delete;
+    IdempotencyStore& operator=(const IdempotencyStore&) = delete;
+
+    Claim claim(const std::string& key, uint64_t fingerprint) {
+        Shard& shard = shardFor(key);
+        auto now = Clock::now();
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.expire(now);
+
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            const Entry& entry = *it->second;
+            if (entry.fingerprint != fingerprint) {
+                mismatches_.fetch_add(1, std::memory_order_relaxed);
+                return {Outcome::Mismatch, nullptr};
+            }
+            if (!entry.response) {
+                inProgress_.fetch_add(1, std::memory_order_relaxed);
+                return {Outcome::InProgress, nullptr};
+            }
+            replays_.fetch_add(1, std::memory_order_relaxed);
+            return {Outcome::Replay, entry.response};
+        }
+
+        while (shard.index.size() >= shardCapacity_) {
+            shard.index.erase(shard.order.front().key);
+            shard.order.pop_front();
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+        }
+        shard.order.push_back(Entry{key, fingerprint, now + ttl_, nullptr});
+        shard.index.emplace(shard.order.back().key, std::prev(shard.order.end()));
+        started_.fetch_add(1, std::memory_order_relaxed);
+        return {Outcome::Started, nullptr};
+    }
+
+    /**
+     * Remember the response to a claimed key (a no-op if it was evicted meanwhile)
+     */
+    void complete(const std::string& key, int status, std::string body) {
+        auto response = std::make_shared<const Response>(Response{status, std::move(body)});
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end() && !it->second->response) {
+            it->second->response = std::move(response);
+        }
+    }
+
+    /**
+     * Forget a claimed key whose request failed, so the client's retry runs again
+     */
+    void release(const std::string& key) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end() && !it->second->response) {
+            shard.order.erase(it->second);
+            shard.index.erase(it);
+        }
+    }
+
+    nlohmann::json stats() const {
+        size_t entries = 0;
+        for (const Shard& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            entries += shard.index.size();
+        }
+        return {
+            {"entries", entries},
+            {"max_entries", shardCapacity_ * SHARDS},
+            {"ttl_seconds", ttl_.count()},
+            {"started", started_.load(std::memory_order_relaxed)},
+            {"replays", replays_.load(std::memory_order_relaxed)},
+            {"in_progress", inProgress_.load(std::memory_order_relaxed)},
+            {"mismatches", mismatches_.load(std::memory_order_relaxed)},
+            {"evictions", evictions_.load(std::memory_order_relaxed)}
+        };
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t fingerprint;
+        Clock::time_point expires;
+        std::shared_ptr<const Response> response;  // null while the first request runs
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> order;  // oldest first
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;  // views into order
+
+        void expire(Clock::time_point now) {
+            while (!order.empty() && order.front().expires <= now) {
+                index.erase(order.front().key);
+                order.pop_front();
+            }
+        }
+    };
+
+    Shard& shardFor(const std::string& key) {
+        return shards_[std::hash<std::string>{}(key) % SHARDS];
+    }
+
+    const size_t shardCapacity_;
+    const std::chrono::seconds ttl_;
+    std::array<Shard, SHARDS> shards_;
+
+    std::atomic<uint64_t> started_{0};
+    std::atomic<uint64_t> replays_{0};
+    std::atomic<uint64_t> inProgress_{0};
+    std::atomic<uint64_t> mismatches_{0};
+    std::atomic<uint64_t> evictions_{0};
+};
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "../external/json.hpp"
+
+/**
+ * In-process cache of serialized response bodies for the hot GET endpoints
+ * - Keys are (kind, id) pairs: 'L' = room list, 'R' = one room, 'M' = first message page,
+ *   'S' = default room snapshot
+ * - Each entry remembers the ETag it was built under; a lookup with a different tag is a
+ *   miss, so an entry filled by a reader that raced a write can never be served
+ * - Writes also drop the affected entries straight away (invalidateRoom / invalidateRoomList)
+ * - Eviction is LRU within a byte budget, split across shards by id to keep locks short
+ */
+class ResponseCache {
+public:
+    using Body = std::shared_ptr<const std::string>;
+
+    static constexpr size_t SHARDS = 16;
+
+    // Bookkeeping charged per entry on top of the body bytes
+    static constexpr size_t ENTRY_OVERHEAD = 128;
+
+    explicit ResponseCache(size_t maxBytes)
+        : shardBudget_(maxBytes / SHARDS) {
+    }
+
+    ResponseCache(const ResponseCache&) = delete;
+    ResponseCache& operator=(const ResponseCache&) = delete;
+
+    /**
+     * Body cached for (kind, id) under exactly this tag, or nullptr
+     */
+    Body get(char kind, int id, const std::string& tag) {
+        Shard& shard = shardFor(id);
+        uint64_t key = makeKey(kind, id);
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.index.find(key);
+            if (it != shard.index.end()) {
+                if (it->second->tag == tag) {
+                    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                    hits_.fetch_add(1, std::memory_order_relaxed);
+                    return it->second->body;
+                }
+                // Built under an older version - useless from now on
+                shard.erase(it);
+            }
+        }
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    void put(char kind, int id, const std::string& tag, std::string body) {
+        size_t cost = body.size() + tag.size() + ENTRY_OVERHEAD;
+        if (cost > shardBudget_) {
+            return;
+        }
+
+        auto shared = std::make_shared<const std::string>(std::move(body));
+        Shard& shard = shardFor(id);
+        uint64_t key = makeKey(kind, id);
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto existing = shard.index.find(key);
+        if (existing != shard.index.end()) {
+            shard.erase(existing);
+        }
+
+        shard.lru.push_front(Entry{key, tag, std::move(shared), cost});
+        shard.index.emplace(key, shard.lru.begin());
+        shard.bytes += cost;
+
+        while (shard.bytes > shardBudget_) {
+            shard.erase(shard.index.find(shard.lru.back().key));
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Drop everything derived from one room (its detail, first message page and snapshot)
+     */
+    void invalidateRoom(int roomId) {
+        invalidate('R', roomId);
+        invalidate('M', roomId);
+        invalidate('S', roomId);
+    }
+
+    void invalidateRoomList() {
+        invalidate('L', 0);
+    }
+
+    nlohmann::json stats() const {
+        uint64_t hits = hits_.load(std::memory_order_relaxed);
+        uint64_t misses = misses_.load(std::memory_order_relaxed);
+
+        size_t entries = 0;
+        size_t bytes = 0;
+        for (const Shard& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            entries += shard.index.size();
+            bytes += shard.bytes;
+        }
+
+        return {
+            {"hits", hits},
+            {"misses", misses},
+            {"hit_rate", hits + misses == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(hits + misses)},
+            {"entries", entries},
+            {"bytes", bytes},
+            {"max_bytes", shardBudget_ * SHARDS},
+            {"evictions", evictions_.load(std::memory_order_relaxed)},
+            {"invalidations", invalidations_.load(std::memory_order_relaxed)}
+        };
+    }
+
+private:
+    struct Entry {
+        uint64_t key;
+        std::string tag;
+        Body body;
+        size_t cost;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> lru;  // front = most recently used
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+        size_t bytes{0};
+
+        void erase(std::unordered_map<uint64_t, std::list<Entry>::iterator>::iterator it) {
+            bytes -= it->second->cost;
+            lru.erase(it->second);
+            index.erase(it);
+        }
+    };
+
+    static uint64_t makeKey(char kind, int id) {
+        return (static_cast<uint64_t>(static_cast<unsigned char>(kind)) << 32) | static_cast<uint32_t>(id);
+    }
+
+    Shard& shardFor(int id) {
+        return shards_[static_cast<uint32_t>(id) % SHARDS];
+    }
+
+    void invalidate(char kind, int id) {
+        Shard& shard = shardFor(id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(makeKey(kind, id));
+        if (it != shard.index.end()) {
+            shard.erase(it);
+            invalidations_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    const size_t shardBudget_;
+    std::array<Shard, SHARDS> shards_;
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> evictions_{0};
+    std::atomic<uint64_t> invalidations_{0};
+};
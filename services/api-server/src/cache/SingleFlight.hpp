@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "../utils/RequestContext.hpp"
+
+/**
+ * Request coalescing for identical concurrent reads
+ * The first caller for a key (the leader) runs fn; callers that arrive with the same key
+ * while it is running wait for and share the leader's result instead of running their own
+ * query. Exceptions thrown by fn are rethrown in every waiter.
+ *
+ * The key must capture everything the result depends on - including the data version -
+ * so a caller that arrives after a write never joins a flight that started before it.
+ *
+ * Deadlines (RequestContext) are per caller: a follower waits no longer than its own and
+ * then throws DeadlineExceeded. A leader whose request was abandoned hands its followers
+ * DeadlineExceeded rather than what it got, and a follower that still has time left
+ * retries with a flight of its own (or joins a newer one) instead of failing with it.
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class SingleFlight {
+public:
+    using Result = std::shared_ptr<const Value>;
+
+    /**
+     * Result for key; fn runs at most once per flight.
+     * joined (optional) is set to true when this caller shared another caller's flight.
+     */
+    template <typename F>
+    Result run(const Key& key, F&& fn, bool* joined = nullptr) {
+        for (;;) {
+            try {
+                return attempt(key, fn, joined);
+            } catch (const LeaderAbandoned&) {
+                // Another request's deadline, not ours: try again
+            }
+        }
+    }
+
+    // Flights actually executed / callers that piggybacked on one
+    uint64_t leaders() const { return leaders_.load(std::memory_order_relaxed); }
+    uint64_t followers() const { return followers_.load(std::memory_order_relaxed); }
+
+private:
+    // What followers of an abandoned leader get; the leader itself sees DeadlineExceeded
+    struct LeaderAbandoned : DeadlineExceeded {};
+
+    template <typename F>
+    Result attempt(const Key& key, F& fn, bool* joined) {
+        std::shared_future<Result> result;
+        std::promise<Result> promise;
+        bool leader = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = calls_.find(key);
+            if (it != calls_.end()) {
+                result = it->second;
+            } else {
+                result = promise.get_future().share();
+                calls_.emplace(key, result);
+                leader = true;
+            }
+        }
+
+        if (joined) {
+            *joined = !leader;
+        }
+
+        RequestContext& context = RequestContext::current();
+        if (!leader) {
+            followers_.fetch_add(1, std::memory_order_relaxed);
+            if (context.hasDeadline() && result.wait_until(context.deadline()) == std::future_status::timeout) {
+                context.markAbandoned();
+                throw DeadlineExceeded();
+            }
+            return result.get();
+        }
+
+        leaders_.fetch_add(1, std::memory_order_relaxed);
+        std::exception_ptr failure;
+        try {
+            auto value = std::make_shared<const Value>(fn());
+            if (context.abandoned()) {
+                // Built from calls given up on at our deadline - not a result to share
+                promise.set_exception(std::make_exception_ptr(LeaderAbandoned()));
+                failure = std::make_exception_ptr(DeadlineExceeded());
+            } else {
+                promise.set_value(std::move(value));
+            }
+        } catch (const DeadlineExceeded&) {
+            promise.set_exception(std::make_exception_ptr(LeaderAbandoned()));
+            failure = std::current_exception();
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            calls_.erase(key);
+        }
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+        return result.get();
+    }
+
+    std::mutex mutex_;
+    std::unordered_map<Key, std::shared_future<Result>, Hash> calls_;
+    std::atomic<uint64_t> leaders_{0};
+    std::atomic<uint64_t> followers_{0};
+};
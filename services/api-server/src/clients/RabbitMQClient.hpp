@@ -1,7 +1,16 @@
 #pragma once
 #include <string>
+#include <string_view>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
 #include <ctime>
+#include <mutex>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/time.h>
 #include <rabbitmq-c/amqp.h>
 #include <rabbitmq-c/tcp_socket.h>
 #include "../external/json.hpp"
@@ -10,103 +19,62 @@ using json = nlohmann::json;
 
 /**
  * Simple RabbitMQ Client using rabbitmq-c
- * Publishes events to message queue
+ * Publishes events to message queue. A rabbitmq-c connection is not thread-safe, so
+ * publishes from concurrent request threads are serialized.
+ *
+ * A publish waits at most publishTimeout, both for its turn on the connection and for
+ * the socket to take the frame, so a stalled broker can't hold request threads. This is
+ * independent of the request's deadline: the write an event describes has already been
+ * committed, so the event is sent even for a request its client has given up on.
+ *
+ * A publish that fails on the socket leaves the AMQP stream unusable, so the connection
+ * is dropped and a background thread reconnects, waiting RECONNECT_DELAY and doubling
+ * up to MAX_RECONNECT_DELAY between attempts. Publishes fail fast until it is back.
  */
 class RabbitMQClient {
 public:
+    static constexpr std::chrono::milliseconds RECONNECT_DELAY{500};
+    static constexpr std::chrono::milliseconds MAX_RECONNECT_DELAY{30000};
+
     /**
      * Constructor - connects to RabbitMQ
      */
-    RabbitMQClient(const std::string& host, int port, const std::string& user, const std::string& password) 
-        : connected_(false), conn_(nullptr), socket_(nullptr) {
-        
-        try {
-            // Create connection
-            conn_ = amqp_new_connection();
-            socket_ = amqp_tcp_socket_new(conn_);
-            
-            if (!socket_) {
-                std::cerr << "Failed to create TCP socket" << std::endl;
-                return;
-            }
-            
-            // Open socket
-            int status = amqp_socket_open(socket_, host.c_str(), port);
-            if (status) {
-                std::cerr << "Failed to open socket to RabbitMQ" << std::endl;
-                return;
-            }
-            
-            // Login
-            amqp_rpc_reply_t reply = amqp_login(
-                conn_, 
-                "/",           // vhost
-                0,             // channel_max
-                131072,        // frame_max
-                0,             // heartbeat
-                AMQP_SASL_METHOD_PLAIN,
-                user.c_str(),
-                password.c_str()
-            );
-            
-            if (reply.reply_type != AMQP_RESPONSE_NORMAL) {
-                std::cerr << "RabbitMQ login failed" << std::endl;
-                return;
-            }
-            
-            // Open channel
-            amqp_channel_open(conn_, 1);
-            reply = amqp_get_rpc_reply(conn_);
-            
-            if (reply.reply_type != AMQP_RESPONSE_NORMAL) {
-                std::cerr << "Failed to open channel" << std::endl;
-                return;
-            }
-            
-            // Declare exchange
-            amqp_exchange_declare(
-                conn_,
-                1,
-                amqp_cstring_bytes("chat_events"),
-                amqp_cstring_bytes("topic"),
-                0,  // passive
-                1,  // durable
-                0,  // auto_delete
-                0,  // internal
-                amqp_empty_table
-            );
-            
-            reply = amqp_get_rpc_reply(conn_);
-            if (reply.reply_type != AMQP_RESPONSE_NORMAL) {
-                std::cerr << "Failed to declare exchange" << std::endl;
-                return;
-            }
-            
-            connected_ = true;
-            std::cout << "Connected to RabbitMQ at " << host << ":" << port << std::endl;
-            
-        } catch (const std::exception& e) {
-            std::cerr << "RabbitMQ connection error: " << e.what() << std::endl;
-            connected_ = false;
+    RabbitMQClient(const std::string& host, int port, const std::string& user, const std::string& password,
+                   std::chrono::milliseconds publishTimeout = std::chrono::milliseconds(1000))
+        : connected_(false), conn_(nullptr), host_(host), port_(port), user_(user), password_(password),
+          publishTimeout_(publishTimeout) {
+        if (connect()) {
+            std::cout << "Connected to RabbitMQ at " << host_ << ":" << port_ << std::endl;
         }
+        reconnector_ = std::thread([this] { reconnectLoop(); });
     }
     
     /**
      * Destructor - cleanup
      */
     ~RabbitMQClient() {
+        {
+            std::lock_guard<std::mutex> lock(stateMutex_);
+            stopping_ = true;
+        }
+        stateCond_.notify_all();
+        reconnector_.join();
+
         if (conn_) {
             amqp_channel_close(conn_, 1, AMQP_REPLY_SUCCESS);
             amqp_connection_close(conn_, AMQP_REPLY_SUCCESS);
             amqp_destroy_connection(conn_);
         }
     }
+
+    RabbitMQClient(const RabbitMQClient&) = delete;
+    RabbitMQClient& operator=(const RabbitMQClient&) = delete;
     
     /**
      * Publish event to RabbitMQ
      */
     void publishEvent(const std::string& routingKey, const json& eventData) {
-        if (!connected_ || !conn_) {
+        if (!connected_) {
             std::cerr << "RabbitMQ not connected" << std::endl;
             return;
         }
@@ -121,19 +89,7 @@ public:
             props.content_type = amqp_cstring_bytes("application/json");
             props.delivery_mode = 2;  // persistent
             
-            // Publish message
-            int result = amqp_basic_publish(
-                conn_,
-                1,  // channel
-                amqp_cstring_bytes("chat_events"),
-                amqp_cstring_bytes(routingKey.c_str()),
-                0,  // mandatory
-                0,  // immediate
-                &props,
-                amqp_cstring_bytes(messageBody.c_str())
-            );
-            
-            if (result < 0) {
+            if (!publish(routingKey, messageBody, props)) {
                 std::cerr << "Failed to publish message" << std::endl;
                 return;
             }
@@ -145,6 +101,47 @@ public:
         }
     }
     
+    /**
+     * Publish a raw body with caller-built properties to chat_events; false on failure
+     */
+    bool publish(const std::string& routingKey, std::string_view body, const amqp_basic_properties_t& props) {
+        if (!connected_) {
+            return false;
+        }
+
+        amqp_bytes_t bytes;
+        bytes.len = body.size();
+        bytes.bytes = const_cast<char*>(body.data());
+
+        std::unique_lock<std::timed_mutex> lock(publishMutex_, publishTimeout_);
+        if (!lock.owns_lock() || !conn_) {
+            return false;
+        }
+        int result = amqp_basic_publish(
+            conn_,
+            1,  // channel
+            amqp_cstring_bytes("chat_events"),
+            amqp_cstring_bytes(routingKey.c_str()),
+            0,  // mandatory
+            0,  // immediate
+            &props,
+            bytes
+        );
+        // A send cut off mid-frame leaves the AMQP stream unusable for later publishes
+        if (result == AMQP_STATUS_SOCKET_ERROR || result == AMQP_STATUS_TIMEOUT) {
+            std::cerr << "RabbitMQ publish failed; reconnecting" << std::endl;
+            amqp_destroy_connection(conn_);
+            conn_ = nullptr;
+            lock.unlock();
+            {
+                std::lock_guard<std::mutex> state(stateMutex_);
+                connected_ = false;
+            }
+            stateCond_.notify_all();
+        }
+        return result >= 0;
+    }
+
     /**
      * Check if connected
      */
@@ -153,7 +150,139 @@ public:
     }
 
 private:
-    bool connected_;
-    amqp_connection_state_t conn_;
-    amqp_socket_t* socket_;
-};
\ No newline at end of file
+    std::atomic<bool> connected_;
+    amqp_connection_state_t conn_;  // guarded by publishMutex_ once the reconnect thread runs
+    const std::string host_;
+    const int port_;
+    const std::string user_;
+    const std::string password_;
+    std::chrono::milliseconds publishTimeout_;
+    std::timed_mutex publishMutex_;
+
+    // Reconnect thread; stateMutex_ guards stopping_ and changes of connected_ to false
+    std::thread reconnector_;
+    std::mutex stateMutex_;
+    std::condition_variable stateCond_;
+    bool stopping_{false};
+
+    /**
+     * Open a connection and channel and declare the exchange; on success it becomes conn_
+     */
+    bool connect() {
+        amqp_connection_state_t conn = amqp_new_connection();
+        if (!conn) {
+            return false;
+        }
+
+        bool ready = false;
+        try {
+            ready = open(conn);
+        } catch (const std::exception& e) {
+            std::cerr << "RabbitMQ connection error: " << e.what() << std::endl;
+        }
+        if (!ready) {
+            amqp_destroy_connection(conn);
+            return false;
+        }
+
+        {
+            std::lock_guard<std::timed_mutex> lock(publishMutex_);
+            conn_ = conn;
+            connected_ = true;
+        }
+        return true;
+    }
+
+    bool open(amqp_connection_state_t conn) {
+        amqp_socket_t* socket = amqp_tcp_socket_new(conn);
+        if (!socket) {
+            std::cerr << "Failed to create TCP socket" << std::endl;
+            return false;
+        }
+
+        // Bounded, so the reconnect thread notices the destructor
+        timeval connectTimeout{5, 0};
+        if (amqp_socket_open_noblock(socket, host_.c_str(), port_, &connectTimeout) != AMQP_STATUS_OK) {
+            std::cerr << "Failed to open socket to RabbitMQ" << std::endl;
+            return false;
+        }
+
+        // Login
+        amqp_rpc_reply_t reply = amqp_login(
+            conn,
+            "/",           // vhost
+            0,             // channel_max
+            131072,        // frame_max
+            0,             // heartbeat
+            AMQP_SASL_METHOD_PLAIN,
+            user_.c_str(),
+            password_.c_str()
+        );
+
+        if (reply.reply_type != AMQP_RESPONSE_NORMAL) {
+            std::cerr << "RabbitMQ login failed" << std::endl;
+            return false;
+        }
+
+        // Open channel
+        amqp_channel_open(conn, 1);
+        reply = amqp_get_rpc_reply(conn);
+
+        if (reply.reply_type != AMQP_RESPONSE_NORMAL) {
+            std::cerr << "Failed to open channel" << std::endl;
+            return false;
+        }
+
+        // Declare exchange
+        amqp_exchange_declare(
+            conn,
+            1,
+            amqp_cstring_bytes("chat_events"),
+            amqp_cstring_bytes("topic"),
+            0,  // passive
+            1,  // durable
+            0,  // auto_delete
+            0,  // internal
+            amqp_empty_table
+        );
+
+        reply = amqp_get_rpc_reply(conn);
+        if (reply.reply_type != AMQP_RESPONSE_NORMAL) {
+            std::cerr << "Failed to declare exchange" << std::endl;
+            return false;
+        }
+
+        // A send that can't complete within the timeout fails instead of blocking
+        timeval sendTimeout{};
+        sendTimeout.tv_sec = static_cast<time_t>(publishTimeout_.count() / 1000);
+        sendTimeout.tv_usec = static_cast<suseconds_t>((publishTimeout_.count() % 1000) * 1000);
+        setsockopt(amqp_get_sockfd(conn), SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, sizeof(sendTimeout));
+        return true;
+    }
+
+    /**
+     * Reconnect thread: wait for the connection to be lost (or never made), then retry
+     * with a doubling delay until it is back
+     */
+    void reconnectLoop() {
+        std::unique_lock<std::mutex> lock(stateMutex_);
+        std::chrono::milliseconds delay = RECONNECT_DELAY;
+        while (!stopping_) {
+            stateCond_.wait(lock, [this] { return stopping_ || !connected_; });
+            if (stateCond_.wait_for(lock, delay, [this] { return stopping_; })) {
+                break;
+            }
+
+            lock.unlock();
+            bool reconnected = connect();
+            lock.lock();
+
+            if (reconnected) {
+                std::cout << "Reconnected to RabbitMQ at " << host_ << ":" << port_ << std::endl;
+                delay = RECONNECT_DELAY;
+            } else {
+                delay = std::min(delay * 2, MAX_RECONNECT_DELAY);
+            }
+        }
+    }
+};
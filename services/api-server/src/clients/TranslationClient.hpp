@@ -2,7 +2,10 @@
 #include <string>
 #include <curl/curl.h>
 #include <../external/json.hpp>
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include "../utils/RequestContext.hpp"
 
 using json = nlohmann::json;
 
@@ -12,6 +15,8 @@ using json = nlohmann::json;
  */
 class TranslationClient {
 public:
+    static constexpr long TIMEOUT_MS = 5000;
+
     /**
      * Constructor - sets up LibreTranslate API endpoint
      */
@@ -29,8 +34,20 @@ public:
 
     /**
      * Translate text from source language to target language
+     * Gives up after 5 seconds, or sooner if the calling request's deadline comes first.
      */
     std::string translate(const std::string& text, const std::string& sourceLang, const std::string& targetLang) {
+        long timeoutMs = TIMEOUT_MS;
+        RequestContext& context = RequestContext::current();
+        if (context.hasDeadline()) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(context.remaining()).count();
+            if (left <= 0) {
+                context.markAbandoned();
+                return "";
+            }
+            timeoutMs = std::min<long>(timeoutMs, left);
+        }
+
         // Initialize curl session
         CURL* curl = curl_easy_init();
         if(!curl) {
@@ -38,13 +55,7 @@ public:
             return "";
         }
 
-        // Initialize curl session
-        json payload = {
-            {"q", text},
-            {"source", sourceLang},
-            {"target", targetLang},    
-        };
-        std::string jsonPayload = payload.dump();
+        std::string jsonPayload = requestBody(text, sourceLang, targetLang);
 
         // Response buffer
         std::string responseBuffer;
@@ -64,8 +75,9 @@ public:
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responseBuffer);
 
-        // Set timeout (5 seconds)
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 5L);
+        // Set timeout; without signals, which are process-wide and unsafe across request threads
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeoutMs);
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
 
         // Perform the request
         CURLcode res = curl_easy_perform(curl);
@@ -75,26 +87,15 @@ public:
         curl_easy_cleanup(curl);
 
         // Check for errors
+        if(res == CURLE_OPERATION_TIMEDOUT && context.expired()) {
+            context.markAbandoned();
+        }
         if(res != CURLE_OK) {
             std::cerr << "CURL request failed: " << curl_easy_strerror(res) << std::endl;
             return "";
         }
 
-        // Parse JSON response
-        try {
-            json response = json::parse(responseBuffer);
-
-            if(response.contains("translatedText")) {
-                return response["translatedText"];
-            } else {
-                std::cerr << "Translation API error: " << response["error"] << std::endl;
-                return "";
-            }
-        } catch(const json::parse_error& e) {
-            std::cerr << "Json parse error: " << e.what() << std::endl;
-            std::cerr << "Response: " << responseBuffer << std::endl;
-            return "";
-        }
+        return parseResponse(responseBuffer);
     }
 
     /**
@@ -127,6 +128,42 @@ public:
         return (res == CURLE_OK);
     }
 
+    /**
+     * Request body for POST /translate
+     */
+    static std::string requestBody(const std::string& text, const std::string& sourceLang, const std::string& targetLang) {
+        json payload = {
+            {"q", text},
+            {"source", sourceLang},
+            {"target", targetLang},    
+        };
+        return payload.dump();
+    }
+
+    /**
+     * translatedText from a /translate response; empty on an API error or a malformed body
+     */
+    static std::string parseResponse(const std::string& responseBuffer) {
+        try {
+            json response = json::parse(responseBuffer);
+
+            if(response.contains("translatedText")) {
+                return response["translatedText"];
+            } else {
+                std::cerr << "Translation API error: " << response["error"] << std::endl;
+                return "";
+            }
+        } catch(const json::parse_error& e) {
+            std::cerr << "Json parse error: " << e.what() << std::endl;
+            std::cerr << "Response: " << responseBuffer << std::endl;
+            return "";
+        }
+    }
+
+    const std::string& apiUrl() const {
+        return apiUrl_;
+    }
+
 private:
 
     /**
@@ -5,14 +5,152 @@
  */
 
 #include "Database.h"
+#include "../utils/RequestContext.hpp"
+#if defined(__linux__)
+#include "../async/AsyncPostgres.hpp"
+#include <future>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+// Idle connections plus the bookkeeping to open new ones up to capacity
+struct Database::ConnectionPool {
+    explicit ConnectionPool(size_t capacity) : capacity(std::max<size_t>(capacity, 1)) {}
+
+    const size_t capacity;
+    std::mutex mutex;
+    std::condition_variable returned;
+    std::vector<std::unique_ptr<pqxx::connection>> idle;
+    size_t open{0};              // idle + lent out
+    std::vector<int> backendPids;
+    std::unordered_map<const pqxx::connection*, int> statementTimeoutMs;  // session value last SET
+    Database::WaitObserver waitObserver;
+};
+
+namespace {
+// The connection pinned on this thread by Database::ConnectionPin, if any
+struct PinnedConnection {
+    const Database* db{nullptr};
+    pqxx::connection* conn{nullptr};
+};
+thread_local PinnedConnection pinned;
+}
+
+// Operations catch their own errors, so the lease is where a timed-out statement is noticed:
+// if it unwinds past the request's deadline, the request is marked abandoned
+class Database::Lease {
+    public:
+        Lease(const Database& db, std::unique_ptr<pqxx::connection> owned)
+            : db_(&db), owned_(std::move(owned)), conn_(owned_.get()) {}
+        explicit Lease(pqxx::connection* pinnedConn)
+            : db_(nullptr), conn_(pinnedConn) {}
+        ~Lease() {
+            if(std::uncaught_exceptions() > unwinding_ && RequestContext::current().expired()) {
+                RequestContext::current().markAbandoned();
+            }
+            if(owned_) db_->giveBack(std::move(owned_));
+        }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        pqxx::connection& operator*() const { return *conn_; }
+
+    private:
+        const Database* db_;
+        std::unique_ptr<pqxx::connection> owned_;
+        pqxx::connection* conn_;
+        int unwinding_{std::uncaught_exceptions()};
+};
+
+#if defined(__linux__)
+// Reads as coroutines on an event loop thread of their own, pipelined onto a few connections;
+// the calling thread blocks on a future for the result (but not past its request's deadline)
+struct Database::ReadEngine {
+    static constexpr std::chrono::milliseconds QUERY_TIMEOUT{30000};  // for callers without a deadline
+
+    ReadEngine(const std::string& connectionString, const ReadPipeline& options, ConnectionPool& pool)
+        : postgres(loop, AsyncPostgres::Options{
+              .connectionString = connectionString,
+              .connections = options.connections,
+              .pipelineDepth = options.depth,
+              .queryTimeout = QUERY_TIMEOUT}),
+          thread([this] { loop.run(); }) {
+        // Waiting for room in a pipeline is this engine's queue, like waiting for a pooled connection
+        postgres.setWaitObserver([&pool](std::chrono::steady_clock::duration wait) {
+            Database::WaitObserver observer;
+            {
+                std::lock_guard<std::mutex> lock(pool.mutex);
+                observer = pool.waitObserver;
+            }
+            if(observer) observer(wait);
+        });
+    }
+
+    ~ReadEngine() {
+        loop.stop();
+        thread.join();
+    }
+
+    AsyncPostgres::Result exec(const char* sql, AsyncPostgres::Params params) {
+        const RequestContext& context = RequestContext::current();
+        std::chrono::milliseconds timeout{0};  // AsyncPostgres default: QUERY_TIMEOUT
+        if(context.hasDeadline()) {
+            timeout = std::max(std::chrono::ceil<std::chrono::milliseconds>(context.remaining()),
+                               std::chrono::milliseconds(1));
+        }
+
+        auto done = std::make_shared<std::promise<AsyncPostgres::Result>>();
+        auto result = done->get_future();
+        loop.post([this, sql, params = std::move(params), timeout, done]() mutable {
+            spawn(run(postgres, sql, std::move(params), timeout, std::move(done)));
+        });
+        try {
+            if(context.hasDeadline() && result.wait_until(context.deadline()) == std::future_status::timeout) {
+                throw DeadlineExceeded();
+            }
+            return result.get();
+        } catch (const DeadlineExceeded&) {
+            RequestContext::current().markAbandoned();
+            throw;
+        }
+    }
+
+    static Task<void> run(AsyncPostgres& postgres, const char* sql, AsyncPostgres::Params params,
+                          std::chrono::milliseconds timeout, std::shared_ptr<std::promise<AsyncPostgres::Result>> done) {
+        try {
+            done->set_value(co_await postgres.query(sql, std::move(params), timeout));
+        } catch (...) {
+            done->set_exception(std::current_exception());
+        }
+    }
+
+    EventLoop loop;
+    AsyncPostgres postgres;
+    std::thread thread;
+};
+#else
+struct Database::ReadEngine {};
+#endif
 
 // Constructor - initialize database with connection string
-Database::Database(const std::string& connectionString)
-    : connectionString_(connectionString), connected_(false) {}
+Database::Database(const std::string& connectionString, size_t poolSize)
+    : Database(connectionString, poolSize, ReadPipeline{}) {}
+
+Database::Database(const std::string& connectionString, size_t poolSize, ReadPipeline readPipeline)
+    : pool_(std::make_unique<ConnectionPool>(poolSize)), connectionString_(connectionString), connected_(false),
+      readPipeline_(readPipeline) {}
 
 // Destructor - ensure proper disconnection
 Database::~Database() {
+    stopListening();
     disconnect();
 }
 
@@ -20,13 +158,22 @@ Database::~Database() {
 
 bool Database::connect() {
     try {
-        // Create PostgreSQL database connection
-        conn_ = std::make_unique<pqxx::connection>(connectionString_);
+        // Open the first pooled connection now, so a bad connection string fails at startup
+        auto conn = take();
         // Check if connection was successfully opened
-        connected_ = conn_->is_open();
+        connected_ = conn->is_open();
         if(connected_){
-            std::cout << "Connected to database : " << conn_->dbname() << std::endl;
+            std::cout << "Connected to database : " << conn->dbname()
+                      << " (pool of " << pool_->capacity << ")" << std::endl;
         }
+        giveBack(std::move(conn));
+#if defined(__linux__)
+        if(connected_ && readPipeline_.connections > 0 && !reads_) {
+            reads_ = std::make_unique<ReadEngine>(connectionString_, readPipeline_, *pool_);
+            std::cout << "Read pipeline: " << readPipeline_.connections << " connection(s), "
+                      << readPipeline_.depth << " statements deep" << std::endl;
+        }
+#endif
         return connected_;
         
     } catch (const std::exception& e) {
@@ -37,7 +184,16 @@ bool Database::connect() {
 }
 
 void Database::disconnect() {
-    conn_.reset();
+    reads_.reset();
+    if(pool_) {
+        std::lock_guard<std::mutex> lock(pool_->mutex);
+        for(const auto& conn : pool_->idle) {
+            pool_->statementTimeoutMs.erase(conn.get());
+        }
+        pool_->open -= pool_->idle.size();
+        pool_->idle.clear();
+        pool_->backendPids.clear();
+    }
     connected_ = false;
 }
 
@@ -45,21 +201,182 @@ bool Database::isConnected() const {
     return connected_;
 }
 
+// Borrow an idle connection, open a new one below capacity, or wait for one to come back
+// (but not past the request's deadline)
+std::unique_ptr<pqxx::connection> Database::take() const {
+    ConnectionPool& pool = *pool_;
+    const RequestContext& context = RequestContext::current();
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<pqxx::connection> idle;
+    {
+        std::unique_lock<std::mutex> lock(pool.mutex);
+        auto available = [&] { return !pool.idle.empty() || pool.open < pool.capacity; };
+        if(!context.hasDeadline()) {
+            pool.returned.wait(lock, available);
+        } else if(!pool.returned.wait_until(lock, context.deadline(), available)) {
+            lock.unlock();
+            RequestContext::current().markAbandoned();
+            throw DeadlineExceeded();
+        }
+        if(!pool.idle.empty()) {
+            idle = std::move(pool.idle.back());
+            pool.idle.pop_back();
+        } else {
+            ++pool.open;
+        }
+    }
+    if(pool.waitObserver) {
+        pool.waitObserver(std::chrono::steady_clock::now() - start);
+    }
+    if(idle) {
+        return idle;
+    }
+
+    // Connect outside the lock; it takes a network round trip or more
+    try {
+        auto conn = std::make_unique<pqxx::connection>(connectionString_);
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.backendPids.push_back(conn->backendpid());
+        return conn;
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        --pool.open;
+        pool.returned.notify_one();
+        throw;
+    }
+}
+
+// Return a connection to the pool; broken ones are dropped and reopened on demand
+void Database::giveBack(std::unique_ptr<pqxx::connection> conn) const {
+    ConnectionPool& pool = *pool_;
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    if(conn->is_open()) {
+        pool.idle.push_back(std::move(conn));
+    } else {
+        pool.statementTimeoutMs.erase(conn.get());
+        std::erase(pool.backendPids, conn->backendpid());
+        --pool.open;
+    }
+    pool.returned.notify_one();
+}
+
+void Database::setWaitObserver(WaitObserver observer) {
+    std::lock_guard<std::mutex> lock(pool_->mutex);
+    pool_->waitObserver = std::move(observer);
+}
+
+// Don't start work the request no longer has time for; bound each statement by what's left
+Database::Lease Database::acquire() const {
+    if(RequestContext::current().expired()) {
+        RequestContext::current().markAbandoned();
+        throw DeadlineExceeded();
+    }
+    if(pinned.db == this && pinned.conn) {
+        applyStatementTimeout(*pinned.conn);
+        return Lease(pinned.conn);
+    }
+    auto conn = take();
+    try {
+        applyStatementTimeout(*conn);
+    } catch (...) {
+        giveBack(std::move(conn));
+        throw;
+    }
+    return Lease(*this, std::move(conn));
+}
+
+// statement_timeout is set on the session, not per transaction, and only when it changes:
+// the time left is rounded down to 4 significant bits (at most 12.5% early), so requests
+// with similar budgets reuse the value already set instead of paying a round trip for it
+void Database::applyStatementTimeout(pqxx::connection& conn) const {
+    const RequestContext& context = RequestContext::current();
+    int wanted = 0;  // no deadline: Postgres default (none)
+    if(context.hasDeadline()) {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(context.remaining()).count();
+        auto left = static_cast<uint32_t>(std::clamp<int64_t>(ms, 1, INT32_MAX));
+        int shift = std::max(static_cast<int>(std::bit_width(left)) - 4, 0);
+        wanted = static_cast<int>((left >> shift) << shift);
+    }
+
+    ConnectionPool& pool = *pool_;
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        auto it = pool.statementTimeoutMs.find(&conn);
+        if(it == pool.statementTimeoutMs.end() ? wanted == 0 : it->second == wanted) {
+            return;
+        }
+    }
+    conn.set_session_var("statement_timeout", wanted);
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.statementTimeoutMs[&conn] = wanted;
+}
+
+Database::ConnectionPin::ConnectionPin(const Database& db)
+    : db_(&db) {
+    if(pinned.db) {
+        return;
+    }
+    try {
+        conn_ = db.take();
+        pinned = PinnedConnection{&db, conn_.get()};
+    } catch (const std::exception& e) {
+        // Operations fall back to borrowing per call (and report the failure themselves)
+        std::cerr << "Pin connection error: " << e.what() << std::endl;
+    }
+}
+
+Database::ConnectionPin::~ConnectionPin() {
+    if(conn_) {
+        pinned = PinnedConnection{};
+        db_->giveBack(std::move(conn_));
+    }
+}
+
+Database::ConnectionPin Database::pinConnection() const {
+    return ConnectionPin(*this);
+}
+
+// Reads go through the pipeline unless this thread has pinned a connection for a run of
+// operations; a pooled connection runs them in a transaction of their own otherwise
+template <typename OnRow, typename... Args>
+void Database::read(const char* sql, OnRow&& onRow, const Args&... args) const {
+#if defined(__linux__)
+    if(reads_ && pinned.db != this) {
+        if(RequestContext::current().expired()) {
+            RequestContext::current().markAbandoned();
+            throw DeadlineExceeded();
+        }
+        AsyncPostgres::Result r = reads_->exec(sql, AsyncPostgres::Params{pqxx::to_string(args)...});
+        for(int i = 0; i < r.rows(); ++i) {
+            onRow(r[i]);
+        }
+        return;
+    }
+#endif
+    auto conn = acquire();
+    pqxx::work txn(*conn);
+    pqxx::result r = txn.exec(sql, pqxx::params(args...));
+    for(const auto& row : r) {
+        onRow(row);
+    }
+}
+
 // ========== USER OPERATIONS ===========
 
 // Helper function to convert database row to User struct
-User Database::rowToUser(const pqxx::row& row) const {
+template <typename Row>
+User Database::rowToUser(const Row& row) const {
     return User{
         // Convert PostgreSQL row values to C++ types
-        row["id"].as<int>(),
-        row["username"].as<std::string>(),
-        row["email"].as<std::string>(),
-        row["password_hash"].as<std::string>(),
-        row["created_at"].as<std::string>(),
+        row["id"].template as<int>(),
+        row["username"].template as<std::string>(),
+        row["email"].template as<std::string>(),
+        row["password_hash"].template as<std::string>(),
+        row["created_at"].template as<std::string>(),
         // Handle NULL values - convert to empty string
-        row["updated_at"].is_null() ? "" : row["updated_at"].as<std::string>(),
-        row["last_login"].is_null() ? "" : row["last_login"].as<std::string>(),
-        row["is_active"].as<bool>()
+        row["updated_at"].is_null() ? "" : row["updated_at"].template as<std::string>(),
+        row["last_login"].is_null() ? "" : row["last_login"].template as<std::string>(),
+        row["is_active"].template as<bool>()
     };
 }
 
@@ -67,7 +384,8 @@ std::optional<User> Database::createUser(const User& user) {
     if(!connected_) return std::nullopt;
     try {
         // Begin transaction for data write
-        pqxx::work txn(*conn_);
+        auto conn = acquire();
+        pqxx::work txn(*conn);
         // Execute parameterized query 
         pqxx::result r = txn.exec(
             "INSERT INTO users (username, email, password_hash, is_active) "
@@ -92,7 +410,8 @@ bool Database::updateUser(const User& user) {
     if(!connected_) return false;
     try {
         // update transaction
-        pqxx::work txn(*conn_);
+        auto conn = acquire();
+        pqxx::work txn(*conn);
         // Handle NULL for last_login if string is empty
         if (user.last_login.empty()) {
             txn.exec(
@@ -121,7 +440,8 @@ bool Database::updateUser(const User& user) {
 bool Database::updateLastLogin(int id) {
     if(!connected_) return false;
     try {
-        pqxx::work txn(*conn_);
+        auto conn = acquire();
+        pqxx::work txn(*conn);
         // Execute UPDATE with parameter - CURRENT_TIMESTAMP function on PostgreSQL side
         txn.exec(
             "UPDATE users SET last_login=CURRENT_TIMESTAMP WHERE id=$1",
@@ -138,7 +458,8 @@ bool Database::updateLastLogin(int id) {
 bool Database::deleteUser(int id) {
     if(!connected_) return false;
     try {
-        pqxx::work txn(*conn_);
+        auto conn = acquire();
+        pqxx::work txn(*conn);
         // DELETE with parameter 
         txn.exec("DELETE FROM users WHERE id=$1", pqxx::params(id));
         txn.commit();
@@ -150,66 +471,59 @@ bool Database::deleteUser(int id) {
 }
 
 std::optional<User> Database::getUserByUsername(const std::string& username) const {
-    if(!connected_) return std::nullopt;
+    if(!connected_) throw std::runtime_error("Database not connected");
     try {
-        // Read-only transaction
-        pqxx::work txn(*conn_);
-        // Execute SELECT with parameter
-        pqxx::result r = txn.exec("SELECT * FROM users WHERE username=$1", pqxx::params(username));
-        // Check if result contains any rows
-        if(!r.empty()) {
-            return rowToUser(r[0]);
-        }
-        return std::nullopt;
+        std::optional<User> user;
+        // Execute SELECT with parameter; at most one row matches
+        read("SELECT * FROM users WHERE username=$1", [&](const auto& row) { user = rowToUser(row); }, username);
+        return user;
+    } catch (const DeadlineExceeded&) {
+        throw;
     } catch (const std::exception& e) {
         std::cerr << "Get user by username error: " << e.what() << std::endl;
-        return std::nullopt;
+        throw;
     }
 }
 
 std::optional<User> Database::getUserById(int id) const {
-    if(!connected_) return std::nullopt;
+    if(!connected_) throw std::runtime_error("Database not connected");
     try {
-        pqxx::work txn(*conn_);
-        pqxx::result r = txn.exec("SELECT * FROM users WHERE id=$1", pqxx::params(id));
-        if(!r.empty()) {
-            return rowToUser(r[0]);
-        }
-        return std::nullopt;
+        std::optional<User> user;
+        read("SELECT * FROM users WHERE id=$1", [&](const auto& row) { user = rowToUser(row); }, id);
+        return user;
+    } catch (const DeadlineExceeded&) {
+        throw;
     } catch (const std::exception& e) {
         std::cerr << "Get user by ID error: " << e.what() << std::endl;
-        return std::nullopt;
+        throw;
     }
 }
 
 std::optional<User> Database::getUserByEmail(const std::string& email) const {
-    if(!connected_) return std::nullopt;
+    if(!connected_) throw std::runtime_error("Database not connected");
     try {
-        pqxx::work txn(*conn_);
-        pqxx::result r = txn.exec("SELECT * FROM users WHERE email=$1", pqxx::params(email));
-        if(!r.empty()) {
-            return rowToUser(r[0]);
-        }
-        return std::nullopt;
+        std::optional<User> user;
+        read("SELECT * FROM users WHERE email=$1", [&](const auto& row) { user = rowToUser(row); }, email);
+        return user;
+    } catch (const DeadlineExceeded&) {
+        throw;
     } catch (const std::exception& e) {
         std::cerr << "Get user by email error: " << e.what() << std::endl;
-        return std::nullopt;
+        throw;
     }
 }
 
 std::vector<User> Database::getAllUsers() const {
     std::vector<User> users;
-    if(!connected_) return users;
+    if(!connected_) throw std::runtime_error("Database not connected");
     try {
-        pqxx::work txn(*conn_);
         // SELECT without parameters - fetch all records
-        pqxx::result r = txn.exec("SELECT * FROM users");
-        // Iterate through result - pqxx::result works like a container
-        for(const auto& row : r) {
-            users.emplace_back(rowToUser(row));
-        }
+        read("SELECT * FROM users", [&](const auto& row) { users.emplace_back(rowToUser(row)); });
+    } catch (const DeadlineExceeded&) {
+        throw;
     } catch (const std::exception& e) {
         std::cerr << "Get all users error: " << e.what() << std::endl;
+        throw;
     }
     return users;
 }
@@ -217,16 +531,18 @@ std::vector<User> Database::getAllUsers() const {
 // ========== ROOM OPERATIONS ===========
 
 // Helper function to convert database row to Room struct
-Room Database::rowToRoom(const pqxx::row& row) const {
+template <typename Row>
+Room Database::rowToRoom(const Row& row) const {
     // Convert PostgreSQL row to Room struct
     // Handle NULL values for description and created_by fields
     return Room{
-        row["id"].as<int>(),
-        row["name"].as<std::string>(),
-        row["description"].is_null() ? "" : row["description"].as<std::string>(),
-        row["created_by"].is_null() ? 0 : row["created_by"].as<int>(),
-        row["created_at"].as<std::string>(),
-        row["is_private"].as<bool>()
+        row["id"].template as<int>(),
+        row["name"].template as<std::string>(),
+        row["description"].is_null() ? "" : row["description"].template as<std::string>(),
+        row["created_by"].is_null() ? 0 : row["created_by"].template as<int>(),
+        row["created_at"].template as<std::string>(),
+        row["is_private"].template as<bool>(),
+        row["change_seq"].template as<int64_t>()
     };
 }
 
@@ -234,7 +550,8 @@ std::optional<Room> Database::createRoom(const std::string& name, const std::str
     if(!connected_) return std::nullopt;
     try {
         // Begin transaction for room creation
-        pqxx::work txn(*conn_);
+        auto conn = acquire();
+        pqxx::work txn(*conn);
         // Execute parameterized INSERT query with RETURNING clause
         pqxx::result r = txn.exec(
             "INSERT INTO rooms (name, description, created_by, is_private) "
@@ -259,7 +576,8 @@ bool Database::updateRoom(int id, const std::string& name, const std::string& de
     if(!connected_) return false;
     try {
         // Room update transaction
-        pqxx::work txn(*conn_);
+        auto conn = acquire();
+        pqxx::work txn(*conn);
         // Execute UPDATE with parameters
         txn.exec(
             "UPDATE rooms SET name=$1, description=$2 WHERE id=$3",
@@ -277,7 +595,8 @@ bool Database::updateRoom(int id, const std::string& name, const std::string& de
 bool Database::deleteRoom(int id){
     if(!connected_) return false;
     try {
-        pqxx::work txn(*conn_);
+        auto conn = acquire();
+        pqxx::work txn(*conn);
         // DELETE room with parameterized query
         txn.exec("DELETE FROM rooms WHERE id=$1", pqxx::params(id));
         txn.commit();
@@ -289,77 +608,69 @@ bool Database::deleteRoom(int id){
 }
 
 std::optional<Room> Database::getRoomByName(const std::string& name) const{
-    if(!connected_) return std::nullopt;
+    if(!connected_) throw std::runtime_error("Database not connected");
     try {
-        // Read-only transaction
-        pqxx::work txn(*conn_);
+        std::optional<Room> room;
         // Execute SELECT with room name parameter
-        pqxx::result r = txn.exec("SELECT * FROM rooms WHERE name=$1", pqxx::params(name));
-        if(!r.empty()) {
-            return rowToRoom(r[0]);
-        }
-        return std::nullopt;
+        read("SELECT * FROM rooms WHERE name=$1", [&](const auto& row) { room = rowToRoom(row); }, name);
+        return room;
+    } catch (const DeadlineExceeded&) {
+        throw;
     } catch (const std::exception& e) {
         std::cerr << "Get room by name error: " << e.what() << std::endl;
-        return std::nullopt;
+        throw;
     }
 }
 
 std::optional<Room> Database::getRoomById(int id) const{
-    if(!connected_) return std::nullopt;
+    if(!connected_) throw std::runtime_error("Database not connected");
     try {
-        // Read-only transaction
-        pqxx::work txn(*conn_);
+        std::optional<Room> room;
         // Execute SELECT with room id parameter
-        pqxx::result r = txn.exec("SELECT * FROM rooms WHERE id=$1", pqxx::params(id));
-        if(!r.empty()) {
-            return rowToRoom(r[0]);
-        }
-        return std::nullopt;
+        read("SELECT * FROM rooms WHERE id=$1", [&](const auto& row) { room = rowToRoom(row); }, id);
+        return room;
+    } catch (const DeadlineExceeded&) {
+        throw;
     } catch (const std::exception& e) {
         std::cerr << "Get room by id error: " << e.what() << std::endl;
-        return std::nullopt;
+        throw;
     }
 }
 
 std::vector<Room> Database::getAllRooms() const{
     std::vector<Room> rooms;
-    if(!connected_) return rooms;
+    if(!connected_) throw std::runtime_error("Database not connected");
     try {
-        pqxx::work txn(*conn_);
         // Fetch all rooms ordered by creation date (newest first)
-        pqxx::result r = txn.exec("SELECT * FROM rooms ORDER BY created_at DESC");
-        // Iterate through result set and convert each row
-        for(const auto& row : r){
-            rooms.emplace_back(rowToRoom(row));
-        }
+        read("SELECT * FROM rooms ORDER BY created_at DESC", [&](const auto& row) { rooms.emplace_back(rowToRoom(row)); });
+    } catch (const DeadlineExceeded&) {
+        throw;
     } catch (const std::exception& e) {
         std::cerr << "Get all rooms error: " << e.what() << std::endl;
+        throw;
     }
     return rooms;
 }
 
 std::vector<Room> Database::getRoomsByUser(int user_id) const{
     std::vector<Room> rooms;
-    if(!connected_) return rooms;
+    if(!connected_) throw std::runtime_error("Database not connected");
     try {
-        // Read-only transaction
-        pqxx::work txn(*conn_);
         // Fetch all rooms where user is a member
         // JOIN with room_members to find user's rooms, ordered by newest first
-        pqxx::result r = txn.exec(
+        read(
             "SELECT r.* FROM rooms r "
             "JOIN room_members rm ON r.id = rm.room_id "
             "WHERE rm.user_id = $1 "
             "ORDER BY r.created_at DESC",
-            pqxx::params(user_id)
+            [&](const auto& row) { rooms.emplace_back(rowToRoom(row)); },
+            user_id
         );
-        // Convert each room row to Room object
-        for(const auto& row : r){
-            rooms.emplace_back(rowToRoom(row));
-        }
+    } catch (const DeadlineExceeded&) {
+        throw;
     } catch (const std::exception& e) {
         std::cerr << "Get rooms by user error: " << e.what() << std::endl;
+        throw;
     }
     return rooms;
 }
@@ -370,7 +681,8 @@ bool Database::addUserToRoom(int user_id, int room_id, const std::string& role){
     if(!connected_) return false;
     try {
         // Begin transaction for adding user to room
-        pqxx::work txn(*conn_);
+        auto conn = acquire();
+        pqxx::work txn(*conn);
 
         // Execute INSERT with ON CONFLICT to prevent duplicates
         txn.exec(
@@ -392,7 +704,8 @@ bool Database::removeUserFromRoom(int user_id, int room_id){
     if(!connected_) return false;
     try {
         // Begin transaction for removing user from room
-        pqxx::work txn(*conn_);
+        auto conn = acquire();
+        pqxx::work txn(*conn);
         // Execute DELETE with user and room parameters
         txn.exec(
             "DELETE FROM room_members WHERE user_id = $1 AND room_id = $2",
@@ -408,80 +721,96 @@ bool Database::removeUserFromRoom(int user_id, int room_id){
 
 std::vector<User> Database::getRoomMembers(int room_id) const{
     std::vector<User> members;
-    if(!connected_) return members;
+    if(!connected_) throw std::runtime_error("Database not connected");
     try {
-        // Read-only transaction
-        pqxx::work txn(*conn_);
         // Fetch all users belonging to the specified room
         // JOIN with room_members table and order by join date
-        pqxx::result r = txn.exec(
+        read(
             "SELECT u.* FROM users u "
             "JOIN room_members rm ON u.id = rm.user_id "
             "WHERE rm.room_id = $1 "
             "ORDER BY rm.joined_at",
-            pqxx::params(room_id)
+            [&](const auto& row) { members.emplace_back(rowToUser(row)); },
+            room_id
         );
-        // Convert each row to User object
-        for(const auto& row : r){
-            members.emplace_back(rowToUser(row));
-        }
-        return members;
+    } catch (const DeadlineExceeded&) {
+        throw;
     } catch (const std::exception& e) {
         std::cerr << "Get room members error: " << e.what() << std::endl;
+        throw;
     }
     return members;
 }
 
 bool Database::isUserInRoom(int user_id, int room_id) const{
-    if(!connected_) return false;
+    if(!connected_) throw std::runtime_error("Database not connected");
     try {
-        // Read-only transaction
-        pqxx::work txn(*conn_);
+        bool member = false;
         // Check if membership record exists
-        pqxx::result r = txn.exec(
+        read(
             "SELECT 1 FROM room_members WHERE user_id = $1 AND room_id = $2",
-            pqxx::params(user_id, room_id)
+            [&](const auto&) { member = true; },
+            user_id, room_id
         );
-        return !r.empty();
+        return member;
+    } catch (const DeadlineExceeded&) {
+        throw;
     } catch (const std::exception& e) {
         std::cerr << "Is user in room error: " << e.what() << std::endl;
-        return false;
+        throw;
     }
 }
 
 // ========== MESSAGE OPERATIONS ===========
 
 // Helper function to convert database row to Message struct
-Message Database::rowToMessage(const pqxx::row& row) const {
+template <typename Row>
+Message Database::rowToMessage(const Row& row) const {
     return Message{
-        row["id"].as<int>(),
-        row["room_id"].as<int>(),
-        row["user_id"].as<int>(),
-        row["content"].as<std::string>(),
-        row["message_type"].as<std::string>(),
-        row["created_at"].as<std::string>(),
+        row["id"].template as<int>(),
+        row["room_id"].template as<int>(),
+        row["user_id"].template as<int>(),
+        row["content"].template as<std::string>(),
+        row["message_type"].template as<std::string>(),
+        row["created_at"].template as<std::string>(),
         // Handle NULL edited_at
-        row["edited_at"].is_null() ? "" : row["edited_at"].as<std::string>(),
-        row["is_deleted"].as<bool>()
+        row["edited_at"].is_null() ? "" : row["edited_at"].template as<std::string>(),
+        row["is_deleted"].template as<bool>(),
+        row["change_seq"].template as<int64_t>()
     };
 }
 
-std::optional<Message> Database::createMessage(int room_id, int user_id, const std::string& content, const std::string& message_type){
+std::optional<Message> Database::createMessage(int room_id, int user_id, const std::string& content, const std::string& message_type,
+                                               const std::string& idempotency_key, bool* existed){
+    if(existed) *existed = false;
     if(!connected_) return std::nullopt;
     try {
         // Begin transaction for message creation
-        pqxx::work txn(*conn_);
+        auto conn = acquire();
+        pqxx::work txn(*conn);
         // Execute parameterized INSERT query with RETURNING clause
+        // A sender repeating an idempotency key inserts nothing (NULL keys never conflict)
+        std::optional<std::string> key;
+        if(!idempotency_key.empty()) key = idempotency_key;
         pqxx::result r = txn.exec(
-            "INSERT INTO messages (room_id, user_id, content, message_type) "
-            "VALUES ($1, $2, $3, $4) RETURNING *",
-            pqxx::params(room_id, user_id, content, message_type)
+            "INSERT INTO messages (room_id, user_id, content, message_type, idempotency_key) "
+            "VALUES ($1, $2, $3, $4, $5) "
+            "ON CONFLICT (user_id, idempotency_key) DO NOTHING RETURNING *",
+            pqxx::params(room_id, user_id, content, message_type, key)
         );
+
+        bool found = false;
+        if(r.empty() && key) {
+            // Retry of a send that already committed - hand back the original row
+            r = txn.exec("SELECT * FROM messages WHERE user_id=$1 AND idempotency_key=$2", pqxx::params(user_id, *key));
+            found = !r.empty();
+        }
         // Commit transaction
         txn.commit();
 
         if(!r.empty()) {
-            std::cout << "Message created in room " << room_id << " by user " << user_id << std::endl;
+            if(existed) *existed = found;
+            if(!found) std::cout << "Message created in room " << room_id << " by user " << user_id << std::endl;
             return rowToMessage(r[0]);
         }
         return std::nullopt;
@@ -491,83 +820,256 @@ std::optional<Message> Database::createMessage(int room_id, int user_id, const s
     }
 }
 
-bool Database::updateMessage(int id, const std::string& content){
-    if(!connected_) return false;
+std::optional<Message> Database::updateMessage(int id, const std::string& content){
+    if(!connected_) return std::nullopt;
     try {
         // Message update transaction
-        pqxx::work txn(*conn_);
-        // Execute UPDATE with parameters
-        txn.exec(
-            "UPDATE messages SET content=$1, edited_at=CURRENT_TIMESTAMP WHERE id=$2",
+        auto conn = acquire();
+        pqxx::work txn(*conn);
+        // Execute UPDATE with parameters; RETURNING picks up the change_seq the trigger stamped
+        pqxx::result r = txn.exec(
+            "UPDATE messages SET content=$1, edited_at=CURRENT_TIMESTAMP WHERE id=$2 RETURNING *",
             pqxx::params(content, id)
         );
         txn.commit();
+        if(r.empty()) {
+            return std::nullopt;
+        }
         std::cout << "Message updated: " << id << std::endl;
-        return true;
+        return rowToMessage(r[0]);
     } catch (const std::exception& e) {
         std::cerr << "Update message error: " << e.what() << std::endl;
-        return false;
+        return std::nullopt;
     }
 }
 
-bool Database::deleteMessage(int id){
-    if(!connected_) return false;
+std::optional<Message> Database::deleteMessage(int id){
+    if(!connected_) return std::nullopt;
     try {
-        // Soft delete - mark message as deleted instead of removing from database
-        pqxx::work txn(*conn_);
-        txn.exec(
-            "UPDATE messages SET is_deleted=true WHERE id=$1",
+        // Soft delete - mark message as deleted instead of removing from database,
+        // so delta sync can still report it
+        auto conn = acquire();
+        pqxx::work txn(*conn);
+        pqxx::result r = txn.exec(
+            "UPDATE messages SET is_deleted=true WHERE id=$1 RETURNING *",
             pqxx::params(id)
         );
         txn.commit();
-        return true;
+        if(r.empty()) {
+            return std::nullopt;
+        }
+        return rowToMessage(r[0]);
     } catch (const std::exception& e) {
         std::cerr << "Delete message error: " << e.what() << std::endl;
-        return false;
+        return std::nullopt;
     }
 }
 
 std::optional<Message> Database::getMessageById(int id) const{
-    if(!connected_) return std::nullopt;
+    if(!connected_) throw std::runtime_error("Database not connected");
     try {
-        // Read-only transaction
-        pqxx::work txn(*conn_);
+        std::optional<Message> message;
         // Fetch message by ID (includes deleted messages)
-        pqxx::result r = txn.exec(
+        read(
             "SELECT * FROM messages WHERE id=$1",
-            pqxx::params(id)
+            [&](const auto& row) { message = rowToMessage(row); },
+            id
         );
-        if(!r.empty()) {
-            return rowToMessage(r[0]);
-        }
-        return std::nullopt;
+        return message;
+    } catch (const DeadlineExceeded&) {
+        throw;
     } catch (const std::exception& e) {
         std::cerr << "Get message by ID error: " << e.what() << std::endl;
-        return std::nullopt;
+        throw;
     }
 }
 
 std::vector<Message> Database::getMessagesByRoom(int room_id, int limit, int offset) const{
     std::vector<Message> messages;
-    if(!connected_) return messages;
+    if(!connected_) throw std::runtime_error("Database not connected");
     try {
-        // Read-only transaction
-        pqxx::work txn(*conn_);
         // Fetch messages for the specified room with pagination
         // Excludes soft-deleted messages, ordered by newest first
-        pqxx::result r = txn.exec(
+        read(
             "SELECT * FROM messages "
             "WHERE room_id=$1 AND is_deleted=false "
             "ORDER BY created_at DESC "
             "LIMIT $2 OFFSET $3",
-            pqxx::params(room_id, limit, offset)
+            [&](const auto& row) { messages.emplace_back(rowToMessage(row)); },
+            room_id, limit, offset
         );
-        // Convert each row to Message object
-        for(const auto& row : r){
-            messages.emplace_back(rowToMessage(row));
-        }
+    } catch (const DeadlineExceeded&) {
+        throw;
     } catch (const std::exception& e) {
         std::cerr << "Get messages by room error: " << e.what() << std::endl;
+        throw;
     }
     return messages;
 }
+
+std::vector<Message> Database::getMessagesAfter(int room_id, int after_id, int limit) const{
+    std::vector<Message> messages;
+    if(!connected_) throw std::runtime_error("Database not connected");
+    try {
+        // Messages newer than after_id, oldest first, so a client can resume from the last id it saw
+        read(
+            "SELECT * FROM messages "
+            "WHERE room_id=$1 AND id>$2 AND is_deleted=false "
+            "ORDER BY id ASC "
+            "LIMIT $3",
+            [&](const auto& row) { messages.emplace_back(rowToMessage(row)); },
+            room_id, after_id, limit
+        );
+    } catch (const DeadlineExceeded&) {
+        throw;
+    } catch (const std::exception& e) {
+        std::cerr << "Get messages after id error: " << e.what() << std::endl;
+        throw;
+    }
+    return messages;
+}
+
+std::optional<RoomChanges> Database::getRoomChanges(int room_id, int64_t since, int limit) const{
+    if(!connected_) throw std::runtime_error("Database not connected");
+    try {
+        // The room's counter and the changes must come from the same snapshot, or a change
+        // committed between the two reads could be skipped by the returned resume point
+        auto conn = acquire();
+        pqxx::transaction<pqxx::isolation_level::repeatable_read, pqxx::write_policy::read_only> txn(*conn);
+        pqxx::result room = txn.exec("SELECT change_seq FROM rooms WHERE id=$1", pqxx::params(room_id));
+        if(room.empty()) {
+            return std::nullopt;
+        }
+
+        // One extra row tells us whether the client has to ask again
+        pqxx::result r = txn.exec(
+            "SELECT * FROM messages "
+            "WHERE room_id=$1 AND change_seq>$2 "
+            "ORDER BY change_seq ASC "
+            "LIMIT $3",
+            pqxx::params(room_id, since, limit + 1)
+        );
+
+        RoomChanges changes;
+        for(const auto& row : r){
+            if(static_cast<int>(changes.messages.size()) == limit) {
+                changes.has_more = true;
+                break;
+            }
+            changes.messages.emplace_back(rowToMessage(row));
+        }
+        changes.change_seq = changes.has_more ? changes.messages.back().change_seq
+                                              : room[0]["change_seq"].as<int64_t>();
+
+        txn.commit();
+        return changes;
+    } catch (const DeadlineExceeded&) {
+        throw;
+    } catch (const std::exception& e) {
+        std::cerr << "Get room changes error: " << e.what() << std::endl;
+        throw;
+    }
+}
+
+std::optional<RoomSnapshot> Database::getRoomSnapshot(int room_id, int message_limit) const{
+    if(!connected_) throw std::runtime_error("Database not connected");
+    try {
+        // Repeatable read: all three queries see the same snapshot, so the member list
+        // and messages can't straddle a write that lands between them
+        auto conn = acquire();
+        pqxx::transaction<pqxx::isolation_level::repeatable_read, pqxx::write_policy::read_only> txn(*conn);
+        pqxx::result room = txn.exec("SELECT * FROM rooms WHERE id=$1", pqxx::params(room_id));
+        if(room.empty()) {
+            return std::nullopt;
+        }
+
+        RoomSnapshot snapshot;
+        snapshot.room = rowToRoom(room[0]);
+
+        pqxx::result members = txn.exec(
+            "SELECT u.* FROM users u "
+            "JOIN room_members rm ON u.id = rm.user_id "
+            "WHERE rm.room_id = $1 "
+            "ORDER BY rm.joined_at",
+            pqxx::params(room_id)
+        );
+        for(const auto& row : members){
+            snapshot.members.emplace_back(rowToUser(row));
+        }
+
+        // Same order as getMessagesByRoom, so a snapshot matches the first message page
+        pqxx::result messages = txn.exec(
+            "SELECT * FROM messages "
+            "WHERE room_id=$1 AND is_deleted=false "
+            "ORDER BY created_at DESC "
+            "LIMIT $2",
+            pqxx::params(room_id, message_limit)
+        );
+        for(const auto& row : messages){
+            snapshot.messages.emplace_back(rowToMessage(row));
+        }
+
+        txn.commit();
+        return snapshot;
+    } catch (const DeadlineExceeded&) {
+        throw;
+    } catch (const std::exception& e) {
+        std::cerr << "Get room snapshot error: " << e.what() << std::endl;
+        throw;
+    }
+}
+
+// ========== CHANGE NOTIFICATIONS ===========
+
+struct Database::NotificationListener {
+    std::thread thread;
+    std::atomic<bool> stopping{false};
+};
+
+bool Database::startListening(const std::string& channel, NotificationHandler handler) {
+    if (listener_) {
+        return false;
+    }
+    listener_ = std::make_unique<NotificationListener>();
+    NotificationListener* listener = listener_.get();
+
+    listener->thread = std::thread([this, listener, channel, handler = std::move(handler)] {
+        while (!listener->stopping.load()) {
+            try {
+                // Its own connection: LISTEN state is per session, and waiting must not block queries
+                pqxx::connection conn(connectionString_);
+                conn.listen(channel, [&handler](pqxx::notification notification) {
+                    handler(std::string_view(notification.payload), notification.backend_pid);
+                });
+                std::cout << "Listening for " << channel << " notifications" << std::endl;
+
+                while (!listener->stopping.load()) {
+                    // Wake up regularly to notice stopListening()
+                    conn.await_notification(0, 250000);
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Notification listener error: " << e.what() << std::endl;
+                for (int i = 0; i < 20 && !listener->stopping.load(); ++i) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
+            }
+        }
+    });
+    return true;
+}
+
+void Database::stopListening() {
+    if (!listener_) {
+        return;
+    }
+    listener_->stopping.store(true);
+    if (listener_->thread.joinable()) {
+        listener_->thread.join();
+    }
+    listener_.reset();
+}
+
+bool Database::isOwnBackend(int backend_pid) const {
+    std::lock_guard<std::mutex> lock(pool_->mutex);
+    return std::find(pool_->backendPids.begin(), pool_->backendPids.end(), backend_pid) != pool_->backendPids.end();
+}
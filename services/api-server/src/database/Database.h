@@ -1,8 +1,12 @@
 #pragma once 
 
 #include <pqxx/pqxx>
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
 
@@ -33,6 +37,7 @@ struct Room{
     int created_by{0};
     std::string created_at;
     bool is_private;
+    int64_t change_seq{0};  // sequence of the room's latest message change
 };
 
 // Message data structure - represents a message in a chat room
@@ -45,20 +50,54 @@ struct Message{
     std::string created_at;
     std::string edited_at;
     bool is_deleted;
+    int64_t change_seq{0};  // room change sequence of the insert, edit or delete that wrote this version
+};
+
+// Message changes in a room after some change sequence
+struct RoomChanges{
+    int64_t change_seq{0};          // resume point: the last change included
+    std::vector<Message> messages;  // oldest change first; deleted messages included
+    bool has_more{false};           // limit reached, ask again from change_seq
+};
+
+// A room with its members and latest messages, read from one consistent snapshot
+struct RoomSnapshot{
+    Room room;
+    std::vector<User> members;
+    std::vector<Message> messages;  // newest first
 };
 
 /**
  * Database class - Main database access layer
- * Manages PostgreSQL connection and provides methods for:
+ * Manages a pool of PostgreSQL connections and provides methods for:
  * - User management (CRUD, authentication helpers)
  * - Room management (CRUD, queries)
  * - Room membership operations
  * - Message operations (CRUD, queries with pagination)
+ * - Change notifications (LISTEN on a dedicated connection)
  * All methods use parameterized queries to prevent SQL injection
+ *
+ * Each call borrows a connection from the pool for the duration of its transaction,
+ * so concurrent requests never share one. The pool opens connections on demand up to
+ * poolSize and callers beyond that wait for one to be returned.
+ *
+ * Single-statement reads can instead go through a read pipeline (Linux): a thread that
+ * multiplexes them, from all callers, onto a few connections in libpq pipeline mode, so
+ * they share round trips instead of holding a pooled connection each. Callers still
+ * block until their rows arrive. Transactions and writes always use the pool.
+ *
+ * Query methods throw when the database can't answer (DeadlineExceeded once the calling
+ * request's deadline has passed), so an empty result or nullopt always means "none".
  */
 class Database {
     public: 
-        explicit Database(const std::string& connectionString);
+        struct ReadPipeline {
+            size_t connections{0};  // 0: reads use the pool too
+            size_t depth{32};       // statements in flight per connection
+        };
+
+        explicit Database(const std::string& connectionString, size_t poolSize = 1);
+        Database(const std::string& connectionString, size_t poolSize, ReadPipeline readPipeline);
         ~Database();
 
         // Prevent copying
@@ -73,6 +112,35 @@ class Database {
         bool connect();
         void disconnect();
         bool isConnected() const;
+        const std::string& connectionString() const { return connectionString_; }
+
+        /**
+         * Keeps one pooled connection on the calling thread while it lives, so a run of
+         * operations (e.g. a batch request) doesn't return to the pool between queries.
+         * Nested pins on the same thread share the outer one.
+         */
+        class ConnectionPin {
+            public:
+                ~ConnectionPin();
+                ConnectionPin(const ConnectionPin&) = delete;
+                ConnectionPin& operator=(const ConnectionPin&) = delete;
+
+            private:
+                friend class Database;
+                explicit ConnectionPin(const Database& db);
+
+                const Database* db_;
+                std::unique_ptr<pqxx::connection> conn_;  // null for a nested or failed pin
+        };
+
+        ConnectionPin pinConnection() const;
+
+        /**
+         * Called with how long each borrow waited for a pooled connection (zero when one
+         * was idle). Set before serving requests; the callback runs on the borrowing thread.
+         */
+        using WaitObserver = std::function<void(std::chrono::steady_clock::duration)>;
+        void setWaitObserver(WaitObserver observer);
 
         // ========== USER OPERATIONS ===========
 
@@ -113,21 +181,62 @@ class Database {
         // ========== MESSAGE OPERATIONS ===========
 
         // CRUD operations
-        std::optional<Message> createMessage(int room_id, int user_id, const std::string& content, const std::string& message_type = "text");
-        bool updateMessage(int id, const std::string& content);
-        bool deleteMessage(int id);
+        // With an idempotency_key, a key user_id already stored returns that row instead and sets *existed
+        std::optional<Message> createMessage(int room_id, int user_id, const std::string& content, const std::string& message_type = "text",
+                                             const std::string& idempotency_key = "", bool* existed = nullptr);
+        // Edits and soft deletes return the row as written, with its new change_seq
+        std::optional<Message> updateMessage(int id, const std::string& content);
+        std::optional<Message> deleteMessage(int id);
 
         // Query methods
         std::optional<Message> getMessageById(int id) const;
         std::vector<Message> getMessagesByRoom(int room_id, int limit = 50, int offset = 0) const;
+        std::vector<Message> getMessagesAfter(int room_id, int after_id, int limit = 100) const;
+
+        // Messages inserted, edited or deleted after change sequence since; nullopt if the room doesn't exist
+        std::optional<RoomChanges> getRoomChanges(int room_id, int64_t since, int limit = 500) const;
+
+        // Room, members and the newest message_limit messages in one repeatable-read transaction
+        std::optional<RoomSnapshot> getRoomSnapshot(int room_id, int message_limit = 50) const;
+
+        // ========== CHANGE NOTIFICATIONS ===========
+
+        // payload as sent by pg_notify, and the PID of the backend that sent it
+        using NotificationHandler = std::function<void(std::string_view payload, int backend_pid)>;
+
+        // LISTEN on channel from a dedicated connection and thread; reconnects if the connection drops
+        bool startListening(const std::string& channel, NotificationHandler handler);
+        void stopListening();
+
+        // Whether backend_pid is one of the pool's connections - notifications it sent are this process' own writes
+        bool isOwnBackend(int backend_pid) const;
 
     private:
-        std::unique_ptr<pqxx::connection> conn_;  // PostgreSQL connection object
+        struct NotificationListener;
+        std::unique_ptr<NotificationListener> listener_;
+
+        struct ConnectionPool;
+        std::unique_ptr<ConnectionPool> pool_;    // PostgreSQL connections for queries
         std::string connectionString_;            // Database connection string
         bool connected_;                          // Connection status flag
 
-        // Helper functions to convert database rows to structs
-        User rowToUser(const pqxx::row& row) const;
-        Room rowToRoom(const pqxx::row& row) const;
-        Message rowToMessage(const pqxx::row& row) const;
+        // A connection borrowed for one operation: the thread's pinned one, or one from the pool
+        class Lease;
+        Lease acquire() const;
+        std::unique_ptr<pqxx::connection> take() const;
+        void giveBack(std::unique_ptr<pqxx::connection> conn) const;
+        void applyStatementTimeout(pqxx::connection& conn) const;
+
+        struct ReadEngine;
+        std::unique_ptr<ReadEngine> reads_;       // null unless readPipeline.connections > 0 and connected
+        ReadPipeline readPipeline_;
+
+        // Run one SELECT and call onRow for each row: through the read pipeline when there is one, else a pooled connection
+        template <typename OnRow, typename... Args>
+        void read(const char* sql, OnRow&& onRow, const Args&... args) const;
+
+        // Helper functions to convert database rows (pqxx or read pipeline ones) to structs
+        template <typename Row> User rowToUser(const Row& row) const;
+        template <typename Row> Room rowToRoom(const Row& row) const;
+        template <typename Row> Message rowToMessage(const Row& row) const;
 };
\ No newline at end of file
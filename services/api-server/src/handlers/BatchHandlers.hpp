@@ -0,0 +1,217 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "../external/httplib.h"
+#include "../utils/JsonReader.hpp"
+#include "../utils/JsonResponses.hpp"
+#include "../utils/JsonWriter.hpp"
+#include "../database/Database.h"
+#include "../routing/RateLimiter.hpp"
+#include "../routing/RouteTable.hpp"
+#include "../utils/RequestContext.hpp"
+#include "../utils/RequestTrace.hpp"
+
+using JsonResponses::sendError;
+using JsonResponses::sendBody;
+
+/**
+ * POST /api/batch - many API calls in one HTTP request
+ *   [{"method":"POST","path":"/api/rooms/1/messages","body":{...},"headers":{"Idempotency-Key":"a"}},
+ *    {"method":"GET","path":"/api/rooms/2/messages?limit=20"}]
+ * is answered with one result per entry, in order:
+ *   [{"status":201,"body":{...}},{"status":200,"headers":{"ETag":"..."},"body":[...]}]
+ *
+ * Entries run one after another on this thread through the same handlers as direct calls
+ * (looked up in RouteTable), so validation, caching, idempotency and live events behave
+ * identically. They share one pinned database connection instead of going back to the
+ * pool between calls. A failing entry only fails its own result, and each entry is
+ * charged to the client's rate limits like a direct call.
+ */
+class BatchHandlers {
+private:
+    RouteTable& routes_;
+    Database& db_;
+    RateLimiter& rateLimiter_;
+    const size_t maxRequests_;
+
+    struct SubRequest {
+        std::string method;
+        std::string path;
+        std::string body;
+        std::vector<std::pair<std::string, std::string>> headers;
+    };
+
+    static bool parseEntry(const JsonValue& entry, SubRequest& out) {
+        if (entry.type != JsonType::Object) {
+            return false;
+        }
+        bool headersOk = true;
+        JsonReader reader(entry.text);
+        bool wellFormed = reader.forEachMember([&](std::string_view key, const JsonValue& value) {
+            if (key == "method" && value.type == JsonType::String) {
+                out.method = value.text;
+            } else if (key == "path" && value.type == JsonType::String) {
+                out.path = value.text;
+            } else if (key == "body") {
+                // Objects and arrays are forwarded as written; a string is sent as-is
+                if (value.type != JsonType::Null) out.body = value.text;
+            } else if (key == "headers" && value.type == JsonType::Object) {
+                JsonReader headers(value.text);
+                headersOk = headers.forEachMember([&](std::string_view name, const JsonValue& header) {
+                    if (header.type != JsonType::String) {
+                        headersOk = false;
+                        return false;
+                    }
+                    out.headers.emplace_back(std::string(name), std::string(header.text));
+                    return true;
+                }) && headersOk;
+            }
+            return true;
+        });
+        return wellFormed && headersOk && !out.method.empty() && out.path.starts_with("/api/");
+    }
+
+    void run(const httplib::Request& outer, const SubRequest& entry, httplib::Response& res) const {
+        httplib::Request sub;
+        sub.method = entry.method;
+        sub.remote_addr = outer.remote_addr;
+        size_t query = entry.path.find('?');
+        sub.path = entry.path.substr(0, query);
+        if (query != std::string::npos) {
+            httplib::detail::parse_query_text(entry.path.substr(query + 1), sub.params);
+        }
+        sub.body = entry.body;
+        sub.headers.emplace("Content-Type", "application/json");
+        for (const auto& [name, value] : entry.headers) {
+            sub.headers.emplace(name, value);
+        }
+
+        if (sub.path == "/api/batch") {
+            sendError<"Batches can't be nested">(res, 400);
+            return;
+        }
+
+        // Each entry costs what the same call would on its own
+        if (!rateLimiter_.admit(sub, res)) {
+            return;
+        }
+
+        const RouteTable::Route* route = routes_.match(sub.method, sub);
+        if (!route) {
+            if (routes_.knowsPath(sub.path)) {
+                sendError<"Method not allowed">(res, 405);
+            } else {
+                sendError<"Not found">(res, 404);
+            }
+            return;
+        }
+
+        try {
+            route->handler(sub, res);
+        } catch (const std::exception& e) {
+            std::cerr << "Batch entry error: " << e.what() << std::endl;
+            sendError<"Internal server error">(res, 500);
+        }
+
+        // The batch shares one deadline: once it has passed, this and every later entry is a 504
+        // (taken here, so the batch itself is still answered 200)
+        if (RequestContext::current().takeAbandoned()) {
+            res.headers.erase("ETag");
+            sendError<"Request deadline exceeded">(res, 504);
+        }
+    }
+
+    static void writeResult(JsonWriter& w, const httplib::Response& res) {
+        // A handler that only set a body answered 200, as httplib would have sent it
+        w.beginObject().field("status", res.status == -1 ? 200 : res.status);
+
+        bool anyHeaders = false;
+        for (const auto& [name, value] : res.headers) {
+            if (name == "Content-Type" || name == "Content-Length") {
+                continue;
+            }
+            if (!anyHeaders) {
+                w.key("headers").beginObject();
+                anyHeaders = true;
+            }
+            w.field(name, value);
+        }
+        if (anyHeaders) {
+            w.endObject();
+        }
+
+        // Handlers answer JSON; anything else is passed on as a string
+        w.key("body");
+        if (res.body.empty()) {
+            w.null();
+        } else if (res.get_header_value("Content-Type") == JsonResponses::CONTENT_TYPE) {
+            w.raw(res.body);
+        } else {
+            w.value(res.body);
+        }
+        w.endObject();
+    }
+
+public:
+    BatchHandlers(RouteTable& routes, Database& db, RateLimiter& rateLimiter, size_t maxRequests)
+        : routes_(routes), db_(db), rateLimiter_(rateLimiter), maxRequests_(maxRequests) {
+    }
+
+    /**
+     * POST /api/batch - Run an array of sub-requests and return their results
+     */
+    void runBatch(const httplib::Request& req, httplib::Response& res) {
+        try {
+            TraceSpan parseSpan("parse");
+            std::vector<SubRequest> entries;
+            bool valid = true;
+            JsonReader reader(req.body);
+            bool wellFormed = reader.forEachElement([&](const JsonValue& value) {
+                if (entries.size() == maxRequests_) {
+                    entries.emplace_back();  // one past the limit is enough to refuse
+                    return false;
+                }
+                valid = parseEntry(value, entries.emplace_back());
+                return valid;
+            });
+            parseSpan.end();
+
+            if (!wellFormed) {
+                sendError<"Expected a JSON array of requests">(res, 400);
+                return;
+            }
+            if (entries.size() > maxRequests_) {
+                sendError<"Too many requests in one batch">(res, 413);
+                return;
+            }
+            if (!valid) {
+                sendError<"Each request needs a method and a path under /api/">(res, 400);
+                return;
+            }
+
+            // Every entry reuses this connection instead of queueing for the pool again
+            auto pin = db_.pinConnection();
+
+            // Not forResponse(): the handlers below serialize into that per-thread buffer
+            std::string body;
+            JsonWriter response(body);
+            response.beginArray();
+            for (const SubRequest& entry : entries) {
+                httplib::Response result;
+                run(req, entry, result);
+                writeResult(response, result);
+            }
+            response.endArray();
+
+            sendBody(res, 200, body);
+
+        } catch (const std::exception& e) {
+            std::cerr << "Batch error: " << e.what() << std::endl;
+            sendError<"Internal server error">(res, 500);
+        }
+    }
+};
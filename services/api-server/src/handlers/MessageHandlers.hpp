@@ -2,15 +2,26 @@
 
 #include <iostream>
 #include <string>
-#include <set>
-#include <vector>
 #include "../external/httplib.h"
 #include "../external/json.hpp"
+#include "../utils/JsonResponses.hpp"
+#include "RequestBodies.hpp"
 #include "../database/Database.h"
 #include "../utils/Validator.hpp"
 #include "../clients/RabbitMQClient.hpp"
+#include "../utils/RequestContext.hpp"
+#include "../utils/RequestTrace.hpp"
+#include "../cache/ChangeVersions.hpp"
+#include "../cache/ResponseCache.hpp"
+#include "../cache/SingleFlight.hpp"
+#include "../cache/IdempotencyStore.hpp"
+#include "../routing/RateLimiter.hpp"
+#include "../realtime/RoomHub.hpp"
 
 using json = nlohmann::json;
+using JsonResponses::sendError;
+using JsonResponses::sendJson;
+using JsonResponses::sendNotice;
 
 /**
  * Message-related HTTP Request Handlers
@@ -20,46 +31,117 @@ class MessageHandlers {
 private:
     Database& db_;
     RabbitMQClient& rabbitmq_;
+    ChangeVersions& versions_;
+    ResponseCache& cache_;
+    IdempotencyStore& idempotency_;
+    RateLimiter& rateLimiter_;
+    RoomHub& hub_;
 
-    static std::vector<std::string> validateAllowedFields(
-        const json& j,
-        const std::set<std::string>& allowedFields
-    ) {
-        std::vector<std::string> invalidFields;
-        
-        for (auto it = j.begin(); it != j.end(); ++it) {
-            if (allowedFields.find(it.key()) == allowedFields.end()) {
-                invalidFields.emplace_back(it.key());
-            }
+    /**
+     * One serialized page of room messages, shared by coalesced readers
+     */
+    struct MessagePage {
+        bool roomFound{false};
+        std::string body;
+    };
+
+    SingleFlight<std::string, MessagePage> messagePages_;
+    SingleFlight<std::string, std::string> newMessages_;
+
+    MessagePage loadMessagePage(int roomId, int limit, int offset) {
+        MessagePage page;
+
+        auto room = traced("db_room", [&] { return db_.getRoomById(roomId); });
+        if (!room) {
+            return page;
         }
-        
-        return invalidFields;
-    }
 
-    static void sendInvalidFieldsError(
-        httplib::Response& res,
-        const std::vector<std::string>& invalidFields,
-        const std::set<std::string>& allowedFields
-    ) {
-        std::string fieldsList;
-        for (size_t i = 0; i < invalidFields.size(); ++i) {
-            if (i > 0) {
-                fieldsList += ", ";
-            }
-            fieldsList += "'" + invalidFields[i] + "'";
+        auto messages = traced("db_messages", [&] { return db_.getMessagesByRoom(roomId, limit, offset); });
+        TraceSpan serializeSpan("serialize");
+        JsonWriter response = JsonWriter::forResponse();
+        response.beginArray();
+
+        for (const auto& message : messages) {
+            JsonResponses::writeMessage(response, message);
         }
-        
-        json error = {
-            {"error", "Invalid fields: " + fieldsList},
-            {"allowed_fields", allowedFields}
-        };
-        res.set_content(error.dump(), "application/json");
-        res.status = 400;
+
+        response.endArray();
+        // A page built from reads given up on at the deadline must not be shared or cached
+        RequestContext::current().throwIfAbandoned();
+        page.roomFound = true;
+        page.body = response.str();
+        return page;
+    }
+
+    /**
+     * Push a message change to the room's live streams, long-polls and other nodes
+     */
+    void publishToStreams(std::string_view type, const Message& message) {
+        std::string data;
+        JsonWriter writer(data);
+        JsonResponses::writeMessage(writer, message);
+        hub_.publish(message.room_id, type, data);
     }
 
 public:
-    MessageHandlers(Database& db, RabbitMQClient& rabbitmq)
-        : db_(db), rabbitmq_(rabbitmq) {
+    MessageHandlers(Database& db, RabbitMQClient& rabbitmq, ChangeVersions& versions, ResponseCache& cache,
+                    IdempotencyStore& idempotency, RateLimiter& rateLimiter, RoomHub& hub)
+        : db_(db), rabbitmq_(rabbitmq), versions_(versions), cache_(cache), idempotency_(idempotency),
+          rateLimiter_(rateLimiter), hub_(hub) {
+    }
+
+    /**
+     * Message-page queries run vs. readers that shared one
+     */
+    json coalescingStats() const {
+        return {
+            {"queries", messagePages_.leaders()},
+            {"coalesced", messagePages_.followers()},
+            {"wait_queries", newMessages_.leaders()},
+            {"wait_coalesced", newMessages_.followers()}
+        };
+    }
+
+    /**
+     * Messages newer than afterId as a JSON array (oldest first, at most limit), or an empty
+     * string if there are none yet. Long-polls woken by the same message share one query;
+     * the room version in the key keeps a wait from joining a query older than its wake-up.
+     */
+    std::shared_ptr<const std::string> messagesAfter(int roomId, int afterId, int limit) {
+        return newMessages_.run(newMessagesKey(roomId, afterId, limit), [&] {
+            auto messages = db_.getMessagesAfter(roomId, afterId, limit);
+            RequestContext::current().throwIfAbandoned();
+            return messagesJson(messages);
+        });
+    }
+
+    /**
+     * Coalescing key for messagesAfter(), also used by the gateway's loops for their own flights
+     */
+    std::string newMessagesKey(int roomId, int afterId, int limit) const {
+        std::string key = versions_.roomTag('M', roomId);
+        key += '|';
+        key += std::to_string(afterId);
+        key += '|';
+        key += std::to_string(limit);
+        return key;
+    }
+
+    /**
+     * messages as a JSON array; an empty string (not "[]") when there are none
+     */
+    static std::string messagesJson(const std::vector<Message>& messages) {
+        std::string body;
+        if (messages.empty()) {
+            return body;
+        }
+        JsonWriter writer(body);
+        writer.beginArray();
+        for (const auto& message : messages) {
+            JsonResponses::writeMessage(writer, message);
+        }
+        writer.endArray();
+        return body;
     }
 
     /**
@@ -68,12 +150,10 @@ public:
     void getRoomMessages(const httplib::Request& req, httplib::Response& res) {
         try {
             int roomId = std::stoi(req.matches[1]);
-            auto room = db_.getRoomById(roomId);
 
-            if (!room) {
-                json error = {{"error", "Room not found"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 404;
+            // Same tag for every page: any write to the room invalidates them all
+            const std::string etag = versions_.roomTag('M', roomId);
+            if (ConditionalGet::notModified(req, res, etag)) {
                 return;
             }
 
@@ -83,154 +163,314 @@ public:
             int limit = req.has_param("limit") ? std::stoi(req.get_param_value("limit")) : DEFAULT_LIMIT;
             int offset = req.has_param("offset") ? std::stoi(req.get_param_value("offset")) : DEFAULT_OFFSET;
 
-            auto messages = db_.getMessagesByRoom(roomId, limit, offset);
-            json response = json::array();
-
-            for (const auto& message : messages) {
-                response.emplace_back(json{
-                    {"id", message.id},
-                    {"room_id", message.room_id},
-                    {"user_id", message.user_id},
-                    {"content", message.content},
-                    {"message_type", message.message_type},
-                    {"created_at", message.created_at},
-                    {"edited_at", message.edited_at},
-                    {"is_deleted", message.is_deleted}
-                });
+            // Only the default first page is cached - it is what every client opens a room with
+            const bool firstPage = limit == DEFAULT_LIMIT && offset == DEFAULT_OFFSET;
+            if (firstPage) {
+                if (auto cached = cache_.get('M', roomId, etag)) {
+                    ConditionalGet::tag(res, etag);
+                    JsonResponses::sendBody(res, 200, *cached);
+                    return;
+                }
+            }
+
+            // Identical concurrent reads of the same version share one query and one serialization
+            std::string flightKey = etag;
+            flightKey += '|';
+            flightKey += std::to_string(limit);
+            flightKey += '|';
+            flightKey += std::to_string(offset);
+
+            bool joined = false;
+            auto waitStart = RequestTrace::Clock::now();
+            auto page = messagePages_.run(flightKey, [&] { return loadMessagePage(roomId, limit, offset); }, &joined);
+            if (joined) {
+                // The leader's db_* spans live in its own trace; show the wait instead
+                RequestTrace::current().record("coalesced", waitStart, RequestTrace::Clock::now());
+            }
+
+            if (!page->roomFound) {
+                sendError<"Room not found">(res, 404);
+                return;
             }
 
-            res.set_content(response.dump(), "application/json");
-            res.status = 200;
+            if (firstPage && !joined) {
+                cache_.put('M', roomId, etag, page->body);
+            }
+            ConditionalGet::tag(res, etag);
+            JsonResponses::sendBody(res, 200, page->body);
 
         } catch (const std::exception& e) {
             std::cerr << "Get room messages error: " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 
     /**
-     * POST /api/rooms/:id/messages - Send a message to a room
+     * GET /api/rooms/:id/changes?since=SEQ - Message changes after a room change sequence
+     * Lets a reconnecting client catch up on inserts, edits and deletes without refetching
+     * pages: upsert "messages", drop "deleted", then resume from "change_seq" (also on every
+     * message and on the room snapshot). has_more means the limit was hit; ask again.
      */
-    void sendMessage(const httplib::Request& req, httplib::Response& res) {
+    void getRoomChanges(const httplib::Request& req, httplib::Response& res) {
         try {
             int roomId = std::stoi(req.matches[1]);
-            json j = json::parse(req.body);
-
-            static const std::set<std::string> allowedFields = {
-                "user_id", "content", "message_type"
-            };
 
-            auto invalidFields = validateAllowedFields(j, allowedFields);
-            if (!invalidFields.empty()) {
-                sendInvalidFieldsError(res, invalidFields, allowedFields);
+            // One tag per room version, like the message pages; since is part of the URL
+            const std::string etag = versions_.roomTag('C', roomId);
+            if (ConditionalGet::notModified(req, res, etag)) {
                 return;
             }
 
-            if (!j.contains("user_id") || !j.contains("content")) {
-                json error = {{"error", "Missing required fields: user_id, content"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 400;
+            constexpr int DEFAULT_LIMIT = 500;
+            constexpr int MAX_LIMIT = 1000;
+
+            if (!req.has_param("since")) {
+                sendError<"since is required">(res, 400);
                 return;
             }
-
-            const std::string& content = j["content"].get_ref<const std::string&>();
-            if (!Validator::isValidMessageContent(content)) {
-                json error = {{"error", "Invalid message content (must be 1-1000 characters)"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 400;
+            int64_t since = std::stoll(req.get_param_value("since"));
+            int limit = req.has_param("limit") ? std::stoi(req.get_param_value("limit")) : DEFAULT_LIMIT;
+            if (since < 0 || limit < 1 || limit > MAX_LIMIT) {
+                sendError<"since must be >= 0 and limit between 1 and 1000">(res, 400);
                 return;
             }
 
-            const std::string messageType = j.value("message_type", "text");
-            if (messageType != "text" && messageType != "image" && messageType != "file") {
-                json error = {{"error", "Invalid message type (must be 'text', 'image', or 'file')"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 400;
+            auto changes = traced("db_changes", [&] { return db_.getRoomChanges(roomId, since, limit); });
+
+            if (!changes) {
+                sendError<"Room not found">(res, 404);
                 return;
             }
 
-            auto room = db_.getRoomById(roomId);
-            if (!room) {
-                json error = {{"error", "Room not found"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 404;
-                return;
+            TraceSpan serializeSpan("serialize");
+            JsonWriter response = JsonWriter::forResponse();
+            response.beginObject()
+                .field("room_id", roomId)
+                .field("since", since)
+                .field("change_seq", changes->change_seq)
+                .field("has_more", changes->has_more);
+
+            // Deleted messages only need their id
+            response.key("messages").beginArray();
+            for (const auto& message : changes->messages) {
+                if (!message.is_deleted) {
+                    JsonResponses::writeMessage(response, message);
+                }
+            }
+            response.endArray();
+
+            response.key("deleted").beginArray();
+            for (const auto& message : changes->messages) {
+                if (message.is_deleted) {
+                    response.value(message.id);
+                }
             }
+            response.endArray();
+
+            response.endObject();
+            RequestContext::current().throwIfAbandoned();
+            ConditionalGet::tag(res, etag);
+            sendJson(res, 200, response);
+
+        } catch (const std::exception& e) {
+            std::cerr << "Get room changes error: " << e.what() << std::endl;
+            sendError<"Internal server error">(res, 500);
+        }
+    }
+
+    /**
+     * POST /api/rooms/:id/messages - Send a message to a room
+     * With an Idempotency-Key header, a retry of a send that succeeded gets the original
+     * 201 back (marked Idempotent-Replayed) without touching the database.
+     */
+    void sendMessage(const httplib::Request& req, httplib::Response& res) {
+        constexpr size_t MAX_IDEMPOTENCY_KEY = 255;
 
-            int userId = j["user_id"].get<int>();
-            auto user = db_.getUserById(userId);
-            if (!user) {
-                json error = {{"error", "User not found"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 404;
+        std::string claimed;  // store key while this request holds its claim
+        try {
+            int roomId = std::stoi(req.matches[1]);
+
+            std::string key = req.get_header_value("Idempotency-Key");
+            if (key.empty()) {
+                postMessage(roomId, req.body, res);
+                return;
+            }
+            if (key.size() > MAX_IDEMPOTENCY_KEY) {
+                sendError<"Idempotency-Key must be at most 255 characters">(res, 400);
                 return;
             }
 
-            if (!db_.isUserInRoom(userId, roomId)) {
-                json error = {{"error", "User is not a member of the room"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 403;
+            // Keys belong to the sender, as in the database: two users may pick the same one
+            int userId = 0;
+            if (!senderOf(req.body, userId)) {
+                postMessage(roomId, req.body, res, key);  // validation answers it
+                return;
+            }
+            std::string storeKey = std::to_string(userId);
+            storeKey += ':';
+            storeKey += key;
+
+            // The same key with another room or body is a client bug, not a retry
+            uint64_t fingerprint = std::hash<std::string_view>{}(req.body) ^
+                                   (static_cast<uint64_t>(roomId) * 0x9E3779B97F4A7C15ull);
+            auto claim = idempotency_.claim(storeKey, fingerprint);
+            switch (claim.outcome) {
+            case IdempotencyStore::Outcome::Replay:
+                res.set_header("Idempotent-Replayed", "true");
+                JsonResponses::sendBody(res, claim.response->status, claim.response->body);
+                return;
+            case IdempotencyStore::Outcome::InProgress:
+                sendError<"A request with this Idempotency-Key is still in progress">(res, 409);
                 return;
+            case IdempotencyStore::Outcome::Mismatch:
+                sendError<"Idempotency-Key was already used for a different request">(res, 422);
+                return;
+            case IdempotencyStore::Outcome::Started:
+                break;
             }
+            claimed = std::move(storeKey);
 
-            auto createdMessage = db_.createMessage(
-                roomId,
-                userId,
-                content,
-                messageType
-            );
+            postMessage(roomId, req.body, res, key);
 
-            if (!createdMessage) {
-                json error = {{"error", "Failed to create message"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 500;
-                return;
+            // Only a stored message is worth replaying; after an error the retry runs again
+            if (res.status == 201) {
+                idempotency_.complete(claimed, res.status, res.body);
+            } else {
+                idempotency_.release(claimed);
             }
+            claimed.clear();
 
-            json response = {
-                {"id", createdMessage->id},
-                {"room_id", createdMessage->room_id},
-                {"user_id", createdMessage->user_id},
-                {"content", content},
-                {"message_type", createdMessage->message_type},
-                {"created_at", createdMessage->created_at},
-                {"edited_at", createdMessage->edited_at},
-                {"is_deleted", createdMessage->is_deleted},
-                {"message", "Message sent successfully"}
-            };
-
-            json event = {
-                {"event_type", "message.created"},
-                {"message_id", createdMessage->id},
-                {"room_id", createdMessage->room_id},
-                {"user_id", createdMessage->user_id},
-                {"sender_username", user->username},
-                {"sender_email", user->email},
-                {"room_name", room->name},
-                {"content", content},
-                {"message_type", createdMessage->message_type},
-                {"timestamp", createdMessage->created_at}
-            };
-
-            rabbitmq_.publishEvent("message.created", event);
-
-            res.set_content(response.dump(), "application/json");
-            res.status = 201;
-
-        } catch (json::parse_error& e) {
-            json error = {{"error", "Invalid JSON format"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 400;
         } catch (const std::exception& e) {
+            if (!claimed.empty()) {
+                idempotency_.release(claimed);
+            }
             std::cerr << "Create message error: " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 
+    /**
+     * user_id of a send request body, before it is validated; false if there is none
+     */
+    static bool senderOf(std::string_view requestBody, int& userId) {
+        bool found = false;
+        JsonReader reader(requestBody);
+        bool wellFormed = reader.forEachMember([&](std::string_view key, const JsonValue& value) {
+            if (key == "user_id") found = value.asInteger(userId);
+            return true;
+        });
+        return wellFormed && found;
+    }
+
+    /**
+     * Validate, store and announce one message; the response (201 or the error) goes to res.
+     * Shared by POST /api/rooms/:id/messages and the WebSocket gateway's "send" command,
+     * so both paths validate, rate-limit, invalidate and publish identically. Throws on unexpected errors.
+     * A non-empty idempotencyKey is stored with the message; if the key is already in the
+     * database the original message is answered again and nothing is invalidated or published.
+     */
+    void postMessage(int roomId, std::string_view requestBody, httplib::Response& res,
+                     const std::string& idempotencyKey = {}) {
+        TraceSpan parseSpan("parse");
+        JsonReader reader(requestBody);
+        using Body = RequestBodies::SendMessage;
+        auto body = Body::SCHEMA.decode(reader, res);
+        if (!body) {
+            return;
+        }
+
+        std::string_view content = body->string(Body::CONTENT);
+        std::string_view messageType = body->string(Body::MESSAGE_TYPE, "text");
+        int userId = body->integer(Body::USER_ID);
+        parseSpan.end();
+
+        // Per sender, whichever address or transport the message came through
+        if (!rateLimiter_.admitUser(userId, res)) {
+            return;
+        }
+
+        auto room = traced("db_room", [&] { return db_.getRoomById(roomId); });
+        if (!room) {
+            sendError<"Room not found">(res, 404);
+            return;
+        }
+
+        auto user = traced("db_user", [&] { return db_.getUserById(userId); });
+        if (!user) {
+            sendError<"User not found">(res, 404);
+            return;
+        }
+
+        if (!traced("db_membership", [&] { return db_.isUserInRoom(userId, roomId); })) {
+            sendError<"User is not a member of the room">(res, 403);
+            return;
+        }
+
+        bool existed = false;
+        auto createdMessage = traced("db_insert", [&] {
+            return db_.createMessage(
+                roomId,
+                userId,
+                std::string(content),
+                std::string(messageType),
+                idempotencyKey,
+                &existed
+            );
+        });
+
+        if (!createdMessage) {
+            sendError<"Failed to create message">(res, 500);
+            return;
+        }
+
+        if (existed && (createdMessage->room_id != roomId || createdMessage->user_id != userId ||
+                        createdMessage->content != content || createdMessage->message_type != messageType)) {
+            sendError<"Idempotency-Key was already used for a different request">(res, 422);
+            return;
+        }
+
+        if (!existed) {
+            versions_.bumpRoom(roomId);
+            cache_.invalidateRoom(roomId);
+        }
+
+        TraceSpan serializeSpan("serialize");
+
+        JsonWriter response = JsonWriter::forResponse();
+        response.beginObject();
+        JsonResponses::writeMessageFields(response, *createdMessage);
+        response
+            .field("message", "Message sent successfully")
+            .endObject();
+
+        // A retry of a send that already committed: same answer, no second announcement
+        if (existed) {
+            res.set_header("Idempotent-Replayed", "true");
+            sendJson(res, 201, response);
+            return;
+        }
+
+        sendJson(res, 201, response);
+        serializeSpan.end();
+
+        traced("stream_publish", [&] { publishToStreams("message.created", *createdMessage); });
+
+        json event = {
+            {"event_type", "message.created"},
+            {"message_id", createdMessage->id},
+            {"room_id", createdMessage->room_id},
+            {"user_id", createdMessage->user_id},
+            {"sender_username", user->username},
+            {"sender_email", user->email},
+            {"room_name", room->name},
+            {"content", createdMessage->content},
+            {"message_type", createdMessage->message_type},
+            {"timestamp", createdMessage->created_at}
+        };
+
+        traced("publish", [&] { rabbitmq_.publishEvent("message.created", event); });
+    }
+
     /**
      * GET /api/rooms/messages/:id - Get message by ID
      */
@@ -238,34 +478,23 @@ public:
         try {
             int messageId = std::stoi(req.matches[1]);
 
-            auto message = db_.getMessageById(messageId);
+            auto message = traced("db_message", [&] { return db_.getMessageById(messageId); });
 
             if (!message) {
-                json error = {{"error", "Message not found"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 404;
+                sendError<"Message not found">(res, 404);
                 return;
             }
 
-            json response = {
-                {"id", message->id},
-                {"room_id", message->room_id},
-                {"user_id", message->user_id},
-                {"content", message->content},
-                {"message_type", message->message_type},
-                {"created_at", message->created_at},
-                {"edited_at", message->edited_at},
-                {"is_deleted", message->is_deleted}
-            };
+            TraceSpan serializeSpan("serialize");
+
+            JsonWriter response = JsonWriter::forResponse();
+            JsonResponses::writeMessage(response, *message);
 
-            res.set_content(response.dump(), "application/json");
-            res.status = 200;
+            sendJson(res, 200, response);
 
         } catch (const std::exception& e) {
             std::cerr << "Get message error: " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 
@@ -275,77 +504,57 @@ public:
     void updateMessage(const httplib::Request& req, httplib::Response& res) {
         try {
             int messageId = std::stoi(req.matches[1]);
-            json j = json::parse(req.body);
-
-            static const std::set<std::string> allowedFields = {
-                "content"
-            };
-
-            auto invalidFields = validateAllowedFields(j, allowedFields);
-            if (!invalidFields.empty()) {
-                sendInvalidFieldsError(res, invalidFields, allowedFields);
+            TraceSpan parseSpan("parse");
+            JsonReader reader(req.body);
+            using Body = RequestBodies::UpdateMessage;
+            auto body = Body::SCHEMA.decode(reader, res);
+            if (!body) {
                 return;
             }
 
-            auto message = db_.getMessageById(messageId);
+            std::string_view content = body->string(Body::CONTENT);
+            parseSpan.end();
+
+            auto message = traced("db_message", [&] { return db_.getMessageById(messageId); });
 
             if (!message) {
-                json error = {{"error", "Message not found"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 404;
+                sendError<"Message not found">(res, 404);
                 return;
             }
 
             if (message->is_deleted) {
-                json error = {{"error", "Cannot update a deleted message"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 400;
+                sendError<"Cannot update a deleted message">(res, 400);
                 return;
             }
 
-            const std::string& content = j["content"].get_ref<const std::string&>();
-            if (!Validator::isValidMessageContent(content)) {
-                json error = {{"error", "Invalid message content (must be 1-1000 characters)"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 400;
+            auto updated = traced("db_update", [&] { return db_.updateMessage(message->id, std::string(content)); });
+
+            if (!updated) {
+                sendError<"Failed to update message">(res, 500);
                 return;
-                }
+            }
+            message = std::move(updated);
 
-            message->content = content;
+            versions_.bumpRoom(message->room_id);
+            cache_.invalidateRoom(message->room_id);
 
-            bool success = db_.updateMessage(message->id, message->content);
+            TraceSpan serializeSpan("serialize");
 
-            if (!success) {
-                json error = {{"error", "Failed to update message"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 500;
-                return;
-            }
+            JsonWriter response = JsonWriter::forResponse();
+            response.beginObject();
+            JsonResponses::writeMessageFields(response, *message);
+            response
+                .field("message", "Message updated successfully")
+                .endObject();
+
+            sendJson(res, 200, response);
+            serializeSpan.end();
+
+            traced("stream_publish", [&] { publishToStreams("message.updated", *message); });
 
-            json response = {
-                {"id", message->id},
-                {"room_id", message->room_id},
-                {"user_id", message->user_id},
-                {"content", message->content},
-                {"message_type", message->message_type},
-                {"created_at", message-> created_at},
-                {"edited_at", message->edited_at},
-                {"is_deleted", message->is_deleted},
-                {"message", "Message updated successfully"}
-            };
-
-            res.set_content(response.dump(), "application/json");
-            res.status = 200;
-
-        } catch (json::parse_error& e) {
-            json error = {{"error", "Invalid JSON format"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 400;
         } catch (const std::exception& e) {
             std::cerr << "Update message error: " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 
@@ -356,33 +565,33 @@ public:
         try {
             int messageId = std::stoi(req.matches[1]);
 
-            auto message = db_.getMessageById(messageId);
+            auto message = traced("db_message", [&] { return db_.getMessageById(messageId); });
 
             if (!message) {
-                json error = {{"error", "Message not found"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 404;
+                sendError<"Message not found">(res, 404);
                 return;
             }
 
-            bool success = db_.deleteMessage(messageId);
+            auto deleted = traced("db_delete", [&] { return db_.deleteMessage(messageId); });
 
-            if (!success) {
-                json error = {{"error", "Failed to delete message"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 500;
+            if (!deleted) {
+                sendError<"Failed to delete message">(res, 500);
                 return;
             }
 
-            json response = {{"message", "Message deleted successfully"}};
-            res.set_content(response.dump(), "application/json");
-            res.status = 200;
+            versions_.bumpRoom(message->room_id);
+            cache_.invalidateRoom(message->room_id);
+
+            TraceSpan serializeSpan("serialize");
+
+            sendNotice<"Message deleted successfully">(res, 200);
+            serializeSpan.end();
+
+            traced("stream_publish", [&] { publishToStreams("message.deleted", *deleted); });
 
         } catch (const std::exception& e) {
             std::cerr << "Delete message error: " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 };
\ No newline at end of file
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <string_view>
+#include "../utils/RequestSchema.hpp"
+#include "../utils/Validator.hpp"
+
+/**
+ * Request-body schemas for the POST/PATCH endpoints
+ * Each body lists its fields once; the enum gives handlers a name for each position.
+ *
+ *   JsonReader reader(req.body);
+ *   auto body = RequestBodies::SendMessage::SCHEMA.decode(reader, res);
+ *   if (!body) return;
+ *   std::string_view content = body->string(RequestBodies::SendMessage::CONTENT);
+ */
+namespace RequestBodies {
+
+// ---------- user bodies ----------
+
+struct RegisterUser {
+    enum Field { USERNAME, EMAIL, PASSWORD };
+
+    static constexpr RequestSchema SCHEMA{{
+        {.name = "username", .type = FieldType::String, .required = true,
+         .check = Validator::isValidUsername, .error = "Invalid username format"},
+        {.name = "email", .type = FieldType::String, .required = true,
+         .check = Validator::isValidEmail, .error = "Invalid email format"},
+        {.name = "password", .type = FieldType::String, .required = true,
+         .check = Validator::isValidPassword,
+         .error = "Password must be at least 8 characters long and contain both letters and numbers"},
+    }, "Missing required fields:  username, email, password"};
+};
+
+struct Login {
+    enum Field { USERNAME, PASSWORD };
+
+    static constexpr RequestSchema SCHEMA{{
+        {.name = "username", .type = FieldType::String, .required = true},
+        {.name = "password", .type = FieldType::String, .required = true},
+    }, "Missing required fields: username, password"};
+};
+
+struct UpdateUser {
+    enum Field { EMAIL, PASSWORD, IS_ACTIVE };
+
+    static constexpr RequestSchema SCHEMA{{
+        {.name = "email", .type = FieldType::String,
+         .check = Validator::isValidEmail, .error = "Invalid email format"},
+        {.name = "password", .type = FieldType::String,
+         .check = Validator::isValidPassword,
+         .error = "Password must be at least 8 characters and contain letters and numbers"},
+        {.name = "is_active", .type = FieldType::Bool},
+    }, {}};
+};
+
+// ---------- room bodies ----------
+
+struct CreateRoom {
+    enum Field { NAME, DESCRIPTION, CREATED_BY, IS_PRIVATE };
+
+    static constexpr RequestSchema SCHEMA{{
+        {.name = "name", .type = FieldType::String, .required = true,
+         .minLength = 1, .maxLength = Validator::MAX_ROOM_NAME_LENGTH,
+         .error = "Invalid room name (must be 1-100 characters)"},
+        {.name = "description", .type = FieldType::String, .required = true,
+         .maxLength = Validator::MAX_ROOM_DESCRIPTION_LENGTH,
+         .error = "Description too long (max 500 characters)"},
+        {.name = "created_by", .type = FieldType::Integer, .required = true},
+        {.name = "is_private", .type = FieldType::Bool},
+    }, "Missing required fields: name, description, created_by"};
+};
+
+struct AddRoomMember {
+    enum Field { USER_ID, ROLE };
+
+    static constexpr RequestSchema SCHEMA{{
+        {.name = "user_id", .type = FieldType::Integer, .required = true},
+        {.name = "role", .type = FieldType::String},
+    }, "Missing required field: user_id"};
+};
+
+struct UpdateRoom {
+    enum Field { NAME, DESCRIPTION };
+
+    static constexpr RequestSchema SCHEMA{{
+        {.name = "name", .type = FieldType::String,
+         .minLength = 1, .maxLength = Validator::MAX_ROOM_NAME_LENGTH,
+         .error = "Invalid room name (must be 1-100 characters)"},
+        {.name = "description", .type = FieldType::String,
+         .maxLength = Validator::MAX_ROOM_DESCRIPTION_LENGTH,
+         .error = "Description too long (max 500 characters)"},
+    }, {}};
+};
+
+// ---------- message bodies ----------
+
+struct SendMessage {
+    enum Field { USER_ID, CONTENT, MESSAGE_TYPE };
+
+    static constexpr RequestSchema SCHEMA{{
+        {.name = "user_id", .type = FieldType::Integer, .required = true},
+        {.name = "content", .type = FieldType::String, .required = true,
+         .minLength = 1, .maxLength = Validator::MAX_MESSAGE_LENGTH,
+         .error = "Invalid message content (must be 1-1000 characters)"},
+        {.name = "message_type", .type = FieldType::String,
+         .check = Validator::isValidMessageType,
+         .error = "Invalid message type (must be 'text', 'image', or 'file')"},
+    }, "Missing required fields: user_id, content"};
+};
+
+struct UpdateMessage {
+    enum Field { CONTENT };
+
+    static constexpr RequestSchema SCHEMA{{
+        {.name = "content", .type = FieldType::String, .required = true,
+         .minLength = 1, .maxLength = Validator::MAX_MESSAGE_LENGTH,
+         .error = "Invalid message content (must be 1-1000 characters)"},
+    }, "Missing required field: content"};
+};
+
+// ---------- translation body ----------
+
+struct Translate {
+    enum Field { TEXT, SOURCE_LANG, TARGET_LANG };
+
+    static constexpr RequestSchema SCHEMA{{
+        {.name = "text", .type = FieldType::String, .required = true,
+         .minLength = 1, .maxLength = Validator::MAX_TRANSLATION_LENGTH,
+         .error = "Text must be between 1 and 5000 characters"},
+        {.name = "source_lang", .type = FieldType::String,
+         .check = Validator::isValidSourceLanguage,
+         .error = "Invalid language code format (use 2-letter ISO 639-1 codes)"},
+        {.name = "target_lang", .type = FieldType::String, .required = true,
+         .minLength = Validator::LANGUAGE_CODE_LENGTH, .maxLength = Validator::LANGUAGE_CODE_LENGTH,
+         .error = "Invalid language code format (use 2-letter ISO 639-1 codes)"},
+    }, "Missing required fields: text, target_lang"};
+};
+
+} // namespace RequestBodies
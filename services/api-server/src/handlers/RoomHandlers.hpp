@@ -2,15 +2,22 @@
 
 #include <iostream>
 #include <string>
-#include <set>
-#include <vector>
 #include "../external/httplib.h"
 #include "../external/json.hpp"
+#include "../utils/JsonResponses.hpp"
+#include "RequestBodies.hpp"
 #include "../database/Database.h"
 #include "../utils/Validator.hpp"
 #include "../clients/RabbitMQClient.hpp"
+#include "../utils/RequestContext.hpp"
+#include "../utils/RequestTrace.hpp"
+#include "../cache/ChangeVersions.hpp"
+#include "../cache/ResponseCache.hpp"
 
 using json = nlohmann::json;
+using JsonResponses::sendError;
+using JsonResponses::sendJson;
+using JsonResponses::sendNotice;
 
 /**
  * Room-related HTTP Request Handlers
@@ -20,75 +27,48 @@ class RoomHandlers {
 private:
     Database& db_;
     RabbitMQClient& rabbitmq_;
-
-    static std::vector<std::string> validateAllowedFields(
-        const json& j,
-        const std::set<std::string>& allowedFields
-    ) {
-        std::vector<std::string> invalidFields;
-        
-        for (auto it = j.begin(); it != j.end(); ++it) {
-            if (allowedFields.find(it.key()) == allowedFields.end()) {
-                invalidFields.emplace_back(it.key());
-            }
-        }
-        
-        return invalidFields;
-    }
-
-    static void sendInvalidFieldsError(
-        httplib::Response& res,
-        const std::vector<std::string>& invalidFields,
-        const std::set<std::string>& allowedFields
-    ) {
-        std::string fieldsList;
-        for (size_t i = 0; i < invalidFields.size(); ++i) {
-            if (i > 0) {
-                fieldsList += ", ";
-            }
-            fieldsList += "'" + invalidFields[i] + "'";
-        }
-        
-        json error = {
-            {"error", "Invalid fields: " + fieldsList},
-            {"allowed_fields", allowedFields}
-        };
-        res.set_content(error.dump(), "application/json");
-        res.status = 400;
-    }
+    ChangeVersions& versions_;
+    ResponseCache& cache_;
 
 public:
-    RoomHandlers(Database& db, RabbitMQClient& rabbitmq)
-        : db_(db), rabbitmq_(rabbitmq) {
+    RoomHandlers(Database& db, RabbitMQClient& rabbitmq, ChangeVersions& versions, ResponseCache& cache)
+        : db_(db), rabbitmq_(rabbitmq), versions_(versions), cache_(cache) {
     }
 
     /**
      * GET /api/rooms - Get all rooms
      */
-    void getAllRooms(const httplib::Request&, httplib::Response& res) {
+    void getAllRooms(const httplib::Request& req, httplib::Response& res) {
         try {
-            auto rooms = db_.getAllRooms();
-            json response = json::array();
+            const std::string etag = versions_.roomListTag();
+            if (ConditionalGet::notModified(req, res, etag)) {
+                return;
+            }
+
+            if (auto cached = cache_.get('L', 0, etag)) {
+                ConditionalGet::tag(res, etag);
+                JsonResponses::sendBody(res, 200, *cached);
+                return;
+            }
+
+            auto rooms = traced("db_rooms", [&] { return db_.getAllRooms(); });
+            TraceSpan serializeSpan("serialize");
+            JsonWriter response = JsonWriter::forResponse();
+            response.beginArray();
 
             for (const auto& room : rooms) {
-                response.emplace_back(json{
-                    {"id", room.id},
-                    {"name", room.name},
-                    {"description", room.description},
-                    {"created_by", room.created_by},
-                    {"created_at", room.created_at},
-                    {"is_private", room.is_private}
-                });
+                JsonResponses::writeRoom(response, room);
             }
 
-            res.set_content(response.dump(), "application/json");
-            res.status = 200;
+            response.endArray();
+            RequestContext::current().throwIfAbandoned();
+            cache_.put('L', 0, etag, response.str());
+            ConditionalGet::tag(res, etag);
+            sendJson(res, 200, response);
 
         } catch (const std::exception& e) {
             std::cerr << "Get rooms error: " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 
@@ -98,32 +78,37 @@ public:
     void getRoomById(const httplib::Request& req, httplib::Response& res) {
         try {
             int roomId = std::stoi(req.matches[1]);
-            auto room = db_.getRoomById(roomId);
+            const std::string etag = versions_.roomTag('R', roomId);
+            if (ConditionalGet::notModified(req, res, etag)) {
+                return;
+            }
+
+            if (auto cached = cache_.get('R', roomId, etag)) {
+                ConditionalGet::tag(res, etag);
+                JsonResponses::sendBody(res, 200, *cached);
+                return;
+            }
+
+            auto room = traced("db_room", [&] { return db_.getRoomById(roomId); });
 
             if (!room) {
-                json error = {{"error", "Room not found"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 404;
+                sendError<"Room not found">(res, 404);
                 return;
             }
 
-            json response = {
-                {"id", room->id},
-                {"name", room->name},
-                {"description", room->description},
-                {"created_by", room->created_by},
-                {"created_at", room->created_at},
-                {"is_private", room->is_private}
-            };
+            TraceSpan serializeSpan("serialize");
+
+            JsonWriter response = JsonWriter::forResponse();
+            JsonResponses::writeRoom(response, *room);
 
-            res.set_content(response.dump(), "application/json");
-            res.status = 200;
+            RequestContext::current().throwIfAbandoned();
+            cache_.put('R', roomId, etag, response.str());
+            ConditionalGet::tag(res, etag);
+            sendJson(res, 200, response);
 
         } catch (const std::exception& e) {
             std::cerr << "Get room error: " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 
@@ -132,94 +117,63 @@ public:
      */
     void createRoom(const httplib::Request& req, httplib::Response& res) {
         try {
-            json j = json::parse(req.body);
-
-            static const std::set<std::string> allowedFields = {
-                "name", "description", "created_by", "is_private"
-            };
-
-            auto invalidFields = validateAllowedFields(j, allowedFields);
-            if (!invalidFields.empty()) {
-                sendInvalidFieldsError(res, invalidFields, allowedFields);
+            TraceSpan parseSpan("parse");
+            JsonReader reader(req.body);
+            using Body = RequestBodies::CreateRoom;
+            auto body = Body::SCHEMA.decode(reader, res);
+            if (!body) {
                 return;
             }
 
-            if (!j.contains("name") || !j.contains("description") || !j.contains("created_by")) {
-                json error = {{"error", "Missing required fields: name, description, created_by"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 400;
-                return;
-            }
-
-            const std::string& name = j["name"].get_ref<const std::string&>();
-            if (!Validator::isValidRoomName(name)) {
-                json error = {{"error", "Invalid room name (must be 1-100 characters)"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 400;
-                return;
-            }
-
-            const std::string& description = j["description"].get_ref<const std::string&>();
-            if (!Validator::isValidRoomDescription(description)) {
-                json error = {{"error", "Description too long (max 500 characters)"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 400;
-                return;
-            }
+            const std::string name(body->string(Body::NAME));
+            std::string_view description = body->string(Body::DESCRIPTION);
+            int createdBy = body->integer(Body::CREATED_BY);
+            parseSpan.end();
 
-            int createdBy = j["created_by"].get<int>();
-            auto creator = db_.getUserById(createdBy);
+            auto creator = traced("db_user", [&] { return db_.getUserById(createdBy); });
             if (!creator) {
-                json error = {{"error", "Creator user not found"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 404;
+                sendError<"Creator user not found">(res, 404);
                 return;
             }
 
-            auto room = db_.getRoomByName(name);
+            auto room = traced("db_room_name", [&] { return db_.getRoomByName(name); });
             if (room) {
-                json error = {{"error", "Room name already exists"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 409;
+                sendError<"Room name already exists">(res, 409);
                 return;
             }
 
-            auto createdRoom = db_.createRoom(
-                name,
-                description,
-                createdBy,
-                j.value("is_private", false)
-            );
+            auto createdRoom = traced("db_insert", [&] {
+                return db_.createRoom(
+                    name,
+                    std::string(description),
+                    createdBy,
+                    body->boolean(Body::IS_PRIVATE)
+                );
+            });
 
             if (!createdRoom) {
-                json error = {{"error", "Failed to create room"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 500;
+                sendError<"Failed to create room">(res, 500);
                 return;
             }
 
-            json response = {
-                {"id", createdRoom->id},
-                {"name", createdRoom->name},
-                {"description", createdRoom->description},
-                {"created_by", createdRoom->created_by},
-                {"created_at", createdRoom->created_at},
-                {"is_private", createdRoom->is_private},
-                {"message", "Room created successfully"}
-            };
+            versions_.bumpRoom(createdRoom->id);
+            versions_.bumpRoomList();
+            cache_.invalidateRoomList();
 
-            res.set_content(response.dump(), "application/json");
-            res.status = 201;
+            TraceSpan serializeSpan("serialize");
+
+            JsonWriter response = JsonWriter::forResponse();
+            response.beginObject();
+            JsonResponses::writeRoomFields(response, *createdRoom);
+            response
+                .field("message", "Room created successfully")
+                .endObject();
+
+            sendJson(res, 201, response);
 
-        } catch (json::parse_error& e) {
-            json error = {{"error", "Invalid JSON format"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 400;
         } catch (const std::exception& e) {
             std::cerr << "Create room error: " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 
@@ -230,28 +184,21 @@ public:
         try {
             int userId = std::stoi(req.matches[1]);
 
-            auto rooms = db_.getRoomsByUser(userId);
-            json response = json::array();
+            auto rooms = traced("db_rooms", [&] { return db_.getRoomsByUser(userId); });
+            TraceSpan serializeSpan("serialize");
+            JsonWriter response = JsonWriter::forResponse();
+            response.beginArray();
 
             for (const auto& room : rooms) {
-                response.emplace_back(json{
-                    {"id", room.id},
-                    {"name", room.name},
-                    {"description", room.description},
-                    {"created_by", room.created_by},
-                    {"created_at", room.created_at},
-                    {"is_private", room.is_private}
-                });
+                JsonResponses::writeRoom(response, room);
             }
 
-            res.set_content(response.dump(), "application/json");
-            res.status = 200;
+            response.endArray();
+            sendJson(res, 200, response);
 
         } catch (const std::exception& e) {
             std::cerr << "Get user rooms error: " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 
@@ -261,95 +208,167 @@ public:
     void getRoomMembers(const httplib::Request& req, httplib::Response& res) {
         try {
             int roomId = std::stoi(req.matches[1]);
+            const std::string etag = versions_.roomTag('U', roomId);
+            if (ConditionalGet::notModified(req, res, etag)) {
+                return;
+            }
 
-            auto members = db_.getRoomMembers(roomId);
-            json response = json::array();
+            auto members = traced("db_members", [&] { return db_.getRoomMembers(roomId); });
+            TraceSpan serializeSpan("serialize");
+            JsonWriter response = JsonWriter::forResponse();
+            response.beginArray();
 
             for (const auto& user : members) {
-                response.emplace_back(json{
-                    {"id", user.id},
-                    {"username", user.username},
-                    {"email", user.email}
-                });
+                response.beginObject();
+                JsonResponses::writeUserSummaryFields(response, user);
+                response.endObject();
             }
 
-            res.set_content(response.dump(), "application/json");
-            res.status = 200;
+            response.endArray();
+            RequestContext::current().throwIfAbandoned();
+            ConditionalGet::tag(res, etag);
+            sendJson(res, 200, response);
 
         } catch (const std::exception& e) {
             std::cerr << "Get room members error: " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 
     /**
-     * POST /api/rooms/:id/members - Add user to room
+     * GET /api/rooms/:id/snapshot - Room, members and latest messages in one response
+     * Everything a client needs to open a room, read in one transaction and serialized once.
+     * Any write to the room bumps its version, so one tag covers all three parts.
      */
-    void addUserToRoom(const httplib::Request& req, httplib::Response& res) {
+    void getRoomSnapshot(const httplib::Request& req, httplib::Response& res) {
         try {
             int roomId = std::stoi(req.matches[1]);
-            json j = json::parse(req.body);
+            const std::string etag = versions_.roomTag('S', roomId);
+            if (ConditionalGet::notModified(req, res, etag)) {
+                return;
+            }
 
-            static const std::set<std::string> allowedFields = {
-                "user_id", "role"
-            };
+            constexpr int DEFAULT_LIMIT = 50;
+            constexpr int MAX_LIMIT = 200;
+
+            int limit = req.has_param("limit") ? std::stoi(req.get_param_value("limit")) : DEFAULT_LIMIT;
+            if (limit < 1 || limit > MAX_LIMIT) {
+                sendError<"limit must be between 1 and 200">(res, 400);
+                return;
+            }
+
+            // Only the default snapshot is cached, like the first message page
+            const bool defaultLimit = limit == DEFAULT_LIMIT;
+            if (defaultLimit) {
+                if (auto cached = cache_.get('S', roomId, etag)) {
+                    ConditionalGet::tag(res, etag);
+                    JsonResponses::sendBody(res, 200, *cached);
+                    return;
+                }
+            }
+
+            auto snapshot = traced("db_snapshot", [&] { return db_.getRoomSnapshot(roomId, limit); });
 
-            auto invalidFields = validateAllowedFields(j, allowedFields);
-            if (!invalidFields.empty()) {
-                sendInvalidFieldsError(res, invalidFields, allowedFields);
+            if (!snapshot) {
+                sendError<"Room not found">(res, 404);
                 return;
             }
 
-            if (!j.contains("user_id")) {
-                json error = {{"error", "Missing required field: user_id"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 400;
+            TraceSpan serializeSpan("serialize");
+            JsonWriter response = JsonWriter::forResponse();
+            response.beginObject();
+
+            response.key("room");
+            JsonResponses::writeRoom(response, snapshot->room);
+            // Where GET /api/rooms/:id/changes picks up from this snapshot
+            response.field("change_seq", snapshot->room.change_seq);
+
+            response.key("members").beginArray();
+            for (const auto& user : snapshot->members) {
+                response.beginObject();
+                JsonResponses::writeUserSummaryFields(response, user);
+                response.endObject();
+            }
+            response.endArray();
+
+            response.key("messages").beginArray();
+            for (const auto& message : snapshot->messages) {
+                JsonResponses::writeMessage(response, message);
+            }
+            response.endArray();
+
+            response.endObject();
+
+            RequestContext::current().throwIfAbandoned();
+            if (defaultLimit) {
+                cache_.put('S', roomId, etag, response.str());
+            }
+            ConditionalGet::tag(res, etag);
+            sendJson(res, 200, response);
+
+        } catch (const std::exception& e) {
+            std::cerr << "Get room snapshot error: " << e.what() << std::endl;
+            sendError<"Internal server error">(res, 500);
+        }
+    }
+
+    /**
+     * POST /api/rooms/:id/members - Add user to room
+     */
+    void addUserToRoom(const httplib::Request& req, httplib::Response& res) {
+        try {
+            int roomId = std::stoi(req.matches[1]);
+            TraceSpan parseSpan("parse");
+            JsonReader reader(req.body);
+            using Body = RequestBodies::AddRoomMember;
+            auto body = Body::SCHEMA.decode(reader, res);
+            if (!body) {
                 return;
             }
 
-            int userId = j["user_id"];
-            std::string role = j.value("role", "member");
+            int userId = body->integer(Body::USER_ID);
+            const std::string role(body->string(Body::ROLE, "member"));
 
-            auto room = db_.getRoomById(roomId);
+            parseSpan.end();
+
+            auto room = traced("db_room", [&] { return db_.getRoomById(roomId); });
             if (!room) {
-                json error = {{"error", "Room not found"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 404;
+                sendError<"Room not found">(res, 404);
                 return;
             }
 
-            auto user = db_.getUserById(userId);
+            auto user = traced("db_user", [&] { return db_.getUserById(userId); });
             if (!user) {
-                json error = {{"error", "User not found"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 404;
+                sendError<"User not found">(res, 404);
                 return;
             }
 
-            if (db_.isUserInRoom(userId, roomId)) {
-                json error = {{"error", "User is already a member of the room"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 409;
+            if (traced("db_membership", [&] { return db_.isUserInRoom(userId, roomId); })) {
+                sendError<"User is already a member of the room">(res, 409);
                 return;
             }
 
-            bool success = db_.addUserToRoom(userId, roomId, role);
+            bool success = traced("db_insert", [&] { return db_.addUserToRoom(userId, roomId, role); });
 
             if (!success) {
-                json error = {{"error", "Failed to add user to room"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 500;
+                sendError<"Failed to add user to room">(res, 500);
                 return;
             }
 
-            json response = {
-                {"message", "User added to room successfully"},
-                {"room_id", roomId},
-                {"user_id", userId},
-                {"role", role}
-            };
+            versions_.bumpRoom(roomId);
+
+            TraceSpan serializeSpan("serialize");
+
+            JsonWriter response = JsonWriter::forResponse();
+            response.beginObject()
+                .field("message", "User added to room successfully")
+                .field("room_id", roomId)
+                .field("user_id", userId)
+                .field("role", role)
+                .endObject();
+
+            sendJson(res, 200, response);
+            serializeSpan.end();
 
             json event = {
                 {"event_type", "user.joined_room"},
@@ -361,20 +380,11 @@ public:
                 {"role", role}
             };
 
-            rabbitmq_.publishEvent("user.joined_room", event);
-
-            res.set_content(response.dump(), "application/json");
-            res.status = 200;
+            traced("publish", [&] { rabbitmq_.publishEvent("user.joined_room", event); });
 
-        } catch (json::parse_error& e) {
-            json error = {{"error", "Invalid JSON format"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 400;
         } catch (const std::exception& e) {
             std::cerr << "Add user to room error: " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 
@@ -384,90 +394,65 @@ public:
     void updateRoom(const httplib::Request& req, httplib::Response& res) {
         try {
             int roomId = std::stoi(req.matches[1]);
-            json j = json::parse(req.body);
-
-            static const std::set<std::string> allowedFields = {
-                "name", "description"
-            };
-
-            auto invalidFields = validateAllowedFields(j, allowedFields);
-            if (!invalidFields.empty()) {
-                sendInvalidFieldsError(res, invalidFields, allowedFields);
+            TraceSpan parseSpan("parse");
+            JsonReader reader(req.body);
+            using Body = RequestBodies::UpdateRoom;
+            auto body = Body::SCHEMA.decode(reader, res);
+            if (!body) {
                 return;
             }
 
-            auto room = db_.getRoomById(roomId);
+            parseSpan.end();
+
+            auto room = traced("db_room", [&] { return db_.getRoomById(roomId); });
 
             if (!room) {
-                json error = {{"error", "Room not found"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 404;
+                sendError<"Room not found">(res, 404);
                 return;
             }
             
-            if (j.contains("name")) {
-                const std::string& name = j["name"].get_ref<const std::string&>();
-                if (!Validator::isValidRoomName(name)) {
-                    json error = {{"error", "Invalid room name (must be 1-100 characters)"}};
-                    res.set_content(error.dump(), "application/json");
-                    res.status = 400;
-                    return;
-                }
+            if (body->has(Body::NAME)) {
+                const std::string name(body->string(Body::NAME));
 
-                auto currentRoom = db_.getRoomByName(name);
+                auto currentRoom = traced("db_room_name", [&] { return db_.getRoomByName(name); });
                 if (currentRoom && currentRoom->id != roomId) {
-                    json error = {{"error", "Room name already exists"}};
-                    res.set_content(error.dump(), "application/json");
-                    res.status = 409;
+                    sendError<"Room name already exists">(res, 409);
                     return;
                 }
 
                 room->name = name;
             }
 
-            if (j.contains("description")) {
-                const std::string& description = j["description"].get_ref<const std::string&>();
-                if (!Validator::isValidRoomDescription(description)) {
-                    json error = {{"error", "Description too long (max 500 characters)"}};
-                    res.set_content(error.dump(), "application/json");
-                    res.status = 400;
-                    return;
-                }
-
-                room->description = description;
+            if (body->has(Body::DESCRIPTION)) {
+                room->description = body->string(Body::DESCRIPTION);
             }
 
-            bool success = db_.updateRoom(room->id, room->name, room->description);
+            bool success = traced("db_update", [&] { return db_.updateRoom(room->id, room->name, room->description); });
 
             if (!success) {
-                json error = {{"error", "Failed to update room"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 500;
+                sendError<"Failed to update room">(res, 500);
                 return;
             }
 
-            json response = {
-                {"id", room->id},
-                {"name", room->name},
-                {"description", room->description},
-                {"created_by", room->created_by},
-                {"created_at", room->created_at},
-                {"is_private", room->is_private},
-                {"message", "Room updated successfully"}
-            };
+            versions_.bumpRoom(room->id);
+            versions_.bumpRoomList();
+            cache_.invalidateRoom(room->id);
+            cache_.invalidateRoomList();
+
+            TraceSpan serializeSpan("serialize");
+
+            JsonWriter response = JsonWriter::forResponse();
+            response.beginObject();
+            JsonResponses::writeRoomFields(response, *room);
+            response
+                .field("message", "Room updated successfully")
+                .endObject();
 
-            res.set_content(response.dump(), "application/json");
-            res.status = 200;
+            sendJson(res, 200, response);
 
-        } catch (json::parse_error& e) {
-            json error = {{"error", "Invalid JSON format"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 400;
         } catch (const std::exception& e) {
             std::cerr << "Update room error: " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 
@@ -478,33 +463,32 @@ public:
         try {
             int roomId = std::stoi(req.matches[1]);
 
-            auto room = db_.getRoomById(roomId);
+            auto room = traced("db_room", [&] { return db_.getRoomById(roomId); });
 
             if (!room) {
-                json error = {{"error", "Room not found"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 404;
+                sendError<"Room not found">(res, 404);
                 return;
             }
 
-            bool success = db_.deleteRoom(roomId);
+            bool success = traced("db_delete", [&] { return db_.deleteRoom(roomId); });
 
             if (!success) {
-                json error = {{"error", "Failed to delete room"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 500;
+                sendError<"Failed to delete room">(res, 500);
                 return;
             }
 
-            json response = {{"message", "Room deleted successfully"}};
-            res.set_content(response.dump(), "application/json");
-            res.status = 200;
+            versions_.bumpRoom(roomId);
+            versions_.bumpRoomList();
+            cache_.invalidateRoom(roomId);
+            cache_.invalidateRoomList();
+
+            TraceSpan serializeSpan("serialize");
+
+            sendNotice<"Room deleted successfully">(res, 200);
 
         } catch (const std::exception& e) {
             std::cerr << "Delete room error: " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 
@@ -516,52 +500,46 @@ public:
             int roomId = std::stoi(req.matches[1]);
             int userId = std::stoi(req.matches[2]);
 
-            auto room = db_.getRoomById(roomId);
+            auto room = traced("db_room", [&] { return db_.getRoomById(roomId); });
             if (!room) {
-                json error = {{"error", "Room not found"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 404;
+                sendError<"Room not found">(res, 404);
                 return;
             }
 
-            auto user = db_.getUserById(userId);
+            auto user = traced("db_user", [&] { return db_.getUserById(userId); });
             if (!user) {
-                json error = {{"error", "User not found"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 404;
+                sendError<"User not found">(res, 404);
                 return;
             }
 
-            if (!db_.isUserInRoom(userId, roomId)) {
-                json error = {{"error", "User is not a member of the room"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 404;
+            if (!traced("db_membership", [&] { return db_.isUserInRoom(userId, roomId); })) {
+                sendError<"User is not a member of the room">(res, 404);
                 return;
             }
 
-            bool success = db_.removeUserFromRoom(userId, roomId);
+            bool success = traced("db_delete", [&] { return db_.removeUserFromRoom(userId, roomId); });
 
             if (!success) {
-                json error = {{"error", "Failed to remove user from room"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 500;
+                sendError<"Failed to remove user from room">(res, 500);
                 return;
             }
 
-            json response = {
-                {"message", "User removed from room successfully"},
-                {"room_id", roomId},
-                {"user_id", userId}
-            };
+            versions_.bumpRoom(roomId);
+
+            TraceSpan serializeSpan("serialize");
+
+            JsonWriter response = JsonWriter::forResponse();
+            response.beginObject()
+                .field("message", "User removed from room successfully")
+                .field("room_id", roomId)
+                .field("user_id", userId)
+                .endObject();
 
-            res.set_content(response.dump(), "application/json");
-            res.status = 200;
+            sendJson(res, 200, response);
 
         } catch (const std::exception& e) {
             std::cerr << "Remove user from room error:  " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 };
\ No newline at end of file
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+#include "../external/httplib.h"
+#include "../external/json.hpp"
+#include "../utils/JsonResponses.hpp"
+#include "../database/Database.h"
+#include "../realtime/RoomHub.hpp"
+#include "../routing/ServerOptions.hpp"
+#include "../utils/RequestTrace.hpp"
+
+using json = nlohmann::json;
+using JsonResponses::sendError;
+
+/**
+ * Live room streams (Server-Sent Events)
+ * Each stream holds one worker thread for as long as it is open, so the number of
+ * concurrent streams is capped; the server's thread pool is sized for that cap plus
+ * the threads that serve ordinary requests.
+ */
+class StreamHandlers {
+private:
+    Database& db_;
+    RoomHub& hub_;
+    const std::chrono::milliseconds heartbeat_;
+    const size_t maxStreams_;
+    std::atomic<size_t> openStreams_{0};
+
+    static constexpr std::string_view PREAMBLE = "retry: 3000\n\n";
+    static constexpr std::string_view HEARTBEAT = ": keep-alive\n\n";
+    static constexpr std::string_view EVICTED =
+        "event: evicted\ndata: {\"reason\":\"consumer too slow, reconnect with Last-Event-ID\"}\n\n";
+
+public:
+    StreamHandlers(Database& db, RoomHub& hub, const ServerOptions& options)
+        : db_(db),
+          hub_(hub),
+          heartbeat_(std::chrono::seconds(options.sseHeartbeatSeconds)),
+          maxStreams_(options.sseMaxStreams) {
+    }
+
+    json stats() const {
+        json stats = hub_.stats();
+        stats["open_streams"] = openStreams_.load(std::memory_order_relaxed);
+        stats["max_streams"] = maxStreams_;
+        return stats;
+    }
+
+    /**
+     * GET /api/rooms/:id/stream - message.created / message.updated / message.deleted as SSE
+     */
+    void streamRoom(const httplib::Request& req, httplib::Response& res) {
+        try {
+            int roomId = std::stoi(req.matches[1]);
+
+            auto room = traced("db_room", [&] { return db_.getRoomById(roomId); });
+            if (!room) {
+                sendError<"Room not found">(res, 404);
+                return;
+            }
+
+            if (openStreams_.fetch_add(1, std::memory_order_relaxed) >= maxStreams_) {
+                openStreams_.fetch_sub(1, std::memory_order_relaxed);
+                res.set_header("Retry-After", "5");
+                sendError<"Too many open streams">(res, 503);
+                return;
+            }
+
+            std::optional<std::string_view> lastEventId;
+            const std::string lastEventHeader = req.get_header_value("Last-Event-ID");
+            if (!lastEventHeader.empty()) {
+                lastEventId = lastEventHeader;
+            }
+            RoomHub::SubscriberPtr subscriber = hub_.subscribe(roomId, lastEventId);
+
+            res.set_header("Cache-Control", "no-cache");
+            res.set_header("X-Accel-Buffering", "no");
+            res.set_chunked_content_provider(
+                "text/event-stream",
+                [this, subscriber, started = false, frames = std::vector<RoomHub::Frame>{}, batch = std::string{}](
+                    size_t, httplib::DataSink& sink) mutable {
+                    batch.clear();
+                    if (!started) {
+                        started = true;
+                        batch += PREAMBLE;
+                    }
+
+                    if (!subscriber->next(frames, heartbeat_)) {
+                        if (subscriber->evicted()) {
+                            batch += EVICTED;
+                        }
+                        if (!batch.empty() && !sink.write(batch.data(), batch.size())) {
+                            return false;
+                        }
+                        sink.done();
+                        return true;
+                    }
+
+                    if (frames.empty()) {
+                        batch += HEARTBEAT;
+                    }
+                    // Everything queued since the last wake-up goes out as one chunk
+                    for (const RoomHub::Frame& frame : frames) {
+                        batch += *frame;
+                    }
+                    return sink.write(batch.data(), batch.size());
+                },
+                [this, subscriber](bool) {
+                    hub_.unsubscribe(subscriber);
+                    openStreams_.fetch_sub(1, std::memory_order_relaxed);
+                });
+            res.status = 200;
+
+        } catch (const std::exception& e) {
+            std::cerr << "Stream room error: " << e.what() << std::endl;
+            sendError<"Internal server error">(res, 500);
+        }
+    }
+};
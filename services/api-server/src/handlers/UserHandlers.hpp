@@ -2,16 +2,21 @@
 
 #include <iostream>
 #include <string>
-#include <set>
-#include <vector>
 #include "../external/httplib.h"
 #include "../external/json.hpp"
+#include "../utils/JsonResponses.hpp"
+#include "RequestBodies.hpp"
 #include "../database/Database.h"
 #include "../utils/PasswordHelper.hpp"
 #include "../utils/Validator.hpp"
 #include "../clients/RabbitMQClient.hpp"
+#include "../utils/RequestTrace.hpp"
+#include "../cache/ChangeVersions.hpp"
 
 using json = nlohmann::json;
+using JsonResponses::sendError;
+using JsonResponses::sendJson;
+using JsonResponses::sendNotice;
 
 /**
  * User-related HTTP Request Handlers
@@ -21,52 +26,11 @@ class UserHandlers {
 private:
     Database& db_;
     RabbitMQClient& rabbitmq_;
-
-    /**
-     * Validate that JSON contains only allowed fields
-     */
-    static std::vector<std::string> validateAllowedFields(
-        const json& j,
-        const std::set<std::string>& allowedFields
-    ) {
-        std::vector<std::string> invalidFields;
-        
-        for (auto it = j.begin(); it != j.end(); ++it) {
-            if (allowedFields.find(it.key()) == allowedFields.end()) {
-                invalidFields.emplace_back(it.key());
-            }
-        }
-        
-        return invalidFields;
-    }
-
-    /**
-     * Send error response for invalid fields
-     */
-    static void sendInvalidFieldsError(
-        httplib::Response& res,
-        const std::vector<std::string>& invalidFields,
-        const std::set<std::string>& allowedFields
-    ) {
-        std::string fieldsList;
-        for (size_t i = 0; i < invalidFields.size(); ++i) {
-            if (i > 0) {
-                fieldsList += ", ";
-            }
-            fieldsList += "'" + invalidFields[i] + "'";
-        }
-        
-        json error = {
-            {"error", "Invalid fields: " + fieldsList},
-            {"allowed_fields", allowedFields}
-        };
-        res.set_content(error.dump(), "application/json");
-        res.status = 400;
-    }
+    ChangeVersions& versions_;
 
 public:
-    UserHandlers(Database& db, RabbitMQClient& rabbitmq)
-        : db_(db), rabbitmq_(rabbitmq) {
+    UserHandlers(Database& db, RabbitMQClient& rabbitmq, ChangeVersions& versions)
+        : db_(db), rabbitmq_(rabbitmq), versions_(versions) {
     }
 
     /**
@@ -74,55 +38,22 @@ public:
      */
     void registerUser(const httplib::Request& req, httplib::Response& res) {
         try {
-            json j = json::parse(req.body);
-
-            static const std::set<std::string> allowedFields = {
-                "username", "email", "password"
-            };
-
-            auto invalidFields = validateAllowedFields(j, allowedFields);
-            if (!invalidFields.empty()) {
-                sendInvalidFieldsError(res, invalidFields, allowedFields);
-                return;
-            }
-
-            if (!j.contains("username") || !j.contains("email") || !j.contains("password")) {
-                json error = {{"error", "Missing required fields:  username, email, password"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 400;
+            TraceSpan parseSpan("parse");
+            JsonReader reader(req.body);
+            using Body = RequestBodies::RegisterUser;
+            auto body = Body::SCHEMA.decode(reader, res);
+            if (!body) {
                 return;
             }
 
-            const std::string& username = j["username"].get_ref<const std::string&>();
-            const std::string& email = j["email"].get_ref<const std::string&>();
-            const std::string& password = j["password"].get_ref<const std::string&>();
-
-            if (!Validator::isValidUsername(username)) {
-                json error = {{"error", "Invalid username format"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 400;
-                return;
-            }
-
-            if (!Validator::isValidEmail(email)) {
-                json error = {{"error", "Invalid email format"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 400;
-                return;
-            }
-
-            if (!Validator::isValidPassword(password)) {
-                json error = {{"error", "Password must be at least 8 characters long and contain both letters and numbers"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 400;
-                return;
-            }
+            const std::string username(body->string(Body::USERNAME));
+            const std::string email(body->string(Body::EMAIL));
+            const std::string password(body->string(Body::PASSWORD));
+            parseSpan.end();
 
-            auto user = db_.getUserByUsername(username);
+            auto user = traced("db_user", [&] { return db_.getUserByUsername(username); });
             if (user) {
-                json error = {{"error", "Username already exists"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 409;
+                sendError<"Username already exists">(res, 409);
                 return;
             }
 
@@ -131,21 +62,24 @@ public:
             user->password_hash = PasswordHelper::hashPassword(password);
             user->is_active = true;
 
-            auto created = db_.createUser(*user);
+            auto created = traced("db_insert", [&] { return db_.createUser(*user); });
 
             if (!created) {
-                json error = {{"error", "Failed to create user"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 500;
+                sendError<"Failed to create user">(res, 500);
                 return;
             }
 
-            json response = {
-                {"id", created->id},
-                {"username", created->username},
-                {"email", created->email},
-                {"message", "User registered successfully"}
-            };
+            TraceSpan serializeSpan("serialize");
+
+            JsonWriter response = JsonWriter::forResponse();
+            response.beginObject();
+            JsonResponses::writeUserSummaryFields(response, *created);
+            response
+                .field("message", "User registered successfully")
+                .endObject();
+
+            sendJson(res, 201, response);
+            serializeSpan.end();
 
             json event = {
                 {"event_type", "user.registered"},
@@ -155,20 +89,11 @@ public:
                 {"timestamp", created->created_at}
             };
 
-            rabbitmq_.publishEvent("user.registered", event);
-
-            res.set_content(response.dump(), "application/json");
-            res.status = 201;
+            traced("publish", [&] { rabbitmq_.publishEvent("user.registered", event); });
 
-        } catch (json::parse_error& e) {
-            json error = {{"error", "Invalid JSON format"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 400;
         } catch (const std::exception& e) {
             std::cerr << "Register error: " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 
@@ -177,71 +102,51 @@ public:
      */
     void login(const httplib::Request& req, httplib::Response& res) {
         try {
-            json j = json::parse(req.body);
-
-            static const std::set<std::string> allowedFields = {
-                "username", "password"
-            };
-
-            auto invalidFields = validateAllowedFields(j, allowedFields);
-            if (!invalidFields.empty()) {
-                sendInvalidFieldsError(res, invalidFields, allowedFields);
-                return;
-            }
-
-            if (!j.contains("username") || !j.contains("password")) {
-                json error = {{"error", "Missing required fields: username, password"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 400;
+            TraceSpan parseSpan("parse");
+            JsonReader reader(req.body);
+            using Body = RequestBodies::Login;
+            auto body = Body::SCHEMA.decode(reader, res);
+            if (!body) {
                 return;
             }
 
-            const std::string& username = j["username"].get_ref<const std::string&>();
-            const std::string& password = j["password"].get_ref<const std::string&>();
+            const std::string username(body->string(Body::USERNAME));
+            const std::string password(body->string(Body::PASSWORD));
             
-            auto user = db_.getUserByUsername(username);
+            parseSpan.end();
+
+            auto user = traced("db_user", [&] { return db_.getUserByUsername(username); });
             if (!user) {
-                json error = {{"error", "Invalid credentials"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 401;
+                sendError<"Invalid credentials">(res, 401);
                 return;
             }
 
             if (!PasswordHelper::verifyPassword(password, user->password_hash)) {
-                json error = {{"error", "Invalid credentials"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 401;
+                sendError<"Invalid credentials">(res, 401);
                 return;
             }
 
             if (!user->is_active) {
-                json error = {{"error", "Account is disabled"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 403;
+                sendError<"Account is disabled">(res, 403);
                 return;
             }
 
-            db_.updateLastLogin(user->id);
+            traced("db_update", [&] { return db_.updateLastLogin(user->id); });
 
-            json response = {
-                {"id", user->id},
-                {"username", user->username},
-                {"email", user->email},
-                {"message", "Login successful"}
-            };
+            TraceSpan serializeSpan("serialize");
+
+            JsonWriter response = JsonWriter::forResponse();
+            response.beginObject();
+            JsonResponses::writeUserSummaryFields(response, *user);
+            response
+                .field("message", "Login successful")
+                .endObject();
 
-            res.set_content(response.dump(), "application/json");
-            res.status = 200;
+            sendJson(res, 200, response);
 
-        } catch (json::parse_error& e) {
-            json error = {{"error", "Invalid JSON"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 400;
         } catch (const std::exception& e) {
             std::cerr << "Login error: " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 
@@ -251,29 +156,25 @@ public:
     void getUserById(const httplib::Request& req, httplib::Response& res) {
         try {
             int userId = std::stoi(req.matches[1]);
-            auto user = db_.getUserById(userId);
+            auto user = traced("db_user", [&] { return db_.getUserById(userId); });
 
             if (!user) {
-                json error = {{"error", "User not found"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 404;
+                sendError<"User not found">(res, 404);
                 return;
             }
 
-            json response = {
-                {"id", user->id},
-                {"username", user->username},
-                {"email", user->email}
-            };
+            TraceSpan serializeSpan("serialize");
+
+            JsonWriter response = JsonWriter::forResponse();
+            response.beginObject();
+            JsonResponses::writeUserSummaryFields(response, *user);
+            response.endObject();
 
-            res.set_content(response.dump(), "application/json");
-            res.status = 200;
+            sendJson(res, 200, response);
 
         } catch (const std::exception& e) {
             std::cerr << "Get user error: " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 
@@ -282,27 +183,26 @@ public:
      */
     void getAllUsers(const httplib::Request&, httplib::Response& res) {
         try {
-            auto users = db_.getAllUsers();
-            json response = json::array();
+            auto users = traced("db_users", [&] { return db_.getAllUsers(); });
+            TraceSpan serializeSpan("serialize");
+            JsonWriter response = JsonWriter::forResponse();
+            response.beginArray();
 
             for (const auto& user : users) {
-                response.emplace_back(json{
-                    {"id", user.id},
-                    {"username", user.username},
-                    {"email", user.email},
-                    {"created_at", user.created_at},
-                    {"is_active", user.is_active}
-                });
+                response.beginObject();
+                JsonResponses::writeUserSummaryFields(response, user);
+                response
+                    .field("created_at", user.created_at)
+                    .field("is_active", user.is_active)
+                    .endObject();
             }
 
-            res.set_content(response.dump(), "application/json");
-            res.status = 200;
+            response.endArray();
+            sendJson(res, 200, response);
 
         } catch (const std::exception& e) {
             std::cerr << "Get users error: " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 
@@ -312,82 +212,60 @@ public:
     void updateUser(const httplib::Request& req, httplib::Response& res) {
         try {
             int userId = std::stoi(req.matches[1]);
-            json j = json::parse(req.body);
-
-            static const std::set<std::string> allowedFields = {
-                "email", "password", "is_active"
-            };
-
-            auto invalidFields = validateAllowedFields(j, allowedFields);
-            if (!invalidFields.empty()) {
-                sendInvalidFieldsError(res, invalidFields, allowedFields);
+            TraceSpan parseSpan("parse");
+            JsonReader reader(req.body);
+            using Body = RequestBodies::UpdateUser;
+            auto body = Body::SCHEMA.decode(reader, res);
+            if (!body) {
                 return;
             }
 
-            auto user = db_.getUserById(userId);
+            parseSpan.end();
+
+            auto user = traced("db_user", [&] { return db_.getUserById(userId); });
 
             if (!user) {
-                json error = {{"error", "User not found"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 404;
+                sendError<"User not found">(res, 404);
                 return;
             }
 
-            if (j.contains("email")) {
-                const std::string& email = j["email"].get_ref<const std::string&>();
-                if (!Validator::isValidEmail(email)) {
-                    json error = {{"error", "Invalid email format"}};
-                    res.set_content(error.dump(), "application/json");
-                    res.status = 400;
-                    return;
-                }
-                user->email = email;
+            if (body->has(Body::EMAIL)) {
+                user->email = body->string(Body::EMAIL);
             }
 
-            if (j.contains("password")) {
-                const std::string& password = j["password"].get_ref<const std::string&>();
-                if (!Validator::isValidPassword(password)) {
-                    json error = {{"error", "Password must be at least 8 characters and contain letters and numbers"}};
-                    res.set_content(error.dump(), "application/json");
-                    res.status = 400;
-                    return;
-                }
-                user->password_hash = PasswordHelper::hashPassword(password);
+            if (body->has(Body::PASSWORD)) {
+                user->password_hash = PasswordHelper::hashPassword(std::string(body->string(Body::PASSWORD)));
             }
 
-            if (j.contains("is_active")) {
-                user->is_active = j["is_active"];
+            if (body->has(Body::IS_ACTIVE)) {
+                user->is_active = body->boolean(Body::IS_ACTIVE);
             }
 
-            bool success = db_.updateUser(*user);
+            bool success = traced("db_update", [&] { return db_.updateUser(*user); });
 
             if (!success) {
-                json error = {{"error", "Failed to update user"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 500;
+                sendError<"Failed to update user">(res, 500);
                 return;
             }
 
-            json response = {
-                {"id", user->id},
-                {"username", user->username},
-                {"email", user->email},
-                {"is_active", user->is_active},
-                {"message", "User updated successfully"}
-            };
+            // Member lists embed user details
+            versions_.bumpAll();
+
+            TraceSpan serializeSpan("serialize");
 
-            res.set_content(response.dump(), "application/json");
-            res.status = 200;
+            JsonWriter response = JsonWriter::forResponse();
+            response.beginObject();
+            JsonResponses::writeUserSummaryFields(response, *user);
+            response
+                .field("is_active", user->is_active)
+                .field("message", "User updated successfully")
+                .endObject();
+
+            sendJson(res, 200, response);
 
-        } catch (json::parse_error& e) {
-            json error = {{"error", "Invalid JSON format"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 400;
         } catch (const std::exception& e) {
             std::cerr << "Update user error: " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 
@@ -397,33 +275,30 @@ public:
     void deleteUser(const httplib::Request& req, httplib::Response& res) {
         try {
             int userId = std::stoi(req. matches[1]);
-            auto user = db_.getUserById(userId);
+            auto user = traced("db_user", [&] { return db_.getUserById(userId); });
 
             if (!user) {
-                json error = {{"error", "User not found"}};
-                res.set_content(error. dump(), "application/json");
-                res.status = 404;
+                sendError<"User not found">(res, 404);
                 return;
             }
 
-            bool success = db_.deleteUser(userId);
+            bool success = traced("db_delete", [&] { return db_.deleteUser(userId); });
 
             if (!success) {
-                json error = {{"error", "Failed to delete user"}};
-                res.set_content(error.dump(), "application/json");
-                res.status = 500;
+                sendError<"Failed to delete user">(res, 500);
                 return;
             }
 
-            json response = {{"message", "User deleted successfully"}};
-            res.set_content(response.dump(), "application/json");
-            res.status = 200;
+            // Deleting a user cascades into memberships, messages and room creators
+            versions_.bumpAll();
+
+            TraceSpan serializeSpan("serialize");
+
+            sendNotice<"User deleted successfully">(res, 200);
 
         } catch (const std::exception& e) {
             std::cerr << "Delete user error: " << e.what() << std::endl;
-            json error = {{"error", "Internal server error"}};
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+            sendError<"Internal server error">(res, 500);
         }
     }
 };
\ No newline at end of file
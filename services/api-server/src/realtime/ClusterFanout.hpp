@@ -0,0 +1,465 @@
+#pragma once
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <sys/time.h>
+#include <unistd.h>
+#include <rabbitmq-c/amqp.h>
+#include <rabbitmq-c/tcp_socket.h>
+#include "../clients/RabbitMQClient.hpp"
+#include "../external/json.hpp"
+#include "RoomHub.hpp"
+
+/**
+ * Cross-node fan-out of room events over the chat_events exchange
+ * With several api_server replicas behind a load balancer, a message posted on one node
+ * must reach SSE / WebSocket / long-poll clients connected to the others.
+ *
+ * - Out: every event published to the local RoomHub is sent with routing key
+ *   fanout.room.<id>, transient, with this node's id as app_id and the event type as type
+ * - In: each node consumes from its own exclusive, auto-delete queue, bound only to the
+ *   rooms that currently have local consumers; its own events coming back are dropped
+ *   by node id, the rest are handed to the delivery callback (RoomHub::deliver)
+ *
+ * - Invalidations: every change-version bump (room, member and message writes) is sent
+ *   as invalidate.<what>.<id> with an empty body. Cached responses and ETags depend on
+ *   them whether or not anyone is streaming, so every node binds invalidate.# for as
+ *   long as it is connected and hands them to the invalidation callback.
+ *
+ * Bindings are made as soon as a room gets its first local consumer and dropped after
+ * the room has had none for two sweeps, so clients that reconnect or re-poll do not
+ * churn bindings. The consumer has its own broker connection and thread (a rabbitmq-c
+ * connection is not thread-safe) and reconnects, re-binding every room, if it is lost.
+ */
+class ClusterFanout {
+public:
+    struct Options {
+        std::string host;
+        int port{5672};
+        std::string user;
+        std::string password;
+    };
+
+    using Delivery = std::function<void(int roomId, std::string_view type, std::string_view data)>;
+    using Invalidation = std::function<void(std::string_view what, int roomId)>;
+
+    ClusterFanout(RabbitMQClient& publisher, RoomHub& hub, const Options& options, Delivery deliver,
+                  Invalidation invalidate)
+        : publisher_(publisher),
+          hub_(hub),
+          options_(options),
+          deliver_(std::move(deliver)),
+          invalidate_(std::move(invalidate)),
+          nodeId_(makeNodeId()) {
+    }
+
+    ~ClusterFanout() {
+        stop();
+    }
+
+    ClusterFanout(const ClusterFanout&) = delete;
+    ClusterFanout& operator=(const ClusterFanout&) = delete;
+
+    void start() {
+        consumer_ = std::thread([this] { run(); });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) {
+                return;
+            }
+            stopping_ = true;
+        }
+        stopCond_.notify_all();
+        if (consumer_.joinable()) {
+            consumer_.join();
+        }
+    }
+
+    /**
+     * RoomHub relay: send a locally published event to the other nodes
+     */
+    void relay(int roomId, std::string_view type, std::string_view data) {
+        amqp_basic_properties_t props{};
+        props._flags = AMQP_BASIC_CONTENT_TYPE_FLAG | AMQP_BASIC_DELIVERY_MODE_FLAG |
+                       AMQP_BASIC_TYPE_FLAG | AMQP_BASIC_APP_ID_FLAG;
+        props.content_type = amqp_cstring_bytes("application/json");
+        props.delivery_mode = 1;  // transient: a live event is worthless after a broker restart
+        props.type = bytesOf(type);
+        props.app_id = bytesOf(nodeId_);
+
+        if (publisher_.publish(routingKey(roomId), data, props)) {
+            relayed_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            relayFailures_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * ChangeVersions relay: tell the other nodes what a local write invalidated
+     */
+    void relayInvalidation(std::string_view what, int roomId) {
+        amqp_basic_properties_t props{};
+        props._flags = AMQP_BASIC_DELIVERY_MODE_FLAG | AMQP_BASIC_APP_ID_FLAG;
+        props.delivery_mode = 1;
+        props.app_id = bytesOf(nodeId_);
+
+        std::string key(INVALIDATE_PREFIX);
+        key += what;
+        key += '.';
+        key += std::to_string(roomId);
+        if (publisher_.publish(key, {}, props)) {
+            invalidationsSent_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            relayFailures_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * RoomHub interest hook: make sure roomId is bound (any thread)
+     */
+    void want(int roomId) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (wanted_.insert(roomId).second) {
+            changes_.emplace_back(roomId, true);
+        }
+    }
+
+    nlohmann::json stats() const {
+        size_t rooms = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            rooms = wanted_.size();
+        }
+        return {
+            {"transport", "rabbitmq"},
+            {"node", nodeId_},
+            {"connected", connected_.load(std::memory_order_relaxed)},
+            {"bound_rooms", rooms},
+            {"relayed", relayed_.load(std::memory_order_relaxed)},
+            {"relay_failures", relayFailures_.load(std::memory_order_relaxed)},
+            {"received", received_.load(std::memory_order_relaxed)},
+            {"invalidations_sent", invalidationsSent_.load(std::memory_order_relaxed)},
+            {"invalidations_received", invalidationsReceived_.load(std::memory_order_relaxed)},
+            {"own_events_dropped", echoes_.load(std::memory_order_relaxed)},
+            {"reconnects", reconnects_.load(std::memory_order_relaxed)}
+        };
+    }
+
+private:
+    static constexpr amqp_channel_t CHANNEL = 1;
+    static constexpr std::string_view EXCHANGE = "chat_events";
+    static constexpr std::string_view ROUTING_PREFIX = "fanout.room.";
+    static constexpr std::string_view INVALIDATE_PREFIX = "invalidate.";
+    static constexpr std::chrono::seconds RECONNECT_DELAY{5};
+    static constexpr std::chrono::seconds SWEEP_INTERVAL{5};
+    // How long a consume call may block, i.e. the worst-case delay before a new binding
+    static constexpr suseconds_t POLL_MICROSECONDS = 50000;
+
+    RabbitMQClient& publisher_;
+    RoomHub& hub_;
+    const Options options_;
+    const Delivery deliver_;
+    const Invalidation invalidate_;
+    const std::string nodeId_;
+
+    // Guards wanted_, changes_, idle_ and stopping_
+    mutable std::mutex mutex_;
+    std::condition_variable stopCond_;
+    bool stopping_{false};
+    std::unordered_set<int> wanted_;             // bound, or about to be
+    std::vector<std::pair<int, bool>> changes_;  // (room, bind?) for the consumer thread
+    std::unordered_set<int> idle_;               // wanted rooms with no consumers at the last sweep
+
+    // ---- consumer thread only ----
+    std::thread consumer_;
+    amqp_connection_state_t conn_{nullptr};
+    std::string queue_;
+
+    std::atomic<bool> connected_{false};
+    std::atomic<uint64_t> relayed_{0};
+    std::atomic<uint64_t> relayFailures_{0};
+    std::atomic<uint64_t> received_{0};
+    std::atomic<uint64_t> invalidationsSent_{0};
+    std::atomic<uint64_t> invalidationsReceived_{0};
+    std::atomic<uint64_t> echoes_{0};
+    std::atomic<uint64_t> reconnects_{0};
+
+    static amqp_bytes_t bytesOf(std::string_view text) {
+        amqp_bytes_t bytes;
+        bytes.len = text.size();
+        bytes.bytes = const_cast<char*>(text.data());
+        return bytes;
+    }
+
+    static std::string_view viewOf(const amqp_bytes_t& bytes) {
+        return std::string_view(static_cast<const char*>(bytes.bytes), bytes.len);
+    }
+
+    static std::string routingKey(int roomId) {
+        std::string key(ROUTING_PREFIX);
+        key += std::to_string(roomId);
+        return key;
+    }
+
+    // <hostname>-<random>: unique per process even when replicas share a hostname
+    static std::string makeNodeId() {
+        char host[64] = {};
+        if (gethostname(host, sizeof(host) - 1) != 0) {
+            host[0] = '\0';
+        }
+        std::random_device random;
+        uint64_t salt = (static_cast<uint64_t>(random()) << 32) | random();
+
+        char suffix[17];
+        std::to_chars_result result = std::to_chars(suffix, suffix + 16, salt, 16);
+        *result.ptr = '\0';
+        return std::string(host) + "-" + suffix;
+    }
+
+    bool sleepUnlessStopping(std::chrono::seconds delay) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return !stopCond_.wait_for(lock, delay, [this] { return stopping_; });
+    }
+
+    bool stopping() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stopping_;
+    }
+
+    void run() {
+        while (!stopping()) {
+            if (connect()) {
+                consume();
+                disconnect();
+                if (stopping()) {
+                    break;
+                }
+                reconnects_.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                disconnect();
+            }
+            if (!sleepUnlessStopping(RECONNECT_DELAY)) {
+                break;
+            }
+        }
+    }
+
+    bool connect() {
+        conn_ = amqp_new_connection();
+        amqp_socket_t* socket = conn_ ? amqp_tcp_socket_new(conn_) : nullptr;
+        timeval timeout{5, 0};
+        if (!socket || amqp_socket_open_noblock(socket, options_.host.c_str(), options_.port, &timeout) != AMQP_STATUS_OK) {
+            std::cerr << "Cluster fan-out: cannot reach RabbitMQ at " << options_.host << ":" << options_.port
+                      << ", retrying" << std::endl;
+            return false;
+        }
+
+        if (!ok(amqp_login(conn_, "/", 0, 131072, 0, AMQP_SASL_METHOD_PLAIN,
+                           options_.user.c_str(), options_.password.c_str()), "login")) {
+            return false;
+        }
+
+        amqp_channel_open(conn_, CHANNEL);
+        if (!ok(amqp_get_rpc_reply(conn_), "open channel")) {
+            return false;
+        }
+
+        // Same declaration as the publisher, in case this connection gets there first
+        amqp_exchange_declare(conn_, CHANNEL, bytesOf(EXCHANGE), amqp_cstring_bytes("topic"),
+                              0, 1, 0, 0, amqp_empty_table);
+        if (!ok(amqp_get_rpc_reply(conn_), "declare exchange")) {
+            return false;
+        }
+
+        // Server-named, exclusive, auto-delete: it disappears with this connection
+        amqp_queue_declare_ok_t* declared = amqp_queue_declare(conn_, CHANNEL, amqp_empty_bytes,
+                                                               0, 0, 1, 1, amqp_empty_table);
+        if (!ok(amqp_get_rpc_reply(conn_), "declare queue") || !declared) {
+            return false;
+        }
+        queue_.assign(viewOf(declared->queue));
+
+        // Invalidations concern every node, streaming or not
+        std::string invalidations(INVALIDATE_PREFIX);
+        invalidations += '#';
+        amqp_queue_bind(conn_, CHANNEL, bytesOf(queue_), bytesOf(EXCHANGE), bytesOf(invalidations), amqp_empty_table);
+        if (!ok(amqp_get_rpc_reply(conn_), "bind invalidations")) {
+            return false;
+        }
+
+        amqp_basic_consume(conn_, CHANNEL, bytesOf(queue_), amqp_empty_bytes, 0, 1, 1, amqp_empty_table);
+        if (!ok(amqp_get_rpc_reply(conn_), "consume")) {
+            return false;
+        }
+
+        // A new queue starts with no bindings: bind every room that is still wanted
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            changes_.clear();
+            for (int roomId : wanted_) {
+                changes_.emplace_back(roomId, true);
+            }
+        }
+
+        connected_.store(true, std::memory_order_relaxed);
+        std::cout << "Cluster fan-out connected as node " << nodeId_ << std::endl;
+        return true;
+    }
+
+    void disconnect() {
+        connected_.store(false, std::memory_order_relaxed);
+        if (conn_) {
+            amqp_connection_close(conn_, AMQP_REPLY_SUCCESS);
+            amqp_destroy_connection(conn_);
+            conn_ = nullptr;
+        }
+    }
+
+    static bool ok(const amqp_rpc_reply_t& reply, const char* what) {
+        if (reply.reply_type == AMQP_RESPONSE_NORMAL) {
+            return true;
+        }
+        std::cerr << "Cluster fan-out: failed to " << what << std::endl;
+        return false;
+    }
+
+    /**
+     * Receive until the connection fails or stop() is called
+     */
+    void consume() {
+        auto lastSweep = std::chrono::steady_clock::now();
+
+        while (!stopping()) {
+            if (!applyBindingChanges()) {
+                return;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (now - lastSweep >= SWEEP_INTERVAL) {
+                sweep();
+                lastSweep = now;
+            }
+
+            amqp_maybe_release_buffers(conn_);
+            timeval timeout{0, POLL_MICROSECONDS};
+            amqp_envelope_t envelope;
+            amqp_rpc_reply_t reply = amqp_consume_message(conn_, &envelope, &timeout, 0);
+
+            if (reply.reply_type == AMQP_RESPONSE_NORMAL) {
+                handle(envelope);
+                amqp_destroy_envelope(&envelope);
+                continue;
+            }
+            if (reply.reply_type == AMQP_RESPONSE_LIBRARY_EXCEPTION && reply.library_error == AMQP_STATUS_TIMEOUT) {
+                continue;
+            }
+            std::cerr << "Cluster fan-out: lost the broker connection, reconnecting" << std::endl;
+            return;
+        }
+    }
+
+    bool applyBindingChanges() {
+        std::vector<std::pair<int, bool>> changes;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            changes.swap(changes_);
+        }
+
+        for (size_t i = 0; i < changes.size(); ++i) {
+            auto [roomId, bind] = changes[i];
+            std::string key = routingKey(roomId);
+            if (bind) {
+                amqp_queue_bind(conn_, CHANNEL, bytesOf(queue_), bytesOf(EXCHANGE), bytesOf(key), amqp_empty_table);
+            } else {
+                amqp_queue_unbind(conn_, CHANNEL, bytesOf(queue_), bytesOf(EXCHANGE), bytesOf(key), amqp_empty_table);
+            }
+            if (!ok(amqp_get_rpc_reply(conn_), bind ? "bind room" : "unbind room")) {
+                // The channel is gone; the reconnect re-binds everything in wanted_
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Unbind rooms that had no local consumers at this sweep and the previous one
+     */
+    void sweep() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = wanted_.begin(); it != wanted_.end();) {
+            int roomId = *it;
+            if (hub_.hasLocalInterest(roomId)) {
+                idle_.erase(roomId);
+                ++it;
+            } else if (idle_.insert(roomId).second) {
+                ++it;
+            } else {
+                // A consumer arriving after this point finds the room unwanted and re-binds it
+                idle_.erase(roomId);
+                changes_.emplace_back(roomId, false);
+                it = wanted_.erase(it);
+            }
+        }
+    }
+
+    void handle(const amqp_envelope_t& envelope) {
+        const amqp_basic_properties_t& props = envelope.message.properties;
+        if ((props._flags & AMQP_BASIC_APP_ID_FLAG) && viewOf(props.app_id) == nodeId_) {
+            echoes_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        std::string_view key = viewOf(envelope.routing_key);
+        if (key.starts_with(INVALIDATE_PREFIX)) {
+            handleInvalidation(key.substr(INVALIDATE_PREFIX.size()));
+            return;
+        }
+        if (!(props._flags & AMQP_BASIC_TYPE_FLAG)) {
+            return;
+        }
+        if (!key.starts_with(ROUTING_PREFIX)) {
+            return;
+        }
+        key.remove_prefix(ROUTING_PREFIX.size());
+        int roomId = 0;
+        auto [end, ec] = std::from_chars(key.data(), key.data() + key.size(), roomId);
+        if (ec != std::errc() || end != key.data() + key.size()) {
+            return;
+        }
+
+        received_.fetch_add(1, std::memory_order_relaxed);
+        deliver_(roomId, viewOf(props.type), viewOf(envelope.message.body));
+    }
+
+    // <what>.<room id>
+    void handleInvalidation(std::string_view key) {
+        size_t dot = key.rfind('.');
+        if (dot == std::string_view::npos) {
+            return;
+        }
+        int roomId = 0;
+        std::string_view id = key.substr(dot + 1);
+        auto [end, ec] = std::from_chars(id.data(), id.data() + id.size(), roomId);
+        if (ec != std::errc() || end != id.data() + id.size()) {
+            return;
+        }
+
+        invalidationsReceived_.fetch_add(1, std::memory_order_relaxed);
+        invalidate_(key.substr(0, dot), roomId);
+    }
+};
@@ -0,0 +1,232 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "MpscQueue.hpp"
+
+/**
+ * Single-threaded epoll reactor
+ * File descriptors are registered with a handler that runs on the loop thread whenever
+ * epoll reports events for them. Other threads hand work to the loop with post(): the
+ * task goes onto a lock-free queue and an eventfd wakes epoll_wait, at most once per
+ * burst of posts. Timers share one timerfd armed for the earliest deadline.
+ *
+ * Everything except post() and stop() must be called on the loop thread.
+ */
+class EventLoop {
+public:
+    using Handler = std::function<void(uint32_t events)>;
+    using Task = std::function<void()>;
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr int MAX_EVENTS = 256;
+
+    EventLoop()
+        : epollFd_(epoll_create1(EPOLL_CLOEXEC)),
+          wakeFd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+          timerFd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) {
+        if (valid()) {
+            for (int fd : {wakeFd_, timerFd_}) {
+                epoll_event event{};
+                event.events = EPOLLIN;
+                event.data.fd = fd;
+                epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event);
+            }
+        }
+    }
+
+    ~EventLoop() {
+        if (timerFd_ >= 0) ::close(timerFd_);
+        if (wakeFd_ >= 0) ::close(wakeFd_);
+        if (epollFd_ >= 0) ::close(epollFd_);
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    bool valid() const {
+        return epollFd_ >= 0 && wakeFd_ >= 0 && timerFd_ >= 0;
+    }
+
+    bool add(int fd, uint32_t events, Handler handler) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+            return false;
+        }
+        handlers_[fd] = std::make_shared<Handler>(std::move(handler));
+        return true;
+    }
+
+    bool modify(int fd, uint32_t events) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        return epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &event) == 0;
+    }
+
+    /**
+     * Stop watching fd (the caller still owns and closes it)
+     */
+    void remove(int fd) {
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+        handlers_.erase(fd);
+    }
+
+    /**
+     * Run task on the loop thread; safe from any thread
+     */
+    void post(Task task) {
+        tasks_.push(std::move(task));
+        if (!wakePending_.exchange(true, std::memory_order_acq_rel)) {
+            uint64_t one = 1;
+            [[maybe_unused]] ssize_t written = ::write(wakeFd_, &one, sizeof(one));
+        }
+    }
+
+    /**
+     * Run task once after delay; returns an id for cancelTimer
+     */
+    uint64_t runAfter(std::chrono::milliseconds delay, Task task) {
+        uint64_t id = ++lastTimerId_;
+        auto it = timers_.emplace(Clock::now() + delay, Timer{id, std::move(task)});
+        timerIndex_.emplace(id, it);
+        if (it == timers_.begin()) {
+            armTimer();
+        }
+        return id;
+    }
+
+    /**
+     * Drop a timer that has not fired yet (unknown or fired ids are ignored)
+     */
+    void cancelTimer(uint64_t id) {
+        auto found = timerIndex_.find(id);
+        if (found == timerIndex_.end()) {
+            return;
+        }
+        timers_.erase(found->second);
+        timerIndex_.erase(found);
+    }
+
+    void run() {
+        loopThread_.store(std::this_thread::get_id(), std::memory_order_release);
+        std::array<epoll_event, MAX_EVENTS> events;
+
+        while (!stopping_.load(std::memory_order_acquire)) {
+            int ready = epoll_wait(epollFd_, events.data(), MAX_EVENTS, -1);
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+
+            for (int i = 0; i < ready; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == wakeFd_) {
+                    runPostedTasks();
+                    continue;
+                }
+                if (fd == timerFd_) {
+                    runDueTimers();
+                    continue;
+                }
+                // A handler may remove itself (or others); keep this one alive while it runs
+                auto it = handlers_.find(fd);
+                if (it == handlers_.end()) {
+                    continue;
+                }
+                std::shared_ptr<Handler> handler = it->second;
+                (*handler)(events[i].events);
+            }
+        }
+
+        runPostedTasks();
+    }
+
+    void stop() {
+        stopping_.store(true, std::memory_order_release);
+        post([] {});
+    }
+
+    bool inLoopThread() const {
+        return loopThread_.load(std::memory_order_acquire) == std::this_thread::get_id();
+    }
+
+private:
+    void runPostedTasks() {
+        uint64_t count = 0;
+        [[maybe_unused]] ssize_t drained = ::read(wakeFd_, &count, sizeof(count));
+        // Cleared before draining: a post that lands after this point wakes us again.
+        // An RMW rather than a store, so every push that saw the flag set is visible below.
+        wakePending_.exchange(false, std::memory_order_acq_rel);
+
+        Task task;
+        while (tasks_.pop(task)) {
+            task();
+        }
+    }
+
+    void runDueTimers() {
+        uint64_t expirations = 0;
+        [[maybe_unused]] ssize_t drained = ::read(timerFd_, &expirations, sizeof(expirations));
+
+        auto now = Clock::now();
+        while (!timers_.empty() && timers_.begin()->first <= now) {
+            auto due = timers_.begin();
+            Task task = std::move(due->second.task);
+            timerIndex_.erase(due->second.id);
+            timers_.erase(due);
+            task();
+        }
+        armTimer();
+    }
+
+    // Point the timerfd at the earliest deadline (or disarm it)
+    void armTimer() {
+        itimerspec spec{};
+        if (!timers_.empty()) {
+            auto delay = std::chrono::duration_cast<std::chrono::nanoseconds>(timers_.begin()->first - Clock::now());
+            // A zero it_value would disarm the timer, so overdue deadlines fire after 1ns
+            int64_t ns = std::max<int64_t>(delay.count(), 1);
+            spec.it_value.tv_sec = static_cast<time_t>(ns / 1000000000);
+            spec.it_value.tv_nsec = static_cast<long>(ns % 1000000000);
+        }
+        timerfd_settime(timerFd_, 0, &spec, nullptr);
+    }
+
+    struct Timer {
+        uint64_t id;
+        Task task;
+    };
+    using TimerMap = std::multimap<Clock::time_point, Timer>;
+
+    const int epollFd_;
+    const int wakeFd_;
+    const int timerFd_;
+    TimerMap timers_;
+    std::unordered_map<uint64_t, TimerMap::iterator> timerIndex_;
+    uint64_t lastTimerId_{0};
+    std::unordered_map<int, std::shared_ptr<Handler>> handlers_;
+    MpscQueue<Task> tasks_;
+    std::atomic<bool> wakePending_{false};
+    std::atomic<bool> stopping_{false};
+    std::atomic<std::thread::id> loopThread_{};
+};
+
+#endif // __linux__
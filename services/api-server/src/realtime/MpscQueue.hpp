@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+/**
+ * Unbounded lock-free multi-producer / single-consumer queue (Vyukov's node-based design)
+ * - push() is wait-free: one exchange on the head plus one store, from any thread
+ * - pop() must only be called from the owning consumer thread
+ *
+ * A push that is still between its two steps is invisible to pop() for that instant, so
+ * producers must pair push() with a wake-up the consumer handles after it drains
+ * (see EventLoop::post and the connection flush flag in WebSocketGateway).
+ */
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue()
+        : head_(new Node()), tail_(head_.load(std::memory_order_relaxed)) {
+    }
+
+    ~MpscQueue() {
+        T discarded;
+        while (pop(discarded)) {
+        }
+        delete tail_;
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(T value) {
+        Node* node = new Node(std::move(value));
+        Node* previous = head_.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    bool pop(T& out) {
+        Node* tail = tail_;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (next == nullptr) {
+            return false;
+        }
+        out = std::move(next->value);
+        tail_ = next;
+        delete tail;
+        return true;
+    }
+
+private:
+    struct Node {
+        Node() = default;
+        explicit Node(T v)
+            : value(std::move(v)) {
+        }
+
+        std::atomic<Node*> next{nullptr};
+        T value{};
+    };
+
+    alignas(64) std::atomic<Node*> head_;  // producers
+    alignas(64) Node* tail_;               // consumer (a drained node stays as the stub)
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include "../database/Database.h"
+#include "../external/json.hpp"
+#include "../utils/JsonReader.hpp"
+#include "../utils/JsonResponses.hpp"
+#include "../utils/JsonWriter.hpp"
+
+/**
+ * Real-time fan-out through Postgres LISTEN/NOTIFY, for installs without RabbitMQ
+ * The messages_notify trigger (database/init.sql) sends every insert, edit and delete on
+ * the chat_messages channel as
+ *   {"type":"message.created","room_id":1,"id":7,"sent_at_us":...,"message":{...}}
+ * Database's listener connection hands the payloads here and they are replayed into the
+ * local RoomHub, so every replica sharing the database sees every replica's messages.
+ * Writes made through this process' own connections were already published locally and
+ * are recognised by the notifying backend's PID, which is one of the pool's. Payloads
+ * over the NOTIFY size limit arrive without "message" and the row is read back instead.
+ *
+ * Triggers on rooms, room_members and users send what those writes invalidate on the
+ * same channel, as {"type":"invalidate","what":"room","room_id":1} (the names of
+ * ChangeVersions' relay), and they go to the invalidation callback.
+ *
+ * sent_at_us is stamped by the trigger, so the latency figures cover insert to delivery
+ * (including the commit), assuming the database and server clocks agree.
+ */
+class PostgresFanout {
+public:
+    static constexpr const char* CHANNEL = "chat_messages";
+
+    using Delivery = std::function<void(int roomId, std::string_view type, std::string_view data)>;
+    using Invalidation = std::function<void(std::string_view what, int roomId)>;
+
+    PostgresFanout(Database& db, Delivery deliver, Invalidation invalidate)
+        : db_(db), deliver_(std::move(deliver)), invalidate_(std::move(invalidate)) {
+    }
+
+    ~PostgresFanout() {
+        stop();
+    }
+
+    PostgresFanout(const PostgresFanout&) = delete;
+    PostgresFanout& operator=(const PostgresFanout&) = delete;
+
+    bool start() {
+        return db_.startListening(CHANNEL, [this](std::string_view payload, int backendPid) {
+            handle(payload, backendPid);
+        });
+    }
+
+    void stop() {
+        db_.stopListening();
+    }
+
+    nlohmann::json stats() const {
+        uint64_t measured = measured_.load(std::memory_order_relaxed);
+        uint64_t totalUs = latencyTotalUs_.load(std::memory_order_relaxed);
+        return {
+            {"transport", "postgres"},
+            {"received", received_.load(std::memory_order_relaxed)},
+            {"invalidations_received", invalidations_.load(std::memory_order_relaxed)},
+            {"own_events_dropped", echoes_.load(std::memory_order_relaxed)},
+            {"read_back", readBack_.load(std::memory_order_relaxed)},
+            {"malformed", malformed_.load(std::memory_order_relaxed)},
+            {"latency_ms", {
+                {"last", latencyLastUs_.load(std::memory_order_relaxed) / 1000.0},
+                {"avg", measured == 0 ? 0.0 : static_cast<double>(totalUs) / static_cast<double>(measured) / 1000.0},
+                {"max", latencyMaxUs_.load(std::memory_order_relaxed) / 1000.0}
+            }}
+        };
+    }
+
+private:
+    Database& db_;
+    const Delivery deliver_;
+    const Invalidation invalidate_;
+
+    std::atomic<uint64_t> received_{0};
+    std::atomic<uint64_t> invalidations_{0};
+    std::atomic<uint64_t> echoes_{0};
+    std::atomic<uint64_t> readBack_{0};
+    std::atomic<uint64_t> malformed_{0};
+    std::atomic<uint64_t> measured_{0};
+    std::atomic<uint64_t> latencyTotalUs_{0};
+    std::atomic<uint64_t> latencyLastUs_{0};
+    std::atomic<uint64_t> latencyMaxUs_{0};
+
+    // Listener thread
+    void handle(std::string_view payload, int backendPid) {
+        if (db_.isOwnBackend(backendPid)) {
+            echoes_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        std::string_view type;
+        std::string_view what;
+        std::string_view message;
+        int roomId = 0;
+        int messageId = 0;
+        int64_t sentAtUs = 0;
+        bool hasRoom = false, hasId = false;
+
+        JsonReader reader(payload);
+        bool wellFormed = reader.forEachMember([&](std::string_view key, const JsonValue& value) {
+            if (key == "type" && value.type == JsonType::String) type = value.text;
+            else if (key == "what" && value.type == JsonType::String) what = value.text;
+            else if (key == "room_id") hasRoom = value.asInteger(roomId);
+            else if (key == "id") hasId = value.asInteger(messageId);
+            else if (key == "sent_at_us") value.asInteger(sentAtUs);
+            else if (key == "message" && value.type == JsonType::Object) message = value.text;
+            return true;
+        });
+        if (wellFormed && type == "invalidate" && hasRoom && !what.empty()) {
+            invalidations_.fetch_add(1, std::memory_order_relaxed);
+            invalidate_(what, roomId);
+            return;
+        }
+        if (!wellFormed || type.empty() || !hasRoom || !hasId) {
+            malformed_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        received_.fetch_add(1, std::memory_order_relaxed);
+        recordLatency(sentAtUs);
+
+        if (!message.empty()) {
+            deliver_(roomId, type, message);
+            return;
+        }
+
+        // Too long to travel in the notification
+        std::optional<Message> row;
+        try {
+            row = db_.getMessageById(messageId);
+        } catch (const std::exception&) {
+            return;  // logged by the database; don't drop the LISTEN connection over one read
+        }
+        if (!row) {
+            return;
+        }
+        readBack_.fetch_add(1, std::memory_order_relaxed);
+        std::string data;
+        JsonWriter writer(data);
+        JsonResponses::writeMessage(writer, *row);
+        deliver_(roomId, type, data);
+    }
+
+    void recordLatency(int64_t sentAtUs) {
+        if (sentAtUs <= 0) {
+            return;
+        }
+        int64_t nowUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        uint64_t latency = static_cast<uint64_t>(std::max<int64_t>(nowUs - sentAtUs, 0));
+
+        // Only the listener thread writes these
+        measured_.fetch_add(1, std::memory_order_relaxed);
+        latencyTotalUs_.fetch_add(latency, std::memory_order_relaxed);
+        latencyLastUs_.store(latency, std::memory_order_relaxed);
+        if (latency > latencyMaxUs_.load(std::memory_order_relaxed)) {
+            latencyMaxUs_.store(latency, std::memory_order_relaxed);
+        }
+    }
+};
@@ -0,0 +1,445 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../external/json.hpp"
+
+/**
+ * In-process broadcast of room events to live subscribers (SSE streams)
+ * - Every event is rendered into its wire frame once and shared by all subscribers
+ * - Event ids are "<epoch>-<seq>", seq from one process-wide counter; a client resuming
+ *   with Last-Event-ID gets the missed events from a per-room history ring, or a "reset"
+ *   event when they are no longer there (history rolled over, or another process)
+ * - Each subscriber has a bounded queue; one that falls behind by more than that is
+ *   evicted instead of making the publisher wait or buffer without limit
+ *
+ * Publishing never blocks on a subscriber: it only appends to queues under short locks.
+ *
+ * Local consumers other than SSE streams (WebSocket subscriptions, parked long-polls)
+ * register with addWatcher() so the hub knows which rooms this node cares about; the
+ * interest hook fires when a room gains its first consumer of any kind. Events published
+ * here also go to the relay (other nodes); events from other nodes come in via deliver().
+ */
+class RoomHub {
+public:
+    using Frame = std::shared_ptr<const std::string>;
+
+    static constexpr size_t SHARDS = 16;
+
+    struct Options {
+        size_t historySize{256};    // events kept per room for Last-Event-ID resume
+        size_t queueCapacity{512};  // frames a subscriber may fall behind before eviction
+        std::chrono::seconds idleRetention{60};  // history kept after the last subscriber leaves
+    };
+
+    /**
+     * One live stream. Filled by the hub, drained by the thread serving the connection.
+     */
+    class Subscriber {
+    public:
+        Subscriber(int roomId, size_t capacity)
+            : roomId_(roomId), capacity_(capacity) {
+        }
+
+        int roomId() const { return roomId_; }
+
+        /**
+         * Wait up to timeout for frames; moves them into out (cleared first).
+         * Returns false once the subscriber was evicted or closed.
+         */
+        bool next(std::vector<Frame>& out, std::chrono::milliseconds timeout) {
+            out.clear();
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait_for(lock, timeout, [&] { return !queue_.empty() || evicted_ || closed_; });
+            if (evicted_ || closed_) {
+                return false;
+            }
+            out.assign(std::make_move_iterator(queue_.begin()), std::make_move_iterator(queue_.end()));
+            queue_.clear();
+            return true;
+        }
+
+        bool evicted() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return evicted_;
+        }
+
+        void close() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                closed_ = true;
+            }
+            cond_.notify_all();
+        }
+
+    private:
+        friend class RoomHub;
+
+        // false = queue overflowed and the subscriber is now evicted
+        bool push(const Frame& frame) {
+            bool accepted = true;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (evicted_ || closed_) {
+                    return true;
+                }
+                if (queue_.size() >= capacity_) {
+                    evicted_ = true;
+                    accepted = false;
+                    queue_.clear();
+                } else {
+                    queue_.push_back(frame);
+                }
+            }
+            cond_.notify_one();
+            return accepted;
+        }
+
+        const int roomId_;
+        const size_t capacity_;
+        mutable std::mutex mutex_;
+        std::condition_variable cond_;
+        std::deque<Frame> queue_;
+        bool evicted_{false};
+        bool closed_{false};
+    };
+
+    using SubscriberPtr = std::shared_ptr<Subscriber>;
+
+    // Sees every published event on the publishing thread, whether or not a room has SSE subscribers
+    using Listener = std::function<void(int roomId, std::string_view type, std::string_view data)>;
+    using ListenerId = uint64_t;
+    using InterestHook = std::function<void(int roomId)>;
+
+    explicit RoomHub(const Options& options)
+        : options_(options),
+          epoch_(static_cast<uint64_t>(
+              std::chrono::system_clock::now().time_since_epoch() / std::chrono::microseconds(1))) {
+    }
+
+    RoomHub(const RoomHub&) = delete;
+    RoomHub& operator=(const RoomHub&) = delete;
+
+    /**
+     * Listeners run under a shared lock, so they must not publish or (un)register listeners themselves
+     */
+    ListenerId addListener(Listener listener) {
+        std::unique_lock lock(listenersMutex_);
+        ListenerId id = ++nextListenerId_;
+        listeners_.emplace_back(id, std::move(listener));
+        return id;
+    }
+
+    /**
+     * Returns once no thread is inside the listener any more
+     */
+    void removeListener(ListenerId id) {
+        std::unique_lock lock(listenersMutex_);
+        std::erase_if(listeners_, [id](const auto& entry) { return entry.first == id; });
+    }
+
+    /**
+     * Forward locally published events to other nodes (set before serving, like listeners)
+     */
+    void setRelay(Listener relay) {
+        relay_ = std::move(relay);
+    }
+
+    /**
+     * Called outside the hub's locks when a room goes from no local consumers to one
+     */
+    void setInterestHook(InterestHook hook) {
+        interestHook_ = std::move(hook);
+    }
+
+    /**
+     * Broadcast one event; data must be a single-line JSON document
+     */
+    void publish(int roomId, std::string_view type, std::string_view data) {
+        if (relay_) {
+            relay_(roomId, type, data);
+        }
+        deliver(roomId, type, data);
+    }
+
+    /**
+     * Broadcast an event that another node published (not relayed again)
+     */
+    void deliver(int roomId, std::string_view type, std::string_view data) {
+        {
+            std::shared_lock lock(listenersMutex_);
+            for (const auto& [id, listener] : listeners_) {
+                listener(roomId, type, data);
+            }
+        }
+
+        Shard& shard = shardFor(roomId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.rooms.find(roomId);
+        if (it == shard.rooms.end()) {
+            // Nobody listening and nobody recently was - nothing to resume either
+            return;
+        }
+        Room& room = it->second;
+
+        // Sequence taken under the room lock, so ids within a room are strictly increasing
+        uint64_t seq = seq_.fetch_add(1, std::memory_order_relaxed) + 1;
+        Frame frame = std::make_shared<const std::string>(renderFrame(seq, type, data));
+
+        room.history.push_back({seq, frame});
+        if (room.history.size() > options_.historySize) {
+            room.coveredAfter = room.history.front().seq;
+            room.history.pop_front();
+        }
+
+        published_.fetch_add(1, std::memory_order_relaxed);
+        size_t evicted = std::erase_if(room.subscribers, [&](const SubscriberPtr& sub) {
+            return !sub->push(frame);
+        });
+        if (evicted > 0) {
+            evictions_.fetch_add(evicted, std::memory_order_relaxed);
+            if (!room.hasConsumers()) {
+                room.idleSince = std::chrono::steady_clock::now();
+            }
+        }
+    }
+
+    /**
+     * Join a room's stream. With lastEventId, events after it are queued straight away,
+     * or a reset frame if they can't all be replayed.
+     */
+    SubscriberPtr subscribe(int roomId, std::optional<std::string_view> lastEventId = std::nullopt) {
+        auto subscriber = std::make_shared<Subscriber>(roomId, options_.queueCapacity);
+        bool firstConsumer = false;
+        {
+            Shard& shard = shardFor(roomId);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            Room& room = openRoom(shard, roomId);
+            firstConsumer = !room.hasConsumers();
+            replay(room, *subscriber, lastEventId);
+            room.subscribers.push_back(subscriber);
+        }
+
+        subscribers_.fetch_add(1, std::memory_order_relaxed);
+        if (firstConsumer && interestHook_) {
+            interestHook_(roomId);
+        }
+        return subscriber;
+    }
+
+    /**
+     * A local consumer outside the hub started following roomId
+     */
+    void addWatcher(int roomId) {
+        bool firstConsumer = false;
+        {
+            Shard& shard = shardFor(roomId);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            Room& room = openRoom(shard, roomId);
+            firstConsumer = !room.hasConsumers();
+            ++room.watchers;
+        }
+        if (firstConsumer && interestHook_) {
+            interestHook_(roomId);
+        }
+    }
+
+    void removeWatcher(int roomId) {
+        Shard& shard = shardFor(roomId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.rooms.find(roomId);
+        if (it == shard.rooms.end() || it->second.watchers == 0) {
+            return;
+        }
+        if (--it->second.watchers == 0 && it->second.subscribers.empty()) {
+            it->second.idleSince = std::chrono::steady_clock::now();
+        }
+    }
+
+    /**
+     * Does any SSE stream or watcher on this node follow roomId?
+     */
+    bool hasLocalInterest(int roomId) const {
+        const Shard& shard = shardFor(roomId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.rooms.find(roomId);
+        return it != shard.rooms.end() && it->second.hasConsumers();
+    }
+
+    void unsubscribe(const SubscriberPtr& subscriber) {
+        subscriber->close();
+
+        Shard& shard = shardFor(subscriber->roomId());
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        subscribers_.fetch_sub(1, std::memory_order_relaxed);
+
+        auto it = shard.rooms.find(subscriber->roomId());
+        if (it == shard.rooms.end()) {
+            return;
+        }
+        auto& subs = it->second.subscribers;
+        std::erase(subs, subscriber);
+        if (!it->second.hasConsumers()) {
+            it->second.idleSince = std::chrono::steady_clock::now();
+        }
+    }
+
+    nlohmann::json stats() const {
+        size_t rooms = 0;
+        for (const Shard& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            rooms += shard.rooms.size();
+        }
+        return {
+            {"subscribers", subscribers_.load(std::memory_order_relaxed)},
+            {"rooms", rooms},
+            {"published", published_.load(std::memory_order_relaxed)},
+            {"evictions", evictions_.load(std::memory_order_relaxed)},
+            {"resets", resets_.load(std::memory_order_relaxed)}
+        };
+    }
+
+private:
+    struct Event {
+        uint64_t seq;
+        Frame frame;
+    };
+
+    struct Room {
+        std::deque<Event> history;
+        std::vector<SubscriberPtr> subscribers;
+        // Every event with a larger seq is still in history (or was never published)
+        uint64_t coveredAfter{0};
+        size_t watchers{0};  // addWatcher() consumers
+        std::chrono::steady_clock::time_point idleSince{};
+
+        bool hasConsumers() const {
+            return !subscribers.empty() || watchers > 0;
+        }
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<int, Room> rooms;
+    };
+
+    Shard& shardFor(int roomId) {
+        return shards_[static_cast<uint32_t>(roomId) % SHARDS];
+    }
+
+    const Shard& shardFor(int roomId) const {
+        return shards_[static_cast<uint32_t>(roomId) % SHARDS];
+    }
+
+    // Drop the history of rooms nobody has listened to for a while (caller holds the lock)
+    void sweepIdle(Shard& shard) {
+        auto cutoff = std::chrono::steady_clock::now() - options_.idleRetention;
+        std::erase_if(shard.rooms, [&](const auto& entry) {
+            return !entry.second.hasConsumers() && entry.second.idleSince < cutoff;
+        });
+    }
+
+    // Find or start tracking a room (caller holds the lock)
+    Room& openRoom(Shard& shard, int roomId) {
+        sweepIdle(shard);
+        auto [it, created] = shard.rooms.try_emplace(roomId);
+        if (created) {
+            it->second.coveredAfter = seq_.load(std::memory_order_relaxed);
+        }
+        return it->second;
+    }
+
+    // Queue what a resuming subscriber missed, or a reset frame (caller holds the lock)
+    void replay(const Room& room, Subscriber& subscriber, std::optional<std::string_view> lastEventId) {
+        if (!lastEventId) {
+            return;
+        }
+        std::optional<uint64_t> last = parseEventId(*lastEventId);
+        if (!last || *last < room.coveredAfter) {
+            subscriber.push(resetFrame());
+            resets_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        for (const Event& event : room.history) {
+            if (event.seq > *last) {
+                subscriber.push(event.frame);
+            }
+        }
+    }
+
+    std::string formatEventId(uint64_t seq) const {
+        return std::to_string(epoch_) + "-" + std::to_string(seq);
+    }
+
+    std::string renderFrame(uint64_t seq, std::string_view type, std::string_view data) const {
+        std::string frame;
+        frame.reserve(data.size() + type.size() + 48);
+        frame += "id: ";
+        frame += formatEventId(seq);
+        frame += "\nevent: ";
+        frame += type;
+        frame += "\ndata: ";
+        frame += data;
+        frame += "\n\n";
+        return frame;
+    }
+
+    static Frame resetFrame() {
+        static const Frame frame = std::make_shared<const std::string>(
+            "event: reset\ndata: {\"reason\":\"history unavailable, refetch messages\"}\n\n");
+        return frame;
+    }
+
+    // "<epoch>-<seq>" from this process, or nullopt
+    std::optional<uint64_t> parseEventId(std::string_view id) const {
+        size_t dash = id.find('-');
+        if (dash == std::string_view::npos) {
+            return std::nullopt;
+        }
+        auto number = [](std::string_view digits) -> std::optional<uint64_t> {
+            uint64_t n = 0;
+            auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), n);
+            if (ec != std::errc() || end != digits.data() + digits.size() || digits.empty()) {
+                return std::nullopt;
+            }
+            return n;
+        };
+        auto epoch = number(id.substr(0, dash));
+        if (!epoch || *epoch != epoch_) {
+            return std::nullopt;
+        }
+        return number(id.substr(dash + 1));
+    }
+
+    const Options options_;
+    const uint64_t epoch_;
+    std::atomic<uint64_t> seq_{0};
+    std::array<Shard, SHARDS> shards_;
+    std::shared_mutex listenersMutex_;
+    std::vector<std::pair<ListenerId, Listener>> listeners_;
+    ListenerId nextListenerId_{0};
+    Listener relay_;
+    InterestHook interestHook_;
+
+    std::atomic<int64_t> subscribers_{0};
+    std::atomic<uint64_t> published_{0};
+    std::atomic<uint64_t> evictions_{0};
+    std::atomic<uint64_t> resets_{0};
+};
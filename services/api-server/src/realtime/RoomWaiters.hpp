@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Per-room registry of parked long-poll requests
+ * A parked request is just a callback; nothing blocks while it waits. wake() hands every
+ * callback parked on the room back to its owner exactly once, so a waiter that wants
+ * more must park again. Rooms are spread over shards so wakes in different rooms rarely
+ * share a lock.
+ */
+class RoomWaiters {
+public:
+    using Callback = std::function<void()>;
+
+    /**
+     * Park callback on roomId until the next wake(roomId); returns a token for cancel()
+     */
+    uint64_t park(int roomId, Callback callback) {
+        uint64_t token = nextToken_.fetch_add(1, std::memory_order_relaxed) + 1;
+        Shard& shard = shardFor(roomId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.rooms[roomId].emplace_back(token, std::move(callback));
+        parked_.fetch_add(1, std::memory_order_relaxed);
+        return token;
+    }
+
+    /**
+     * Remove a parked callback; false if it already ran (or is running) or never existed
+     */
+    bool cancel(int roomId, uint64_t token) {
+        Shard& shard = shardFor(roomId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.rooms.find(roomId);
+        if (it == shard.rooms.end()) {
+            return false;
+        }
+        auto& waiters = it->second;
+        for (size_t i = 0; i < waiters.size(); ++i) {
+            if (waiters[i].first == token) {
+                waiters[i] = std::move(waiters.back());
+                waiters.pop_back();
+                if (waiters.empty()) {
+                    shard.rooms.erase(it);
+                }
+                parked_.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Run (and unpark) every callback waiting on roomId; they run on the caller's thread
+     */
+    void wake(int roomId) {
+        std::vector<std::pair<uint64_t, Callback>> woken;
+        {
+            Shard& shard = shardFor(roomId);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.rooms.find(roomId);
+            if (it == shard.rooms.end()) {
+                return;
+            }
+            woken = std::move(it->second);
+            shard.rooms.erase(it);
+        }
+        parked_.fetch_sub(woken.size(), std::memory_order_relaxed);
+        wakes_.fetch_add(woken.size(), std::memory_order_relaxed);
+
+        // Outside the lock: callbacks may park again on the same room
+        for (auto& [token, callback] : woken) {
+            callback();
+        }
+    }
+
+    size_t parked() const {
+        return parked_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t wakes() const {
+        return wakes_.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr size_t SHARDS = 64;
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<int, std::vector<std::pair<uint64_t, Callback>>> rooms;
+    };
+
+    Shard& shardFor(int roomId) {
+        return shards_[static_cast<uint32_t>(roomId) % SHARDS];
+    }
+
+    std::array<Shard, SHARDS> shards_;
+    std::atomic<uint64_t> nextToken_{0};
+    std::atomic<size_t> parked_{0};
+    std::atomic<uint64_t> wakes_{0};
+};
@@ -0,0 +1,1129 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "../async/AsyncHttpClient.hpp"
+#include "../async/AsyncPostgres.hpp"
+#include "../async/AsyncSingleFlight.hpp"
+#include "../async/Task.hpp"
+#include "../clients/TranslationClient.hpp"
+#include "../external/httplib.h"
+#include "../external/json.hpp"
+#include "../handlers/MessageHandlers.hpp"
+#include "../handlers/RequestBodies.hpp"
+#include "../handlers/TranslationHandlers.hpp"
+#include "../database/Database.h"
+#include "../utils/JsonReader.hpp"
+#include "../utils/JsonWriter.hpp"
+#include "../utils/RequestContext.hpp"
+#include "../utils/RequestTrace.hpp"
+#include "../utils/Utf8.hpp"
+#include "EventLoop.hpp"
+#include "MpscQueue.hpp"
+#include "RoomHub.hpp"
+#include "RoomWaiters.hpp"
+#include "WebSocketProtocol.hpp"
+
+/**
+ * Real-time port: WebSocket endpoint for interactive clients (ws://host:<port>/ws) and
+ * long-poll for clients that can use neither WebSockets nor SSE.
+ * Runs on its own epoll loops (one listening socket per loop via SO_REUSEPORT), apart
+ * from the httplib workers. Commands that touch Postgres run on a separate worker pool,
+ * one at a time per connection so a client's messages keep their order. Long-poll
+ * queries and translations instead run as coroutines on the loop itself (AsyncPostgres,
+ * AsyncHttpClient), so thousands of them can be waiting on I/O without a thread each.
+ *
+ * Client -> server (text frames, JSON):
+ *   {"type":"subscribe","room_id":1,"ref":"a"}
+ *   {"type":"unsubscribe","room_id":1,"ref":"b"}
+ *   {"type":"send","room_id":1,"ref":"c","message":{"user_id":2,"content":"hi"}}
+ *   {"type":"translate","ref":"d","message":{"text":"hi","target_lang":"es"}}   as POST /api/translate
+ * Server -> client:
+ *   {"type":"reply","ref":"c","status":201,"body":{...}}   body = what the HTTP endpoint returns
+ *   {"type":"message.created","room_id":1,"data":{...}}    also message.updated / message.deleted
+ *
+ * Fan-out: every RoomHub event is encoded into one WebSocket frame, and that frame is
+ * pushed onto the lock-free send queue of each subscribed connection; the owning loop
+ * is woken once per burst and writes each connection's queue with a single writev.
+ *
+ * Long-poll: GET /api/rooms/:id/messages/wait?after_id=X&timeout=30 answers at once with
+ * the messages newer than X, or parks the request on RoomWaiters until sendMessage wakes
+ * the room or the timeout passes (then []). A parked request is a socket on the loop, a
+ * timer and a callback - it holds no thread. The response closes the connection.
+ */
+class WebSocketGateway {
+public:
+    struct Options {
+        std::string host;
+        int port{0};
+        std::string path;
+        unsigned loops{0};            // epoll threads (0 = half the cores)
+        unsigned workers{0};          // threads for commands that query Postgres
+        size_t maxMessageBytes{0};    // largest client message after reassembly
+        size_t maxPendingBytes{0};    // unsent output before a connection counts as too slow
+        size_t maxRoomsPerConnection{0};
+        size_t maxQueuedCommands{0};  // per connection
+        int maxLongPollSeconds{0};
+        // Coroutine I/O on the loops: Postgres connections per loop for long-polls (none: they
+        // query from the worker pool) and the translation API (empty: no translate command)
+        std::string asyncDbConnection;
+        size_t asyncDbConnectionsPerLoop{0};
+        size_t asyncDbPipelineDepth{16};  // long-polls woken together share round trips
+        std::chrono::milliseconds asyncQueryTimeout{5000};
+        std::string translationUrl;
+        std::chrono::milliseconds translationTimeout{5000};
+        std::chrono::milliseconds commandTimeout{0};  // deadline of each worker command (0 = none)
+    };
+
+    WebSocketGateway(MessageHandlers& messages, Database& db, RoomHub& hub, RoomWaiters& waiters,
+                     const Options& options)
+        : messages_(messages),
+          db_(db),
+          hub_(hub),
+          waiters_(waiters),
+          options_(options),
+          workers_(options.workers) {
+        unsigned loops = options.loops;
+        if (loops == 0) {
+            loops = std::max(1u, std::thread::hardware_concurrency() / 2);
+        }
+        for (unsigned i = 0; i < loops; ++i) {
+            auto loop = std::make_unique<Loop>();
+            if (!options.asyncDbConnection.empty() && options.asyncDbConnectionsPerLoop > 0) {
+                loop->db = std::make_unique<AsyncPostgres>(loop->events, AsyncPostgres::Options{
+                    .connectionString = options.asyncDbConnection,
+                    .connections = options.asyncDbConnectionsPerLoop,
+                    .pipelineDepth = options.asyncDbPipelineDepth,
+                    .queryTimeout = options.asyncQueryTimeout
+                });
+            }
+            if (!options.translationUrl.empty()) {
+                loop->http = std::make_unique<AsyncHttpClient>(loop->events);
+            }
+            loops_.push_back(std::move(loop));
+        }
+
+        hubListener_ = hub.addListener([this](int roomId, std::string_view type, std::string_view data) {
+            fanOut(roomId, type, data);
+        });
+    }
+
+    ~WebSocketGateway() {
+        stop();
+    }
+
+    WebSocketGateway(const WebSocketGateway&) = delete;
+    WebSocketGateway& operator=(const WebSocketGateway&) = delete;
+
+    /**
+     * Bind the listening sockets and start the loop threads
+     */
+    bool start() {
+        for (auto& loop : loops_) {
+            if (!loop->events.valid()) {
+                std::cerr << "WebSocket gateway: failed to create event loop" << std::endl;
+                return false;
+            }
+            loop->listenFd = listenSocket();
+            if (loop->listenFd < 0) {
+                std::cerr << "WebSocket gateway: cannot listen on " << options_.host << ":" << options_.port
+                          << " (" << std::strerror(errno) << ")" << std::endl;
+                return false;
+            }
+            Loop* owner = loop.get();
+            loop->events.add(loop->listenFd, EPOLLIN, [this, owner](uint32_t) { acceptAll(*owner); });
+        }
+
+        for (auto& loop : loops_) {
+            Loop* owner = loop.get();
+            loop->thread = std::thread([owner] { owner->events.run(); });
+        }
+        return true;
+    }
+
+    void stop() {
+        if (stopped_.exchange(true)) {
+            return;
+        }
+        // Commands still queued may post replies, so drain them while the loops run
+        workers_.shutdown();
+        // After this returns no publisher is inside fanOut, so nothing posts to the loops below
+        hub_.removeListener(hubListener_);
+
+        for (auto& loop : loops_) {
+            Loop* owner = loop.get();
+            if (!owner->thread.joinable()) {
+                if (owner->listenFd >= 0) ::close(owner->listenFd);
+                continue;
+            }
+            owner->events.post([this, owner] {
+                for (auto& [fd, connection] : owner->connections) {
+                    closeNow(connection, false);
+                }
+                owner->connections.clear();
+                ::close(owner->listenFd);
+            });
+            owner->events.stop();
+        }
+        for (auto& loop : loops_) {
+            if (loop->thread.joinable()) loop->thread.join();
+        }
+    }
+
+    json stats() const {
+        return {
+            {"connections", connections_.load(std::memory_order_relaxed)},
+            {"subscriptions", subscriptions_.load(std::memory_order_relaxed)},
+            {"loops", loops_.size()},
+            {"frames_fanned_out", fannedOut_.load(std::memory_order_relaxed)},
+            {"commands", commands_.load(std::memory_order_relaxed)},
+            {"slow_consumers_closed", slowClosed_.load(std::memory_order_relaxed)},
+            {"long_polls", longPolls_.load(std::memory_order_relaxed)},
+            {"long_polls_parked", waiters_.parked()},
+            {"long_poll_wakes", waiters_.wakes()},
+            {"loop_db_queries", loopDbQueries_.load(std::memory_order_relaxed)},
+            {"loop_translations", loopTranslations_.load(std::memory_order_relaxed)}
+        };
+    }
+
+private:
+    using Frame = std::shared_ptr<const std::string>;
+
+    struct Loop;
+
+    struct Connection {
+        Connection(Loop& owner, int socket)
+            : loop(owner), fd(socket) {
+        }
+
+        Loop& loop;
+        const int fd;
+
+        // ---- loop thread only ----
+        bool open{false};         // handshake done
+        bool closing{false};      // close once pending output is written
+        bool wantWrite{false};    // EPOLLOUT registered
+        std::string input;
+        std::string message;      // data frames reassembled so far
+        bool inMessage{false};
+        WebSocket::Opcode messageOpcode{WebSocket::Opcode::Text};
+        std::deque<Frame> pending;
+        size_t pendingOffset{0};  // bytes of pending.front() already written
+        size_t pendingBytes{0};
+        std::unordered_set<int> rooms;
+        bool polling{false};      // a long-poll request, not a WebSocket
+        bool pollWatching{false};
+        uint64_t pollTimer{0};
+
+        // ---- long-poll: set on the loop thread before the first job, then read-only ----
+        int pollRoom{0};
+        int pollAfter{0};
+
+        // ---- any thread ----
+        MpscQueue<Frame> outbox;
+        std::atomic<bool> flushScheduled{false};
+        std::atomic<bool> closed{false};
+
+        // Commands for the worker pool, run one at a time in arrival order
+        std::mutex jobsMutex;
+        std::deque<std::function<void()>> jobs;
+        bool jobRunning{false};
+
+        // Long-poll: the current RoomWaiters token and whether the response is decided
+        std::atomic<uint64_t> pollToken{0};
+        std::atomic<bool> responded{false};
+    };
+
+    using ConnectionPtr = std::shared_ptr<Connection>;
+
+    struct Loop {
+        EventLoop events;
+        int listenFd{-1};
+        std::thread thread;
+        std::unordered_map<int, ConnectionPtr> connections;
+
+        // Coroutine I/O, used on this loop's thread only (declared after events: destroyed first)
+        std::unique_ptr<AsyncPostgres> db;
+        std::unique_ptr<AsyncHttpClient> http;
+        AsyncSingleFlight<std::string> newMessages;
+    };
+
+    struct RoomShard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<int, std::vector<ConnectionPtr>> rooms;
+    };
+
+    static constexpr size_t ROOM_SHARDS = 64;
+    static constexpr size_t MAX_HANDSHAKE_BYTES = 8192;
+    static constexpr size_t READ_CHUNK = 64 * 1024;
+    static constexpr int MAX_IOVECS = 64;
+    static constexpr int LONG_POLL_BATCH = 100;
+    static constexpr int DEFAULT_LONG_POLL_SECONDS = 30;
+
+    MessageHandlers& messages_;
+    Database& db_;
+    RoomHub& hub_;
+    RoomHub::ListenerId hubListener_{0};
+    RoomWaiters& waiters_;
+    const Options options_;
+    httplib::ThreadPool workers_;
+    std::vector<std::unique_ptr<Loop>> loops_;
+    std::array<RoomShard, ROOM_SHARDS> roomShards_;
+    std::atomic<bool> stopped_{false};
+
+    std::atomic<int64_t> connections_{0};
+    std::atomic<int64_t> subscriptions_{0};
+    std::atomic<uint64_t> fannedOut_{0};
+    std::atomic<uint64_t> commands_{0};
+    std::atomic<uint64_t> slowClosed_{0};
+    std::atomic<uint64_t> longPolls_{0};
+    std::atomic<uint64_t> loopDbQueries_{0};
+    std::atomic<uint64_t> loopTranslations_{0};
+
+    // ---------- sockets ----------
+
+    int listenSocket() const {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(options_.port));
+        if (inet_pton(AF_INET, options_.host.c_str(), &address.sin_addr) != 1 ||
+            ::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(fd, SOMAXCONN) != 0) {
+            int saved = errno;
+            ::close(fd);
+            errno = saved;
+            return -1;
+        }
+        return fd;
+    }
+
+    void acceptAll(Loop& loop) {
+        for (;;) {
+            int fd = ::accept4(loop.listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                return;  // EAGAIN, or out of descriptors until someone disconnects
+            }
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+            auto connection = std::make_shared<Connection>(loop, fd);
+            if (!loop.events.add(fd, EPOLLIN | EPOLLRDHUP, [this, connection](uint32_t events) {
+                    onEvents(connection, events);
+                })) {
+                ::close(fd);
+                continue;
+            }
+            loop.connections.emplace(fd, connection);
+            connections_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void onEvents(const ConnectionPtr& connection, uint32_t events) {
+        if (events & (EPOLLERR | EPOLLHUP)) {
+            closeNow(connection);
+            return;
+        }
+        if (events & EPOLLOUT) {
+            writePending(connection);
+        }
+        if ((events & (EPOLLIN | EPOLLRDHUP)) && !connection->closed.load(std::memory_order_relaxed)) {
+            readAll(connection);
+        }
+    }
+
+    void readAll(const ConnectionPtr& connection) {
+        thread_local std::string chunk(READ_CHUNK, '\0');
+        Connection& c = *connection;
+
+        for (;;) {
+            ssize_t n = ::recv(c.fd, chunk.data(), chunk.size(), 0);
+            if (n > 0) {
+                c.input.append(chunk.data(), static_cast<size_t>(n));
+                if (!process(connection) || c.closed.load(std::memory_order_relaxed)) {
+                    return;
+                }
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+            closeNow(connection);  // orderly shutdown by the peer, or a socket error
+            return;
+        }
+    }
+
+    // ---------- protocol ----------
+
+    /**
+     * Consume what is buffered in input; false once the connection stops reading
+     */
+    bool process(const ConnectionPtr& connection) {
+        Connection& c = *connection;
+        if (c.closing || c.polling) {
+            c.input.clear();
+            return false;
+        }
+
+        if (!c.open) {
+            size_t end = c.input.find("\r\n\r\n");
+            if (end == std::string::npos) {
+                if (c.input.size() > MAX_HANDSHAKE_BYTES) {
+                    rejectHandshake(connection);
+                    return false;
+                }
+                return true;
+            }
+
+            std::string_view head = std::string_view(c.input).substr(0, end + 2);
+            if (auto poll = parseLongPoll(head)) {
+                c.input.clear();
+                startLongPoll(connection, *poll);
+                return false;
+            }
+
+            auto response = WebSocket::handshakeResponse(head, options_.path);
+            if (!response) {
+                rejectHandshake(connection);
+                return false;
+            }
+            c.open = true;
+            c.input.erase(0, end + 4);
+            queueLocal(connection, std::make_shared<const std::string>(std::move(*response)));
+        }
+
+        size_t offset = 0;
+        while (!c.closing) {
+            WebSocket::Frame frame;
+            auto status = WebSocket::parseFrame(c.input, offset, options_.maxMessageBytes, frame);
+            if (status == WebSocket::ParseStatus::NeedMore) {
+                break;
+            }
+            if (status != WebSocket::ParseStatus::Ok) {
+                closeWith(connection, status == WebSocket::ParseStatus::TooBig ? WebSocket::CLOSE_TOO_BIG
+                                                                              : WebSocket::CLOSE_PROTOCOL_ERROR);
+                return false;
+            }
+            handleFrame(connection, frame);
+        }
+
+        c.input.erase(0, offset);
+        if (c.input.empty() && c.input.capacity() > 4096) {
+            // Most sockets sit idle; don't let one burst pin a large buffer
+            std::string().swap(c.input);
+        }
+        return !c.closing;
+    }
+
+    void handleFrame(const ConnectionPtr& connection, const WebSocket::Frame& frame) {
+        using WebSocket::Opcode;
+        Connection& c = *connection;
+
+        switch (frame.opcode) {
+        case Opcode::Ping:
+            queueLocal(connection, std::make_shared<const std::string>(WebSocket::encodeFrame(Opcode::Pong, frame.payload)));
+            return;
+        case Opcode::Pong:
+            return;
+        case Opcode::Close:
+            closeWith(connection, WebSocket::CLOSE_NORMAL);
+            return;
+        case Opcode::Text:
+        case Opcode::Binary:
+            if (c.inMessage) {
+                closeWith(connection, WebSocket::CLOSE_PROTOCOL_ERROR);
+                return;
+            }
+            c.inMessage = true;
+            c.messageOpcode = frame.opcode;
+            c.message.assign(frame.payload);
+            break;
+        case Opcode::Continuation:
+            if (!c.inMessage) {
+                closeWith(connection, WebSocket::CLOSE_PROTOCOL_ERROR);
+                return;
+            }
+            if (c.message.size() + frame.payload.size() > options_.maxMessageBytes) {
+                closeWith(connection, WebSocket::CLOSE_TOO_BIG);
+                return;
+            }
+            c.message.append(frame.payload);
+            break;
+        default:
+            closeWith(connection, WebSocket::CLOSE_PROTOCOL_ERROR);
+            return;
+        }
+
+        if (!frame.fin) {
+            return;
+        }
+        c.inMessage = false;
+
+        if (c.messageOpcode != Opcode::Text) {
+            closeWith(connection, WebSocket::CLOSE_UNSUPPORTED);
+            return;
+        }
+        if (!Utf8::isValid(c.message)) {
+            closeWith(connection, WebSocket::CLOSE_INVALID_DATA);
+            return;
+        }
+        dispatch(connection, c.message);
+        c.message.clear();
+    }
+
+    /**
+     * Run one client command (loop thread)
+     */
+    void dispatch(const ConnectionPtr& connection, std::string_view text) {
+        commands_.fetch_add(1, std::memory_order_relaxed);
+
+        std::string_view type;
+        std::string ref;
+        std::string body;
+        int roomId = 0;
+        bool hasRoom = false;
+
+        JsonReader reader(text);
+        bool wellFormed = reader.forEachMember([&](std::string_view key, const JsonValue& value) {
+            if (key == "type" && value.type == JsonType::String) type = value.text;
+            else if (key == "ref" && value.type == JsonType::String) ref = value.text;
+            else if (key == "room_id") hasRoom = value.asInteger(roomId);
+            else if (key == "message" && value.type == JsonType::Object) body = value.text;
+            return true;
+        });
+
+        if (!wellFormed) {
+            reply(connection, ref, 400, R"({"error":"Invalid JSON format"})");
+            return;
+        }
+        if (type == "translate" && connection->loop.http) {
+            spawn(translate(connection, std::move(ref), std::move(body)));
+            return;
+        }
+        if (!hasRoom || (type != "subscribe" && type != "unsubscribe" && type != "send")) {
+            reply(connection, ref, 400, R"({"error":"Expected type subscribe, unsubscribe or send with an integer room_id"})");
+            return;
+        }
+
+        if (type == "unsubscribe") {
+            if (connection->rooms.erase(roomId) > 0) {
+                removeSubscriber(roomId, connection);
+            }
+            reply(connection, ref, 200, R"({"message":"Unsubscribed"})");
+            return;
+        }
+
+        if (type == "subscribe") {
+            if (connection->rooms.contains(roomId)) {
+                reply(connection, ref, 200, R"({"message":"Subscribed"})");
+                return;
+            }
+            if (connection->rooms.size() >= options_.maxRoomsPerConnection) {
+                reply(connection, ref, 400, R"({"error":"Too many subscriptions on this connection"})");
+                return;
+            }
+            submit(connection, ref, [this, connection, roomId, ref] {
+                std::optional<Room> room;
+                try {
+                    room = db_.getRoomById(roomId);
+                } catch (const std::exception&) {
+                    reply(connection, ref, 500, R"({"error":"Internal server error"})");
+                    return;
+                }
+                if (!room) {
+                    reply(connection, ref, 404, R"({"error":"Room not found"})");
+                    return;
+                }
+                connection->loop.events.post([this, connection, roomId, ref] {
+                    if (connection->closed.load(std::memory_order_relaxed)) {
+                        return;
+                    }
+                    if (connection->rooms.insert(roomId).second) {
+                        addSubscriber(roomId, connection);
+                    }
+                    reply(connection, ref, 200, R"({"message":"Subscribed"})");
+                });
+            });
+            return;
+        }
+
+        // send - the same path as POST /api/rooms/:id/messages
+        if (body.empty()) {
+            reply(connection, ref, 400, R"({"error":"send needs a message object"})");
+            return;
+        }
+        submit(connection, ref, [this, connection, roomId, ref, body = std::move(body)] {
+            RequestTrace::current().begin();
+            httplib::Response res;
+            try {
+                messages_.postMessage(roomId, body, res);
+                // Same answer the router gives when the HTTP request ran out of time
+                if (RequestContext::current().abandoned()) {
+                    JsonResponses::sendError<"Request deadline exceeded">(res, 504);
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "WebSocket send error: " << e.what() << std::endl;
+                JsonResponses::sendError<"Internal server error">(res, 500);
+            }
+            reply(connection, ref, res.status, res.body);
+        });
+    }
+
+    /**
+     * Loop thread: POST /api/translate without a worker. Unordered with the connection's
+     * other commands; the ref tells the client which reply is which.
+     */
+    Task<void> translate(ConnectionPtr connection, std::string ref, std::string body) {
+        using Body = RequestBodies::Translate;
+        httplib::Response res;
+        JsonReader reader(body);
+        auto fields = Body::SCHEMA.decode(reader, res);
+        if (!fields) {
+            reply(connection, ref, res.status, res.body);
+            co_return;
+        }
+        std::string text(fields->string(Body::TEXT));
+        std::string sourceLang(fields->string(Body::SOURCE_LANG, "auto"));
+        std::string targetLang(fields->string(Body::TARGET_LANG));
+        loopTranslations_.fetch_add(1, std::memory_order_relaxed);
+
+        std::vector<std::string> headers{"Content-Type: application/json"};
+        AsyncHttpClient::Response response = co_await connection->loop.http->post(
+            options_.translationUrl + "/translate", TranslationClient::requestBody(text, sourceLang, targetLang),
+            std::move(headers), options_.translationTimeout);
+
+        std::string translated;
+        if (response.code != CURLE_OK) {
+            std::cerr << "CURL request failed: " << curl_easy_strerror(response.code) << std::endl;
+        } else {
+            translated = TranslationClient::parseResponse(response.body);
+        }
+        if (translated.empty()) {
+            reply(connection, ref, 500, R"({"error":"Translation failed. Check if the language codes are supported."})");
+            co_return;
+        }
+
+        std::string result;
+        JsonWriter writer(result);
+        TranslationHandlers::writeResult(writer, text, translated, sourceLang, targetLang);
+        reply(connection, ref, 200, result);
+    }
+
+    /**
+     * Queue a worker-pool job behind the connection's earlier ones
+     */
+    void submit(const ConnectionPtr& connection, const std::string& ref, std::function<void()> job) {
+        bool full = false;
+        bool startRunner = false;
+        {
+            std::lock_guard<std::mutex> lock(connection->jobsMutex);
+            if (connection->jobs.size() >= options_.maxQueuedCommands) {
+                full = true;
+            } else {
+                connection->jobs.push_back(std::move(job));
+                startRunner = !connection->jobRunning;
+                connection->jobRunning = true;
+            }
+        }
+
+        if (full) {
+            reply(connection, ref, 429, R"({"error":"Too many commands in flight"})");
+        } else if (startRunner) {
+            workers_.enqueue([this, connection] { runJobs(connection); });
+        }
+    }
+
+    void runJobs(const ConnectionPtr& connection) {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::lock_guard<std::mutex> lock(connection->jobsMutex);
+                if (connection->jobs.empty() || connection->closed.load(std::memory_order_relaxed)) {
+                    connection->jobs.clear();
+                    connection->jobRunning = false;
+                    return;
+                }
+                job = std::move(connection->jobs.front());
+                connection->jobs.pop_front();
+            }
+            // Each command gets its own deadline, like a request does in beforeRouting
+            RequestContext& context = RequestContext::current();
+            if (options_.commandTimeout.count() > 0) {
+                context.begin(options_.commandTimeout);
+            } else {
+                context.clear();
+            }
+            try {
+                job();
+            } catch (const std::exception& e) {
+                std::cerr << "WebSocket command error: " << e.what() << std::endl;
+            }
+            context.clear();
+        }
+    }
+
+    /**
+     * {"type":"reply","ref":...,"status":N,"body":<body>} - body is an already-serialized JSON value
+     */
+    void reply(const ConnectionPtr& connection, std::string_view ref, int status, std::string_view body) {
+        std::string payload;
+        JsonWriter writer(payload);
+        writer.beginObject().field("type", "reply");
+        if (ref.empty()) {
+            writer.key("ref").null();
+        } else {
+            writer.field("ref", ref);
+        }
+        writer.field("status", status);
+        writer.key("body");
+        if (body.empty()) {
+            writer.null();
+        } else {
+            writer.raw(body);
+        }
+        writer.endObject();
+        send(connection, std::make_shared<const std::string>(WebSocket::encodeFrame(WebSocket::Opcode::Text, payload)));
+    }
+
+    // ---------- long-poll ----------
+
+    struct LongPoll {
+        int roomId{0};
+        int afterId{0};
+        int timeoutSeconds{DEFAULT_LONG_POLL_SECONDS};
+        std::string_view error;  // set when the query string is unusable
+    };
+
+    /**
+     * GET /api/rooms/<id>/messages/wait[?after_id=X&timeout=S]; nullopt for any other request
+     */
+    std::optional<LongPoll> parseLongPoll(std::string_view head) const {
+        static constexpr std::string_view PREFIX = "/api/rooms/";
+        static constexpr std::string_view SUFFIX = "/messages/wait";
+
+        std::string_view requestLine = head.substr(0, head.find("\r\n"));
+        if (!requestLine.starts_with("GET ")) {
+            return std::nullopt;
+        }
+        requestLine.remove_prefix(4);
+        std::string_view target = requestLine.substr(0, requestLine.find(' '));
+
+        size_t question = target.find('?');
+        std::string_view path = target.substr(0, question);
+        std::string_view query = question == std::string_view::npos ? std::string_view{} : target.substr(question + 1);
+        if (!path.starts_with(PREFIX) || !path.ends_with(SUFFIX) || path.size() <= PREFIX.size() + SUFFIX.size()) {
+            return std::nullopt;
+        }
+
+        auto parseInt = [](std::string_view text, int& out) {
+            auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+            return ec == std::errc() && end == text.data() + text.size();
+        };
+
+        LongPoll poll;
+        std::string_view id = path.substr(PREFIX.size(), path.size() - PREFIX.size() - SUFFIX.size());
+        if (!parseInt(id, poll.roomId) || poll.roomId < 0) {
+            return std::nullopt;  // not one of our paths; the handshake check rejects it
+        }
+
+        while (!query.empty()) {
+            size_t amp = query.find('&');
+            std::string_view pair = query.substr(0, amp);
+            query = amp == std::string_view::npos ? std::string_view{} : query.substr(amp + 1);
+
+            size_t equals = pair.find('=');
+            std::string_view name = pair.substr(0, equals);
+            std::string_view value = equals == std::string_view::npos ? std::string_view{} : pair.substr(equals + 1);
+            if (name == "after_id" && (!parseInt(value, poll.afterId) || poll.afterId < 0)) {
+                poll.error = R"({"error":"after_id must be a non-negative integer"})";
+            } else if (name == "timeout" && (!parseInt(value, poll.timeoutSeconds) || poll.timeoutSeconds < 0)) {
+                poll.error = R"({"error":"timeout must be a non-negative number of seconds"})";
+            }
+        }
+        poll.timeoutSeconds = std::min(poll.timeoutSeconds, options_.maxLongPollSeconds);
+        return poll;
+    }
+
+    /**
+     * Loop thread: arm the timeout and queue the first check
+     */
+    void startLongPoll(const ConnectionPtr& connection, const LongPoll& poll) {
+        Connection& c = *connection;
+        c.polling = true;
+        longPolls_.fetch_add(1, std::memory_order_relaxed);
+
+        if (!poll.error.empty()) {
+            c.responded.store(true);
+            c.closing = true;
+            queueLocal(connection, std::make_shared<const std::string>(httpResponse(400, poll.error)));
+            return;
+        }
+
+        c.pollRoom = poll.roomId;
+        c.pollAfter = poll.afterId;
+        // Counts as a local consumer of the room, so other nodes' messages reach it too
+        hub_.addWatcher(c.pollRoom);
+        c.pollWatching = true;
+        c.pollTimer = c.loop.events.runAfter(std::chrono::seconds(poll.timeoutSeconds), [this, connection] {
+            finishLongPoll(connection, 200, "[]");
+        });
+        if (c.loop.db) {
+            spawn(checkLongPollOnLoop(connection, true));
+        } else {
+            submit(connection, {}, [this, connection] { checkLongPoll(connection, true); });
+        }
+    }
+
+    /**
+     * Loop thread: checkLongPoll as a coroutine over the loop's own Postgres connections.
+     * Polls woken together on this loop share one query per (room version, after_id).
+     */
+    Task<void> checkLongPollOnLoop(ConnectionPtr connection, bool first) {
+        Connection& c = *connection;
+        if (c.responded.load()) {
+            co_return;
+        }
+        Loop& loop = c.loop;
+        try {
+            if (first) {
+                loopDbQueries_.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (first && !co_await loop.db->roomExists(c.pollRoom)) {
+                finishLongPoll(connection, 404, R"({"error":"Room not found"})");
+                co_return;
+            }
+
+            // Park before querying, so a message committed after the query still wakes us.
+            // Wakes arrive on the posting thread; the check belongs on this loop.
+            uint64_t token = waiters_.park(c.pollRoom, [this, connection] {
+                connection->loop.events.post([this, connection] { spawn(checkLongPollOnLoop(connection, false)); });
+            });
+            c.pollToken.store(token);
+
+            auto body = co_await loop.newMessages.run(messages_.newMessagesKey(c.pollRoom, c.pollAfter, LONG_POLL_BATCH),
+                                                      newMessagesJson(loop.db.get(), c.pollRoom, c.pollAfter));
+            if (!body->empty()) {
+                finishLongPoll(connection, 200, *body);
+            } else if (c.responded.load()) {
+                waiters_.cancel(c.pollRoom, token);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Long-poll error: " << e.what() << std::endl;
+            finishLongPoll(connection, 500, R"({"error":"Internal server error"})");
+        }
+    }
+
+    Task<std::string> newMessagesJson(AsyncPostgres* db, int roomId, int afterId) {
+        loopDbQueries_.fetch_add(1, std::memory_order_relaxed);
+        co_return MessageHandlers::messagesJson(co_await db->messagesAfter(roomId, afterId, LONG_POLL_BATCH));
+    }
+
+    /**
+     * Worker: answer with new messages, or stay parked until the room is woken
+     */
+    void checkLongPoll(const ConnectionPtr& connection, bool first) {
+        Connection& c = *connection;
+        if (c.responded.load()) {
+            return;
+        }
+        try {
+            if (first && !db_.getRoomById(c.pollRoom)) {
+                finishLongPoll(connection, 404, R"({"error":"Room not found"})");
+                return;
+            }
+
+            // Park before querying, so a message committed after the query still wakes us
+            uint64_t token = waiters_.park(c.pollRoom, [this, connection] {
+                submit(connection, {}, [this, connection] { checkLongPoll(connection, false); });
+            });
+            c.pollToken.store(token);
+
+            auto body = messages_.messagesAfter(c.pollRoom, c.pollAfter, LONG_POLL_BATCH);
+            if (!body->empty()) {
+                finishLongPoll(connection, 200, *body);
+            } else if (c.responded.load()) {
+                // The timeout or a disconnect got in between park and store; undo the park
+                waiters_.cancel(c.pollRoom, token);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Long-poll error: " << e.what() << std::endl;
+            finishLongPoll(connection, 500, R"({"error":"Internal server error"})");
+        }
+    }
+
+    /**
+     * Any thread: send the one response (later calls are ignored) and close
+     */
+    void finishLongPoll(const ConnectionPtr& connection, int status, std::string_view body) {
+        Connection& c = *connection;
+        if (c.responded.exchange(true)) {
+            return;
+        }
+        waiters_.cancel(c.pollRoom, c.pollToken.load());
+
+        c.loop.events.post([this, connection, response = httpResponse(status, body)]() mutable {
+            Connection& c = *connection;
+            c.loop.events.cancelTimer(c.pollTimer);
+            if (c.closed.load(std::memory_order_relaxed)) {
+                return;
+            }
+            c.closing = true;
+            queueLocal(connection, std::make_shared<const std::string>(std::move(response)));
+        });
+    }
+
+    static std::string httpResponse(int status, std::string_view body) {
+        std::string_view reason = status == 200   ? "OK"
+                                  : status == 400 ? "Bad Request"
+                                  : status == 404 ? "Not Found"
+                                                  : "Internal Server Error";
+        std::string response = "HTTP/1.1 " + std::to_string(status) + " ";
+        response += reason;
+        response +=
+            "\r\nContent-Type: application/json\r\n"
+            "Cache-Control: no-store\r\n"
+            "Access-Control-Allow-Origin: *\r\n"
+            "Connection: close\r\n"
+            "Content-Length: ";
+        response += std::to_string(body.size());
+        response += "\r\n\r\n";
+        response += body;
+        return response;
+    }
+
+    // ---------- fan-out ----------
+
+    RoomShard& roomShard(int roomId) {
+        return roomShards_[static_cast<uint32_t>(roomId) % ROOM_SHARDS];
+    }
+
+    void addSubscriber(int roomId, const ConnectionPtr& connection) {
+        RoomShard& shard = roomShard(roomId);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        shard.rooms[roomId].push_back(connection);
+        subscriptions_.fetch_add(1, std::memory_order_relaxed);
+        hub_.addWatcher(roomId);
+    }
+
+    void removeSubscriber(int roomId, const ConnectionPtr& connection) {
+        RoomShard& shard = roomShard(roomId);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.rooms.find(roomId);
+        if (it == shard.rooms.end()) {
+            return;
+        }
+        if (std::erase(it->second, connection) > 0) {
+            subscriptions_.fetch_sub(1, std::memory_order_relaxed);
+            hub_.removeWatcher(roomId);
+        }
+        if (it->second.empty()) {
+            shard.rooms.erase(it);
+        }
+    }
+
+    /**
+     * RoomHub listener: one encoded frame, shared by every subscriber of the room
+     */
+    void fanOut(int roomId, std::string_view type, std::string_view data) {
+        RoomShard& shard = roomShard(roomId);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.rooms.find(roomId);
+        if (it == shard.rooms.end()) {
+            return;
+        }
+
+        std::string payload;
+        payload.reserve(data.size() + type.size() + 40);
+        JsonWriter writer(payload);
+        writer.beginObject()
+            .field("type", type)
+            .field("room_id", roomId)
+            .key("data").raw(data)
+            .endObject();
+        Frame frame = std::make_shared<const std::string>(WebSocket::encodeFrame(WebSocket::Opcode::Text, payload));
+
+        for (const ConnectionPtr& connection : it->second) {
+            send(connection, frame);
+        }
+        fannedOut_.fetch_add(it->second.size(), std::memory_order_relaxed);
+    }
+
+    // ---------- output ----------
+
+    /**
+     * Queue a frame from any thread; the owning loop is woken once per burst
+     */
+    void send(const ConnectionPtr& connection, Frame frame) {
+        connection->outbox.push(std::move(frame));
+        if (!connection->flushScheduled.exchange(true, std::memory_order_acq_rel)) {
+            connection->loop.events.post([this, connection] { flush(connection); });
+        }
+    }
+
+    // Loop thread: bypasses the outbox (handshake reply, pong, close)
+    void queueLocal(const ConnectionPtr& connection, Frame frame) {
+        connection->pendingBytes += frame->size();
+        connection->pending.push_back(std::move(frame));
+        writePending(connection);
+    }
+
+    void flush(const ConnectionPtr& connection) {
+        Connection& c = *connection;
+        // Reset before draining, as in EventLoop: a push we miss here schedules another flush
+        c.flushScheduled.exchange(false, std::memory_order_acq_rel);
+        if (c.closed.load(std::memory_order_relaxed) || c.closing) {
+            return;
+        }
+
+        Frame frame;
+        while (c.outbox.pop(frame)) {
+            c.pendingBytes += frame->size();
+            c.pending.push_back(std::move(frame));
+        }
+        if (c.pendingBytes > options_.maxPendingBytes) {
+            // Not reading fast enough - a close frame would only queue behind the backlog
+            slowClosed_.fetch_add(1, std::memory_order_relaxed);
+            closeNow(connection);
+            return;
+        }
+        writePending(connection);
+    }
+
+    void writePending(const ConnectionPtr& connection) {
+        Connection& c = *connection;
+        if (c.closed.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        while (!c.pending.empty()) {
+            std::array<iovec, MAX_IOVECS> iov;
+            int count = 0;
+            for (auto it = c.pending.begin(); it != c.pending.end() && count < MAX_IOVECS; ++it, ++count) {
+                size_t skip = count == 0 ? c.pendingOffset : 0;
+                iov[count].iov_base = const_cast<char*>((*it)->data() + skip);
+                iov[count].iov_len = (*it)->size() - skip;
+            }
+
+            ssize_t written = ::writev(c.fd, iov.data(), count);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    setWantWrite(connection, true);
+                    return;
+                }
+                closeNow(connection);
+                return;
+            }
+
+            size_t remaining = static_cast<size_t>(written);
+            c.pendingBytes -= remaining;
+            while (remaining > 0) {
+                size_t left = c.pending.front()->size() - c.pendingOffset;
+                if (remaining < left) {
+                    c.pendingOffset += remaining;
+                    break;
+                }
+                remaining -= left;
+                c.pending.pop_front();
+                c.pendingOffset = 0;
+            }
+        }
+
+        setWantWrite(connection, false);
+        if (c.closing) {
+            closeNow(connection);
+        }
+    }
+
+    void setWantWrite(const ConnectionPtr& connection, bool want) {
+        if (connection->wantWrite == want) {
+            return;
+        }
+        connection->wantWrite = want;
+        connection->loop.events.modify(connection->fd, EPOLLIN | EPOLLRDHUP | (want ? EPOLLOUT : 0u));
+    }
+
+    // ---------- closing ----------
+
+    void rejectHandshake(const ConnectionPtr& connection) {
+        connection->closing = true;
+        queueLocal(connection, std::make_shared<const std::string>(WebSocket::HANDSHAKE_REJECTED));
+    }
+
+    /**
+     * Send a close frame, then close once it (and anything queued before it) is written
+     */
+    void closeWith(const ConnectionPtr& connection, uint16_t code) {
+        if (connection->closing) {
+            return;
+        }
+        connection->closing = true;
+        queueLocal(connection, std::make_shared<const std::string>(WebSocket::encodeClose(code)));
+    }
+
+    void closeNow(const ConnectionPtr& connection, bool forget = true) {
+        Connection& c = *connection;
+        if (c.closed.exchange(true, std::memory_order_acq_rel)) {
+            return;
+        }
+
+        c.loop.events.remove(c.fd);
+        ::close(c.fd);
+
+        if (c.polling) {
+            c.responded.store(true);
+            waiters_.cancel(c.pollRoom, c.pollToken.load());
+            c.loop.events.cancelTimer(c.pollTimer);
+            if (c.pollWatching) {
+                hub_.removeWatcher(c.pollRoom);
+            }
+        }
+
+        for (int roomId : c.rooms) {
+            removeSubscriber(roomId, connection);
+        }
+        c.rooms.clear();
+        c.pending.clear();
+        connections_.fetch_sub(1, std::memory_order_relaxed);
+
+        if (forget) {
+            c.loop.connections.erase(c.fd);
+        }
+    }
+};
+
+#endif // __linux__
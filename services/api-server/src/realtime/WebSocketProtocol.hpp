@@ -0,0 +1,251 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <openssl/evp.h>
+
+/**
+ * RFC 6455 pieces the gateway needs: the opening handshake and the frame codec
+ * Server frames are never masked or fragmented; client frames must be masked and may
+ * be fragmented (the gateway reassembles them).
+ */
+namespace WebSocket {
+
+enum class Opcode : uint8_t {
+    Continuation = 0x0,
+    Text = 0x1,
+    Binary = 0x2,
+    Close = 0x8,
+    Ping = 0x9,
+    Pong = 0xA
+};
+
+// Close status codes used by the gateway
+constexpr uint16_t CLOSE_NORMAL = 1000;
+constexpr uint16_t CLOSE_PROTOCOL_ERROR = 1002;
+constexpr uint16_t CLOSE_UNSUPPORTED = 1003;
+constexpr uint16_t CLOSE_INVALID_DATA = 1007;
+constexpr uint16_t CLOSE_TOO_BIG = 1009;
+
+/**
+ * Sec-WebSocket-Accept for a client's Sec-WebSocket-Key: base64(SHA-1(key + GUID))
+ */
+inline std::string acceptKey(std::string_view clientKey) {
+    static constexpr std::string_view GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+    std::string input;
+    input.reserve(clientKey.size() + GUID.size());
+    input += clientKey;
+    input += GUID;
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digestLength = 0;
+    if (EVP_Digest(input.data(), input.size(), digest, &digestLength, EVP_sha1(), nullptr) != 1) {
+        return {};
+    }
+
+    // 20 digest bytes -> 28 base64 characters plus the terminator EVP_EncodeBlock writes
+    unsigned char encoded[32];
+    int encodedLength = EVP_EncodeBlock(encoded, digest, static_cast<int>(digestLength));
+    return std::string(reinterpret_cast<const char*>(encoded), static_cast<size_t>(encodedLength));
+}
+
+namespace detail {
+
+inline bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        char x = a[i], y = b[i];
+        if (x >= 'A' && x <= 'Z') x = static_cast<char>(x - 'A' + 'a');
+        if (y >= 'A' && y <= 'Z') y = static_cast<char>(y - 'A' + 'a');
+        if (x != y) return false;
+    }
+    return true;
+}
+
+// Does a comma-separated header value contain token (case-insensitive)?
+inline bool hasToken(std::string_view value, std::string_view token) {
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view item = value.substr(0, comma);
+        value = comma == std::string_view::npos ? std::string_view{} : value.substr(comma + 1);
+        while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+        while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+        if (equalsIgnoreCase(item, token)) return true;
+    }
+    return false;
+}
+
+} // namespace detail
+
+/**
+ * Validate an opening handshake (request line and headers, up to the blank line) for path.
+ * Returns the complete 101 response to send back, or nullopt if it is not a valid upgrade.
+ */
+inline std::optional<std::string> handshakeResponse(std::string_view head, std::string_view path) {
+    size_t lineEnd = head.find("\r\n");
+    if (lineEnd == std::string_view::npos) {
+        return std::nullopt;
+    }
+
+    // GET <target> HTTP/1.1 - the target may carry a query string
+    std::string_view requestLine = head.substr(0, lineEnd);
+    if (!requestLine.starts_with("GET ") || !requestLine.ends_with(" HTTP/1.1")) {
+        return std::nullopt;
+    }
+    std::string_view target = requestLine.substr(4, requestLine.size() - 4 - 9);
+    target = target.substr(0, target.find('?'));
+    if (target != path) {
+        return std::nullopt;
+    }
+
+    bool upgrade = false, connection = false, version = false;
+    std::string_view key;
+
+    std::string_view headers = head.substr(lineEnd + 2);
+    while (!headers.empty()) {
+        size_t end = headers.find("\r\n");
+        std::string_view line = headers.substr(0, end);
+        headers = end == std::string_view::npos ? std::string_view{} : headers.substr(end + 2);
+
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) continue;
+        std::string_view name = line.substr(0, colon);
+        std::string_view value = line.substr(colon + 1);
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+        while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+
+        if (detail::equalsIgnoreCase(name, "Upgrade")) upgrade = detail::hasToken(value, "websocket");
+        else if (detail::equalsIgnoreCase(name, "Connection")) connection = detail::hasToken(value, "upgrade");
+        else if (detail::equalsIgnoreCase(name, "Sec-WebSocket-Version")) version = value == "13";
+        else if (detail::equalsIgnoreCase(name, "Sec-WebSocket-Key")) key = value;
+    }
+
+    // The key is 16 random bytes, base64-encoded
+    if (!upgrade || !connection || !version || key.size() != 24) {
+        return std::nullopt;
+    }
+
+    std::string accept = acceptKey(key);
+    if (accept.empty()) {
+        return std::nullopt;
+    }
+
+    std::string response =
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: ";
+    response += accept;
+    response += "\r\n\r\n";
+    return response;
+}
+
+inline constexpr std::string_view HANDSHAKE_REJECTED =
+    "HTTP/1.1 400 Bad Request\r\n"
+    "Connection: close\r\n"
+    "Content-Length: 0\r\n\r\n";
+
+/**
+ * One unfragmented, unmasked server frame
+ */
+inline std::string encodeFrame(Opcode opcode, std::string_view payload) {
+    std::string frame;
+    frame.reserve(payload.size() + 10);
+    frame += static_cast<char>(0x80 | static_cast<uint8_t>(opcode));  // FIN
+
+    size_t length = payload.size();
+    if (length < 126) {
+        frame += static_cast<char>(length);
+    } else if (length <= 0xFFFF) {
+        frame += static_cast<char>(126);
+        frame += static_cast<char>((length >> 8) & 0xFF);
+        frame += static_cast<char>(length & 0xFF);
+    } else {
+        frame += static_cast<char>(127);
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            frame += static_cast<char>((static_cast<uint64_t>(length) >> shift) & 0xFF);
+        }
+    }
+
+    frame += payload;
+    return frame;
+}
+
+inline std::string encodeClose(uint16_t code) {
+    char payload[2] = {static_cast<char>(code >> 8), static_cast<char>(code & 0xFF)};
+    return encodeFrame(Opcode::Close, std::string_view(payload, 2));
+}
+
+struct Frame {
+    bool fin{false};
+    Opcode opcode{Opcode::Continuation};
+    std::string_view payload;  // unmasked, points into the parser's buffer
+};
+
+enum class ParseStatus { NeedMore, Ok, TooBig, ProtocolError };
+
+/**
+ * Parse one client frame starting at buffer[offset], unmasking its payload in place.
+ * On Ok, offset is advanced past the frame.
+ */
+inline ParseStatus parseFrame(std::string& buffer, size_t& offset, size_t maxPayload, Frame& out) {
+    size_t available = buffer.size() - offset;
+    if (available < 2) {
+        return ParseStatus::NeedMore;
+    }
+
+    auto byte = [&](size_t i) { return static_cast<uint8_t>(buffer[offset + i]); };
+
+    uint8_t first = byte(0);
+    uint8_t second = byte(1);
+    if ((first & 0x70) != 0 || (second & 0x80) == 0) {
+        return ParseStatus::ProtocolError;  // reserved bits without an extension, or unmasked
+    }
+
+    out.fin = (first & 0x80) != 0;
+    out.opcode = static_cast<Opcode>(first & 0x0F);
+    bool control = (first & 0x08) != 0;
+
+    uint64_t length = second & 0x7F;
+    size_t header = 2;
+    if (length == 126) {
+        if (available < 4) return ParseStatus::NeedMore;
+        length = (static_cast<uint64_t>(byte(2)) << 8) | byte(3);
+        header = 4;
+    } else if (length == 127) {
+        if (available < 10) return ParseStatus::NeedMore;
+        length = 0;
+        for (size_t i = 2; i < 10; ++i) {
+            length = (length << 8) | byte(i);
+        }
+        header = 10;
+    }
+
+    if (control && (length > 125 || !out.fin)) {
+        return ParseStatus::ProtocolError;
+    }
+    if (length > maxPayload) {
+        return ParseStatus::TooBig;
+    }
+
+    size_t total = header + 4 + static_cast<size_t>(length);
+    if (available < total) {
+        return ParseStatus::NeedMore;
+    }
+
+    uint8_t mask[4] = {byte(header), byte(header + 1), byte(header + 2), byte(header + 3)};
+    char* payload = buffer.data() + offset + header + 4;
+    for (size_t i = 0; i < length; ++i) {
+        payload[i] = static_cast<char>(static_cast<uint8_t>(payload[i]) ^ mask[i & 3]);
+    }
+
+    out.payload = std::string_view(payload, static_cast<size_t>(length));
+    offset += total;
+    return ParseStatus::Ok;
+}
+
+} // namespace WebSocket
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include "../external/httplib.h"
+#include "../external/json.hpp"
+#include "../utils/JsonResponses.hpp"
+#include "ServerOptions.hpp"
+
+/**
+ * CoDel-style load shedding in front of the handlers
+ * The queues requests wait in - the HTTP worker pool and the Postgres connection pool -
+ * report each item's sojourn time. As in CoDel, a queue is only overloaded when even its
+ * shortest wait over a whole interval stays above target: bursts drain within an interval,
+ * a standing queue doesn't. Each overloaded interval raises the shedding level by one and
+ * each good one lowers it by one:
+ *   1 - Low:    room, user and member lists, streams, translation and batches are refused
+ *   2 - Normal: a room's messages, changes and snapshot, single-entity reads and other
+ *               writes as well
+ *   3 - High:   message sends as well (the queue must drain before they are let back in)
+ * Priorities are declared per route in the RouteTable.
+ * Refused requests get an immediate 503, so those admitted still finish inside their
+ * clients' timeouts instead of everyone timing out behind the same queue.
+ */
+class AdmissionControl {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Priority : uint8_t { Low = 1, Normal = 2, High = 3 };
+
+    enum class Source : uint8_t { Workers, Database, COUNT };
+
+    explicit AdmissionControl(const ServerOptions& options)
+        : enabled_(options.loadSheddingEnabled),
+          target_(std::chrono::milliseconds(options.loadShedTargetMs)),
+          interval_(std::chrono::milliseconds(options.loadShedIntervalMs)) {
+        int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now().time_since_epoch()).count();
+        for (Queue& queue : queues_) {
+            queue.intervalStartNs.store(nowNs, std::memory_order_relaxed);
+        }
+    }
+
+    AdmissionControl(const AdmissionControl&) = delete;
+    AdmissionControl& operator=(const AdmissionControl&) = delete;
+
+    /**
+     * Admit or refuse (503) an /api/ request according to the current shedding level
+     * classify() gives the request's priority; it is only called while shedding
+     */
+    template <class Classify>
+    bool admit(const httplib::Request& req, httplib::Response& res, Classify&& classify) {
+        if (!enabled_ || !req.path.starts_with("/api/") || req.path.starts_with("/api/debug/")) {
+            return true;
+        }
+        int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now().time_since_epoch()).count();
+        for (Queue& queue : queues_) {
+            closeInterval(queue, nowNs);  // a queue nobody waited in lately has drained
+        }
+
+        int current = level();
+        if (current == 0) {
+            return true;
+        }
+        Priority priority = classify();
+        if (static_cast<int>(priority) > current) {
+            return true;
+        }
+        shed_[static_cast<size_t>(priority) - 1].fetch_add(1, std::memory_order_relaxed);
+        res.set_header("Retry-After", "1");
+        JsonResponses::sendError<"Server overloaded, try again shortly">(res, 503);
+        return false;
+    }
+
+    /**
+     * Record how long one item waited in source's queue
+     */
+    void observe(Source source, Clock::duration sojourn, Clock::time_point now = Clock::now()) {
+        if (!enabled_) {
+            return;
+        }
+        Queue& queue = queues_[static_cast<size_t>(source)];
+        int64_t waitNs = std::chrono::duration_cast<std::chrono::nanoseconds>(sojourn).count();
+        int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+
+        int64_t shortest = queue.shortestNs.load(std::memory_order_relaxed);
+        while (waitNs < shortest &&
+               !queue.shortestNs.compare_exchange_weak(shortest, waitNs, std::memory_order_relaxed)) {
+        }
+
+        closeInterval(queue, nowNs);
+    }
+
+    /**
+     * Current shedding level: the highest of any queue's
+     */
+    int level() const {
+        int level = 0;
+        for (const Queue& queue : queues_) {
+            level = std::max(level, queue.level.load(std::memory_order_relaxed));
+        }
+        return level;
+    }
+
+    nlohmann::json stats() const {
+        auto queueStats = [](const Queue& queue) {
+            int64_t shortest = queue.lastShortestNs.load(std::memory_order_relaxed);
+            return nlohmann::json{
+                {"level", queue.level.load(std::memory_order_relaxed)},
+                {"min_sojourn_ms", shortest == NO_SAMPLES ? 0.0 : shortest / 1e6}
+            };
+        };
+        return {
+            {"enabled", enabled_},
+            {"target_ms", target_.count() / 1e6},
+            {"interval_ms", interval_.count() / 1e6},
+            {"level", level()},
+            {"workers", queueStats(queues_[static_cast<size_t>(Source::Workers)])},
+            {"database", queueStats(queues_[static_cast<size_t>(Source::Database)])},
+            {"shed", {
+                {"low", shed_[0].load(std::memory_order_relaxed)},
+                {"normal", shed_[1].load(std::memory_order_relaxed)},
+                {"high", shed_[2].load(std::memory_order_relaxed)}
+            }}
+        };
+    }
+
+private:
+    static constexpr int MAX_LEVEL = 3;
+    static constexpr int64_t NO_SAMPLES = std::numeric_limits<int64_t>::max();
+
+    struct alignas(64) Queue {
+        std::atomic<int64_t> shortestNs{NO_SAMPLES};  // this interval so far
+        std::atomic<int64_t> intervalStartNs{0};
+        std::atomic<int> level{0};
+        std::atomic<int64_t> lastShortestNs{NO_SAMPLES};  // last closed interval
+    };
+
+    /**
+     * Once interval has passed, move the level by the interval's shortest wait (one thread
+     * wins the CAS). An interval in which nothing left the queue may just mean everyone is
+     * still stuck in it, so it holds the level; only a second one in a row lowers it.
+     */
+    void closeInterval(Queue& queue, int64_t nowNs) {
+        int64_t start = queue.intervalStartNs.load(std::memory_order_relaxed);
+        if (nowNs - start < interval_.count() ||
+            !queue.intervalStartNs.compare_exchange_strong(start, nowNs, std::memory_order_relaxed)) {
+            return;
+        }
+        int64_t shortest = queue.shortestNs.exchange(NO_SAMPLES, std::memory_order_relaxed);
+        int64_t previous = queue.lastShortestNs.exchange(shortest, std::memory_order_relaxed);
+        int level = queue.level.load(std::memory_order_relaxed);
+        if (shortest == NO_SAMPLES) {
+            if (previous == NO_SAMPLES) level = std::max(level - 1, 0);
+        } else if (shortest > target_.count()) {
+            level = std::min(level + 1, MAX_LEVEL);
+        } else {
+            level = std::max(level - 1, 0);
+        }
+        queue.level.store(level, std::memory_order_relaxed);
+    }
+
+    const bool enabled_;
+    const std::chrono::nanoseconds target_;
+    const std::chrono::nanoseconds interval_;
+    std::array<Queue, static_cast<size_t>(Source::COUNT)> queues_;
+    std::array<std::atomic<uint64_t>, 3> shed_{};
+};
@@ -8,6 +8,26 @@
 #include "../handlers/RoomHandlers.hpp"
 #include "../handlers/MessageHandlers.hpp"
 #include "../handlers/TranslationHandlers.hpp"
+#include "../handlers/StreamHandlers.hpp"
+#include "../handlers/BatchHandlers.hpp"
+#include "../realtime/RoomHub.hpp"
+#include "../realtime/RoomWaiters.hpp"
+#include "../realtime/ClusterFanout.hpp"
+#include "../realtime/PostgresFanout.hpp"
+#include "../realtime/WebSocketGateway.hpp"
+#include "../utils/RequestContext.hpp"
+#include "../utils/RequestTrace.hpp"
+#include "../cache/ChangeVersions.hpp"
+#include "../cache/ResponseCache.hpp"
+#include "../cache/IdempotencyStore.hpp"
+#include "AdmissionControl.hpp"
+#include "HttpFrontEnd.hpp"
+#include "RateLimiter.hpp"
+#include "RequestDeadlines.hpp"
+#include "ResponseCompressor.hpp"
+#include "RouteTable.hpp"
+#include "ServerOptions.hpp"
+#include "WorkerPool.hpp"
 
 /**
  * HTTP Router - Central routing configuration
@@ -16,129 +36,431 @@
 class HTTPRouter {
 private:
     httplib::Server& server_;
+    RouteTable routes_;
+    ChangeVersions versions_;
+    ResponseCache cache_;
+    IdempotencyStore idempotency_;
+    RateLimiter rateLimiter_;
+    AdmissionControl admission_;
+    RequestDeadlines deadlines_;
+    RoomHub hub_;
+    RoomWaiters waiters_;
     UserHandlers userHandlers_;
     RoomHandlers roomHandlers_;
     MessageHandlers messageHandlers_;
     TranslationHandlers translationHandlers_;
+    StreamHandlers streamHandlers_;
+    BatchHandlers batchHandlers_;
+    TraceRecorder traceRecorder_;
+    ResponseCompressor compressor_;
+    // Before the gateway: stopping it drains queued sends, whose writes still relay
+    std::unique_ptr<ClusterFanout> cluster_;
+    std::unique_ptr<PostgresFanout> pgFanout_;
+#if defined(__linux__)
+    std::unique_ptr<WebSocketGateway> gateway_;
+    std::unique_ptr<HttpFrontEnd> frontEnd_;  // last: stopped before anything it routes to
+#endif
 
 public:
     /**
      * Constructor - Initialize all handlers
      */
-    HTTPRouter(httplib::Server& server, Database& db, RabbitMQClient& rabbitmq, TranslationClient& translationClient)
+    HTTPRouter(httplib::Server& server, Database& db, RabbitMQClient& rabbitmq, TranslationClient& translationClient,
+               const ServerOptions& options = {})
         : server_(server),
-          userHandlers_(db, rabbitmq),
-          roomHandlers_(db, rabbitmq),
-          messageHandlers_(db, rabbitmq),
-          translationHandlers_(translationClient) {
+          routes_(server),
+          versions_(options.sharedVersions, std::chrono::seconds(options.versionMaxStalenessSeconds)),
+          cache_(options.responseCacheBytes),
+          idempotency_(options.idempotencyMaxKeys, std::chrono::seconds(options.idempotencyTtlSeconds)),
+          rateLimiter_(options),
+          admission_(options),
+          deadlines_(options),
+          hub_(RoomHub::Options{.historySize = options.sseHistorySize, .queueCapacity = options.sseQueueCapacity}),
+          userHandlers_(db, rabbitmq, versions_),
+          roomHandlers_(db, rabbitmq, versions_, cache_),
+          messageHandlers_(db, rabbitmq, versions_, cache_, idempotency_, rateLimiter_, hub_),
+          translationHandlers_(translationClient),
+          streamHandlers_(db, hub_, options),
+          batchHandlers_(routes_, db, rateLimiter_, options.batchMaxRequests),
+          traceRecorder_(options.traceSampleEvery, options.traceBufferSize),
+          compressor_(options) {
+        // New messages wake parked long-polls, whichever node they were posted on
+        hub_.addListener([this](int roomId, std::string_view type, std::string_view) {
+            if (type == "message.created") {
+                waiters_.wake(roomId);
+            }
+        });
+
+        // Waits for a pooled connection are the queue that grows when Postgres slows down
+        db.setWaitObserver([this](std::chrono::steady_clock::duration wait) {
+            admission_.observe(AdmissionControl::Source::Database, wait);
+        });
+
+        startRealtimeTransport(db, rabbitmq, options);
+
+#if defined(__linux__)
+        if (options.websocketPort > 0) {
+            gateway_ = std::make_unique<WebSocketGateway>(messageHandlers_, db, hub_, waiters_, WebSocketGateway::Options{
+                .host = options.websocketHost,
+                .port = options.websocketPort,
+                .path = "/ws",
+                .loops = options.websocketLoops,
+                .workers = options.websocketWorkers,
+                .maxMessageBytes = options.websocketMaxMessageBytes,
+                .maxPendingBytes = options.websocketMaxPendingBytes,
+                .maxRoomsPerConnection = 100,
+                .maxQueuedCommands = 32,
+                .maxLongPollSeconds = 60,
+                .asyncDbConnection = db.connectionString(),
+                .asyncDbConnectionsPerLoop = options.websocketDbConnections,
+                .asyncQueryTimeout = std::chrono::milliseconds(options.deadlineDefaultMs),
+                .translationUrl = options.websocketTranslate ? translationClient.apiUrl() : std::string(),
+                .translationTimeout = std::chrono::milliseconds(TranslationClient::TIMEOUT_MS),
+                .commandTimeout = std::chrono::milliseconds(options.deadlinesEnabled ? options.deadlineDefaultMs : 0)
+            });
+        }
+
+        if (options.httpEventLoop) {
+            frontEnd_ = std::make_unique<HttpFrontEnd>(
+                [this](httplib::Request& req, httplib::Response& res) { serve(req, res); },
+                HttpFrontEnd::Options{
+                    .host = options.httpHost,
+                    .port = options.httpPort,
+                    .loops = options.httpLoops,
+                    .keepAlive = std::chrono::seconds(options.httpKeepAliveSeconds),
+                    .maxHeaderBytes = options.httpMaxHeaderBytes,
+                    .maxBodyBytes = options.httpMaxBodyBytes,
+                    .maxPendingBytes = options.httpMaxPendingBytes
+                });
+        }
+#endif
+    }
+
+    /**
+     * Connect the hub to the other replicas over RabbitMQ or Postgres LISTEN/NOTIFY
+     */
+    void startRealtimeTransport(Database& db, RabbitMQClient& rabbitmq, const ServerOptions& options) {
+        const std::string& transport = options.realtimeTransport;
+        bool useBroker = transport == "rabbitmq" || (transport == "auto" && rabbitmq.isConnected());
+        bool usePostgres = transport == "postgres" || (transport == "auto" && !useBroker);
+
+        // Another node wrote to this room: local ETags and cached bodies are stale
+        auto deliverRemote = [this](int roomId, std::string_view type, std::string_view data) {
+            versions_.bumpRoom(roomId);
+            cache_.invalidateRoom(roomId);
+            hub_.deliver(roomId, type, data);
+        };
+
+        // Another node wrote to a room, its members or a user: repeat its version bump
+        auto invalidateRemote = [this](std::string_view what, int roomId) {
+            if (!versions_.applyRemote(what, roomId)) {
+                return;
+            }
+            if (what == ChangeVersions::ROOM) {
+                cache_.invalidateRoom(roomId);
+            } else if (what == ChangeVersions::ROOM_LIST) {
+                cache_.invalidateRoomList();
+            }
+        };
+
+        if (useBroker && !options.clusterBrokerHost.empty()) {
+            cluster_ = std::make_unique<ClusterFanout>(rabbitmq, hub_, ClusterFanout::Options{
+                .host = options.clusterBrokerHost,
+                .port = options.clusterBrokerPort,
+                .user = options.clusterBrokerUser,
+                .password = options.clusterBrokerPassword
+            }, deliverRemote, invalidateRemote);
+            versions_.setRelay([this](std::string_view what, int roomId) {
+                cluster_->relayInvalidation(what, roomId);
+            });
+            hub_.setRelay([this](int roomId, std::string_view type, std::string_view data) {
+                cluster_->relay(roomId, type, data);
+            });
+            hub_.setInterestHook([this](int roomId) { cluster_->want(roomId); });
+            cluster_->start();
+        } else if (usePostgres) {
+            // The triggers publish every write, so there is no relay and no per-room binding
+            pgFanout_ = std::make_unique<PostgresFanout>(db, deliverRemote, invalidateRemote);
+            pgFanout_->start();
+        }
+    }
+
+    /**
+     * Task queue for the HTTP server (set as its new_task_queue), reporting queueing delay
+     * to load shedding
+     */
+    httplib::TaskQueue* newTaskQueue(size_t threads) {
+        return new WorkerPool(threads, admission_);
+    }
+
+    /**
+     * Start the WebSocket gateway's listeners and loops (no-op when it is disabled)
+     */
+    bool startWebSocketGateway() {
+#if defined(__linux__)
+        return !gateway_ || gateway_->start();
+#else
+        return true;
+#endif
+    }
+
+    /**
+     * Serve HTTP on the event-loop front end (options.httpEventLoop) with workerThreads for
+     * the requests, instead of httplib's listen(); blocks the same way. False if it is
+     * disabled or cannot start.
+     */
+    bool listenEventLoop(size_t workerThreads) {
+#if defined(__linux__)
+        if (!frontEnd_ || !frontEnd_->start(std::unique_ptr<httplib::TaskQueue>(newTaskQueue(workerThreads)))) {
+            return false;
+        }
+        frontEnd_->wait();
+        return true;
+#else
+        (void)workerThreads;
+        return false;
+#endif
     }
 
     /**
      * Register all API routes
      */
     void registerRoutes() {
-        // Configure CORS
-        server_.set_post_routing_handler([](const httplib::Request&, httplib::Response& res) {
-            res.set_header("Access-Control-Allow-Origin", "*");
-            res.set_header("Access-Control-Allow-Methods", "GET, POST, PUT, PATCH, DELETE, OPTIONS");
-            res.set_header("Access-Control-Allow-Headers", "Content-Type");
+        using Priority = RouteTable::Priority;
+
+        server_.set_pre_routing_handler([this](const httplib::Request& req, httplib::Response& res) {
+            return beforeRouting(req, res);
+        });
+        server_.set_post_routing_handler([this](const httplib::Request& req, httplib::Response& res) {
+            afterRouting(req, res);
         });
 
         // Health check
-        server_.Get("/hi", [](const httplib::Request&, httplib::Response& res) {
+        routes_.add("GET", "/hi", [](const httplib::Request&, httplib::Response& res) {
             res.set_content("Hello World!", "text/plain");
-        });
+        }, Priority::Normal, RouteTable::Scope::Direct);
+
+        // Sampled request traces (newest first)
+        routes_.add("GET", "/api/debug/traces", [this](const httplib::Request&, httplib::Response& res) {
+            res.set_content(traceRecorder_.snapshot().dump(), "application/json");
+        }, Priority::Normal, RouteTable::Scope::Direct);
+
+        // Response cache hit rate and size, message-page coalescing and idempotent replays
+        routes_.add("GET", "/api/debug/cache", [this](const httplib::Request&, httplib::Response& res) {
+            json stats = cache_.stats();
+            stats["message_pages"] = messageHandlers_.coalescingStats();
+            stats["idempotency"] = idempotency_.stats();
+            res.set_content(stats.dump(), "application/json");
+        }, Priority::Normal, RouteTable::Scope::Direct);
+
+        // Rate-limit buckets held and requests allowed / refused per rule
+        routes_.add("GET", "/api/debug/ratelimits", [this](const httplib::Request&, httplib::Response& res) {
+            res.set_content(rateLimiter_.stats().dump(), "application/json");
+        }, Priority::Normal, RouteTable::Scope::Direct);
+
+        // Load-shedding level, queueing delays and requests shed per priority
+        routes_.add("GET", "/api/debug/load", [this](const httplib::Request&, httplib::Response& res) {
+            json stats = admission_.stats();
+#if defined(__linux__)
+            if (frontEnd_) {
+                stats["http_front_end"] = frontEnd_->stats();
+            }
+#endif
+            res.set_content(stats.dump(), "application/json");
+        }, Priority::Normal, RouteTable::Scope::Direct);
+
+        // Live stream subscribers, evictions and resume resets, long-polls and cross-node fan-out
+        routes_.add("GET", "/api/debug/streams", [this](const httplib::Request&, httplib::Response& res) {
+            json stats = streamHandlers_.stats();
+#if defined(__linux__)
+            if (gateway_) {
+                stats["websocket"] = gateway_->stats();
+            }
+#endif
+            if (cluster_) {
+                stats["cluster"] = cluster_->stats();
+            } else if (pgFanout_) {
+                stats["cluster"] = pgFanout_->stats();
+            }
+            res.set_content(stats.dump(), "application/json");
+        }, Priority::Normal, RouteTable::Scope::Direct);
 
         // ====== USER ROUTES ======
 
-        server_.Post("/api/register", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("POST", "/api/register", [this](const httplib::Request& req, httplib::Response& res) {
             userHandlers_.registerUser(req, res);
-        });
+        }, Priority::Normal);
 
-        server_.Post("/api/login", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("POST", "/api/login", [this](const httplib::Request& req, httplib::Response& res) {
             userHandlers_.login(req, res);
-        });
+        }, Priority::Normal);
 
-        server_.Get(R"(/api/users/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("GET", R"(/api/users/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
             userHandlers_.getUserById(req, res);
-        });
+        }, Priority::Normal);
 
-        server_.Get("/api/users", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("GET", "/api/users", [this](const httplib::Request& req, httplib::Response& res) {
             userHandlers_.getAllUsers(req, res);
-        });
+        }, Priority::Low);
 
-        server_.Patch(R"(/api/users/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("PATCH", R"(/api/users/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
             userHandlers_.updateUser(req, res);
-        });
+        }, Priority::Normal);
 
-        server_.Delete(R"(/api/users/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("DELETE", R"(/api/users/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
             userHandlers_.deleteUser(req, res);
-        });
+        }, Priority::Normal);
 
         // ====== ROOM ROUTES ======
 
-        server_.Get("/api/rooms", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("GET", "/api/rooms", [this](const httplib::Request& req, httplib::Response& res) {
             roomHandlers_.getAllRooms(req, res);
-        });
+        }, Priority::Low);
 
-        server_.Get(R"(/api/rooms/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("GET", R"(/api/rooms/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
             roomHandlers_.getRoomById(req, res);
-        });
+        }, Priority::Normal);
 
-        server_.Post("/api/rooms", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("POST", "/api/rooms", [this](const httplib::Request& req, httplib::Response& res) {
             roomHandlers_.createRoom(req, res);
-        });
+        }, Priority::Normal);
 
-        server_.Get(R"(/api/rooms/user/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("GET", R"(/api/rooms/user/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
             roomHandlers_.getRoomsByUser(req, res);
-        });
+        }, Priority::Low);
 
-        server_.Get(R"(/api/rooms/(\d+)/members)", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("GET", R"(/api/rooms/(\d+)/members)", [this](const httplib::Request& req, httplib::Response& res) {
             roomHandlers_.getRoomMembers(req, res);
-        });
+        }, Priority::Low);
+
+        routes_.add("GET", R"(/api/rooms/(\d+)/snapshot)", [this](const httplib::Request& req, httplib::Response& res) {
+            roomHandlers_.getRoomSnapshot(req, res);
+        }, Priority::Normal);
 
-        server_.Post(R"(/api/rooms/(\d+)/members)", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("POST", R"(/api/rooms/(\d+)/members)", [this](const httplib::Request& req, httplib::Response& res) {
             roomHandlers_.addUserToRoom(req, res);
-        });
+        }, Priority::Normal);
 
-        server_.Patch(R"(/api/rooms/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("PATCH", R"(/api/rooms/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
             roomHandlers_.updateRoom(req, res);
-        });
+        }, Priority::Normal);
 
-        server_.Delete(R"(/api/rooms/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("DELETE", R"(/api/rooms/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
             roomHandlers_.deleteRoom(req, res);
-        });
+        }, Priority::Normal);
 
-        server_.Delete(R"(/api/rooms/(\d+)/members/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("DELETE", R"(/api/rooms/(\d+)/members/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
             roomHandlers_.removeUserFromRoom(req, res);
-        });
+        }, Priority::Normal);
 
         // ====== MESSAGE ROUTES ======
 
-        server_.Get(R"(/api/rooms/(\d+)/messages)", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("GET", R"(/api/rooms/(\d+)/messages)", [this](const httplib::Request& req, httplib::Response& res) {
             messageHandlers_.getRoomMessages(req, res);
-        });
+        }, Priority::Normal);
+
+        routes_.add("GET", R"(/api/rooms/(\d+)/changes)", [this](const httplib::Request& req, httplib::Response& res) {
+            messageHandlers_.getRoomChanges(req, res);
+        }, Priority::Normal);
 
-        server_.Post(R"(/api/rooms/(\d+)/messages)", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("POST", R"(/api/rooms/(\d+)/messages)", [this](const httplib::Request& req, httplib::Response& res) {
             messageHandlers_.sendMessage(req, res);
-        });
+        }, Priority::High);
 
-        server_.Get(R"(/api/rooms/messages/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("GET", R"(/api/rooms/messages/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
             messageHandlers_.getMessageById(req, res);
-        });
+        }, Priority::Normal);
 
-        server_.Patch(R"(/api/messages/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("PATCH", R"(/api/messages/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
             messageHandlers_.updateMessage(req, res);
-        });
+        }, Priority::Normal);
 
-        server_.Delete(R"(/api/messages/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("DELETE", R"(/api/messages/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
             messageHandlers_.deleteMessage(req, res);
-        });
+        }, Priority::Normal);
+
+        // Streams hold their worker for as long as they are open, so they can't be batched
+        routes_.add("GET", R"(/api/rooms/(\d+)/stream)", [this](const httplib::Request& req, httplib::Response& res) {
+            streamHandlers_.streamRoom(req, res);
+        }, Priority::Low, RouteTable::Scope::Direct);
 
         // ====== TRANSLATION ROUTE ======
 
-        server_.Post("/api/translate", [this](const httplib::Request& req, httplib::Response& res) {
+        routes_.add("POST", "/api/translate", [this](const httplib::Request& req, httplib::Response& res) {
             translationHandlers_.translateText(req, res);
-        });
+        }, Priority::Low);
+
+        // ====== BATCH ROUTE ======
+
+        routes_.add("POST", "/api/batch", [this](const httplib::Request& req, httplib::Response& res) {
+            batchHandlers_.runBatch(req, res);
+        }, Priority::Low, RouteTable::Scope::Direct);
+    }
+private:
+    /**
+     * Start the request trace and deadline before any routing work, then turn away clients
+     * over their rate limit, and low-priority work while overloaded, before the body is read
+     */
+    httplib::Server::HandlerResponse beforeRouting(const httplib::Request& req, httplib::Response& res) {
+        RequestTrace::current().begin();
+        deadlines_.begin(req);
+        auto priority = [&] { return routes_.priority(req.method, req.path); };
+        if (!rateLimiter_.admit(req, res) || !admission_.admit(req, res, priority)) {
+            return httplib::Server::HandlerResponse::Handled;
+        }
+        return httplib::Server::HandlerResponse::Unhandled;
+    }
+
+    /**
+     * Configure CORS, compress the body and report the phase breakdown
+     */
+    void afterRouting(const httplib::Request& req, httplib::Response& res) {
+        // Whatever the handler made of calls abandoned at the deadline, the answer is 504
+        if (RequestContext::current().abandoned()) {
+            res.headers.erase("ETag");
+            JsonResponses::sendError<"Request deadline exceeded">(res, 504);
+        }
+
+        compressor_.apply(req, res);
+
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_header("Access-Control-Allow-Methods", "GET, POST, PUT, PATCH, DELETE, OPTIONS");
+        res.set_header("Access-Control-Allow-Headers", "Content-Type, If-None-Match, Last-Event-ID, Idempotency-Key, "
+                       "X-Request-Timeout-Ms");
+        res.set_header("Access-Control-Expose-Headers", "Server-Timing, ETag, Idempotent-Replayed, "
+                       "RateLimit-Limit, RateLimit-Remaining, RateLimit-Reset, Retry-After");
+        res.set_header("Timing-Allow-Origin", "*");
+
+        const RequestTrace& trace = RequestTrace::current();
+        res.set_header("Server-Timing", trace.serverTiming());
+
+        if (traceRecorder_.shouldSample()) {
+            traceRecorder_.record(req, res, trace);
+        }
+    }
+
+    /**
+     * A request parsed by the event-loop front end, routed as httplib would: the same
+     * pre-routing checks, the first matching route (404 otherwise), then post-routing
+     */
+    void serve(httplib::Request& req, httplib::Response& res) {
+        if (beforeRouting(req, res) == httplib::Server::HandlerResponse::Unhandled) {
+            const RouteTable::Route* route =
+                routes_.match(req.method == "HEAD" ? "GET" : req.method, req, RouteTable::Scope::Direct);
+            if (route) {
+                try {
+                    route->handler(req, res);
+                } catch (const std::exception& e) {
+                    std::cerr << "Route error: " << e.what() << std::endl;
+                    res.status = 500;
+                }
+            } else {
+                res.status = 404;
+            }
+        }
+        if (res.status == -1) {
+            res.status = 200;
+        }
+        afterRouting(req, res);
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,859 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "../external/httplib.h"
+#include "../external/json.hpp"
+#include "../realtime/EventLoop.hpp"
+
+/**
+ * HTTP/1.1 front end on epoll loops, in place of httplib's thread per connection
+ * A few loop threads (one SO_REUSEPORT listener each) own every socket: they read and
+ * parse requests and write responses. Only a complete request goes to the worker pool,
+ * where the router runs exactly as it would under httplib. A connection between requests
+ * is a socket, a small struct and a timer - no thread - so tens of thousands of idle
+ * keep-alive clients cost memory, not threads.
+ *
+ * Keep-alive and pipelining: requests on one connection are served one at a time, in
+ * order; pipelined ones wait in the input buffer and are dispatched as soon as the
+ * previous response is queued (reading pauses while that backlog is large). Bodies come
+ * with one Content-Length or chunked, up to maxBodyBytes. A connection that neither
+ * reads nor writes a byte for keepAlive is closed, so the idle timeout also bounds a
+ * stalled header or body but not a slow one that keeps sending.
+ *
+ * Chunked content providers (SSE streams) run on the worker that served the request,
+ * as under httplib, with each chunk handed to the loop. A client that lets more than
+ * maxPendingBytes pile up is disconnected.
+ */
+class HttpFrontEnd {
+public:
+    using Handler = std::function<void(httplib::Request&, httplib::Response&)>;
+
+    struct Options {
+        std::string host;
+        int port{0};
+        unsigned loops{0};                    // epoll threads (0 = half the cores)
+        std::chrono::seconds keepAlive{0};    // connections with no reads or writes for this are closed
+        size_t maxHeaderBytes{0};             // request line and headers
+        size_t maxBodyBytes{0};
+        size_t maxPendingBytes{0};            // unsent stream output before a client counts as too slow
+    };
+
+    HttpFrontEnd(Handler handler, const Options& options)
+        : handler_(std::move(handler)), options_(options) {
+        unsigned loops = options.loops;
+        if (loops == 0) {
+            loops = std::max(1u, std::thread::hardware_concurrency() / 2);
+        }
+        for (unsigned i = 0; i < loops; ++i) {
+            loops_.push_back(std::make_unique<Loop>());
+        }
+    }
+
+    ~HttpFrontEnd() {
+        stop();
+    }
+
+    HttpFrontEnd(const HttpFrontEnd&) = delete;
+    HttpFrontEnd& operator=(const HttpFrontEnd&) = delete;
+
+    /**
+     * Bind the listening sockets and start the loop threads; requests run on workers
+     */
+    bool start(std::unique_ptr<httplib::TaskQueue> workers) {
+        workers_ = std::move(workers);
+        for (auto& loop : loops_) {
+            if (!loop->events.valid()) {
+                std::cerr << "HTTP front end: failed to create event loop" << std::endl;
+                return false;
+            }
+            loop->listenFd = listenSocket();
+            if (loop->listenFd < 0) {
+                std::cerr << "HTTP front end: cannot listen on " << options_.host << ":" << options_.port
+                          << " (" << std::strerror(errno) << ")" << std::endl;
+                return false;
+            }
+            Loop* owner = loop.get();
+            loop->events.add(loop->listenFd, EPOLLIN, [this, owner](uint32_t) { acceptAll(*owner); });
+        }
+
+        for (auto& loop : loops_) {
+            Loop* owner = loop.get();
+            loop->thread = std::thread([owner] { owner->events.run(); });
+        }
+        return true;
+    }
+
+    /**
+     * Block until the loops stop (like httplib::Server::listen)
+     */
+    void wait() {
+        std::lock_guard<std::mutex> lock(joinMutex_);  // stop() may be joining from another thread
+        for (auto& loop : loops_) {
+            if (loop->thread.joinable()) loop->thread.join();
+        }
+    }
+
+    void stop() {
+        if (stopped_.exchange(true)) {
+            return;
+        }
+        for (auto& loop : loops_) {
+            Loop* owner = loop.get();
+            if (!owner->thread.joinable()) {
+                if (owner->listenFd >= 0) ::close(owner->listenFd);
+                continue;
+            }
+            // Closing marks each connection closed, which also ends streams on the workers
+            owner->events.post([this, owner] {
+                for (auto& [fd, connection] : owner->connections) {
+                    closeNow(connection, false);
+                }
+                owner->connections.clear();
+                ::close(owner->listenFd);
+            });
+            owner->events.stop();
+        }
+        wait();
+        if (workers_) {
+            workers_->shutdown();
+        }
+    }
+
+    nlohmann::json stats() const {
+        return {
+            {"connections", connections_.load(std::memory_order_relaxed)},
+            {"loops", loops_.size()},
+            {"requests", requests_.load(std::memory_order_relaxed)},
+            {"pipelined", pipelined_.load(std::memory_order_relaxed)},
+            {"idle_closed", idleClosed_.load(std::memory_order_relaxed)},
+            {"bad_requests", badRequests_.load(std::memory_order_relaxed)},
+            {"slow_consumers_closed", slowClosed_.load(std::memory_order_relaxed)}
+        };
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Loop;
+
+    struct Connection {
+        Connection(Loop& owner, int socket, std::string address, int port)
+            : loop(owner), fd(socket), remoteAddr(std::move(address)), remotePort(port) {
+        }
+
+        Loop& loop;
+        const int fd;
+        const std::string remoteAddr;
+        const int remotePort;
+
+        // ---- loop thread only ----
+        std::string input;
+        bool busy{false};         // a request is with the workers, or its stream is running
+        bool closing{false};      // close once pending output is written
+        bool peerDone{false};     // peer shut down its side: answer what was read, then close
+        bool reading{true};       // EPOLLIN registered
+        bool wantWrite{false};    // EPOLLOUT registered
+        bool continued{false};    // 100 Continue sent for the request being read
+        std::deque<std::string> pending;
+        size_t pendingOffset{0};  // bytes of pending.front() already written
+        size_t pendingBytes{0};
+        Clock::time_point lastActive;
+        uint64_t idleTimer{0};
+
+        // ---- any thread ----
+        std::atomic<bool> closed{false};
+    };
+
+    using ConnectionPtr = std::shared_ptr<Connection>;
+
+    struct Loop {
+        EventLoop events;
+        int listenFd{-1};
+        std::thread thread;
+        std::unordered_map<int, ConnectionPtr> connections;
+    };
+
+    static constexpr size_t READ_CHUNK = 64 * 1024;
+    static constexpr size_t MAX_BUFFERED_PIPELINE = 64 * 1024;  // input held while a request runs
+    static constexpr size_t IDLE_BUFFER_BYTES = 4096;          // larger input buffers are freed when idle
+    static constexpr size_t MAX_HEADER_COUNT = 100;
+    static constexpr size_t MAX_TARGET_BYTES = 8192;
+    static constexpr int MAX_IOVECS = 64;
+
+    Handler handler_;
+    const Options options_;
+    std::unique_ptr<httplib::TaskQueue> workers_;
+    std::vector<std::unique_ptr<Loop>> loops_;
+    std::atomic<bool> stopped_{false};
+    std::mutex joinMutex_;
+
+    std::atomic<int64_t> connections_{0};
+    std::atomic<uint64_t> requests_{0};
+    std::atomic<uint64_t> pipelined_{0};
+    std::atomic<uint64_t> idleClosed_{0};
+    std::atomic<uint64_t> badRequests_{0};
+    std::atomic<uint64_t> slowClosed_{0};
+
+    // ---------- sockets ----------
+
+    int listenSocket() const {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(options_.port));
+        if (inet_pton(AF_INET, options_.host.c_str(), &address.sin_addr) != 1 ||
+            ::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(fd, SOMAXCONN) != 0) {
+            int saved = errno;
+            ::close(fd);
+            errno = saved;
+            return -1;
+        }
+        return fd;
+    }
+
+    void acceptAll(Loop& loop) {
+        for (;;) {
+            sockaddr_in peer{};
+            socklen_t peerLength = sizeof(peer);
+            int fd = ::accept4(loop.listenFd, reinterpret_cast<sockaddr*>(&peer), &peerLength,
+                               SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                return;  // EAGAIN, or out of descriptors until someone disconnects
+            }
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+            char address[INET_ADDRSTRLEN] = {};
+            inet_ntop(AF_INET, &peer.sin_addr, address, sizeof(address));
+            auto connection = std::make_shared<Connection>(loop, fd, address, ntohs(peer.sin_port));
+            if (!loop.events.add(fd, EPOLLIN | EPOLLRDHUP, [this, connection](uint32_t events) {
+                    onEvents(connection, events);
+                })) {
+                ::close(fd);
+                continue;
+            }
+            loop.connections.emplace(fd, connection);
+            connections_.fetch_add(1, std::memory_order_relaxed);
+            connection->lastActive = Clock::now();
+            armIdleTimer(connection, options_.keepAlive);
+        }
+    }
+
+    void onEvents(const ConnectionPtr& connection, uint32_t events) {
+        if (events & (EPOLLERR | EPOLLHUP)) {
+            closeNow(connection);
+            return;
+        }
+        if (events & EPOLLOUT) {
+            writePending(connection);
+        }
+        if ((events & (EPOLLIN | EPOLLRDHUP)) && !connection->closed.load(std::memory_order_relaxed)) {
+            readAll(connection);
+        }
+    }
+
+    void readAll(const ConnectionPtr& connection) {
+        thread_local std::string chunk(READ_CHUNK, '\0');
+        Connection& c = *connection;
+
+        while (c.reading) {
+            ssize_t n = ::recv(c.fd, chunk.data(), chunk.size(), 0);
+            if (n > 0) {
+                c.lastActive = Clock::now();  // a slow upload is not idle
+                c.input.append(chunk.data(), static_cast<size_t>(n));
+                process(connection);
+                if (c.closed.load(std::memory_order_relaxed) || c.closing) {
+                    return;
+                }
+                if (c.busy && c.input.size() >= MAX_BUFFERED_PIPELINE) {
+                    setReading(connection, false);  // resumed once the running request is answered
+                }
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+            if (n == 0 && c.busy) {
+                // Half-close after the last request: still owed a response
+                c.peerDone = true;
+                setReading(connection, false);
+                return;
+            }
+            closeNow(connection);  // orderly shutdown by the peer, or a socket error
+            return;
+        }
+    }
+
+    // ---------- requests ----------
+
+    /**
+     * Dispatch the next complete request buffered in input, if no other one is running
+     */
+    void process(const ConnectionPtr& connection) {
+        Connection& c = *connection;
+        if (c.busy || c.closing || c.closed.load(std::memory_order_relaxed) || c.input.empty()) {
+            return;
+        }
+
+        size_t headEnd = c.input.find("\r\n\r\n");
+        if (headEnd == std::string::npos) {
+            if (c.input.size() > options_.maxHeaderBytes) {
+                reject(connection, 431);
+            }
+            return;
+        }
+        if (headEnd + 4 > options_.maxHeaderBytes) {
+            reject(connection, 431);
+            return;
+        }
+
+        auto req = std::make_shared<httplib::Request>();
+        if (int status = parseHead(std::string_view(c.input).substr(0, headEnd + 2), *req); status != 0) {
+            reject(connection, status);
+            return;
+        }
+
+        size_t bodyStart = headEnd + 4;
+        size_t consumed = 0;
+        const std::string& encoding = req->get_header_value("Transfer-Encoding");
+        const std::string& length = req->get_header_value("Content-Length");
+        bool hasLength = req->has_header("Content-Length");
+        // One value of digits only: repeated or comma-joined lengths frame the body ambiguously
+        if (req->get_header_value_count("Content-Length") > 1 ||
+            (hasLength && (length.empty() || !std::ranges::all_of(length, [](char ch) { return ch >= '0' && ch <= '9'; })))) {
+            reject(connection, 400);
+            return;
+        }
+        if (!encoding.empty()) {
+            bool chunked = httplib::detail::case_ignore::equal(encoding, "chunked");
+            if (!chunked || hasLength) {
+                reject(connection, chunked ? 400 : 501);  // both framings at once is a smuggling attempt
+                return;
+            }
+            size_t end = decodeChunked(std::string_view(c.input).substr(bodyStart), req->body, options_.maxBodyBytes);
+            if (end == std::string::npos) {
+                reject(connection, 400);
+                return;
+            }
+            if (end == 0) {
+                if (c.input.size() - bodyStart > 2 * options_.maxBodyBytes + options_.maxHeaderBytes) {
+                    reject(connection, 413);  // mostly chunk framing, or endless trailers
+                } else {
+                    sendContinue(connection, *req);
+                }
+                return;
+            }
+            consumed = bodyStart + end;
+        } else if (hasLength) {
+            size_t bodyBytes = 0;
+            auto [end, ec] = std::from_chars(length.data(), length.data() + length.size(), bodyBytes);
+            if (ec != std::errc() || end != length.data() + length.size()) {
+                reject(connection, 400);
+                return;
+            }
+            if (bodyBytes > options_.maxBodyBytes) {
+                reject(connection, 413);
+                return;
+            }
+            if (c.input.size() - bodyStart < bodyBytes) {
+                sendContinue(connection, *req);
+                return;
+            }
+            req->body.assign(c.input, bodyStart, bodyBytes);
+            consumed = bodyStart + bodyBytes;
+        } else {
+            consumed = bodyStart;
+        }
+
+        c.input.erase(0, consumed);
+        if (c.input.empty() && c.input.capacity() > IDLE_BUFFER_BYTES) {
+            c.input.shrink_to_fit();
+        }
+        dispatch(connection, std::move(req));
+    }
+
+    /**
+     * Request line and headers into req; 0, or the status to refuse the request with
+     */
+    static int parseHead(std::string_view head, httplib::Request& req) {
+        size_t lineEnd = head.find("\r\n");
+        std::string_view line = head.substr(0, lineEnd);
+
+        size_t firstSpace = line.find(' ');
+        size_t secondSpace = firstSpace == std::string_view::npos ? firstSpace : line.find(' ', firstSpace + 1);
+        if (secondSpace == std::string_view::npos || line.find(' ', secondSpace + 1) != std::string_view::npos) {
+            return 400;
+        }
+        req.method = line.substr(0, firstSpace);
+        req.target = line.substr(firstSpace + 1, secondSpace - firstSpace - 1);
+        req.version = line.substr(secondSpace + 1);
+
+        static constexpr std::string_view METHODS[] = {"GET", "HEAD", "POST", "PUT", "DELETE", "OPTIONS", "PATCH"};
+        if (std::find(std::begin(METHODS), std::end(METHODS), req.method) == std::end(METHODS)) {
+            return 501;
+        }
+        if (req.version != "HTTP/1.1" && req.version != "HTTP/1.0") {
+            return 505;
+        }
+        if (req.target.size() > MAX_TARGET_BYTES) {
+            return 414;
+        }
+
+        // Same split and decoding as httplib, so handlers see identical paths and params
+        std::string_view target = req.target;
+        target = target.substr(0, target.find('#'));
+        size_t query = target.find('?');
+        req.path = httplib::decode_path_component(std::string(target.substr(0, query)));
+        if (query != std::string_view::npos) {
+            std::string_view text = target.substr(query + 1);
+            httplib::detail::parse_query_text(text.data(), text.size(), req.params);
+        }
+
+        size_t count = 0;
+        size_t pos = lineEnd + 2;
+        while (pos < head.size()) {
+            size_t end = head.find("\r\n", pos);
+            if (++count > MAX_HEADER_COUNT ||
+                !httplib::detail::parse_header(head.data() + pos, head.data() + end,
+                                               [&](const std::string& key, const std::string& value) {
+                                                   req.headers.emplace(key, value);
+                                               })) {
+                return 400;
+            }
+            pos = end + 2;
+        }
+        return 0;
+    }
+
+    /**
+     * Decode a chunked body at the start of in: the bytes it spans once the last chunk and
+     * any trailers are in, 0 while more input is needed, npos if malformed or over maxBytes
+     */
+    static size_t decodeChunked(std::string_view in, std::string& body, size_t maxBytes) {
+        body.clear();
+        size_t pos = 0;
+        for (;;) {
+            size_t lineEnd = in.find("\r\n", pos);
+            if (lineEnd == std::string_view::npos) {
+                return in.size() - pos > 256 ? std::string_view::npos : 0;
+            }
+            std::string_view field = in.substr(pos, lineEnd - pos);
+            field = field.substr(0, field.find(';'));  // chunk extensions are ignored
+            while (!field.empty() && (field.back() == ' ' || field.back() == '\t')) field.remove_suffix(1);
+
+            size_t size = 0;
+            auto [end, ec] = std::from_chars(field.data(), field.data() + field.size(), size, 16);
+            if (field.empty() || ec != std::errc() || end != field.data() + field.size()) {
+                return std::string_view::npos;
+            }
+            pos = lineEnd + 2;
+
+            if (size == 0) {
+                // Trailers (dropped), up to an empty line
+                for (;;) {
+                    size_t trailerEnd = in.find("\r\n", pos);
+                    if (trailerEnd == std::string_view::npos) return 0;
+                    if (trailerEnd == pos) return pos + 2;
+                    pos = trailerEnd + 2;
+                }
+            }
+            if (size > maxBytes - body.size()) {
+                return std::string_view::npos;
+            }
+            if (in.size() - pos < size + 2) {
+                return 0;
+            }
+            if (in.substr(pos + size, 2) != "\r\n") {
+                return std::string_view::npos;
+            }
+            body.append(in.data() + pos, size);
+            pos += size + 2;
+        }
+    }
+
+    void sendContinue(const ConnectionPtr& connection, const httplib::Request& req) {
+        Connection& c = *connection;
+        if (c.continued || !httplib::detail::case_ignore::equal(req.get_header_value("Expect"), "100-continue")) {
+            return;
+        }
+        c.continued = true;
+        queueLocal(connection, "HTTP/1.1 100 Continue\r\n\r\n");
+    }
+
+    void dispatch(const ConnectionPtr& connection, std::shared_ptr<httplib::Request> req) {
+        Connection& c = *connection;
+        c.busy = true;
+        c.continued = false;
+
+        const std::string& header = req->get_header_value("Connection");
+        bool keepAlive = req->version == "HTTP/1.1"
+                             ? !httplib::detail::case_ignore::equal(header, "close")
+                             : httplib::detail::case_ignore::equal(header, "keep-alive");
+
+        req->remote_addr = c.remoteAddr;
+        req->remote_port = c.remotePort;
+        std::weak_ptr<Connection> weak = connection;
+        req->is_connection_closed = [weak] {
+            auto connection = weak.lock();
+            return !connection || connection->closed.load(std::memory_order_relaxed);
+        };
+
+        requests_.fetch_add(1, std::memory_order_relaxed);
+        workers_->enqueue([this, connection, req = std::move(req), keepAlive] {
+            serve(connection, *req, keepAlive);
+        });
+    }
+
+    /**
+     * Worker thread: run the router, then hand the response to the connection's loop
+     */
+    void serve(const ConnectionPtr& connection, httplib::Request& req, bool keepAlive) {
+        httplib::Response res;
+        res.version = "HTTP/1.1";
+        try {
+            handler_(req, res);
+        } catch (const std::exception& e) {
+            std::cerr << "HTTP front end error: " << e.what() << std::endl;
+            res = httplib::Response();
+            res.status = 500;
+        }
+        if (res.status == -1) {
+            res.status = 200;
+        }
+
+        bool head = req.method == "HEAD";
+        if (res.content_provider_ && res.is_chunked_content_provider_ && !head) {
+            stream(connection, res, keepAlive);
+            return;
+        }
+        if (res.content_provider_ && !head) {
+            readProvider(res);
+        }
+        deliver(connection, responseHead(res, keepAlive, false, res.body.size()) + (head ? "" : res.body), true,
+                keepAlive);
+    }
+
+    /**
+     * Worker thread: run a chunked content provider until it is done or the client leaves
+     */
+    void stream(const ConnectionPtr& connection, httplib::Response& res, bool keepAlive) {
+        const Connection& c = *connection;
+        deliver(connection, responseHead(res, keepAlive, true, 0), false, keepAlive);
+
+        bool done = false;
+        size_t offset = 0;
+        httplib::DataSink sink;
+        sink.write = [&](const char* data, size_t size) {
+            if (c.closed.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            if (size == 0) {
+                return true;  // an empty chunk would end the body
+            }
+            char hex[20];
+            auto [end, ec] = std::to_chars(hex, hex + sizeof(hex), size, 16);
+            std::string chunk(hex, end);
+            chunk.reserve(chunk.size() + size + 4);
+            chunk += "\r\n";
+            chunk.append(data, size);
+            chunk += "\r\n";
+            deliver(connection, std::move(chunk), false, keepAlive);
+            offset += size;
+            return true;
+        };
+        sink.is_writable = [&] { return !c.closed.load(std::memory_order_relaxed); };
+        sink.done = [&] { done = true; };
+        sink.done_with_trailer = [&](const httplib::Headers&) { done = true; };
+
+        while (!done && !c.closed.load(std::memory_order_relaxed)) {
+            if (!res.content_provider_(offset, 0, sink)) {
+                break;
+            }
+        }
+
+        if (done) {
+            res.content_provider_success_ = true;
+            deliver(connection, "0\r\n\r\n", true, keepAlive);
+        } else {
+            connection->loop.events.post([this, connection] { closeNow(connection); });
+        }
+    }
+
+    /**
+     * A provider with a known length (none of our handlers use one) is read into the body
+     */
+    static void readProvider(httplib::Response& res) {
+        std::string body;
+        bool ok = true;
+        httplib::DataSink sink;
+        sink.write = [&](const char* data, size_t size) {
+            body.append(data, size);
+            return true;
+        };
+        sink.is_writable = [] { return true; };
+        while (ok && body.size() < res.content_length_) {
+            size_t before = body.size();
+            ok = res.content_provider_(body.size(), res.content_length_ - body.size(), sink) && body.size() > before;
+        }
+        res.content_provider_success_ = ok;
+        res.body = std::move(body);
+    }
+
+    /**
+     * Status line and headers; framing and connection headers are ours, not the handler's
+     */
+    std::string responseHead(const httplib::Response& res, bool keepAlive, bool chunked, size_t length) const {
+        std::string out = "HTTP/1.1 ";
+        out += std::to_string(res.status);
+        out += ' ';
+        out += httplib::status_message(res.status);
+        out += "\r\n";
+
+        for (const auto& [name, value] : res.headers) {
+            using httplib::detail::case_ignore::equal;
+            if (equal(name, "Content-Length") || equal(name, "Transfer-Encoding") || equal(name, "Connection") ||
+                equal(name, "Keep-Alive")) {
+                continue;
+            }
+            out += name;
+            out += ": ";
+            out += value;
+            out += "\r\n";
+        }
+        if ((chunked || length > 0) && !res.has_header("Content-Type")) {
+            out += "Content-Type: text/plain\r\n";
+        }
+        if (chunked) {
+            out += "Transfer-Encoding: chunked\r\n";
+        } else {
+            out += "Content-Length: ";
+            out += std::to_string(length);
+            out += "\r\n";
+        }
+        if (keepAlive) {
+            out += "Keep-Alive: timeout=";
+            out += std::to_string(options_.keepAlive.count());
+            out += "\r\n";
+        } else {
+            out += "Connection: close\r\n";
+        }
+        out += "\r\n";
+        return out;
+    }
+
+    /**
+     * Any thread: queue bytes on the connection's loop; last ends the request, and the
+     * next pipelined one (if any) is dispatched
+     */
+    void deliver(const ConnectionPtr& connection, std::string bytes, bool last, bool keepAlive) {
+        connection->loop.events.post([this, connection, bytes = std::move(bytes), last, keepAlive]() mutable {
+            Connection& c = *connection;
+            if (c.closed.load(std::memory_order_relaxed)) {
+                return;
+            }
+            c.pendingBytes += bytes.size();
+            c.pending.push_back(std::move(bytes));
+            if (!last) {
+                if (c.pendingBytes > options_.maxPendingBytes) {
+                    slowClosed_.fetch_add(1, std::memory_order_relaxed);
+                    closeNow(connection);
+                    return;
+                }
+                writePending(connection);
+                return;
+            }
+
+            c.busy = false;
+            c.lastActive = Clock::now();
+            if (!keepAlive || (c.peerDone && c.input.empty())) {
+                c.closing = true;
+                c.input.clear();
+            }
+            writePending(connection);
+            if (c.closing || c.closed.load(std::memory_order_relaxed)) {
+                return;
+            }
+
+            if (!c.input.empty()) {
+                process(connection);
+                if (c.busy) {
+                    pipelined_.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            if (c.peerDone && !c.busy && !c.closing) {
+                c.closing = true;  // what is left can never become a request
+                writePending(connection);
+                return;
+            }
+            if (!c.reading && !c.peerDone) {
+                setReading(connection, true);
+            }
+        });
+    }
+
+    // Parse errors: answer and close, since the rest of the input can't be framed
+    void reject(const ConnectionPtr& connection, int status) {
+        badRequests_.fetch_add(1, std::memory_order_relaxed);
+        Connection& c = *connection;
+        c.closing = true;
+        c.input.clear();
+        std::string response = "HTTP/1.1 " + std::to_string(status) + " " + httplib::status_message(status) +
+                               "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        queueLocal(connection, std::move(response));
+    }
+
+    // ---------- output ----------
+
+    // Loop thread only
+    void queueLocal(const ConnectionPtr& connection, std::string bytes) {
+        connection->pendingBytes += bytes.size();
+        connection->pending.push_back(std::move(bytes));
+        writePending(connection);
+    }
+
+    void writePending(const ConnectionPtr& connection) {
+        Connection& c = *connection;
+        if (c.closed.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        while (!c.pending.empty()) {
+            std::array<iovec, MAX_IOVECS> iov;
+            int count = 0;
+            for (auto it = c.pending.begin(); it != c.pending.end() && count < MAX_IOVECS; ++it, ++count) {
+                size_t skip = count == 0 ? c.pendingOffset : 0;
+                iov[count].iov_base = const_cast<char*>(it->data() + skip);
+                iov[count].iov_len = it->size() - skip;
+            }
+
+            ssize_t written = ::writev(c.fd, iov.data(), count);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    setWantWrite(connection, true);
+                    return;
+                }
+                closeNow(connection);
+                return;
+            }
+
+            c.lastActive = Clock::now();
+            size_t remaining = static_cast<size_t>(written);
+            c.pendingBytes -= remaining;
+            while (remaining > 0) {
+                size_t left = c.pending.front().size() - c.pendingOffset;
+                if (remaining < left) {
+                    c.pendingOffset += remaining;
+                    break;
+                }
+                remaining -= left;
+                c.pending.pop_front();
+                c.pendingOffset = 0;
+            }
+        }
+
+        setWantWrite(connection, false);
+        if (c.closing) {
+            closeNow(connection);
+        }
+    }
+
+    void setWantWrite(const ConnectionPtr& connection, bool want) {
+        if (connection->wantWrite == want) {
+            return;
+        }
+        connection->wantWrite = want;
+        updateEvents(*connection);
+    }
+
+    void setReading(const ConnectionPtr& connection, bool reading) {
+        if (connection->reading == reading) {
+            return;
+        }
+        connection->reading = reading;
+        updateEvents(*connection);
+    }
+
+    void updateEvents(Connection& c) {
+        uint32_t events = (c.reading ? EPOLLIN | EPOLLRDHUP : 0u) | (c.wantWrite ? EPOLLOUT : 0u);
+        c.loop.events.modify(c.fd, events);
+    }
+
+    // ---------- closing ----------
+
+    /**
+     * Close connections idle for keepAlive; one timer per connection, pushed back lazily
+     * rather than re-armed on every request
+     */
+    void armIdleTimer(const ConnectionPtr& connection, Clock::duration delay) {
+        std::weak_ptr<Connection> weak = connection;
+        auto ms = std::chrono::ceil<std::chrono::milliseconds>(delay);
+        connection->idleTimer = connection->loop.events.runAfter(ms, [this, weak] {
+            ConnectionPtr connection = weak.lock();
+            if (!connection || connection->closed.load(std::memory_order_relaxed)) {
+                return;
+            }
+            Connection& c = *connection;
+            auto idle = Clock::now() - c.lastActive;
+            if (c.busy || idle < options_.keepAlive) {
+                armIdleTimer(connection, c.busy ? Clock::duration(options_.keepAlive) : options_.keepAlive - idle);
+                return;
+            }
+            idleClosed_.fetch_add(1, std::memory_order_relaxed);
+            closeNow(connection);
+        });
+    }
+
+    void closeNow(const ConnectionPtr& connection, bool forget = true) {
+        Connection& c = *connection;
+        if (c.closed.exchange(true, std::memory_order_acq_rel)) {
+            return;
+        }
+
+        c.loop.events.remove(c.fd);
+        c.loop.events.cancelTimer(c.idleTimer);
+        ::close(c.fd);
+        c.input.clear();
+        c.pending.clear();
+        connections_.fetch_sub(1, std::memory_order_relaxed);
+
+        if (forget) {
+            c.loop.connections.erase(c.fd);
+        }
+    }
+};
+
+#endif // __linux__
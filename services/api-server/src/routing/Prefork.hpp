@@ -0,0 +1,228 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <optional>
+#include <thread>
+#include <vector>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Pre-fork launcher: worker processes serving the same ports, supervised by the parent
+ * Each worker binds the HTTP and WebSocket ports itself with SO_REUSEPORT (httplib and the
+ * gateway already set it), so the kernel spreads new connections across the workers and
+ * they share no accept queue or lock. Everything else - database pool, broker connection,
+ * caches, rate limits - belongs to one worker, so a crash or a long stall only affects
+ * the connections that worker holds.
+ *
+ * run() must be called before any thread is started. In a worker it returns at once; the
+ * parent only supervises, and returns once SIGTERM or SIGINT has stopped every worker. A
+ * worker that exits is forked again, after a delay that doubles while workers keep dying
+ * young, so a bad config doesn't fork in a tight loop. Workers get SIGTERM if the parent
+ * dies.
+ */
+class Prefork {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        unsigned workers{0};                              // 0 = one per core
+        std::chrono::milliseconds restartDelay{100};      // before the first restart
+        std::chrono::milliseconds maxRestartDelay{30000};
+        std::chrono::milliseconds stableAfter{10000};     // a worker that ran this long resets its delay
+        std::chrono::milliseconds stopTimeout{10000};     // then workers still running get SIGKILL
+    };
+
+    /**
+     * The worker's index (0 .. workers-1) in a worker; nullopt in the parent, once stopped
+     */
+    static std::optional<unsigned> run(const Options& options) {
+        Prefork prefork(options);
+        return prefork.supervise();
+    }
+
+private:
+    struct Worker {
+        pid_t pid{0};  // 0: waiting for restartAt
+        Clock::time_point started;
+        Clock::time_point restartAt;
+        std::chrono::milliseconds delay;
+    };
+
+    explicit Prefork(const Options& options)
+        : options_(options), parent_(getpid()) {
+        unsigned count = options.workers;
+        if (count == 0) {
+            count = std::max(1u, std::thread::hardware_concurrency());
+        }
+        workers_.resize(count, Worker{0, {}, {}, options.restartDelay});
+    }
+
+    std::optional<unsigned> supervise() {
+        // Handled synchronously below; workers get the previous mask back
+        sigemptyset(&signals_);
+        sigaddset(&signals_, SIGCHLD);
+        sigaddset(&signals_, SIGTERM);
+        sigaddset(&signals_, SIGINT);
+        sigprocmask(SIG_BLOCK, &signals_, &previousMask_);
+
+        std::cout << "Pre-fork supervisor " << parent_ << ": starting " << workers_.size() << " workers" << std::endl;
+        for (unsigned i = 0; i < workers_.size(); ++i) {
+            if (start(i)) {
+                return i;
+            }
+        }
+
+        for (;;) {
+            timespec wait = toTimespec(untilNextRestart());
+            siginfo_t info;
+            int signal = sigtimedwait(&signals_, &info, &wait);
+            if (signal == SIGTERM || signal == SIGINT) {
+                stop();
+                return std::nullopt;
+            }
+            reap();
+
+            auto now = Clock::now();
+            for (unsigned i = 0; i < workers_.size(); ++i) {
+                if (workers_[i].pid == 0 && workers_[i].restartAt <= now && start(i)) {
+                    return i;
+                }
+            }
+        }
+    }
+
+    /**
+     * Fork worker index; true in the new worker
+     */
+    bool start(unsigned index) {
+        std::cout.flush();  // or the worker inherits (and prints again) whatever is buffered
+        std::cerr.flush();
+        pid_t pid = fork();
+        if (pid < 0) {
+            std::cerr << "Fork worker " << index << " error: " << std::strerror(errno) << std::endl;
+            scheduleRestart(workers_[index], Clock::now());
+            return false;
+        }
+        if (pid == 0) {
+            sigprocmask(SIG_SETMASK, &previousMask_, nullptr);
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            if (getppid() != parent_) {
+                _exit(0);  // the supervisor died before prctl took effect
+            }
+            std::cout << "Worker " << index << " started (pid " << getpid() << ")" << std::endl;
+            return true;
+        }
+        workers_[index].pid = pid;
+        workers_[index].started = Clock::now();
+        return false;
+    }
+
+    /**
+     * Collect exited workers and schedule their replacements
+     */
+    void reap() {
+        int status = 0;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            auto it = std::find_if(workers_.begin(), workers_.end(), [pid](const Worker& w) { return w.pid == pid; });
+            if (it == workers_.end()) {
+                continue;
+            }
+            auto now = Clock::now();
+            if (now - it->started >= options_.stableAfter) {
+                it->delay = options_.restartDelay;
+            }
+            it->pid = 0;
+            scheduleRestart(*it, now);
+            std::cerr << "Worker " << (it - workers_.begin()) << " (pid " << pid << ") " << describe(status)
+                      << "; restarting in " << (it->restartAt - now) / std::chrono::milliseconds(1) << " ms"
+                      << std::endl;
+        }
+    }
+
+    void scheduleRestart(Worker& worker, Clock::time_point now) {
+        worker.restartAt = now + worker.delay;
+        worker.delay = std::min(worker.delay * 2, options_.maxRestartDelay);
+    }
+
+    /**
+     * SIGTERM every worker and wait for them; SIGKILL the ones still running after stopTimeout
+     */
+    void stop() {
+        std::cout << "Stopping workers" << std::endl;
+        for (const Worker& worker : workers_) {
+            if (worker.pid > 0) kill(worker.pid, SIGTERM);
+        }
+
+        auto deadline = Clock::now() + options_.stopTimeout;
+        bool killed = false;
+        for (;;) {
+            int status = 0;
+            pid_t pid;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+                for (Worker& worker : workers_) {
+                    if (worker.pid == pid) worker.pid = 0;
+                }
+            }
+            bool running = std::any_of(workers_.begin(), workers_.end(), [](const Worker& w) { return w.pid > 0; });
+            if (!running) {
+                return;
+            }
+            auto now = Clock::now();
+            if (now >= deadline && !killed) {
+                for (const Worker& worker : workers_) {
+                    if (worker.pid > 0) kill(worker.pid, SIGKILL);
+                }
+                killed = true;
+            }
+            timespec wait = toTimespec(killed ? std::chrono::milliseconds(100)
+                                              : std::chrono::ceil<std::chrono::milliseconds>(deadline - now));
+            siginfo_t info;
+            sigtimedwait(&signals_, &info, &wait);
+        }
+    }
+
+    std::chrono::milliseconds untilNextRestart() const {
+        auto wait = std::chrono::milliseconds(1000);  // reap now and then even if a SIGCHLD was merged
+        auto now = Clock::now();
+        for (const Worker& worker : workers_) {
+            if (worker.pid == 0) {
+                wait = std::min(wait, std::max(std::chrono::ceil<std::chrono::milliseconds>(worker.restartAt - now),
+                                               std::chrono::milliseconds(0)));
+            }
+        }
+        return wait;
+    }
+
+    static timespec toTimespec(std::chrono::milliseconds ms) {
+        return timespec{static_cast<time_t>(ms.count() / 1000), static_cast<long>(ms.count() % 1000) * 1000000};
+    }
+
+    static std::string describe(int status) {
+        if (WIFEXITED(status)) {
+            return "exited with status " + std::to_string(WEXITSTATUS(status));
+        }
+        if (WIFSIGNALED(status)) {
+            return std::string("killed by ") + strsignal(WTERMSIG(status));
+        }
+        return "stopped";
+    }
+
+    Options options_;
+    pid_t parent_;
+    std::vector<Worker> workers_;
+    sigset_t signals_;
+    sigset_t previousMask_;
+};
+
+#endif // __linux__
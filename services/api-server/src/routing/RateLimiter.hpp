@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "../external/httplib.h"
+#include "../external/json.hpp"
+#include "../utils/JsonResponses.hpp"
+#include "ServerOptions.hpp"
+
+/**
+ * Token-bucket rate limits per client address and per user
+ * - admit() runs in the pre-routing stage, before the body is read, and charges the
+ *   request to its client's bucket for the route class (read, write or message send)
+ * - admitUser() charges a message send to the sending user, once the body names them
+ * - Once a client has used half its burst, responses carry RateLimit-Limit / -Remaining /
+ *   -Reset so it can slow down; a refused request is answered 429 with Retry-After.
+ *   Below that the headers are left off - setting them costs more than the bucket itself.
+ *
+ * Buckets refill lazily from the time of their last use, so an idle client costs nothing.
+ * They live in SHARDS mutex-guarded maps keyed by a 64-bit hash of (rule, key); a shard
+ * drops its full buckets every sweepInterval while it already holds its lock, since
+ * a full bucket behaves exactly like a missing one.
+ */
+class RateLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t SHARDS = 64;
+
+    enum class Rule : uint8_t {
+        Read,         // GET per client address
+        Write,        // POST / PATCH / PUT / DELETE per client address
+        Send,         // POST .../messages per client address
+        SendPerUser,  // message sends per user_id, over HTTP, batches and WebSocket
+        COUNT
+    };
+
+    struct Decision {
+        bool allowed{true};
+        unsigned limit{0};
+        unsigned remaining{0};
+        double retryAfter{0};  // seconds until one token is back (when refused)
+        double reset{0};       // seconds until the bucket is full again
+    };
+
+    explicit RateLimiter(const ServerOptions& options)
+        : enabled_(options.rateLimitEnabled),
+          sweepInterval_(std::chrono::seconds(options.rateLimitSweepSeconds)) {
+        limits_[index(Rule::Read)] = options.rateLimitRead;
+        limits_[index(Rule::Write)] = options.rateLimitWrite;
+        limits_[index(Rule::Send)] = options.rateLimitSend;
+        limits_[index(Rule::SendPerUser)] = options.rateLimitSendPerUser;
+    }
+
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    /**
+     * Charge one request to its client address; false (with a 429 in res) if over the limit
+     */
+    bool admit(const httplib::Request& req, httplib::Response& res) {
+        if (!enabled_ || !req.path.starts_with("/api/")) {
+            return true;
+        }
+
+        Rule rule;
+        if (req.method == "GET" || req.method == "HEAD") {
+            rule = Rule::Read;
+        } else if (req.method == "OPTIONS") {
+            return true;  // CORS preflight
+        } else if (req.method == "POST" && req.path.ends_with("/messages")) {
+            rule = Rule::Send;
+        } else {
+            rule = Rule::Write;
+        }
+
+        Decision decision = take(rule, req.remote_addr);
+        report(res, decision);
+        return decision.allowed;
+    }
+
+    /**
+     * Charge a message send to userId. Only a refusal is reported: the address bucket
+     * already set the headers on this response.
+     */
+    bool admitUser(int userId, httplib::Response& res) {
+        if (!enabled_) {
+            return true;
+        }
+        char key[sizeof(userId)];
+        std::memcpy(key, &userId, sizeof(userId));
+        Decision decision = take(Rule::SendPerUser, std::string_view(key, sizeof(key)));
+        if (!decision.allowed) {
+            for (const char* name : {"RateLimit-Limit", "RateLimit-Remaining", "RateLimit-Reset"}) {
+                res.headers.erase(name);
+            }
+            report(res, decision);
+        }
+        return decision.allowed;
+    }
+
+    /**
+     * Take one token from the bucket for (rule, key)
+     */
+    Decision take(Rule rule, std::string_view key, Clock::time_point now = Clock::now()) {
+        const ServerOptions::RateLimit& limit = limits_[index(rule)];
+        uint64_t hash = std::hash<std::string_view>{}(key) ^ (static_cast<uint64_t>(rule) * 0x9E3779B97F4A7C15ull);
+        int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+        Shard& shard = shards_[(hash >> 32) % SHARDS];
+
+        Decision decision;
+        decision.limit = static_cast<unsigned>(limit.burst);
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if (nowNs >= shard.nextSweepNs) {
+                shard.sweep(nowNs, sweepInterval_.count());
+            }
+
+            auto [it, created] = shard.buckets.try_emplace(hash);
+            Bucket& bucket = it->second;
+            double tokens = created ? limit.burst
+                                    : std::min(limit.burst, bucket.tokens + (nowNs - bucket.lastNs) * 1e-9 * limit.perSecond);
+            decision.allowed = tokens >= 1.0;
+            if (decision.allowed) {
+                tokens -= 1.0;
+            } else {
+                decision.retryAfter = (1.0 - tokens) / limit.perSecond;
+            }
+            decision.reset = (limit.burst - tokens) / limit.perSecond;
+            decision.remaining = static_cast<unsigned>(tokens);
+
+            bucket.tokens = tokens;
+            bucket.lastNs = nowNs;
+            bucket.fullAtNs = nowNs + static_cast<int64_t>(decision.reset * 1e9);
+        }
+
+        (decision.allowed ? allowed_ : refused_)[index(rule)].fetch_add(1, std::memory_order_relaxed);
+        return decision;
+    }
+
+    nlohmann::json stats() const {
+        size_t buckets = 0;
+        for (const Shard& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            buckets += shard.buckets.size();
+        }
+
+        nlohmann::json rules = nlohmann::json::object();
+        static constexpr const char* NAMES[] = {"read", "write", "send", "send_per_user"};
+        for (size_t i = 0; i < index(Rule::COUNT); ++i) {
+            rules[NAMES[i]] = {
+                {"per_second", limits_[i].perSecond},
+                {"burst", limits_[i].burst},
+                {"allowed", allowed_[i].load(std::memory_order_relaxed)},
+                {"refused", refused_[i].load(std::memory_order_relaxed)}
+            };
+        }
+        return {
+            {"enabled", enabled_},
+            {"buckets", buckets},
+            {"rules", rules}
+        };
+    }
+
+private:
+    struct Bucket {
+        double tokens{0};
+        int64_t lastNs{0};
+        int64_t fullAtNs{0};  // when lazy refill would top it up - from then on it can go
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<uint64_t, Bucket> buckets;
+        int64_t nextSweepNs{0};
+
+        void sweep(int64_t nowNs, int64_t intervalNs) {
+            std::erase_if(buckets, [nowNs](const auto& entry) { return entry.second.fullAtNs <= nowNs; });
+            nextSweepNs = nowNs + intervalNs;
+        }
+    };
+
+    static constexpr size_t index(Rule rule) {
+        return static_cast<size_t>(rule);
+    }
+
+    /**
+     * RateLimit-* as in the IETF RateLimit header fields draft; whole seconds, rounded up
+     */
+    static void report(httplib::Response& res, const Decision& decision) {
+        if (decision.allowed && decision.remaining * 2 >= decision.limit) {
+            return;
+        }
+        res.set_header("RateLimit-Limit", std::to_string(decision.limit));
+        res.set_header("RateLimit-Remaining", std::to_string(decision.remaining));
+        res.set_header("RateLimit-Reset", std::to_string(static_cast<long>(std::ceil(decision.reset))));
+        if (!decision.allowed) {
+            res.set_header("Retry-After", std::to_string(std::max(1L, static_cast<long>(std::ceil(decision.retryAfter)))));
+            JsonResponses::sendError<"Too many requests">(res, 429);
+        }
+    }
+
+    const bool enabled_;
+    const std::chrono::nanoseconds sweepInterval_;
+    std::array<ServerOptions::RateLimit, static_cast<size_t>(Rule::COUNT)> limits_{};
+    std::array<Shard, SHARDS> shards_;
+
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(Rule::COUNT)> allowed_{};
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(Rule::COUNT)> refused_{};
+};
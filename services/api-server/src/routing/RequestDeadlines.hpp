@@ -0,0 +1,67 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <string>
+#include "../external/httplib.h"
+#include "../utils/RequestContext.hpp"
+#include "ServerOptions.hpp"
+
+/**
+ * Picks each request's deadline and starts its RequestContext
+ * - X-Request-Timeout-Ms from the client (how long it will wait), capped at maxMs
+ * - otherwise the route's default: translation and batches get longer than the rest
+ * - live streams (/api/rooms/:id/stream) and non-API paths get none
+ */
+class RequestDeadlines {
+public:
+    static constexpr const char* HEADER = "X-Request-Timeout-Ms";
+
+    explicit RequestDeadlines(const ServerOptions& options)
+        : enabled_(options.deadlinesEnabled),
+          defaultMs_(options.deadlineDefaultMs),
+          translateMs_(options.deadlineTranslateMs),
+          batchMs_(options.deadlineBatchMs),
+          maxMs_(options.deadlineMaxMs) {
+    }
+
+    void begin(const httplib::Request& req) const {
+        RequestContext& context = RequestContext::current();
+        unsigned ms = budgetMs(req);
+        if (ms == 0) {
+            context.clear();
+        } else {
+            context.begin(std::chrono::milliseconds(ms));
+        }
+    }
+
+    /**
+     * Milliseconds the request may take; 0 for no deadline
+     */
+    unsigned budgetMs(const httplib::Request& req) const {
+        if (!enabled_ || !req.path.starts_with("/api/") || req.path.ends_with("/stream")) {
+            return 0;
+        }
+
+        const std::string& asked = req.get_header_value(HEADER);
+        unsigned ms = 0;
+        if (!asked.empty()) {
+            auto [end, ec] = std::from_chars(asked.data(), asked.data() + asked.size(), ms);
+            if (ec == std::errc() && end == asked.data() + asked.size() && ms > 0) {
+                return std::min(ms, maxMs_);
+            }
+        }
+
+        if (req.path == "/api/translate") return translateMs_;
+        if (req.path == "/api/batch") return batchMs_;
+        return defaultMs_;
+    }
+
+private:
+    const bool enabled_;
+    const unsigned defaultMs_;
+    const unsigned translateMs_;
+    const unsigned batchMs_;
+    const unsigned maxMs_;
+};
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <zlib.h>
+#include "../external/httplib.h"
+#include "../utils/RequestTrace.hpp"
+#include "ServerOptions.hpp"
+
+#ifdef CHAT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/**
+ * Response compression for the post-routing stage
+ * Negotiates gzip / zstd from Accept-Encoding (q-values honoured, zstd preferred on a tie),
+ * compresses JSON and text bodies above a size threshold and fixes up Content-Length.
+ * Compressor state is kept per worker thread and reset between responses instead of
+ * being allocated and torn down for every request.
+ */
+class ResponseCompressor {
+public:
+    enum class Encoding { Identity, Gzip, Zstd };
+
+    explicit ResponseCompressor(const ServerOptions& options)
+        : minBytes_(options.compressionMinBytes),
+          gzipLevel_(options.gzipLevel),
+          zstdLevel_(options.zstdLevel),
+          enabled_(options.compressionEnabled) {
+    }
+
+    void apply(const httplib::Request& req, httplib::Response& res) const {
+        if (!enabled_ || res.body.size() < minBytes_ || !isCompressible(req, res)) {
+            return;
+        }
+
+        // The representation now depends on Accept-Encoding, whatever this client sent
+        res.set_header("Vary", "Accept-Encoding");
+
+        Encoding encoding = negotiate(req.get_header_value("Accept-Encoding"));
+        if (encoding == Encoding::Identity) {
+            return;
+        }
+
+        TraceSpan span("compress");
+        thread_local std::string scratch;
+        bool ok = encoding == Encoding::Gzip ? gzip(res.body, scratch) : zstd(res.body, scratch);
+
+        // Not worth it if the output didn't shrink (already-dense or tiny payloads)
+        if (!ok || scratch.size() >= res.body.size()) {
+            return;
+        }
+
+        res.body.swap(scratch);
+        res.set_header("Content-Encoding", encoding == Encoding::Gzip ? "gzip" : "zstd");
+        replaceHeader(res, "Content-Length", std::to_string(res.body.size()));
+    }
+
+    /**
+     * Pick an encoding from an Accept-Encoding value, e.g. "gzip;q=0.8, zstd, *;q=0"
+     */
+    static Encoding negotiate(std::string_view header) {
+        double gzipQ = -1, zstdQ = -1, anyQ = -1;
+
+        while (!header.empty()) {
+            size_t comma = header.find(',');
+            std::string_view item = header.substr(0, comma);
+            header = comma == std::string_view::npos ? std::string_view{} : header.substr(comma + 1);
+
+            size_t semi = item.find(';');
+            std::string_view coding = trim(item.substr(0, semi));
+            double q = semi == std::string_view::npos ? 1.0 : parseQ(item.substr(semi + 1));
+
+            if (equalsIgnoreCase(coding, "gzip") || equalsIgnoreCase(coding, "x-gzip")) gzipQ = q;
+            else if (equalsIgnoreCase(coding, "zstd")) zstdQ = q;
+            else if (coding == "*") anyQ = q;
+        }
+
+        // Codings not listed fall back to the "*" weight, if any
+        if (gzipQ < 0) gzipQ = anyQ;
+        if (zstdQ < 0) zstdQ = anyQ;
+
+#ifdef CHAT_HAVE_ZSTD
+        if (zstdQ > 0 && zstdQ >= gzipQ) {
+            return Encoding::Zstd;
+        }
+#endif
+        return gzipQ > 0 ? Encoding::Gzip : Encoding::Identity;
+    }
+
+private:
+    size_t minBytes_;
+    int gzipLevel_;
+    int zstdLevel_;
+    bool enabled_;
+
+    static bool isCompressible(const httplib::Request& req, const httplib::Response& res) {
+        if (res.status == 204 || res.status == 206 || res.status == 304) return false;
+        if (res.has_header("Content-Encoding") || req.method == "HEAD") return false;
+
+        const std::string type = res.get_header_value("Content-Type");
+        return type.starts_with("application/json") || type.starts_with("text/");
+    }
+
+    static void replaceHeader(httplib::Response& res, const std::string& name, const std::string& value) {
+        res.headers.erase(name);
+        res.set_header(name, value);
+    }
+
+    // ---------- gzip (zlib) ----------
+
+    struct GzipContext {
+        z_stream stream{};
+        int level{-1};
+
+        ~GzipContext() {
+            if (level >= 0) deflateEnd(&stream);
+        }
+    };
+
+    bool gzip(const std::string& in, std::string& out) const {
+        thread_local GzipContext ctx;
+
+        if (ctx.level != gzipLevel_) {
+            if (ctx.level >= 0) deflateEnd(&ctx.stream);
+            ctx.stream = z_stream{};
+            // windowBits 15 + 16 = gzip wrapper instead of raw zlib
+            if (deflateInit2(&ctx.stream, gzipLevel_, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                ctx.level = -1;
+                return false;
+            }
+            ctx.level = gzipLevel_;
+        } else if (deflateReset(&ctx.stream) != Z_OK) {
+            return false;
+        }
+
+        out.resize(deflateBound(&ctx.stream, in.size()));
+        ctx.stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+        ctx.stream.avail_in = static_cast<uInt>(in.size());
+        ctx.stream.next_out = reinterpret_cast<Bytef*>(out.data());
+        ctx.stream.avail_out = static_cast<uInt>(out.size());
+
+        if (deflate(&ctx.stream, Z_FINISH) != Z_STREAM_END) {
+            return false;
+        }
+        out.resize(ctx.stream.total_out);
+        return true;
+    }
+
+    // ---------- zstd ----------
+
+#ifdef CHAT_HAVE_ZSTD
+    struct ZstdContextDeleter {
+        void operator()(ZSTD_CCtx* ctx) const { ZSTD_freeCCtx(ctx); }
+    };
+
+    bool zstd(const std::string& in, std::string& out) const {
+        thread_local std::unique_ptr<ZSTD_CCtx, ZstdContextDeleter> ctx(ZSTD_createCCtx());
+        if (!ctx) {
+            return false;
+        }
+
+        out.resize(ZSTD_compressBound(in.size()));
+        size_t written = ZSTD_compressCCtx(ctx.get(), out.data(), out.size(), in.data(), in.size(), zstdLevel_);
+        if (ZSTD_isError(written)) {
+            return false;
+        }
+        out.resize(written);
+        return true;
+    }
+#else
+    bool zstd(const std::string&, std::string&) const {
+        return false;
+    }
+#endif
+
+    // ---------- header parsing ----------
+
+    static std::string_view trim(std::string_view s) {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+        return s;
+    }
+
+    static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); ++i) {
+            char x = a[i], y = b[i];
+            if (x >= 'A' && x <= 'Z') x = static_cast<char>(x - 'A' + 'a');
+            if (x != y) return false;
+        }
+        return true;
+    }
+
+    // "q=0.5" among the parameters; malformed weights count as 1
+    static double parseQ(std::string_view params) {
+        params = trim(params);
+        if (params.size() < 2 || (params[0] != 'q' && params[0] != 'Q') || params[1] != '=') {
+            return 1.0;
+        }
+        params.remove_prefix(2);
+
+        double q = 0;
+        double scale = 1;
+        bool fraction = false;
+        for (char c : params) {
+            if (c == '.') {
+                fraction = true;
+            } else if (c >= '0' && c <= '9') {
+                if (fraction) {
+                    scale /= 10;
+                    q += (c - '0') * scale;
+                } else {
+                    q = q * 10 + (c - '0');
+                }
+            } else {
+                break;
+            }
+        }
+        return q;
+    }
+};
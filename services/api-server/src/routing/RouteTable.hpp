@@ -0,0 +1,102 @@
+#pragma once
+
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../external/httplib.h"
+#include "AdmissionControl.hpp"
+
+/**
+ * The API routes, kept as a table as well as registered with httplib
+ * POST /api/batch runs its sub-requests through the same handlers by matching them here,
+ * in registration order and with the same full-path regex match httplib uses, so a
+ * sub-request sees exactly the req.matches a direct request would. The event-loop front
+ * end routes every request through the table, including the Direct routes a batch can't
+ * reach (health, debug, streams and the batch endpoint itself).
+ *
+ * Each route also says how urgent it is, for load shedding to go by instead of guessing
+ * from the path.
+ */
+class RouteTable {
+public:
+    using Handler = httplib::Server::Handler;
+    using Priority = AdmissionControl::Priority;
+
+    enum class Scope {
+        Batchable,  // also reachable from POST /api/batch
+        Direct      // only as a request of its own
+    };
+
+    struct Route {
+        std::string method;
+        std::regex pattern;
+        Handler handler;
+        Priority priority;
+        Scope scope;
+    };
+
+    explicit RouteTable(httplib::Server& server)
+        : server_(server) {
+    }
+
+    RouteTable(const RouteTable&) = delete;
+    RouteTable& operator=(const RouteTable&) = delete;
+
+    void add(std::string_view method, const std::string& pattern, Handler handler, Priority priority,
+             Scope scope = Scope::Batchable) {
+        if (method == "GET") server_.Get(pattern, handler);
+        else if (method == "POST") server_.Post(pattern, handler);
+        else if (method == "PATCH") server_.Patch(pattern, handler);
+        else if (method == "PUT") server_.Put(pattern, handler);
+        else if (method == "DELETE") server_.Delete(pattern, handler);
+        routes_.push_back(Route{std::string(method), std::regex(pattern), std::move(handler), priority, scope});
+    }
+
+    /**
+     * First route for method whose pattern matches the whole of req.path; fills req.matches
+     * (Direct routes only count when scope is Direct)
+     */
+    const Route* match(const std::string& method, httplib::Request& req, Scope scope = Scope::Batchable) const {
+        for (const Route& route : routes_) {
+            if (route.method == method && reaches(scope, route) &&
+                std::regex_match(req.path, req.matches, route.pattern)) {
+                return &route;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Priority of the route a request would reach (HEAD as GET); Normal when none matches
+     */
+    Priority priority(const std::string& method, const std::string& path) const {
+        std::string_view routed = method == "HEAD" ? std::string_view("GET") : std::string_view(method);
+        for (const Route& route : routes_) {
+            if (route.method == routed && std::regex_match(path, route.pattern)) {
+                return route.priority;
+            }
+        }
+        return Priority::Normal;
+    }
+
+    /**
+     * Whether any route serves path, to tell 405 from 404
+     */
+    bool knowsPath(const std::string& path, Scope scope = Scope::Batchable) const {
+        for (const Route& route : routes_) {
+            if (reaches(scope, route) && std::regex_match(path, route.pattern)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    static bool reaches(Scope scope, const Route& route) {
+        return scope == Scope::Direct || route.scope == Scope::Batchable;
+    }
+
+    httplib::Server& server_;
+    std::vector<Route> routes_;
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include "../cache/ChangeVersions.hpp"
+
+/**
+ * Tunables for the HTTP layer
+ * Filled from Config in main.cpp and handed to HTTPRouter, so new knobs
+ * don't have to widen every constructor
+ */
+struct ServerOptions {
+    // Token bucket: refills at perSecond, holds at most burst requests
+    struct RateLimit {
+        double perSecond;
+        double burst;
+    };
+
+    // Request tracing - 1 in traceSampleEvery requests lands in the trace ring buffer
+    unsigned traceSampleEvery{100};
+    size_t traceBufferSize{256};
+
+    // Response compression - bodies smaller than compressionMinBytes go out as-is
+    bool compressionEnabled{true};
+    size_t compressionMinBytes{1024};
+    int gzipLevel{6};
+    int zstdLevel{3};
+
+    // Serialized bodies kept for the hot GET endpoints
+    size_t responseCacheBytes{16 * 1024 * 1024};
+    // ETags and cached bodies are rebuilt at least this often, in case an invalidation
+    // relayed by another replica was lost (0: never)
+    unsigned versionMaxStalenessSeconds{30};
+
+    // Idempotency-Key responses remembered for retried message sends
+    size_t idempotencyMaxKeys{65536};
+    unsigned idempotencyTtlSeconds{3600};
+
+    // Rate limits - per client address for each route class, and per user for message sends
+    bool rateLimitEnabled{true};
+    RateLimit rateLimitRead{50, 100};
+    RateLimit rateLimitWrite{10, 20};
+    RateLimit rateLimitSend{10, 30};
+    RateLimit rateLimitSendPerUser{5, 20};
+    unsigned rateLimitSweepSeconds{30};  // how often idle (full) buckets are dropped
+
+    // Load shedding - once the shortest queueing delay over an interval exceeds the target,
+    // low-priority requests are refused with 503 (see AdmissionControl)
+    bool loadSheddingEnabled{true};
+    unsigned loadShedTargetMs{20};
+    unsigned loadShedIntervalMs{100};
+
+    // Request deadlines - X-Request-Timeout-Ms from the client (capped at deadlineMaxMs) or the
+    // route's default; database, translation and broker calls give up once it has passed
+    bool deadlinesEnabled{true};
+    unsigned deadlineDefaultMs{5000};
+    unsigned deadlineTranslateMs{6000};
+    unsigned deadlineBatchMs{15000};
+    unsigned deadlineMaxMs{30000};
+
+    // POST /api/batch - sub-requests accepted in one batch
+    size_t batchMaxRequests{100};
+
+    // Live room streams (SSE) - each open stream holds one worker thread
+    size_t sseMaxStreams{256};
+    unsigned sseHeartbeatSeconds{15};
+    size_t sseHistorySize{256};    // events per room kept for Last-Event-ID resume
+    size_t sseQueueCapacity{512};  // events a subscriber may lag before it is evicted
+
+    // WebSocket gateway (Linux only) - own port and epoll loops; port 0 disables it
+    std::string websocketHost{"0.0.0.0"};
+    int websocketPort{8081};
+    unsigned websocketLoops{0};                   // 0 = half the cores
+    unsigned websocketWorkers{8};                 // threads for commands that query Postgres
+    size_t websocketDbConnections{4};             // per loop, for long-polls run as coroutines (0 = workers)
+    bool websocketTranslate{true};                // translate command, over curl multi on the loops
+    size_t websocketMaxMessageBytes{64 * 1024};
+    size_t websocketMaxPendingBytes{1024 * 1024};  // unsent output before a client is dropped
+
+    // Event-loop HTTP front end (Linux) in place of httplib's listener: connections live on
+    // epoll loops and only requests take a worker, so idle keep-alive clients hold no thread
+    bool httpEventLoop{false};
+    std::string httpHost{"0.0.0.0"};
+    int httpPort{8080};
+    unsigned httpLoops{0};                        // 0 = half the cores
+    unsigned httpKeepAliveSeconds{120};           // idle connections are closed after this
+    size_t httpMaxHeaderBytes{8192};
+    size_t httpMaxBodyBytes{8 * 1024 * 1024};
+    size_t httpMaxPendingBytes{1024 * 1024};      // unsent SSE output before a client is dropped
+
+    // How live events reach other replicas: "rabbitmq", "postgres" (LISTEN/NOTIFY),
+    // "auto" (RabbitMQ when the API is connected to it, else Postgres) or "none"
+    std::string realtimeTransport{"auto"};
+    std::string clusterBrokerHost;
+    int clusterBrokerPort{5672};
+    std::string clusterBrokerUser;
+    std::string clusterBrokerPassword;
+
+    // Pre-fork mode: change versions in memory shared by all workers (null = this process only)
+    ChangeVersions::State* sharedVersions{nullptr};
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../external/httplib.h"
+#include "AdmissionControl.hpp"
+
+/**
+ * httplib's task queue (one task per accepted connection), reporting queueing delay
+ * Same fixed thread count as httplib::ThreadPool, but each task is stamped on enqueue and
+ * a worker tells AdmissionControl how long it waited before starting it.
+ *
+ * FIFO while AdmissionControl sees no standing queue; while it is shedding, the newest
+ * connection is served first (adaptive LIFO). The oldest ones have usually been given up
+ * on by their clients already, and serving them first would only make everyone late.
+ */
+class WorkerPool final : public httplib::TaskQueue {
+public:
+    WorkerPool(size_t threads, AdmissionControl& admission)
+        : admission_(admission) {
+        threads_.reserve(threads);
+        for (size_t i = 0; i < threads; ++i) {
+            threads_.emplace_back([this] { work(); });
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    bool enqueue(std::function<void()> fn) override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(Job{std::move(fn), AdmissionControl::Clock::now()});
+        }
+        ready_.notify_one();
+        return true;
+    }
+
+    void shutdown() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            shutdown_ = true;
+        }
+        ready_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+private:
+    struct Job {
+        std::function<void()> fn;
+        AdmissionControl::Clock::time_point enqueued;
+    };
+
+    void work() {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ready_.wait(lock, [this] { return !jobs_.empty() || shutdown_; });
+                if (jobs_.empty()) {
+                    break;  // shutting down and drained
+                }
+                if (admission_.level() > 0) {
+                    job = std::move(jobs_.back());
+                    jobs_.pop_back();
+                } else {
+                    job = std::move(jobs_.front());
+                    jobs_.pop_front();
+                }
+            }
+
+            auto now = AdmissionControl::Clock::now();
+            admission_.observe(AdmissionControl::Source::Workers, now - job.enqueued, now);
+            job.fn();
+        }
+    }
+
+    AdmissionControl& admission_;
+    std::vector<std::thread> threads_;
+    std::deque<Job> jobs_;
+    bool shutdown_{false};
+    std::mutex mutex_;
+    std::condition_variable ready_;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * Compile-time perfect hash over a fixed set of JSON field names
+ * The constructor searches for a seed under which every name lands in its own slot,
+ * so a lookup is one hash, one table read and one string compare - no std::set, no allocation.
+ *
+ *   static constexpr FieldTable<3> FIELDS{{"user_id", "content", "message_type"}};
+ *   int index = FIELDS.find(key);   // position in the name list, or -1
+ */
+template <size_t N>
+class FieldTable {
+public:
+    // Power of two with room to spare, so a collision-free seed is found quickly
+    static constexpr size_t SLOTS = [] {
+        size_t slots = 4;
+        while (slots < N * 4) slots <<= 1;
+        return slots;
+    }();
+
+    consteval FieldTable(const std::array<std::string_view, N>& names)
+        : names_(names) {
+        for (uint32_t seed = 1; seed < 100000; ++seed) {
+            if (tryBuild(seed)) {
+                seed_ = seed;
+                return;
+            }
+        }
+        // Reaching here fails constant evaluation - names must be distinct
+        throw "FieldTable: no perfect hash seed found (duplicate field names?)";
+    }
+
+    constexpr int find(std::string_view key) const {
+        int index = slots_[hash(key, seed_) & (SLOTS - 1)];
+        return (index >= 0 && names_[index] == key) ? index : -1;
+    }
+
+    constexpr const std::array<std::string_view, N>& names() const { return names_; }
+    constexpr std::string_view name(size_t index) const { return names_[index]; }
+    static constexpr size_t size() { return N; }
+
+private:
+    // FNV-1a with the seed folded into the offset basis
+    static constexpr uint32_t hash(std::string_view s, uint32_t seed) {
+        uint32_t h = 2166136261u ^ (seed * 16777619u);
+        for (char c : s) {
+            h ^= static_cast<unsigned char>(c);
+            h *= 16777619u;
+        }
+        return h ^ (h >> 15);
+    }
+
+    constexpr bool tryBuild(uint32_t seed) {
+        slots_.fill(-1);
+        for (size_t i = 0; i < N; ++i) {
+            size_t slot = hash(names_[i], seed) & (SLOTS - 1);
+            if (slots_[slot] != -1) {
+                return false;
+            }
+            slots_[slot] = static_cast<int>(i);
+        }
+        return true;
+    }
+
+    std::array<std::string_view, N> names_{};
+    std::array<int, SLOTS> slots_{};
+    uint32_t seed_{0};
+};
@@ -0,0 +1,397 @@
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <forward_list>
+#include <string>
+#include <string_view>
+#include "Utf8.hpp"
+
+/**
+ * One decoded JSON value as seen by JsonReader
+ * - String:        text is the decoded contents (a view into the body when no escapes were present)
+ * - Number:        text is the literal as written
+ * - Object/Array:  text is the raw, already-validated span (nested values are not decoded)
+ */
+enum class JsonType { Null, Bool, Number, String, Object, Array };
+
+struct JsonValue {
+    JsonType type{JsonType::Null};
+    std::string_view text;
+    bool boolean{false};
+
+    /**
+     * Integral number that fits in T (no fraction or exponent)
+     */
+    template <typename T>
+    bool asInteger(T& out) const {
+        if (type != JsonType::Number) {
+            return false;
+        }
+        auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+        return ec == std::errc() && end == text.data() + text.size();
+    }
+};
+
+/**
+ * Single-pass JSON reader for request bodies
+ * Walks the top-level object (or array) once and hands each member to a callback - no DOM is built.
+ * Strings without escape sequences are returned as views into the input; only strings
+ * that contain escapes are decoded into reader-owned storage, which lives as long as the reader.
+ * Like nlohmann::json, strings that are not well-formed UTF-8 make the document malformed.
+ */
+class JsonReader {
+public:
+    static constexpr int MAX_DEPTH = 64;
+
+    explicit JsonReader(std::string_view input)
+        : in_(input) {
+    }
+
+    JsonReader(const JsonReader&) = delete;
+    JsonReader& operator=(const JsonReader&) = delete;
+
+    /**
+     * Call onMember(std::string_view key, const JsonValue& value) for every member of
+     * the top-level object. Returns false if the input is not a well-formed JSON object;
+     * stops early (and returns true) when onMember returns false.
+     */
+    template <typename F>
+    bool forEachMember(F&& onMember) {
+        pos_ = 0;
+        skipWhitespace();
+        if (!consume('{')) {
+            return false;
+        }
+
+        skipWhitespace();
+        if (consume('}')) {
+            return atEnd();
+        }
+
+        for (;;) {
+            std::string_view key;
+            skipWhitespace();
+            if (!readString(key)) {
+                return false;
+            }
+
+            skipWhitespace();
+            if (!consume(':')) {
+                return false;
+            }
+
+            JsonValue value;
+            skipWhitespace();
+            if (!readValue(value, 1)) {
+                return false;
+            }
+
+            if (!onMember(key, value)) {
+                return true;
+            }
+
+            skipWhitespace();
+            if (consume(',')) {
+                continue;
+            }
+            if (consume('}')) {
+                return atEnd();
+            }
+            return false;
+        }
+    }
+
+    /**
+     * Call onElement(const JsonValue& value) for every element of the top-level array.
+     * Returns false if the input is not a well-formed JSON array; stops early (and
+     * returns true) when onElement returns false.
+     */
+    template <typename F>
+    bool forEachElement(F&& onElement) {
+        pos_ = 0;
+        skipWhitespace();
+        if (!consume('[')) {
+            return false;
+        }
+
+        skipWhitespace();
+        if (consume(']')) {
+            return atEnd();
+        }
+
+        for (;;) {
+            JsonValue value;
+            skipWhitespace();
+            if (!readValue(value, 1)) {
+                return false;
+            }
+
+            if (!onElement(value)) {
+                return true;
+            }
+
+            skipWhitespace();
+            if (consume(',')) {
+                continue;
+            }
+            if (consume(']')) {
+                return atEnd();
+            }
+            return false;
+        }
+    }
+
+private:
+    bool atEnd() {
+        skipWhitespace();
+        return pos_ == in_.size();
+    }
+
+    bool consume(char c) {
+        if (pos_ < in_.size() && in_[pos_] == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    bool consumeLiteral(std::string_view literal) {
+        if (in_.substr(pos_, literal.size()) == literal) {
+            pos_ += literal.size();
+            return true;
+        }
+        return false;
+    }
+
+    void skipWhitespace() {
+        while (pos_ < in_.size()) {
+            char c = in_[pos_];
+            if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+                return;
+            }
+            ++pos_;
+        }
+    }
+
+    bool readValue(JsonValue& out, int depth) {
+        if (pos_ >= in_.size()) {
+            return false;
+        }
+
+        size_t start = pos_;
+        switch (in_[pos_]) {
+            case '"':
+                out.type = JsonType::String;
+                return readString(out.text);
+            case '{':
+                out.type = JsonType::Object;
+                if (!skipContainer('{', '}', depth)) return false;
+                out.text = in_.substr(start, pos_ - start);
+                return true;
+            case '[':
+                out.type = JsonType::Array;
+                if (!skipContainer('[', ']', depth)) return false;
+                out.text = in_.substr(start, pos_ - start);
+                return true;
+            case 't':
+                out.type = JsonType::Bool;
+                out.boolean = true;
+                return consumeLiteral("true");
+            case 'f':
+                out.type = JsonType::Bool;
+                out.boolean = false;
+                return consumeLiteral("false");
+            case 'n':
+                out.type = JsonType::Null;
+                return consumeLiteral("null");
+            default:
+                out.type = JsonType::Number;
+                if (!skipNumber()) return false;
+                out.text = in_.substr(start, pos_ - start);
+                return true;
+        }
+    }
+
+    // Validate a nested object/array without decoding it
+    bool skipContainer(char open, char close, int depth) {
+        if (depth >= MAX_DEPTH) {
+            return false;
+        }
+
+        ++pos_;  // open
+        skipWhitespace();
+        if (consume(close)) {
+            return true;
+        }
+
+        for (;;) {
+            skipWhitespace();
+            if (open == '{') {
+                std::string_view ignoredKey;
+                if (!readString(ignoredKey)) return false;
+                skipWhitespace();
+                if (!consume(':')) return false;
+                skipWhitespace();
+            }
+
+            JsonValue ignored;
+            if (!readValue(ignored, depth + 1)) {
+                return false;
+            }
+
+            skipWhitespace();
+            if (consume(',')) {
+                continue;
+            }
+            return consume(close);
+        }
+    }
+
+    // JSON number grammar: -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    bool skipNumber() {
+        auto isDigit = [&](size_t i) { return i < in_.size() && in_[i] >= '0' && in_[i] <= '9'; };
+
+        consume('-');
+        if (consume('0')) {
+            // no leading zeros
+        } else if (isDigit(pos_)) {
+            while (isDigit(pos_)) ++pos_;
+        } else {
+            return false;
+        }
+
+        if (consume('.')) {
+            if (!isDigit(pos_)) return false;
+            while (isDigit(pos_)) ++pos_;
+        }
+
+        if (pos_ < in_.size() && (in_[pos_] == 'e' || in_[pos_] == 'E')) {
+            ++pos_;
+            if (!consume('+')) consume('-');
+            if (!isDigit(pos_)) return false;
+            while (isDigit(pos_)) ++pos_;
+        }
+        return true;
+    }
+
+    /**
+     * Read a string starting at the opening quote
+     * Fast path: no escapes -> view into the input. Otherwise decode into owned storage.
+     */
+    bool readString(std::string_view& out) {
+        if (!consume('"')) {
+            return false;
+        }
+
+        size_t start = pos_;
+        while (pos_ < in_.size()) {
+            unsigned char c = static_cast<unsigned char>(in_[pos_]);
+            if (c == '"') {
+                out = in_.substr(start, pos_ - start);
+                ++pos_;
+                return Utf8::isValid(out);
+            }
+            if (c == '\\') {
+                return decodeEscapedString(start, out);
+            }
+            if (c < 0x20) {
+                return false;
+            }
+            ++pos_;
+        }
+        return false;
+    }
+
+    bool decodeEscapedString(size_t start, std::string_view& out) {
+        std::string& decoded = storage_.emplace_front(in_.substr(start, pos_ - start));
+
+        while (pos_ < in_.size()) {
+            unsigned char c = static_cast<unsigned char>(in_[pos_++]);
+            if (c == '"') {
+                // Escapes are ASCII, so checking the raw span covers every literal byte
+                out = decoded;
+                return Utf8::isValid(in_.substr(start, pos_ - 1 - start));
+            }
+            if (c < 0x20) {
+                return false;
+            }
+            if (c != '\\') {
+                decoded += static_cast<char>(c);
+                continue;
+            }
+
+            if (pos_ >= in_.size()) {
+                return false;
+            }
+            switch (in_[pos_++]) {
+                case '"':  decoded += '"'; break;
+                case '\\': decoded += '\\'; break;
+                case '/':  decoded += '/'; break;
+                case 'b':  decoded += '\b'; break;
+                case 'f':  decoded += '\f'; break;
+                case 'n':  decoded += '\n'; break;
+                case 'r':  decoded += '\r'; break;
+                case 't':  decoded += '\t'; break;
+                case 'u': {
+                    uint32_t cp;
+                    if (!readHex4(cp)) return false;
+                    if (cp >= 0xD800 && cp <= 0xDBFF) {
+                        // High surrogate - must be followed by \uDC00-\uDFFF
+                        uint32_t low;
+                        if (!consumeLiteral("\\u") || !readHex4(low) || low < 0xDC00 || low > 0xDFFF) {
+                            return false;
+                        }
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                        return false;
+                    }
+                    appendUtf8(decoded, cp);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        return false;
+    }
+
+    bool readHex4(uint32_t& out) {
+        if (pos_ + 4 > in_.size()) {
+            return false;
+        }
+        out = 0;
+        for (int i = 0; i < 4; ++i) {
+            char h = in_[pos_++];
+            out <<= 4;
+            if (h >= '0' && h <= '9') out |= static_cast<uint32_t>(h - '0');
+            else if (h >= 'a' && h <= 'f') out |= static_cast<uint32_t>(h - 'a' + 10);
+            else if (h >= 'A' && h <= 'F') out |= static_cast<uint32_t>(h - 'A' + 10);
+            else return false;
+        }
+        return true;
+    }
+
+    static void appendUtf8(std::string& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    std::string_view in_;
+    size_t pos_{0};
+    std::forward_list<std::string> storage_;  // decoded strings that contained escapes
+};
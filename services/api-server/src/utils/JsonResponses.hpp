@@ -0,0 +1,148 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include "../external/httplib.h"
+#include "../database/Database.h"
+#include "JsonWriter.hpp"
+
+/**
+ * Response helpers built on JsonWriter
+ * - sendJson:   hand a finished writer buffer to httplib
+ * - sendError / sendNotice: bodies serialized at compile time, copied straight into the response
+ * - write*Fields: the field sets handlers emit for User / Room / Message
+ */
+namespace JsonResponses {
+
+// Shared so set_content doesn't build a fresh std::string per response
+inline const std::string CONTENT_TYPE = "application/json";
+
+/**
+ * Compile-time string usable as a template argument: sendError<"Room not found">(res, 404)
+ */
+template <size_t N>
+struct FixedString {
+    char data[N]{};
+
+    constexpr FixedString(const char (&s)[N]) {
+        for (size_t i = 0; i < N; ++i) {
+            data[i] = s[i];
+        }
+    }
+
+    constexpr size_t size() const { return N - 1; }
+};
+
+/**
+ * {"<Key>":"<Text>"} laid out at compile time
+ */
+template <FixedString Key, FixedString Text>
+struct StaticBody {
+    static constexpr bool needsEscaping(const char* s, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            if (s[i] == '"' || s[i] == '\\' || static_cast<unsigned char>(s[i]) < 0x20) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static_assert(!needsEscaping(Key.data, Key.size()) && !needsEscaping(Text.data, Text.size()),
+                  "static bodies must not need JSON escaping");
+
+    static constexpr auto bytes = [] {
+        std::array<char, Key.size() + Text.size() + 7> out{};
+        size_t pos = 0;
+        auto put = [&](const char* s, size_t n) {
+            for (size_t i = 0; i < n; ++i) out[pos++] = s[i];
+        };
+        put("{\"", 2);
+        put(Key.data, Key.size());
+        put("\":\"", 3);
+        put(Text.data, Text.size());
+        put("\"}", 2);
+        return out;
+    }();
+};
+
+/**
+ * Send a pre-serialized {"error": ...} body
+ */
+template <FixedString Message>
+inline void sendError(httplib::Response& res, int status) {
+    const auto& body = StaticBody<"error", Message>::bytes;
+    res.set_content(body.data(), body.size(), CONTENT_TYPE);
+    res.status = status;
+}
+
+/**
+ * Send a pre-serialized {"message": ...} body (plain success acknowledgements)
+ */
+template <FixedString Text>
+inline void sendNotice(httplib::Response& res, int status) {
+    const auto& body = StaticBody<"message", Text>::bytes;
+    res.set_content(body.data(), body.size(), CONTENT_TYPE);
+    res.status = status;
+}
+
+/**
+ * Send whatever the writer produced
+ */
+inline void sendJson(httplib::Response& res, int status, const JsonWriter& writer) {
+    res.set_content(writer.str().data(), writer.str().size(), CONTENT_TYPE);
+    res.status = status;
+}
+
+/**
+ * Send an already-serialized body (e.g. from ResponseCache)
+ */
+inline void sendBody(httplib::Response& res, int status, const std::string& body) {
+    res.set_content(body.data(), body.size(), CONTENT_TYPE);
+    res.status = status;
+}
+
+/**
+ * id, username, email - the public view of a user
+ */
+inline void writeUserSummaryFields(JsonWriter& w, const User& user) {
+    w.field("id", user.id)
+     .field("username", user.username)
+     .field("email", user.email);
+}
+
+inline void writeRoomFields(JsonWriter& w, const Room& room) {
+    w.field("id", room.id)
+     .field("name", room.name)
+     .field("description", room.description)
+     .field("created_by", room.created_by)
+     .field("created_at", room.created_at)
+     .field("is_private", room.is_private);
+}
+
+inline void writeMessageFields(JsonWriter& w, const Message& message) {
+    w.field("id", message.id)
+     .field("room_id", message.room_id)
+     .field("user_id", message.user_id)
+     .field("content", message.content)
+     .field("message_type", message.message_type)
+     .field("created_at", message.created_at)
+     .field("edited_at", message.edited_at)
+     .field("is_deleted", message.is_deleted)
+     .field("change_seq", message.change_seq);
+}
+
+inline void writeRoom(JsonWriter& w, const Room& room) {
+    w.beginObject();
+    writeRoomFields(w, room);
+    w.endObject();
+}
+
+inline void writeMessage(JsonWriter& w, const Message& message) {
+    w.beginObject();
+    writeMessageFields(w, message);
+    w.endObject();
+}
+
+} // namespace JsonResponses
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+/**
+ * Streaming JSON writer
+ * Appends tokens straight into a caller-owned std::string instead of building a
+ * nlohmann::json tree - no per-field map nodes, no second pass in dump().
+ * Strings are escaped the same way nlohmann::json::dump() escapes them.
+ */
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& out)
+        : out_(out) {
+    }
+
+    /**
+     * Writer over this thread's scratch buffer - cleared, but keeps its capacity
+     * across requests, so steady-state serialization does not reallocate
+     */
+    static JsonWriter forResponse() {
+        thread_local std::string buffer;
+        buffer.clear();
+        return JsonWriter(buffer);
+    }
+
+    JsonWriter& beginObject() {
+        separate();
+        out_ += '{';
+        first_ = true;
+        return *this;
+    }
+
+    JsonWriter& endObject() {
+        out_ += '}';
+        first_ = false;
+        return *this;
+    }
+
+    JsonWriter& beginArray() {
+        separate();
+        out_ += '[';
+        first_ = true;
+        return *this;
+    }
+
+    JsonWriter& endArray() {
+        out_ += ']';
+        first_ = false;
+        return *this;
+    }
+
+    JsonWriter& key(std::string_view name) {
+        separate();
+        appendString(name);
+        out_ += ':';
+        afterKey_ = true;
+        return *this;
+    }
+
+    JsonWriter& value(std::string_view s) {
+        separate();
+        appendString(s);
+        return *this;
+    }
+
+    JsonWriter& value(const char* s) {
+        return value(std::string_view(s));
+    }
+
+    JsonWriter& value(const std::string& s) {
+        return value(std::string_view(s));
+    }
+
+    JsonWriter& value(bool b) {
+        separate();
+        out_ += b ? "true" : "false";
+        return *this;
+    }
+
+    template <typename T>
+        requires (std::is_integral_v<T> && !std::is_same_v<T, bool>)
+    JsonWriter& value(T n) {
+        separate();
+        char digits[24];
+        auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), n);
+        out_.append(digits, end);
+        return *this;
+    }
+
+    JsonWriter& null() {
+        separate();
+        out_ += "null";
+        return *this;
+    }
+
+    /**
+     * Splice in an already-serialized JSON value (e.g. a cached body)
+     */
+    JsonWriter& raw(std::string_view json) {
+        separate();
+        out_ += json;
+        return *this;
+    }
+
+    /**
+     * key + value in one call
+     */
+    template <typename T>
+    JsonWriter& field(std::string_view name, const T& v) {
+        key(name);
+        return value(v);
+    }
+
+    const std::string& str() const { return out_; }
+
+    /**
+     * Append s as a quoted, escaped JSON string
+     * Runs of plain bytes are copied in one append; only '"', '\\' and control
+     * characters are rewritten. UTF-8 is passed through unchanged.
+     */
+    static void appendEscaped(std::string& out, std::string_view s) {
+        out += '"';
+
+        size_t runStart = 0;
+        for (size_t i = 0; i < s.size(); ++i) {
+            unsigned char c = static_cast<unsigned char>(s[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+
+            out.append(s.data() + runStart, i - runStart);
+            runStart = i + 1;
+
+            switch (c) {
+                case '"':  out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\b': out += "\\b"; break;
+                case '\f': out += "\\f"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default: {
+                    static constexpr char HEX[] = "0123456789abcdef";
+                    char esc[6] = {'\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0x0F]};
+                    out.append(esc, sizeof(esc));
+                }
+            }
+        }
+
+        out.append(s.data() + runStart, s.size() - runStart);
+        out += '"';
+    }
+
+private:
+    // Emit the ',' between siblings (never right after a key)
+    void separate() {
+        if (afterKey_) {
+            afterKey_ = false;
+            return;
+        }
+        if (!first_) {
+            out_ += ',';
+        }
+        first_ = false;
+    }
+
+    void appendString(std::string_view s) {
+        appendEscaped(out_, s);
+    }
+
+    std::string& out_;
+    bool first_{true};
+    bool afterKey_{false};
+};
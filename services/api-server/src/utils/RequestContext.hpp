@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+#include <stdexcept>
+
+/**
+ * Deadline of the request running on the calling thread
+ * Like RequestTrace, each worker thread owns one context that the router resets before
+ * routing, so the database, translation and broker clients can bound their waits without
+ * every call passing a deadline along. The WebSocket gateway does the same around each
+ * worker command; threads that never begin() one (listeners) have no deadline.
+ *
+ * Work given up on because the deadline passed marks the context abandoned; the router
+ * then answers 504 instead of whatever the handler made of the failed call.
+ */
+class RequestContext {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static RequestContext& current() {
+        thread_local RequestContext context;
+        return context;
+    }
+
+    /**
+     * Start a request that must finish within budget
+     */
+    void begin(Clock::duration budget) {
+        deadline_ = Clock::now() + budget;
+        abandoned_ = false;
+    }
+
+    /**
+     * Start a request without a deadline (e.g. a live stream)
+     */
+    void clear() {
+        deadline_ = Clock::time_point::max();
+        abandoned_ = false;
+    }
+
+    bool hasDeadline() const { return deadline_ != Clock::time_point::max(); }
+    Clock::time_point deadline() const { return deadline_; }
+
+    bool expired() const {
+        return hasDeadline() && Clock::now() >= deadline_;
+    }
+
+    /**
+     * Time left before the deadline (zero once passed); only meaningful with hasDeadline()
+     */
+    Clock::duration remaining() const {
+        auto now = Clock::now();
+        return now >= deadline_ ? Clock::duration::zero() : deadline_ - now;
+    }
+
+    void markAbandoned() { abandoned_ = true; }
+    bool abandoned() const { return abandoned_; }
+
+    /**
+     * Throw DeadlineExceeded if abandoned() - before caching or tagging a response built
+     * from calls that may have been given up on
+     */
+    void throwIfAbandoned() const;
+
+    /**
+     * abandoned(), and reset it - for callers that answer one part of a request at a time
+     */
+    bool takeAbandoned() {
+        bool was = abandoned_;
+        abandoned_ = false;
+        return was;
+    }
+
+private:
+    Clock::time_point deadline_{Clock::time_point::max()};
+    bool abandoned_{false};
+};
+
+/**
+ * Thrown instead of starting work the request no longer has time for
+ */
+class DeadlineExceeded : public std::runtime_error {
+public:
+    DeadlineExceeded()
+        : std::runtime_error("request deadline exceeded") {
+    }
+};
+
+inline void RequestContext::throwIfAbandoned() const {
+    if (abandoned_) {
+        throw DeadlineExceeded();
+    }
+}
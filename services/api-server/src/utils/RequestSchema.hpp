@@ -0,0 +1,263 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include "../external/httplib.h"
+#include "FieldTable.hpp"
+#include "JsonReader.hpp"
+#include "JsonResponses.hpp"
+#include "Utf8.hpp"
+
+/**
+ * Declarative request-body schemas
+ * An endpoint declares its fields once - name, JSON type, required/optional, length limits,
+ * an optional content check and the error to report - and RequestSchema::decode() validates
+ * the body in the same pass that reads it: one JsonReader walk, one perfect-hash lookup per
+ * member, no DOM, no std::set, no heap allocation on the success path.
+ *
+ *   static constexpr RequestSchema SCHEMA{{
+ *       {.name = "user_id", .type = FieldType::Integer, .required = true},
+ *       {.name = "content", .type = FieldType::String, .required = true,
+ *        .minLength = 1, .maxLength = 1000, .error = "Message content must be 1-1000 characters"},
+ *   }, "Missing required fields: user_id, content"};
+ *
+ *   auto body = SCHEMA.decode(reader, res);   // nullopt -> 400 already sent
+ *   if (!body) return;
+ *   int userId = body->integer(USER_ID);
+ */
+enum class FieldType { String, Integer, Bool };
+
+struct FieldSpec {
+    std::string_view name;
+    FieldType type{FieldType::String};
+    bool required{false};
+
+    // String fields only: length bounds in codepoints and an extra content rule
+    size_t minLength{0};
+    size_t maxLength{SIZE_MAX};
+    bool (*check)(std::string_view){nullptr};
+
+    // Reported when the length or content rule fails
+    std::string_view error{};
+
+    bool accepts(std::string_view s) const {
+        // JsonReader already rejected malformed UTF-8, and bytes >= codepoints,
+        // so the byte count settles most strings without counting
+        if (s.size() < minLength) {
+            return false;
+        }
+        if (s.size() > maxLength || minLength > 1) {
+            size_t codepoints = Utf8::countCodepoints(s);
+            if (codepoints < minLength || codepoints > maxLength) {
+                return false;
+            }
+        }
+        return check == nullptr || check(s);
+    }
+};
+
+/**
+ * Decoded values, indexed by the field's position in its schema
+ * String values are views into the request body (or the JsonReader's storage),
+ * so the reader must outlive this object.
+ */
+template <size_t N>
+class RequestFields {
+public:
+    bool has(size_t field) const {
+        return (present_ >> field) & 1u;
+    }
+
+    std::string_view string(size_t field, std::string_view fallback = {}) const {
+        return has(field) ? slots_[field].text : fallback;
+    }
+
+    int integer(size_t field, int fallback = 0) const {
+        return has(field) ? slots_[field].integer : fallback;
+    }
+
+    bool boolean(size_t field, bool fallback = false) const {
+        return has(field) ? slots_[field].boolean : fallback;
+    }
+
+private:
+    template <size_t>
+    friend class RequestSchema;
+
+    struct Slot {
+        std::string_view text;
+        int integer{0};
+        bool boolean{false};
+    };
+
+    std::array<Slot, N> slots_{};
+    uint32_t present_{0};
+};
+
+template <size_t N>
+class RequestSchema {
+    static_assert(N > 0 && N <= 32, "RequestSchema tracks fields in a 32-bit mask");
+
+public:
+    using Fields = RequestFields<N>;
+
+    consteval RequestSchema(const FieldSpec (&fields)[N], std::string_view missingError)
+        : fields_(toArray(fields)),
+          table_(namesOf(fields)),
+          missingError_(missingError) {
+        for (size_t i = 0; i < N; ++i) {
+            if (fields[i].required) {
+                requiredMask_ |= 1u << i;
+            }
+            if (fields[i].type != FieldType::String &&
+                (fields[i].minLength != 0 || fields[i].maxLength != SIZE_MAX || fields[i].check)) {
+                throw "RequestSchema: length limits and checks apply to string fields only";
+            }
+        }
+    }
+
+    const FieldSpec& field(size_t index) const { return fields_[index]; }
+    static constexpr size_t size() { return N; }
+
+    /**
+     * Read and validate the body in one pass
+     * On failure the 400 response is already written and nullopt is returned. Errors are
+     * reported in a fixed order: malformed JSON, unknown fields, wrong types, missing required
+     * fields, then the first field (in declaration order) whose rule failed.
+     */
+    std::optional<Fields> decode(JsonReader& reader, httplib::Response& res) const {
+        constexpr size_t MAX_REPORTED = 8;
+        std::array<std::string_view, MAX_REPORTED> unknown;
+        size_t unknownCount = 0;
+        int wrongType = -1;
+        uint32_t rejected = 0;
+
+        Fields out;
+        bool wellFormed = reader.forEachMember([&](std::string_view key, const JsonValue& value) {
+            int index = table_.find(key);
+            if (index < 0) {
+                if (unknownCount < MAX_REPORTED) {
+                    unknown[unknownCount++] = key;
+                }
+                return true;
+            }
+
+            const FieldSpec& spec = fields_[index];
+            auto& slot = out.slots_[index];
+            bool typed = false;
+            switch (spec.type) {
+                case FieldType::String:
+                    typed = value.type == JsonType::String;
+                    slot.text = value.text;
+                    break;
+                case FieldType::Integer:
+                    typed = value.asInteger(slot.integer);
+                    break;
+                case FieldType::Bool:
+                    typed = value.type == JsonType::Bool;
+                    slot.boolean = value.boolean;
+                    break;
+            }
+
+            if (!typed) {
+                if (wrongType < 0) {
+                    wrongType = index;
+                }
+                return true;
+            }
+
+            out.present_ |= 1u << index;
+            if (spec.type == FieldType::String && !spec.accepts(slot.text)) {
+                rejected |= 1u << index;
+            } else {
+                rejected &= ~(1u << index);
+            }
+            return true;
+        });
+
+        if (!wellFormed) {
+            JsonResponses::sendError<"Invalid JSON format">(res, 400);
+            return std::nullopt;
+        }
+
+        if (unknownCount > 0) {
+            sendInvalidFields(res, unknown.data(), unknownCount);
+            return std::nullopt;
+        }
+
+        if (wrongType >= 0) {
+            JsonWriter w = JsonWriter::forResponse();
+            w.beginObject()
+             .field("error", "Invalid type for field '" + std::string(fields_[wrongType].name) + "'")
+             .endObject();
+            JsonResponses::sendJson(res, 400, w);
+            return std::nullopt;
+        }
+
+        if ((out.present_ & requiredMask_) != requiredMask_) {
+            sendErrorText(res, missingError_);
+            return std::nullopt;
+        }
+
+        if (rejected != 0) {
+            sendErrorText(res, fields_[std::countr_zero(rejected)].error);
+            return std::nullopt;
+        }
+
+        return out;
+    }
+
+private:
+    static consteval std::array<FieldSpec, N> toArray(const FieldSpec (&fields)[N]) {
+        std::array<FieldSpec, N> out{};
+        for (size_t i = 0; i < N; ++i) out[i] = fields[i];
+        return out;
+    }
+
+    static consteval std::array<std::string_view, N> namesOf(const FieldSpec (&fields)[N]) {
+        std::array<std::string_view, N> out{};
+        for (size_t i = 0; i < N; ++i) out[i] = fields[i].name;
+        return out;
+    }
+
+    static void sendErrorText(httplib::Response& res, std::string_view message) {
+        JsonWriter w = JsonWriter::forResponse();
+        w.beginObject().field("error", message).endObject();
+        JsonResponses::sendJson(res, 400, w);
+    }
+
+    /**
+     * {"error": "Invalid fields: 'a', 'b'", "allowed_fields": [...]}
+     */
+    void sendInvalidFields(httplib::Response& res, const std::string_view* invalid, size_t count) const {
+        std::string fieldsList;
+        for (size_t i = 0; i < count; ++i) {
+            if (i > 0) {
+                fieldsList += ", ";
+            }
+            fieldsList += '\'';
+            fieldsList += invalid[i];
+            fieldsList += '\'';
+        }
+
+        JsonWriter w = JsonWriter::forResponse();
+        w.beginObject()
+         .field("error", "Invalid fields: " + fieldsList)
+         .key("allowed_fields").beginArray();
+        for (std::string_view name : table_.names()) {
+            w.value(name);
+        }
+        w.endArray().endObject();
+        JsonResponses::sendJson(res, 400, w);
+    }
+
+    std::array<FieldSpec, N> fields_;
+    FieldTable<N> table_;
+    std::string_view missingError_;
+    uint32_t requiredMask_{0};
+};
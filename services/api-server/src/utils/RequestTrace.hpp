@@ -0,0 +1,246 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../external/httplib.h"
+#include "../external/json.hpp"
+
+using json = nlohmann::json;
+
+/**
+ * Request-scoped span recorder
+ * httplib runs a whole request on one worker thread, so each thread owns a single
+ * RequestTrace that the router resets before routing and reads back after the handler.
+ * Spans are stored in a fixed-size array - recording a phase never allocates.
+ */
+class RequestTrace {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t MAX_SPANS = 16;
+
+    // One timed phase; name must be a string literal (Server-Timing token, no spaces)
+    struct Span {
+        const char* name;
+        int64_t startNs;
+        int64_t durationNs;
+    };
+
+    /**
+     * Trace of the request running on the calling thread
+     */
+    static RequestTrace& current() {
+        thread_local RequestTrace trace;
+        return trace;
+    }
+
+    /**
+     * Start a new request - drops spans left over from the previous one
+     */
+    void begin() {
+        start_ = Clock::now();
+        count_ = 0;
+        dropped_ = 0;
+    }
+
+    /**
+     * Record a finished phase; spans beyond MAX_SPANS are counted but not kept
+     */
+    void record(const char* name, Clock::time_point start, Clock::time_point end) {
+        if (count_ == MAX_SPANS) {
+            ++dropped_;
+            return;
+        }
+        spans_[count_++] = Span{
+            name,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(start - start_).count(),
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()
+        };
+    }
+
+    size_t size() const { return count_; }
+    size_t dropped() const { return dropped_; }
+    const Span& operator[](size_t i) const { return spans_[i]; }
+    Clock::time_point startedAt() const { return start_; }
+
+    int64_t elapsedNs() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_).count();
+    }
+
+    /**
+     * Build the Server-Timing header value, e.g. "parse;dur=0.041, db_room;dur=0.870, total;dur=1.502"
+     */
+    std::string serverTiming() const {
+        std::string out;
+        out.reserve(24 * (count_ + 1));
+        char dur[32];
+
+        for (size_t i = 0; i < count_; ++i) {
+            std::snprintf(dur, sizeof(dur), ";dur=%.3f, ", spans_[i].durationNs / 1e6);
+            out += spans_[i].name;
+            out += dur;
+        }
+
+        std::snprintf(dur, sizeof(dur), ";dur=%.3f", elapsedNs() / 1e6);
+        out += "total";
+        out += dur;
+        return out;
+    }
+
+private:
+    Clock::time_point start_{Clock::now()};
+    std::array<Span, MAX_SPANS> spans_{};
+    size_t count_{0};
+    size_t dropped_{0};
+};
+
+/**
+ * RAII span - times the enclosing scope, or until end() is called
+ */
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name)
+        : name_(name), start_(RequestTrace::Clock::now()) {
+    }
+
+    ~TraceSpan() {
+        end();
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    void end() {
+        if (!ended_) {
+            RequestTrace::current().record(name_, start_, RequestTrace::Clock::now());
+            ended_ = true;
+        }
+    }
+
+private:
+    const char* name_;
+    RequestTrace::Clock::time_point start_;
+    bool ended_{false};
+};
+
+/**
+ * Run fn as a named span and return its result
+ * Usage: auto room = traced("db_room", [&] { return db_.getRoomById(roomId); });
+ */
+template <typename F>
+decltype(auto) traced(const char* name, F&& fn) {
+    TraceSpan span(name);
+    return std::forward<F>(fn)();
+}
+
+/**
+ * Ring buffer of sampled request traces
+ * One in every sampleEvery requests is copied into a preallocated slot, overwriting the oldest.
+ * Served by GET /api/debug/traces.
+ */
+class TraceRecorder {
+public:
+    static constexpr size_t PATH_CAPACITY = 96;
+
+    TraceRecorder(unsigned sampleEvery, size_t capacity)
+        : sampleEvery_(sampleEvery == 0 ? 1 : sampleEvery),
+          slots_(capacity == 0 ? 1 : capacity) {
+    }
+
+    /**
+     * Decide whether the finishing request should be kept
+     */
+    bool shouldSample() {
+        return counter_.fetch_add(1, std::memory_order_relaxed) % sampleEvery_ == 0;
+    }
+
+    /**
+     * Copy a finished trace into the next slot (no allocation - slots are fixed-size)
+     */
+    void record(const httplib::Request& req, const httplib::Response& res, const RequestTrace& trace) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        Slot& slot = slots_[next_ % slots_.size()];
+        ++next_;
+
+        copyTruncated(slot.method, sizeof(slot.method), req.method);
+        copyTruncated(slot.path, sizeof(slot.path), req.path);
+        slot.status = res.status;
+        slot.startedAtMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        slot.totalNs = trace.elapsedNs();
+        slot.spanCount = trace.size();
+        for (size_t i = 0; i < trace.size(); ++i) {
+            slot.spans[i] = trace[i];
+        }
+    }
+
+    /**
+     * Sampled traces, newest first
+     */
+    json snapshot() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        json traces = json::array();
+        size_t available = std::min<size_t>(next_, slots_.size());
+
+        for (size_t i = 1; i <= available; ++i) {
+            const Slot& slot = slots_[(next_ - i) % slots_.size()];
+
+            json spans = json::array();
+            for (size_t s = 0; s < slot.spanCount; ++s) {
+                spans.push_back({
+                    {"name", slot.spans[s].name},
+                    {"start_ms", slot.spans[s].startNs / 1e6},
+                    {"duration_ms", slot.spans[s].durationNs / 1e6}
+                });
+            }
+
+            traces.push_back({
+                {"method", slot.method},
+                {"path", slot.path},
+                {"status", slot.status},
+                {"timestamp_ms", slot.startedAtMs},
+                {"total_ms", slot.totalNs / 1e6},
+                {"spans", std::move(spans)}
+            });
+        }
+
+        return json{
+            {"sample_every", sampleEvery_},
+            {"requests_seen", counter_.load(std::memory_order_relaxed)},
+            {"traces", std::move(traces)}
+        };
+    }
+
+private:
+    struct Slot {
+        char method[8]{};
+        char path[PATH_CAPACITY]{};
+        int status{0};
+        int64_t startedAtMs{0};
+        int64_t totalNs{0};
+        size_t spanCount{0};
+        std::array<RequestTrace::Span, RequestTrace::MAX_SPANS> spans{};
+    };
+
+    static void copyTruncated(char* dst, size_t capacity, const std::string& src) {
+        size_t n = std::min(capacity - 1, src.size());
+        std::memcpy(dst, src.data(), n);
+        dst[n] = '\0';
+    }
+
+    const unsigned sampleEvery_;
+    std::atomic<uint64_t> counter_{0};
+
+    mutable std::mutex mutex_;
+    std::vector<Slot> slots_;
+    size_t next_{0};
+};
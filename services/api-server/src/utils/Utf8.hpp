@@ -0,0 +1,174 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define CHAT_UTF8_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define CHAT_UTF8_NEON 1
+#endif
+
+/**
+ * UTF-8 validation and codepoint counting
+ * Both walk the input 16 bytes at a time (SSE2 on x86-64, NEON on ARM, scalar otherwise):
+ * - countCodepoints counts every byte that is not a continuation byte (10xxxxxx)
+ * - countIfValid skips all-ASCII blocks and checks multibyte sequences against
+ *   Unicode table 3-7 (no overlongs, no surrogates, nothing above U+10FFFF)
+ */
+namespace Utf8 {
+
+namespace detail {
+
+constexpr size_t BLOCK = 16;
+
+/**
+ * Bit i set = byte i of the 16-byte block at p has its high bit set
+ */
+inline uint32_t nonAsciiMask(const char* p) {
+#if defined(CHAT_UTF8_SSE2)
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    return static_cast<uint32_t>(_mm_movemask_epi8(block));
+#elif defined(CHAT_UTF8_NEON)
+    // NEON has no movemask; the common all-ASCII case is one horizontal max
+    if (vmaxvq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(p))) < 0x80) {
+        return 0;
+    }
+    uint32_t mask = 0;
+    for (size_t i = 0; i < BLOCK; ++i) {
+        mask |= static_cast<uint32_t>(static_cast<unsigned char>(p[i]) >> 7) << i;
+    }
+    return mask;
+#else
+    uint64_t lo, hi;
+    std::memcpy(&lo, p, 8);
+    std::memcpy(&hi, p + 8, 8);
+    if (((lo | hi) & 0x8080808080808080ull) == 0) {
+        return 0;
+    }
+    uint32_t mask = 0;
+    for (size_t i = 0; i < BLOCK; ++i) {
+        mask |= static_cast<uint32_t>(static_cast<unsigned char>(p[i]) >> 7) << i;
+    }
+    return mask;
+#endif
+}
+
+/**
+ * Number of continuation bytes (0x80-0xBF) in the 16-byte block at p
+ */
+inline unsigned continuationCount(const char* p) {
+#if defined(CHAT_UTF8_SSE2)
+    // As signed bytes, continuation bytes are exactly the values below -64
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i isContinuation = _mm_cmplt_epi8(block, _mm_set1_epi8(-64));
+    return static_cast<unsigned>(std::popcount(static_cast<uint32_t>(_mm_movemask_epi8(isContinuation))));
+#elif defined(CHAT_UTF8_NEON)
+    int8x16_t block = vld1q_s8(reinterpret_cast<const int8_t*>(p));
+    uint8x16_t isContinuation = vshrq_n_u8(vcltq_s8(block, vdupq_n_s8(-64)), 7);
+    return vaddvq_u8(isContinuation);
+#else
+    unsigned count = 0;
+    for (size_t i = 0; i < BLOCK; ++i) {
+        count += (static_cast<unsigned char>(p[i]) & 0xC0) == 0x80;
+    }
+    return count;
+#endif
+}
+
+/**
+ * Validate one multibyte sequence starting at s[pos] (a non-ASCII lead byte)
+ * Returns the sequence length, or 0 if it is malformed.
+ */
+inline size_t sequenceLength(std::string_view s, size_t pos) {
+    auto at = [&](size_t i) { return static_cast<unsigned char>(s[i]); };
+    auto isContinuation = [&](size_t i) { return i < s.size() && (at(i) & 0xC0) == 0x80; };
+
+    unsigned char lead = at(pos);
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        return isContinuation(pos + 1) ? 2 : 0;
+    }
+
+    if (lead >= 0xE0 && lead <= 0xEF) {
+        if (!isContinuation(pos + 1) || !isContinuation(pos + 2)) return 0;
+        unsigned char second = at(pos + 1);
+        if (lead == 0xE0 && second < 0xA0) return 0;  // overlong
+        if (lead == 0xED && second > 0x9F) return 0;  // surrogates
+        return 3;
+    }
+
+    if (lead >= 0xF0 && lead <= 0xF4) {
+        if (!isContinuation(pos + 1) || !isContinuation(pos + 2) || !isContinuation(pos + 3)) return 0;
+        unsigned char second = at(pos + 1);
+        if (lead == 0xF0 && second < 0x90) return 0;  // overlong
+        if (lead == 0xF4 && second > 0x8F) return 0;  // above U+10FFFF
+        return 4;
+    }
+
+    return 0;  // stray continuation byte, C0/C1 or F5-FF
+}
+
+} // namespace detail
+
+/**
+ * Codepoints in s, or nullopt if s is not well-formed UTF-8
+ */
+inline std::optional<size_t> countIfValid(std::string_view s) {
+    size_t pos = 0;
+    size_t codepoints = 0;
+
+    while (pos < s.size()) {
+        if (pos + detail::BLOCK <= s.size()) {
+            uint32_t mask = detail::nonAsciiMask(s.data() + pos);
+            if (mask == 0) {
+                pos += detail::BLOCK;
+                codepoints += detail::BLOCK;
+                continue;
+            }
+            // Take the ASCII prefix in one step, then decode from the first lead byte
+            size_t ascii = static_cast<size_t>(std::countr_zero(mask));
+            pos += ascii;
+            codepoints += ascii;
+        } else if (static_cast<unsigned char>(s[pos]) < 0x80) {
+            ++pos;
+            ++codepoints;
+            continue;
+        }
+
+        size_t length = detail::sequenceLength(s, pos);
+        if (length == 0) {
+            return std::nullopt;
+        }
+        pos += length;
+        ++codepoints;
+    }
+
+    return codepoints;
+}
+
+inline bool isValid(std::string_view s) {
+    return countIfValid(s).has_value();
+}
+
+/**
+ * Codepoints in text already known to be valid UTF-8
+ */
+inline size_t countCodepoints(std::string_view s) {
+    size_t continuation = 0;
+    size_t pos = 0;
+    for (; pos + detail::BLOCK <= s.size(); pos += detail::BLOCK) {
+        continuation += detail::continuationCount(s.data() + pos);
+    }
+    for (; pos < s.size(); ++pos) {
+        continuation += (static_cast<unsigned char>(s[pos]) & 0xC0) == 0x80;
+    }
+    return s.size() - continuation;
+}
+
+} // namespace Utf8
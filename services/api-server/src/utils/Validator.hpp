@@ -1,34 +1,101 @@
 #pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <string>
-#include <regex>
+#include <string_view>
+#include "Utf8.hpp"
 
 
 /**
  * Input validation helpers 
+ * Character rules are table lookups compiled at build time; length limits count
+ * UTF-8 codepoints, not bytes.
  */
 class Validator {
+private:
+    enum CharClass : uint8_t {
+        LETTER         = 1 << 0,  // [A-Za-z]
+        DIGIT          = 1 << 1,  // [0-9]
+        USERNAME       = 1 << 2,  // [A-Za-z0-9_]
+        EMAIL_LOCAL    = 1 << 3,  // [A-Za-z0-9._%+-]
+        EMAIL_DOMAIN   = 1 << 4,  // [A-Za-z0-9.-]
+    };
+
+    static constexpr std::array<uint8_t, 256> CHAR_CLASSES = [] {
+        std::array<uint8_t, 256> table{};
+        auto mark = [&](unsigned char c, uint8_t bits) { table[c] |= bits; };
+
+        for (unsigned char c = 'a'; c <= 'z'; ++c) mark(c, LETTER | USERNAME | EMAIL_LOCAL | EMAIL_DOMAIN);
+        for (unsigned char c = 'A'; c <= 'Z'; ++c) mark(c, LETTER | USERNAME | EMAIL_LOCAL | EMAIL_DOMAIN);
+        for (unsigned char c = '0'; c <= '9'; ++c) mark(c, DIGIT | USERNAME | EMAIL_LOCAL | EMAIL_DOMAIN);
+        mark('_', USERNAME | EMAIL_LOCAL);
+        mark('%', EMAIL_LOCAL);
+        mark('+', EMAIL_LOCAL);
+        mark('.', EMAIL_LOCAL | EMAIL_DOMAIN);
+        mark('-', EMAIL_LOCAL | EMAIL_DOMAIN);
+        return table;
+    }();
+
+    static constexpr bool is(char c, uint8_t cls) {
+        return CHAR_CLASSES[static_cast<unsigned char>(c)] & cls;
+    }
+
+    static constexpr bool allOf(std::string_view s, uint8_t cls) {
+        for (char c : s) {
+            if (!is(c, cls)) return false;
+        }
+        return true;
+    }
+
+    static bool codepointsWithin(std::string_view s, size_t min, size_t max) {
+        auto count = Utf8::countIfValid(s);
+        return count && *count >= min && *count <= max;
+    }
+
 public:
+    static constexpr size_t MIN_USERNAME_LENGTH = 3;
+    static constexpr size_t MAX_USERNAME_LENGTH = 20;
+    static constexpr size_t MIN_PASSWORD_LENGTH = 8;
+    static constexpr size_t MAX_ROOM_NAME_LENGTH = 100;
+    static constexpr size_t MAX_ROOM_DESCRIPTION_LENGTH = 500;
+    static constexpr size_t MAX_MESSAGE_LENGTH = 1000;
+    static constexpr size_t MAX_TRANSLATION_LENGTH = 5000;
+    static constexpr size_t LANGUAGE_CODE_LENGTH = 2;
+
     /**
      * Validate email format
+     * Same language as [a-zA-Z0-9._%+-]+@[a-zA-Z0-9.-]+\.[a-zA-Z]{2,}: neither side may
+     * contain '@', so the split is unique, and the TLD is everything after the last dot.
      */
-    static bool isValidEmail(const std::string& email) {
-        const std::regex pattern(R"([a-zA-Z0-9._%+-]+@[a-zA-Z0-9.-]+\.[a-zA-Z]{2,})");
-        return std::regex_match(email, pattern);
+    static constexpr bool isValidEmail(std::string_view email) {
+        size_t at = email.find('@');
+        if (at == 0 || at == std::string_view::npos) return false;
+
+        std::string_view local = email.substr(0, at);
+        std::string_view domain = email.substr(at + 1);
+        if (!allOf(local, EMAIL_LOCAL) || !allOf(domain, EMAIL_DOMAIN)) return false;
+
+        size_t dot = domain.rfind('.');
+        if (dot == 0 || dot == std::string_view::npos) return false;
+
+        std::string_view tld = domain.substr(dot + 1);
+        return tld.size() >= 2 && allOf(tld, LETTER);
     }
     
     /**
      * Validate password strength
      * At least 8 characters, contains letter and number
      */
-    static bool isValidPassword(const std::string& password) {
-        if(password.length() < 8) return false;
+    static constexpr bool isValidPassword(std::string_view password) {
+        if(password.length() < MIN_PASSWORD_LENGTH) return false;
         
         bool hasLetter = false;
         bool hasDigit = false;
         
         for(char c : password) {
-            if(std::isalpha(c)) hasLetter = true;
-            if(std::isdigit(c)) hasDigit = true;
+            if(is(c, LETTER)) hasLetter = true;
+            if(is(c, DIGIT)) hasDigit = true;
         }
         
         return hasLetter && hasDigit;
@@ -38,34 +105,49 @@ public:
      * Validate username
      * 3-20 characters, alphanumeric and underscore only
      */
-    static bool isValidUsername(const std::string& username) {
-        if(username.length() < 3 || username.length() > 20) return false;
+    static constexpr bool isValidUsername(std::string_view username) {
+        if(username.length() < MIN_USERNAME_LENGTH || username.length() > MAX_USERNAME_LENGTH) return false;
         
-        const std::regex pattern(R"(^[a-zA-Z0-9_]+$)");
-        return std::regex_match(username, pattern);
+        return allOf(username, USERNAME);
     }
     
     /**
      * Validate room name
      * 1-100 characters, not empty
      */
-    static bool isValidRoomName(const std::string& name) {
-        return !name.empty() && name.length() <= 100;
+    static bool isValidRoomName(std::string_view name) {
+        return codepointsWithin(name, 1, MAX_ROOM_NAME_LENGTH);
     }
     
     /**
      * Validate message content
      * Not empty, max 1000 characters
      */
-    static bool isValidMessageContent(const std::string& content) {
-        return !content.empty() && content.length() <= 1000;
+    static bool isValidMessageContent(std::string_view content) {
+        return codepointsWithin(content, 1, MAX_MESSAGE_LENGTH);
+    }
+
+    /**
+     * Validate message type
+     * One of text, image, file
+     */
+    static constexpr bool isValidMessageType(std::string_view type) {
+        return type == "text" || type == "image" || type == "file";
     }
 
     /**
      * Validate room description
      * Max 500 characters
      */
-    static bool isValidRoomDescription(const std::string& description) {
-        return description.length() <= 500;
+    static bool isValidRoomDescription(std::string_view description) {
+        return codepointsWithin(description, 0, MAX_ROOM_DESCRIPTION_LENGTH);
+    }
+
+    /**
+     * Validate translation source language
+     * "auto" or a 2-letter ISO 639-1 code
+     */
+    static constexpr bool isValidSourceLanguage(std::string_view lang) {
+        return lang == "auto" || lang.length() == LANGUAGE_CODE_LENGTH;
     }
 };
\ No newline at end of file